@@ -1,25 +1,58 @@
 #ifndef APPLICATION_HPP_
 #define APPLICATION_HPP_
+#include <algorithm>
 #include <cstdio>
+#include <ctime>
 
 #include "SFMLRenderEngine/RenderEngine.hpp"
+#include "WindowSystem/TimerWheel.hpp"
 #include "WindowSystem/Window.hpp"
 
-// Singletone application class
+// Singletone application class. Frames are drawn at the target rate only while there is input,
+// a timer of TimerWheel::Global() fired or a frame was requested; otherwise Run sleeps, drawing at
+// the idle rate, and even less often when the window is not focused. SFML cannot block until
+// input arrives, so an idle Run polls for it; the poll backs off the longer nothing happens.
 class Application {
    public:
+    static constexpr uint32_t activeTime = 500;  // Milliseconds after input with full frame rate
+    static constexpr uint32_t idleFrameInterval = 250;
+    static constexpr uint32_t unfocusedFrameInterval = 1000;
+    static constexpr uint32_t pollInterval = 8;      // Input latency once the active time is over
+    static constexpr uint32_t maxPollInterval = 50;  // Input latency after a long idle
+    static constexpr uint32_t pollBackoff = 100;     // Idle milliseconds per millisecond of poll
+    static constexpr uint32_t unfocusedPollInterval = 250;
+
     static void Init(uint32_t width, uint32_t height);
     static void Finalize();
     static bool Run();
     static void Attach(AbstractWindow *win);
     static void DumpHierarchy(const char *filename);
+    static void SetFrameRate(uint32_t framesPerSecond);  // Target rate while active
+    static void SetVerticalSync(bool isEnabled);
 
    private:
+    static bool IsActive(uint32_t now);
+    static uint32_t CurrentFrameInterval(uint32_t now);
+    static uint32_t CurrentPollInterval(uint32_t now);  // While not active
+    static void Wait(uint32_t now);  // Sleep until the next frame or input is due
+
     static ContainerWindow *rootWindow;
+    static uint32_t frameInterval;  // Milliseconds between frames while active
+    static uint32_t lastFrame;      // Time the last frame was drawn at
+    static uint32_t lastInput;
+    static bool isFocused;
+    static bool isFrameRequested;  // Woken by RenderEngine::RequestFrame
+    static uint32_t framesCount;
     Application();  // Ensure that class is indeed singletone by prohibiting object construction
 };
 
 ContainerWindow *Application::rootWindow;
+uint32_t Application::frameInterval = 16;
+uint32_t Application::lastFrame = 0;
+uint32_t Application::lastInput = 0;
+bool Application::isFocused = true;
+bool Application::isFrameRequested = true;
+uint32_t Application::framesCount = 0;
 
 void Application::Attach(AbstractWindow *win) {
     rootWindow->attachChild(win);
@@ -31,6 +64,11 @@ void Application::Init(uint32_t width, uint32_t height) {
 }
 
 void Application::Finalize() {
+    // CPU time of the whole process against wall time, to keep an eye on the idle cost
+    float seconds = RenderEngine::GetTime() / 1000.f;
+    fprintf(stderr, "Recorded %u frames in %.1f s, %.1f s of CPU time\n", framesCount, seconds,
+            static_cast<float>(clock()) / CLOCKS_PER_SEC);
+
     Application::DumpHierarchy("dump.dot");
     delete rootWindow;
     RenderEngine::Finalize();
@@ -48,26 +86,91 @@ void Application::DumpHierarchy(const char *filename) {
     fclose(f);
 }
 
+void Application::SetFrameRate(uint32_t framesPerSecond) {
+    frameInterval = framesPerSecond ? 1000 / framesPerSecond : 0;
+}
+
+void Application::SetVerticalSync(bool isEnabled) {
+    RenderEngine::SetVerticalSync(isEnabled);
+}
+
+bool Application::IsActive(uint32_t now) {
+    return isFrameRequested || now - lastInput < activeTime;
+}
+
+uint32_t Application::CurrentFrameInterval(uint32_t now) {
+    if (IsActive(now)) return frameInterval;
+    return isFocused ? idleFrameInterval : unfocusedFrameInterval;
+}
+
+uint32_t Application::CurrentPollInterval(uint32_t now) {
+    if (!isFocused) return unfocusedPollInterval;
+
+    uint32_t idle = now - lastInput > activeTime ? now - lastInput - activeTime : 0;
+    return std::min(maxPollInterval, pollInterval + idle / pollBackoff);
+}
+
+void Application::Wait(uint32_t now) {
+    uint32_t interval = CurrentFrameInterval(now);
+    uint32_t untilFrame = lastFrame + interval > now ? lastFrame + interval - now : 0;
+
+    // While idle, wake up often enough to notice input
+    uint32_t timeout = untilFrame;
+    if (!IsActive(now)) timeout = std::min(timeout, CurrentPollInterval(now));
+
+    uint64_t deadline = TimerWheel::Global().getNextDeadline();
+    if (deadline != TimerWheel::noDeadline) {
+        timeout = std::min<uint64_t>(timeout, deadline > now ? deadline - now : 0);
+    }
+
+    if (timeout && RenderEngine::Wait(timeout)) isFrameRequested = true;
+}
+
 bool Application::Run() {
     Event ev;
     while (RenderEngine::PollEvent(ev)) {
         rootWindow->processEvent(ev);
+        lastInput = ev.timestamp;
 
         switch (ev.eventType) {
             case EV_CLOSED:
                 return 0;
                 break;
 
+            case EV_FOCUS_GAINED:
+                isFocused = true;
+                break;
+
+            case EV_FOCUS_LOST:
+                isFocused = false;
+                break;
+
             default:
                 break;
         }
     }
 
-    RenderEngine::Clear();
-    rootWindow->draw();
+    // Timers change what is on the screen as input does
+    uint32_t now = RenderEngine::GetTime();
+    if (TimerWheel::Global().advance(now)) isFrameRequested = true;
 
-    RenderEngine::Display();
+    uint32_t interval = CurrentFrameInterval(now);
+    if (now - lastFrame >= interval) {
+        isFrameRequested = false;
+        RenderEngine::Clear();
+        rootWindow->draw();
+
+        // With vsync enabled this blocks until the render thread is done with the previous frame
+        RenderEngine::Display();
+        framesCount++;
+
+        // Frames are due on a fixed grid so that late wakeups do not lower the rate, a frame that
+        // is a whole interval late starts the grid over instead of being caught up with in a burst
+        lastFrame += interval;
+        if (now - lastFrame >= interval) lastFrame = now;
+    }
 
+    Wait(RenderEngine::GetTime());
     return 1;
 }
 #endif  // APPLICATION_HPP_
\ No newline at end of file
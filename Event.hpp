@@ -1,19 +1,22 @@
 #ifndef EVENT_HPP_
 #define EVENT_HPP_
+#include <bit>
 #include <cstdint>
 
 #include "EventTypes.hpp"
 
+// Event is passed by const reference through the whole window tree, so it is kept small and
+// trivially copyable: 8 bytes of header followed by a 12 byte payload
 struct Event {
     // Useful enumerations
-    enum MOUSE_BUTTON {
+    enum MOUSE_BUTTON : uint8_t {
         NONE = 0,
         LEFT,
         RIGHT,
         MIDDLE
     };
 
-    enum SCROLL {
+    enum SCROLL : uint8_t {
         UP,
         DOWN,
         PG_UP,
@@ -21,6 +24,15 @@ struct Event {
         RELOCATION
     };
 
+    // Modifier keys held at the moment of event generation
+    enum MODIFIER : uint8_t {
+        MOD_NONE = 0,
+        MOD_SHIFT = 0b1,
+        MOD_CTRL = 0b10,
+        MOD_ALT = 0b100,
+        MOD_SYSTEM = 0b1000
+    };
+
     // Structs for different types of events
     struct Mouse {
         unsigned int x;
@@ -29,7 +41,7 @@ struct Event {
     };
 
     struct Keyboard {
-        unsigned char character;
+        uint32_t character;  // Unicode codepoint
     };
 
     struct Scroll {
@@ -38,13 +50,32 @@ struct Event {
         bool isHorizontal;
     };
 
+    // Starts the same way as Mouse, so mouse coordinates can be read through either of them
+    struct Wheel {
+        unsigned int x;
+        unsigned int y;
+        int16_t delta;  // Hundredths of a wheel notch, positive is up or left
+        bool isHorizontal;
+    };
+
     // Member data
-    uint64_t eventType;
+    uint16_t eventType;  // Exactly one of EV_* bits
+    uint8_t modifiers;   // Combination of MODIFIER flags
+    uint32_t timestamp;  // Milliseconds since the render engine initialization
     union {
         Mouse mouse;
         Keyboard keyboard;
         Scroll scroll;
-        
+        Wheel wheel;
     };
 };
-#endif  // EVENT_HPP_
\ No newline at end of file
+
+static_assert(sizeof(Event) == 20, "Event is expected to stay compact");
+
+constexpr unsigned int invalidEventTypeIndex = EV_TYPES_COUNT;  // Past the end of any table
+
+// Index of the event type in per-type dispatch tables, invalidEventTypeIndex for no type at all
+inline unsigned int eventTypeIndex(uint16_t eventType) {
+    return eventType ? std::countr_zero(eventType) : invalidEventTypeIndex;
+}
+#endif  // EVENT_HPP_
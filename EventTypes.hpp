@@ -6,5 +6,10 @@
 #define EV_KEYBOARD_RELEASE  0b100000
 #define EV_SCROLL            0b1000000
 #define EV_TEXT              0b10000000
+#define EV_MOUSE_WHEEL       0b100000000
+#define EV_FOCUS_GAINED      0b1000000000
+#define EV_FOCUS_LOST        0b10000000000
 
-#define IS_MOUSE_EV(X) ((X).eventType & (EV_MOUSE_KEY_PRESS | EV_MOUSE_KEY_RELEASE | EV_MOUSE_MOVE))
\ No newline at end of file
+#define EV_TYPES_COUNT       16  // Width of Event::eventType in bits
+
+#define IS_MOUSE_EV(X) ((X).eventType & (EV_MOUSE_KEY_PRESS | EV_MOUSE_KEY_RELEASE | EV_MOUSE_MOVE))
@@ -3,11 +3,17 @@
 #include <dlfcn.h>
 #include <inttypes.h>
 
-#include <concepts>
+#include <algorithm>
+#include <cmath>
 #include <cstring>
 #include <filesystem>
+#include <new>
+#include <tuple>
 
 #include "../ColorConverter.hpp"
+#include "../ImageProcessing/DabCache.hpp"
+#include "../ImageProcessing/ThreadPool.hpp"
+#include "../Poem.h"
 #include "../SFMLRenderEngine/RenderEngine.hpp"
 
 Canvas *current_canvas = nullptr;
@@ -25,31 +31,280 @@ Color from_hex(uint32_t clr) {
     return c;
 }
 
-Canvas::Canvas(uint32_t width, uint32_t height) {
+Canvas::Canvas(uint32_t width, uint32_t height)
+    : layers(width, height),
+      imageWidth(width),
+      imageHeight(height),
+      saveTimer(TimerWheel::invalidTimer),
+      loadedRows(0),
+      fitWidth(0),
+      fitHeight(0),
+      autosave(Autosave::DefaultPath()),
+      updateTimer(TimerWheel::invalidTimer),
+      zoom(1),
+      viewX(0),
+      viewY(0),
+      viewBitmap(RenderEngine::CreateBitmap()),
+      viewVersion(0),
+      viewLevel(0),
+      viewCrop({0, 0, 0, 0}) {
     setSize(width, height);
+    setBackgroundColor({40, 40, 40, 255});
+    setOutlineColor({0, 0, 0, 0});
+    setThickness(0);
     pressed = false;
+    panning = false;
 
-    data = new uint32_t[width * height];
-    memset(data, 0xFF, width * height * 4);
-    updateEventMask(EV_MOUSE_MOVE | EV_MOUSE_KEY_PRESS | EV_MOUSE_KEY_RELEASE);
+    layers.composite();
+    mips.rebuild(layers.getComposite(), imageWidth, imageHeight);
+    areaTable.reset(imageWidth, imageHeight);
+    updateEventMask(EV_MOUSE_MOVE | EV_MOUSE_KEY_PRESS | EV_MOUSE_KEY_RELEASE | EV_MOUSE_WHEEL |
+                    EV_TEXT);
+
+    autosaveTimer = TimerWheel::Global().schedule(Autosave::interval, [this] { runAutosave(); });
+}
+
+Canvas::~Canvas() {
+    TimerWheel::Global().cancel(autosaveTimer);
+    TimerWheel::Global().cancel(updateTimer);
+    waitForSave();
+}
+
+uint32_t *Canvas::getData() { return layers.getLayerPixels(layers.getActiveLayer()); }
+
+LayerStack &Canvas::getLayers() { return layers; }
+
+uint32_t Canvas::getWidth() { return imageWidth; }
+
+uint32_t Canvas::getHeight() { return imageHeight; }
+
+void Canvas::markDirty(const PixelRect &rect) {
+    layers.markDirty(layers.getActiveLayer(), rect);
+    autosave.markDirty(layers, layers.getActiveLayer(), rect);
+    requestUpdate();
+}
+
+// Timers fire before the windows are drawn, the next frame shows the update
+void Canvas::requestUpdate() { scheduleUpdate(0); }
+
+void Canvas::scheduleUpdate(uint32_t delay) {
+    TimerWheel::Global().cancel(updateTimer);
+    updateTimer = TimerWheel::Global().schedule(delay, [this] { update(); });
 }
 
-Canvas::~Canvas() { delete[] data; }
+void Canvas::update() {
+    // Only tiles touched since the last update are recomposited and reduced
+    pollLoad();
+    updateComposite();
 
-uint32_t *Canvas::getData() { return data; }
+    // Decoder keeps adding rows and the shadows catch up a slice at a time, both come back until
+    // they are done; shadows frozen by a save are caught up once they are thawed
+    if (pendingLoad) {
+        scheduleUpdate(loadPollInterval);
+    } else if (!autosave.sync(layers) && autosave.canSync()) {
+        scheduleUpdate(Autosave::retryDelay);
+    }
+}
 
-uint32_t Canvas::getWidth() { return width; }
+SummedAreaTable &Canvas::getAreaTable() {
+    updateComposite();
+    areaTable.update(layers.getComposite());
+    return areaTable;
+}
 
-uint32_t Canvas::getHeight() { return height; }
+uint32_t Canvas::sampleColor(const PixelRect &rect) {
+    if (static_cast<uint64_t>(imageWidth) * imageHeight <= SummedAreaTable::maxPixels) {
+        return getAreaTable().mean(rect);
+    }
 
-void Canvas::draw() { RenderEngine::DrawBitmap(x, y, width, height, data); }
+    updateComposite();
+    return SummedAreaTable::DirectMean(layers.getComposite(), imageWidth, imageHeight, rect);
+}
+
+void Canvas::updateComposite() {
+    PixelRect changed = layers.composite();
+    if (changed.isEmpty()) return;
+
+    mips.update(changed);
+    areaTable.markDirty(changed);
+    viewVersion++;
+}
+
+void Canvas::drawSelf() {
+    // Background for the part of the view not covered by the image
+    RenderEngine::DrawRect(x, y, width, height, bkg, frg, thickness);
+
+    // Draw from the coarsest level that still has at least one pixel per screen pixel
+    size_t levelIndex = mips.chooseLevel(zoom);
+    MipPyramid::Level level = mips.getLevel(levelIndex);
+    float levelScale = zoom * (1u << levelIndex);  // Screen pixels per level pixel
+    float levelX = viewX / (1u << levelIndex);
+    float levelY = viewY / (1u << levelIndex);
+
+    // Level pixels partially in the view are drawn too, the clip cuts them at the view edges
+    int64_t x0 = std::max<int64_t>(0, std::floor(levelX));
+    int64_t y0 = std::max<int64_t>(0, std::floor(levelY));
+    int64_t x1 = std::min<int64_t>(level.width, std::ceil(levelX + width / levelScale));
+    int64_t y1 = std::min<int64_t>(level.height, std::ceil(levelY + height / levelScale));
+
+    if (x0 < x1 && y0 < y1) {
+        // Render engine reads the level in place, and only when the version says it is new
+        PixelRect crop = {static_cast<uint32_t>(x0), static_cast<uint32_t>(y0),
+                          static_cast<uint32_t>(x1), static_cast<uint32_t>(y1)};
+        if (levelIndex != viewLevel || !(crop == viewCrop)) {
+            viewLevel = levelIndex;
+            viewCrop = crop;
+            viewVersion++;
+        }
+
+        RenderEngine::pushClip(x, y, width, height);
+        RenderEngine::DrawBitmap(viewBitmap, viewVersion,
+                                 std::lround(x + (x0 - levelX) * levelScale),
+                                 std::lround(y + (y0 - levelY) * levelScale), crop.x1 - crop.x0,
+                                 crop.y1 - crop.y0, level.data + y0 * level.width + x0,
+                                 level.width, levelScale);
+        RenderEngine::popClip();
+    }
+
+    // Selection is shown by its bounds
+    if (!selection.isEmpty()) {
+        PixelRect selectionBounds = selection.getBounds();
+        RenderEngine::pushClip(x, y, width, height);
+        RenderEngine::DrawRect(std::lround(x + (selectionBounds.x0 - viewX) * zoom),
+                               std::lround(y + (selectionBounds.y0 - viewY) * zoom),
+                               std::lround((selectionBounds.x1 - selectionBounds.x0) * zoom),
+                               std::lround((selectionBounds.y1 - selectionBounds.y0) * zoom),
+                               {0, 0, 0, 0}, {255, 255, 255, 200}, 1);
+        RenderEngine::popClip();
+    }
+
+    if (pendingSave) {
+        if (pendingSave->isDone()) {
+            fprintf(stderr, "Background save %s\n", pendingSave->succeeded() ? "finished" : "failed");
+            pendingSave.reset();
+        } else {
+            RenderEngine::DrawRect(x, y + height - 4, width * pendingSave->getProgress(), 4,
+                                   {255, 255, 255, 200}, {0, 0, 0, 0}, 0);
+            RenderEngine::RequestFrame();  // Keep the progress moving without input
+        }
+    }
+
+    if (pendingLoad) {
+        // Frames keep coming with the updates that pass the rows on
+        RenderEngine::DrawRect(x, y + height - 4, width * pendingLoad->getProgress(), 4,
+                               {255, 255, 255, 200}, {0, 0, 0, 0}, 0);
+    }
+}
+
+bool Canvas::screenToImage(int screenX, int screenY, uint32_t &imageX, uint32_t &imageY) {
+    float fx = viewX + (screenX - x) / zoom;
+    float fy = viewY + (screenY - y) / zoom;
+
+    bool inside = fx >= 0 && fy >= 0 && fx < imageWidth && fy < imageHeight;
+
+    imageX = std::clamp<float>(fx, 0, imageWidth - 1);
+    imageY = std::clamp<float>(fy, 0, imageHeight - 1);
+
+    return inside;
+}
+
+void Canvas::setSelection(Selection &&selection) { this->selection = std::move(selection); }
+
+void Canvas::clearSelection() { selection = Selection(); }
+
+const Selection &Canvas::getSelection() { return selection; }
+
+void Canvas::setZoom(float newZoom, int pivotX, int pivotY) {
+    newZoom = std::clamp(newZoom, minZoom, maxZoom);
+
+    // Image point under the pivot stays under the pivot
+    float pivotImageX = viewX + (pivotX - x) / zoom;
+    float pivotImageY = viewY + (pivotY - y) / zoom;
+    zoom = newZoom;
+    viewX = pivotImageX - (pivotX - x) / zoom;
+    viewY = pivotImageY - (pivotY - y) / zoom;
+
+    clampView();
+}
+
+void Canvas::pan(float dx, float dy) {
+    viewX -= dx / zoom;
+    viewY -= dy / zoom;
+
+    clampView();
+}
+
+void Canvas::clampView() {
+    // At least half of the view stays over the image
+    float halfWidth = width / zoom / 2;
+    float halfHeight = height / zoom / 2;
+
+    viewX = std::clamp(viewX, -halfWidth, std::max(-halfWidth, imageWidth - halfWidth));
+    viewY = std::clamp(viewY, -halfHeight, std::max(-halfHeight, imageHeight - halfHeight));
+}
+
+void Canvas::fitView() {
+    zoom = std::min({1.0f, static_cast<float>(width) / imageWidth,
+                     static_cast<float>(height) / imageHeight});
+    zoom = std::max(zoom, minZoom);
+    viewX = 0;
+    viewY = 0;
+}
+
+void Canvas::handleWheel(const Event &ev) {
+    if (!isInsideRect(ev.wheel.x, ev.wheel.y)) return;
+
+    float notches = ev.wheel.delta / 100.0f;
+
+    if (ev.modifiers & Event::MOD_CTRL) {
+        setZoom(zoom * std::pow(1.25f, notches), ev.wheel.x, ev.wheel.y);
+    } else if (ev.wheel.isHorizontal || (ev.modifiers & Event::MOD_SHIFT)) {
+        pan(notches * 60, 0);
+    } else {
+        pan(0, notches * 60);
+    }
+}
+
+void Canvas::handleEvent(const Event &ev) {
+    if (ev.eventType == EV_MOUSE_WHEEL) {
+        handleWheel(ev);
+        return;
+    }
+
+    // Middle button drags the view around
+    if (ev.eventType == EV_MOUSE_KEY_PRESS && ev.mouse.button == Event::MIDDLE) {
+        if (isInsideRect(ev.mouse.x, ev.mouse.y)) {
+            panning = true;
+            panLastX = ev.mouse.x;
+            panLastY = ev.mouse.y;
+        }
+        return;
+    }
+
+    if (panning) {
+        if (ev.eventType == EV_MOUSE_MOVE) {
+            pan(static_cast<int>(ev.mouse.x) - panLastX, static_cast<int>(ev.mouse.y) - panLastY);
+            panLastX = ev.mouse.x;
+            panLastY = ev.mouse.y;
+        } else if (ev.eventType == EV_MOUSE_KEY_RELEASE && ev.mouse.button == Event::MIDDLE) {
+            panning = false;
+        }
+        return;
+    }
+
+    // Image that is still being decoded can be looked around but not drawn on
+    if (pendingLoad) {
+        if (ev.eventType == EV_TEXT && ev.keyboard.character == 27) cancelLoad();  // Escape
+        return;
+    }
+    if (ev.eventType == EV_TEXT) return;
 
-void Canvas::handleEvent(Event ev) {
     // ToolManager *manager = static_cast<DrawingManager *>(parent)->getToolManager();
-    uint32_t relX = ev.mouse.x - x;
-    uint32_t relY = ev.mouse.y - y;
+    uint32_t relX = 0;
+    uint32_t relY = 0;
+    bool onImage = screenToImage(ev.mouse.x, ev.mouse.y, relX, relY);
 
-    if (ev.eventType == EV_MOUSE_KEY_PRESS && isInsideRect(ev.mouse.x, ev.mouse.y)) {
+    if (ev.eventType == EV_MOUSE_KEY_PRESS && isInsideRect(ev.mouse.x, ev.mouse.y) && onImage) {
         pressed = true;
         static_cast<DrawingManager *>(parent)->startToolApplication(relX, relY);
     } else if (ev.eventType == EV_MOUSE_KEY_RELEASE && pressed) {
@@ -65,39 +320,223 @@ void Canvas::handleEvent(Event ev) {
     }
 }
 
-void Canvas::emplace(uint32_t width, uint32_t height, uint32_t *data) {
-    delete[] this->data;
-    this->width = width;
-    this->height = height;
-    this->data = data;
+void Canvas::emplace(uint32_t width, uint32_t height, PixelStorage &&pixels) {
+    cancelLoad();
+    waitForSave();
+    imageWidth = width;
+    imageHeight = height;
+
+    // Loaded image becomes the only layer of the document
+    layers.reset(width, height, std::move(pixels));
+    project.forget();
+    rebuildDocument();
+}
+
+bool Canvas::loadProject(const char *path) {
+    cancelLoad();
+    waitForSave();
+    if (!project.load(path, layers)) return false;
+
+    imageWidth = layers.getWidth();
+    imageHeight = layers.getHeight();
+    rebuildDocument();
+    return true;
+}
+
+void Canvas::scale(uint32_t width, uint32_t height, ResampleFilter filter) {
+    waitForLoad();
+    waitForSave();
+    layers.scale(width, height, filter);
+    imageWidth = width;
+    imageHeight = height;
+
+    rebuildDocument();
+}
+
+bool Canvas::streamPNG(const char *path, uint32_t width, uint32_t height, bool fit) {
+    // Header is all there is to go by, the current document stays until the storage is there
+    if (width > ResizeDialog::maxSize || height > ResizeDialog::maxSize) {
+        fprintf(stderr, "%s is %ux%u, which is too large to open\n", path, width, height);
+        return false;
+    }
+
+    PixelStorage pixels;
+    try {
+        pixels = PixelStorage(static_cast<size_t>(width) * height);
+    } catch (const std::bad_alloc &) {
+        fprintf(stderr, "Not enough memory to open %s\n", path);
+        return false;
+    }
+
+    fitWidth = width;
+    fitHeight = height;
+    if (fit) Resampler::FitSize(fitWidth, fitHeight, imageWidth, imageHeight);
+
+    // Document starts transparent and the decoder fills it in from the top
+    emplace(width, height, std::move(pixels));
+    pendingLoad = ImageIO::LoadAsync(path, layers.getLayerPixels(0), width, height);
+    loadedRows = 0;
+    requestUpdate();
+    return true;
+}
+
+void Canvas::cancelLoad() {
+    if (!pendingLoad) return;
+
+    pendingLoad->cancel();
+    waitForLoad();
+}
+
+bool Canvas::isLoading() { return pendingLoad != nullptr; }
+
+void Canvas::pollLoad() {
+    if (!pendingLoad) return;
+
+    // Rows are final before the task is done, so done is read first
+    bool isDone = pendingLoad->isDone();
+    uint32_t rows = pendingLoad->getRowsDone();
+
+    // Tile the decoder is in is left for later, it would be recomposited twice
+    uint32_t ready = isDone ? rows : rows / LayerStack::tileSize * LayerStack::tileSize;
+    if (ready > loadedRows) {
+        layers.markDirty(0, {0, loadedRows, imageWidth, ready});
+        loadedRows = ready;
+    }
+    if (!isDone) return;
+
+    bool isLoaded = pendingLoad->succeeded();
+    pendingLoad.reset();
+    if (isLoaded && (fitWidth != imageWidth || fitHeight != imageHeight)) {
+        scale(fitWidth, fitHeight, ResampleFilter::LANCZOS3);
+    }
+}
+
+void Canvas::waitForLoad() {
+    if (!pendingLoad) return;
+
+    pendingLoad->wait();
+    pollLoad();
+    requestUpdate();
+}
+
+void Canvas::rebuildDocument() {
+    clearSelection();
+    layers.composite();
+    mips.rebuild(layers.getComposite(), imageWidth, imageHeight);
+    areaTable.reset(imageWidth, imageHeight);
+    viewVersion++;
+    fitView();
+    requestUpdate();  // Shadows of the autosave are stale
+}
+
+void Canvas::save(const wchar_t *path) {
+    waitForLoad();
+    waitForSave();
+
+    // Projects keep the layers, only tiles painted on since the last save are written
+    std::string nativePath = ImageIO::ToNativePath(path);
+    ImageFormat format = ImageIO::FormatFromPath(nativePath);
+    if (format == ImageFormat::PROJECT) {
+        project.save(nativePath.c_str(), layers);
+        return;
+    }
+
+    // Flattened image is what gets saved
+    if (format == ImageFormat::FOREIGN) {
+        updateComposite();
+        RenderEngine::SaveToImage(path, layers.getComposite(), imageWidth, imageHeight);
+        return;
+    }
+
+    queuedSave = path;
+    startSave();
+}
+
+void Canvas::startSave(bool wait) {
+    // Encoder composites the frozen autosave shadows band by band, nothing is copied here and
+    // painting goes on; the shadows are usually in sync, otherwise a slice is caught up per try
+    std::shared_ptr<const ShadowSnapshot> shadows = autosave.freeze(layers, wait);
+    if (!shadows && !wait) {
+        saveTimer = TimerWheel::Global().schedule(Autosave::retryDelay, [this] { startSave(); });
+        return;
+    }
+
+    saveTimer = TimerWheel::invalidTimer;
+    if (shadows) {
+        pendingSave = ImageIO::SaveAsync(
+            queuedSave.c_str(),
+            [shadows](uint32_t firstRow, uint32_t rowsCount, uint32_t *out) {
+                shadows->composite(firstRow, rowsCount, out);
+            },
+            imageWidth, imageHeight);
+        RenderEngine::RequestFrame();
+    } else {
+        fprintf(stderr, "Unable to save %ls, the layers are being saved elsewhere\n",
+                queuedSave.c_str());
+    }
+    queuedSave.clear();
+}
+
+void Canvas::runAutosave() {
+    // Shadows that are still behind catch up a slice at a time before the snapshot is taken
+    // Layers that are being decoded are not worth saving yet
+    bool isStarted = !pendingLoad && autosave.start(layers);
+    uint32_t delay = isStarted ? Autosave::interval : Autosave::retryDelay;
+    autosaveTimer = TimerWheel::Global().schedule(delay, [this] { runAutosave(); });
+}
+
+void Canvas::waitForSave() {
+    // Queued save is started right away, whatever it takes to bring the shadows up to date
+    if (TimerWheel::Global().cancel(saveTimer)) startSave(true);
+
+    if (pendingSave) {
+        pendingSave->wait();
+        pendingSave.reset();
+    }
 }
 
 DrawingManager::DrawingManager() {
     toolManager = new ToolManager;
     colorPicker = new ColorPicker();
     settingsContainer = new SettingsContainer;
+    layerPanel = new LayerPanel;
 
     ModalInvokerButton *load_button = new ModalInvokerButton;
     ModalInvokerButton *save_button = new ModalInvokerButton;
+    ModalInvokerButton *resize_button = new ModalInvokerButton;
+    ModalInvokerButton *poem_button = new ModalInvokerButton;
 
     load_button->setPosition(10, 10);
     save_button->setPosition(70, 10);
+    resize_button->setPosition(130, 10);
+    poem_button->setPosition(190, 10);
 
     load_button->attachTexture(RenderEngine::LoadTexture("img/open.png"));
     save_button->attachTexture(RenderEngine::LoadTexture("img/save.png"));
+    resize_button->attachTexture(RenderEngine::LoadTexture("img/resize.png"));
+    poem_button->attachTexture(RenderEngine::LoadTexture("img/text.png"));
 
     load_button->attachModal(new LoadDialog);
     save_button->attachModal(new SaveDialog);
+    resize_button->attachModal(new ResizeDialog);
+    poem_button->attachModal(new TextDialog(poem));
 
     attachChild(load_button);
     attachChild(save_button);
+    attachChild(resize_button);
+    attachChild(poem_button);
 
     attachChild(toolManager);
     attachChild(colorPicker);
     attachChild(settingsContainer);
+    attachChild(layerPanel);
 
     Brush *brush = new Brush;
     Eraser *eraser = new Eraser;
+    FillTool *fillTool = new FillTool;
+    MagicWand *magicWand = new MagicWand;
+    BlurTool *blurTool = new BlurTool;
+    Eyedropper *eyedropper = new Eyedropper;
 
     toolManager->setPosition(2, 100);
     toolManager->setSize(60, 400);
@@ -107,12 +546,17 @@ DrawingManager::DrawingManager() {
 
     toolManager->attachTool(brush);
     toolManager->attachTool(eraser);
+    toolManager->attachTool(fillTool);
+    toolManager->attachTool(magicWand);
+    toolManager->attachTool(blurTool);
+    toolManager->attachTool(eyedropper);
 
     brush->setColor(HSVtoHEX(0, 100, 100));
 
     eraser->setColor(0xFFFFFFFF);
 
     colorPicker->setPosition(1340, 625);
+    layerPanel->setPosition(125, 760);
 
     canvas = nullptr;
 
@@ -122,6 +566,7 @@ DrawingManager::DrawingManager() {
 }
 
 void DrawingManager::createCanvas(uint32_t width, uint32_t height) {
+    if (canvas) canvas->detach();
     delete canvas;
     canvas = new Canvas(width, height);
 
@@ -129,8 +574,11 @@ void DrawingManager::createCanvas(uint32_t width, uint32_t height) {
 
     attachChild(canvas);
     current_canvas = canvas;
+    layerPanel->setCanvas(canvas);
 }
 
+void DrawingManager::onDocumentReplaced() { layerPanel->rebuildEntries(); }
+
 void DrawingManager::startToolApplication(uint32_t x, uint32_t y) {
     toolManager->getActiveTool()->startApplication(*canvas, x, y, colorPicker->getFrgColor(),
                                                    colorPicker->getBkgColor(),
@@ -151,6 +599,8 @@ void DrawingManager::updateActiveColor(uint32_t color) {
     fprintf(stderr, "New active color value is %x" PRIu32 "\n", color);
 }
 
+void DrawingManager::pickColor(uint32_t color) { colorPicker->pickColor(color); }
+
 void DrawingManager::setCurrentSettingsCollection(SettingsCollection *collection) {
     fprintf(stderr, "Currect settings collection is %p\n", static_cast<void *>(settingsContainer));
 
@@ -203,7 +653,6 @@ void DrawingManager::loadPlugins(const char *plugins_dir) {
 PluginTool::PluginTool(void *handle, PluginAPI::Plugin *plugin) : handle(handle), plugin(plugin) {
     plugin->init();
 
-    mySettings = new SettingsCollection;
     for (auto &property : plugin->properties) {
         if (property.first != PluginAPI::TYPE::PRIMARY_COLOR &&
             property.first != PluginAPI::TYPE::SECONDARY_COLOR &&
@@ -218,11 +667,11 @@ PluginTool::PluginTool(void *handle, PluginAPI::Plugin *plugin) : handle(handle)
             }
             switch (property.second.display_type) {
                 case PluginAPI::Property::DISPLAY_TYPE::SLIDER:
-                    mySettings->addSetting(property.first, new SliderSetting(wchar_label));
+                    mySettings->addSetting(property.first, SettingEntry::SLIDER, wchar_label);
                     break;
 
                 case PluginAPI::Property::DISPLAY_TYPE::CHECKBOX:
-                    mySettings->addSetting(property.first, new CheckboxSetting(wchar_label));
+                    mySettings->addSetting(property.first, SettingEntry::CHECKBOX, wchar_label);
                     break;
 
                 default:
@@ -236,7 +685,7 @@ PluginTool::PluginTool(void *handle, PluginAPI::Plugin *plugin) : handle(handle)
     }
 
     if (plugin->properties.contains(PluginAPI::TYPE::THICKNESS)) {
-        mySettings->addSetting(PluginAPI::TYPE::THICKNESS, new SliderSetting(L"Thickness"));
+        mySettings->addSetting(PluginAPI::TYPE::THICKNESS, SettingEntry::SLIDER, L"Thickness");
     }
 }
 
@@ -248,9 +697,11 @@ PluginTool::~PluginTool() {
 void PluginTool::startApplication(Canvas &canvas, uint32_t x, uint32_t y, uint32_t frgColor,
                                   uint32_t bkgColor,
                                   std::unordered_map<SettingKey, Setting> settings) {
+    // Other tools may have drawn on the layer since the last stroke
+    if (canvas.getSelection().isEmpty()) updateMirror(canvas);
+
+    PluginAPI::Canvas api_canvas = lendCanvas(canvas, x, y);
     PluginAPI::Position pos = {x, y};
-    PluginAPI::Canvas api_canvas = {reinterpret_cast<uint8_t *>(canvas.getData()),
-                                    canvas.getHeight(), canvas.getWidth()};
 
     for (auto &property : plugin->properties) {
         switch (property.second.display_type) {
@@ -278,49 +729,184 @@ void PluginTool::startApplication(Canvas &canvas, uint32_t x, uint32_t y, uint32
         plugin->properties[PluginAPI::TYPE::SECONDARY_COLOR].int_value = bkgColor;
 
     plugin->start_apply(api_canvas, pos);
+    takeBack(canvas);
 }
 
 void PluginTool::endApplication(Canvas &canvas, uint32_t x, uint32_t y) {
     fprintf(stderr, "Ending plugin tool application\n");
+    PluginAPI::Canvas api_canvas = lendCanvas(canvas, x, y);
     PluginAPI::Position pos = {x, y};
-    PluginAPI::Canvas api_canvas = {reinterpret_cast<uint8_t *>(canvas.getData()),
-                                    canvas.getHeight(), canvas.getWidth()};
     plugin->stop_apply(api_canvas, pos);
+    takeBack(canvas);
 }
 
 void PluginTool::apply(Canvas &canvas, uint32_t x, uint32_t y) {
     // fprintf(stderr, "Applying plugin tool\n");
+    PluginAPI::Canvas api_canvas = lendCanvas(canvas, x, y);
     PluginAPI::Position pos = {x, y};
-    PluginAPI::Canvas api_canvas = {reinterpret_cast<uint8_t *>(canvas.getData()),
-                                    canvas.getHeight(), canvas.getWidth()};
     plugin->stop_apply(api_canvas, pos);
+    takeBack(canvas);
+}
+
+PluginAPI::Canvas PluginTool::lendCanvas(Canvas &canvas, uint32_t &x, uint32_t &y) {
+    const Selection &selection = canvas.getSelection();
+    if (selection.isEmpty()) {
+        return {reinterpret_cast<uint8_t *>(canvas.getData()), canvas.getHeight(),
+                canvas.getWidth()};
+    }
+
+    // Positions past the bounds are pulled onto their edge, nothing is drawn there anyway
+    PixelRect bounds = selection.getBounds();
+    uint32_t boundsWidth = bounds.x1 - bounds.x0;
+    uint32_t boundsHeight = bounds.y1 - bounds.y0;
+    x = std::clamp(x, bounds.x0, bounds.x1 - 1) - bounds.x0;
+    y = std::clamp(y, bounds.y0, bounds.y1 - 1) - bounds.y0;
+
+    size_t size = static_cast<size_t>(boundsWidth) * boundsHeight;
+    if (scratch.size() != size) scratch = PixelStorage(size);
+    const uint32_t *pixels = canvas.getData();
+    for (uint32_t row = 0; row < boundsHeight; row++) {
+        CopySpan(scratch.data() + static_cast<size_t>(row) * boundsWidth,
+                 pixels + static_cast<size_t>(bounds.y0 + row) * canvas.getWidth() + bounds.x0,
+                 boundsWidth);
+    }
+
+    return {reinterpret_cast<uint8_t *>(scratch.data()), boundsHeight, boundsWidth};
+}
+
+void PluginTool::updateMirror(Canvas &canvas) {
+    size_t size = static_cast<size_t>(canvas.getWidth()) * canvas.getHeight();
+    if (mirror.size() != size) mirror = PixelStorage(size);
+
+    mirror.touch(0, size);
+    CopySpan(mirror.data(), canvas.getData(), size);
+}
+
+void PluginTool::takeBack(Canvas &canvas) {
+    const Selection &selection = canvas.getSelection();
+    if (selection.isEmpty() && mirror.size() != static_cast<size_t>(canvas.getWidth()) *
+                                                    canvas.getHeight()) {
+        updateMirror(canvas);
+        canvas.markDirty({0, 0, canvas.getWidth(), canvas.getHeight()});
+        return;
+    }
+
+    if (selection.isEmpty()) {
+        // Rows of tiles are compared in parallel, changed tiles are copied into the mirror and
+        // every row of tiles marks the span it changed in
+        uint32_t width = canvas.getWidth();
+        uint32_t height = canvas.getHeight();
+        uint32_t tileSize = LayerStack::tileSize;
+        uint32_t tilesX = (width + tileSize - 1) / tileSize;
+        uint32_t tilesY = (height + tileSize - 1) / tileSize;
+        const uint32_t *pixels = canvas.getData();
+
+        std::vector<PixelRect> changed(tilesY, {0, 0, 0, 0});
+        ThreadPool::Global().parallelFor(tilesY, [&](size_t ty) {
+            uint32_t y0 = ty * tileSize;
+            uint32_t y1 = std::min(y0 + tileSize, height);
+            mirror.touch(static_cast<size_t>(y0) * width, static_cast<size_t>(y1) * width);
+
+            for (uint32_t tx = 0; tx < tilesX; tx++) {
+                uint32_t x0 = tx * tileSize;
+                uint32_t x1 = std::min(x0 + tileSize, width);
+
+                uint32_t y = y0;
+                while (y < y1 && !memcmp(pixels + static_cast<size_t>(y) * width + x0,
+                                         mirror.data() + static_cast<size_t>(y) * width + x0,
+                                         (x1 - x0) * sizeof(uint32_t))) {
+                    y++;
+                }
+                if (y == y1) continue;
+
+                CopyRect(mirror.data(), pixels, width, {x0, y, x1, y1});
+                changed[ty].unite({x0, y0, x1, y1});
+            }
+        });
+
+        for (const PixelRect &rect : changed) {
+            if (!rect.isEmpty()) canvas.markDirty(rect);
+        }
+        return;
+    }
+
+    PixelRect bounds = selection.getBounds();
+    selection.apply(canvas.getData(), canvas.getWidth(), scratch.data(), bounds.x1 - bounds.x0,
+                    bounds);
+    canvas.markDirty(bounds);
 }
 
 ToolManager *DrawingManager::getToolManager() { return toolManager; }
 
-ToolManager::ToolManager() { activeTool = nullptr; }
+ToolManager::ToolManager() : activeTool(nullptr) {
+    list = new ListView(this, itemHeight);
+    attachChild(list);
+}
 
-void ToolManager::attachTool(AbstractTool *tool) {
-    fprintf(stderr, "Setting position (%d, %d)\n", x, y);
-    tool->setPosition(x + 5, y + 5 + 60 * children.size());
+void ToolManager::setPosition(int x, int y) {
+    RectangleWindow::setPosition(x, y);
+    list->setPosition({x, y});
+}
 
-    attachChild(tool);
+void ToolManager::setSize(unsigned int width, unsigned int height) {
+    RectangleWindow::setSize(width, height);
+    list->setSize({static_cast<int>(width), static_cast<int>(height)});
+    list->notifyDataChanged();
+}
+
+void ToolManager::attachTool(AbstractTool *tool) {
+    tools.push_back(tool);
+    list->notifyDataChanged();
 
     if (!activeTool) setActiveTool(tool);
 }
 
 void ToolManager::setActiveTool(AbstractTool *tool) {
-    if (activeTool) activeTool->deactivate();
-    SettingsCollection *current_settings = tool->activate();
-
-    static_cast<DrawingManager *>(parent)->setCurrentSettingsCollection(current_settings);
-
     activeTool = tool;
+    static_cast<DrawingManager *>(parent)->setCurrentSettingsCollection(tool->getSettings());
+
+    // Buttons show which tool is active
+    list->notifyDataChanged();
 }
 
 AbstractTool *ToolManager::getActiveTool() { return activeTool; }
 
-HSVSlider::HSVSlider(uint32_t width, uint32_t height) : cur_hue(0) {
+size_t ToolManager::getItemsCount() { return tools.size(); }
+
+AbstractWindow *ToolManager::createItem() { return new ToolButton(this); }
+
+void ToolManager::bindItem(AbstractWindow *widget, size_t index, int x, int y, int, int) {
+    ToolButton *button = static_cast<ToolButton *>(widget);
+    button->setPosition(x + 5, y + 5);
+    button->bind(tools[index], tools[index] == activeTool);
+}
+
+ToolButton::ToolButton(ToolManager *manager) : manager(manager), tool(nullptr) {
+    setSize(50, 50);
+    setThickness(-2);
+    setOutlineColor({255, 255, 255, 255});
+    setPressColor({255, 255, 255, 255});
+}
+
+void ToolButton::bind(AbstractTool *tool, bool isActive) {
+    this->tool = tool;
+    if (tool->getTexture()) attachTexture(*tool->getTexture());
+
+    if (isActive) {
+        setBackgroundColor({255, 255, 255, 255});
+        setHoverColor({255, 255, 255, 255});
+    } else {
+        setBackgroundColor({0, 0, 0, 0});
+        setHoverColor({100, 100, 100, 255});
+    }
+}
+
+void ToolButton::click(const Event &) {
+    if (tool) manager->setActiveTool(tool);
+}
+
+HSVSlider::HSVSlider(uint32_t width, uint32_t height)
+    : cur_hue(0), bitmap(RenderEngine::CreateBitmap()) {
     setSize(width, height);
 
     rainbowBkg = new uint32_t[width * height];
@@ -339,12 +925,12 @@ HSVSlider::HSVSlider(uint32_t width, uint32_t height) : cur_hue(0) {
     }
 }
 
-void HSVSlider::draw() {
-    RenderEngine::DrawBitmap(x, y, width, height, rainbowBkg);
+void HSVSlider::drawSelf() {
+    RenderEngine::DrawBitmap(bitmap, 0, x, y, width, height, rainbowBkg, width);
 
     RenderEngine::DrawRect(x, y + height * cur_hue / 360, width, 3, {0, 0, 0, 0},
                            {255, 255, 255, 255}, -2);
-    RectangleButton::draw();
+    RectangleButton::drawSelf();
 }
 
 void HSVSlider::click(const Event &ev) {
@@ -370,17 +956,19 @@ HSVFader::HSVFader(uint32_t width, uint32_t height) : cur_sat(0), cur_val(0) {
     setThickness(1);
 
     SVBkg = new uint32_t[width * height];
+    bitmap = RenderEngine::CreateBitmap();
+    bitmapVersion = 0;
     H = 0;
     upToDate = false;
 }
 
-void HSVFader::draw() {
+void HSVFader::drawSelf() {
     if (!upToDate) redrawBkg();
 
-    RenderEngine::DrawBitmap(x, y, width, height, SVBkg);
+    RenderEngine::DrawBitmap(bitmap, bitmapVersion, x, y, width, height, SVBkg, width);
     RenderEngine::DrawRect(x + width * cur_sat / 100 - 2, y + height - height * cur_val / 100 - 2,
                            5, 5, {0, 0, 0, 0}, from_hex(HSVtoHEX(0, 0, 100 - cur_val)), -2);
-    RectangleButton::draw();
+    RectangleButton::drawSelf();
 }
 
 void HSVFader::redrawBkg() {
@@ -390,6 +978,7 @@ void HSVFader::redrawBkg() {
         }
     }
 
+    bitmapVersion++;
     upToDate = true;
 }
 
@@ -500,46 +1089,47 @@ void ColorPicker::activateColor(uint32_t tag) {
     }
 }
 
+void ColorPicker::pickColor(uint32_t color) {
+    if (foreground) {
+        curFrg = color;
+        foregroundColor->setColor(curFrg);
+    } else {
+        curBkg = color;
+        backgroundColor->setColor(curBkg);
+    }
+}
+
 uint32_t ColorPicker::getFrgColor() { return curFrg; }
 
 uint32_t ColorPicker::getBkgColor() { return curBkg; }
 
-AbstractTool::AbstractTool() {
-    setSize(50, 50);
-    setThickness(-2);
-    setBackgroundColor({0, 0, 0, 0});
-    setHoverColor({100, 100, 100, 255});
-    setOutlineColor({255, 255, 255, 255});
-    setPressColor({255, 255, 255, 255});
+AbstractTool::AbstractTool() : panelArena(new WindowArena(settingsArenaChunk)) {
+    // Rows of the panel are made in the arena of the panel when it is first shown
+    WindowArena::Scope scope(panelArena);
+    mySettings = new SettingsCollection;
 }
 
-void AbstractTool::click(const Event &) {
-    // fprintf(stderr, "%p was clicked\n", static_cast<void *>(this));
-    if (parent) {
-        static_cast<ToolManager *>(parent)->setActiveTool(this);
-    }
+AbstractTool::~AbstractTool() {
+    mySettings->detach();
+    delete mySettings;
+    panelArena->release();
 }
 
-SettingsCollection *AbstractTool::activate() {
-    setBackgroundColor({255, 255, 255, 255});
-    setHoverColor({255, 255, 255, 255});
+void AbstractTool::attachTexture(uint64_t descriptor) { texture = descriptor; }
 
-    return mySettings;
-}
+std::optional<uint64_t> AbstractTool::getTexture() { return texture; }
 
-void AbstractTool::deactivate() {
-    setBackgroundColor({0, 0, 0, 0});
-    setHoverColor({100, 100, 100, 255});
-}
+SettingsCollection *AbstractTool::getSettings() { return mySettings; }
 
 // TODO different icons for selected and not selected tools
 
 Eraser::Eraser() { attachTexture(RenderEngine::LoadTexture("img/eraser.png")); }
 
-Brush::Brush() {
+Brush::Brush() : opacity(255), hardness(1), mode(BlendMode::NORMAL) {
     attachTexture(RenderEngine::LoadTexture("img/brush.png"));
-    mySettings = new SettingsCollection;
-    mySettings->addSetting(2, new SliderSetting(L"Thickness"));
+    mySettings->addSetting(2, SettingEntry::SLIDER, L"Thickness");
+    mySettings->addSetting(3, SettingEntry::SLIDER, L"Transparency");
+    mySettings->addSetting(4, SettingEntry::SLIDER, L"Softness");
 }
 
 void Brush::startApplication(Canvas &, uint32_t x, uint32_t y, uint32_t frgColor, uint32_t,
@@ -547,15 +1137,18 @@ void Brush::startApplication(Canvas &, uint32_t x, uint32_t y, uint32_t frgColor
     prev_x = x;
     prev_y = y;
     radius = settings[2].slider_pos * 100;
+    opacity = 255 - std::lround(settings[3].slider_pos * 255);
+    hardness = 1 - settings[4].slider_pos;
     color = frgColor;
+    mode = BlendMode::NORMAL;
 }
 
 void Brush::endApplication(Canvas &, uint32_t, uint32_t) {}
 
 void Brush::apply(Canvas &canvas, uint32_t x, uint32_t y) {
     uint32_t *data = canvas.getData();
-    uint32_t width = canvas.getWidth();
-    uint32_t height = canvas.getHeight();
+    int32_t width = canvas.getWidth();
+    int32_t height = canvas.getHeight();
 
     int32_t x0 = prev_x;
     int32_t x1 = x;
@@ -565,39 +1158,418 @@ void Brush::apply(Canvas &canvas, uint32_t x, uint32_t y) {
     int32_t delta_y = y1 - y0;
     int32_t delta_x = x1 - x0;
 
-    uint32_t num_steps = (1 + std::max(std::abs(delta_x), std::abs(delta_y)));
+    // Dabs of large brushes overlap enough for a smooth edge even when they are spread apart
+    double spacing = std::max(1.0, radius / 8.0);
+    uint32_t num_steps = 1 + std::max(std::abs(delta_x), std::abs(delta_y)) / spacing;
 
     double x_step = static_cast<double>(delta_x) / num_steps;
     double y_step = static_cast<double>(delta_y) / num_steps;
 
+    // Bounds of the segment on the canvas, anti-aliased edges reach past the radius
+    int32_t reach = radius + 2;
+    int32_t left = std::max(0, std::min(x0, x1) - reach);
+    int32_t top = std::max(0, std::min(y0, y1) - reach);
+    int32_t right = std::min(width, std::max(x0, x1) + reach + 1);
+    int32_t bottom = std::min(height, std::max(y0, y1) + reach + 1);
+    if (left >= right || top >= bottom) return;
+
+    // Coverage of the whole segment is gathered first, keeping the maximum where dabs overlap, and
+    // blended once, so translucent strokes do not darken where dabs overlap
+    int32_t boxWidth = right - left;
+    coverage.assign(static_cast<size_t>(boxWidth) * (bottom - top), 0);
+    rowSpans.assign(bottom - top, {boxWidth, 0});
+
+    DabCache &cache = DabCache::Global();
     for (uint32_t i = 0; i < num_steps; i++) {
-        double xt = x0 + x_step * i;
-        double yt = y0 + y_step * i;
-        double x_from = std::max(xt - static_cast<double>(radius), 0.0);
-        double y_from = std::max(yt - static_cast<double>(radius), 0.0);
-
-        double x_to = std::min(xt + radius, static_cast<double>(width));
-        double y_to = std::min(yt + radius, static_cast<double>(height));
-
-        // fprintf(stderr, "Drawing circle in boundary (%lf, %lf) - (%lf, %lf)\n", x_from, y_from,
-        //         x_to, y_to);
-
-        for (uint32_t x_cur = x_from; x_cur < x_to; x_cur++) {
-            for (uint32_t y_cur = y_from; y_cur < y_to; y_cur++) {
-                if ((xt - x_cur) * (xt - x_cur) + (yt - y_cur) * (yt - y_cur) <= radius * radius) {
-                    data[static_cast<uint32_t>(y_cur) * width + static_cast<uint32_t>(x_cur)] =
-                        color;
-                }
+        int32_t originX = 0;
+        int32_t originY = 0;
+        const DabMask &mask =
+            cache.get(radius, hardness, x0 + x_step * i, y0 + y_step * i, originX, originY);
+
+        for (uint32_t row = 0; row < mask.size; row++) {
+            int32_t y_cur = originY + static_cast<int32_t>(row);
+            if (y_cur < top || y_cur >= bottom) continue;
+
+            int32_t from = std::max<int32_t>(left, originX + mask.rows[row].first);
+            int32_t to = std::min<int32_t>(right, originX + mask.rows[row].second);
+            if (from >= to) continue;
+
+            const uint8_t *dab = mask.coverage.data() + static_cast<size_t>(row) * mask.size +
+                                 (from - originX);
+            uint8_t *accumulated =
+                coverage.data() + static_cast<size_t>(y_cur - top) * boxWidth + (from - left);
+            for (int32_t column = 0; column < to - from; column++) {
+                accumulated[column] = std::max(accumulated[column], dab[column]);
             }
+
+            auto &span = rowSpans[y_cur - top];
+            span.first = std::min(span.first, from - left);
+            span.second = std::max(span.second, to - left);
         }
     }
 
+    // Pixels outside the selection are left without coverage
+    PixelRect box = {static_cast<uint32_t>(left), static_cast<uint32_t>(top),
+                     static_cast<uint32_t>(right), static_cast<uint32_t>(bottom)};
+    const Selection &selection = canvas.getSelection();
+    if (!selection.isEmpty()) selection.clipMask(coverage.data(), boxWidth, box);
+
+    for (int32_t row = 0; row < bottom - top; row++) {
+        auto [from, to] = rowSpans[row];
+        if (from >= to) continue;
+
+        BlendMaskSpan(data + static_cast<size_t>(top + row) * width + left + from, color,
+                      coverage.data() + static_cast<size_t>(row) * boxWidth + from, to - from,
+                      mode, opacity);
+    }
+
+    canvas.markDirty(box);
+
     prev_x = x;
     prev_y = y;
 }
 
 void Brush::setColor(uint32_t color) { this->color = color; }
 
+FillTool::FillTool() {
+    attachTexture(RenderEngine::LoadTexture("img/fill.png"));
+    mySettings->addSetting(2, SettingEntry::SLIDER, L"Tolerance");
+    mySettings->addSetting(3, SettingEntry::CHECKBOX, L"Global");
+    mySettings->addSetting(4, SettingEntry::CHECKBOX, L"Antialiasing");
+}
+
+FillOptions FillTool::ReadOptions(std::unordered_map<SettingKey, Setting> &settings) {
+    return {static_cast<uint8_t>(std::lround(settings[2].slider_pos * 255)), !settings[3].checkbox,
+            settings[4].checkbox};
+}
+
+void FillTool::startApplication(Canvas &canvas, uint32_t x, uint32_t y, uint32_t frgColor,
+                                uint32_t, std::unordered_map<SettingKey, Setting> settings) {
+    PixelRect changed =
+        FloodFill::Fill(canvas.getData(), canvas.getWidth(), canvas.getHeight(), x, y, frgColor,
+                        ReadOptions(settings), canvas.getSelection(), mask);
+    if (!changed.isEmpty()) canvas.markDirty(changed);
+}
+
+void FillTool::endApplication(Canvas &, uint32_t, uint32_t) {}
+
+void FillTool::apply(Canvas &, uint32_t, uint32_t) {}
+
+MagicWand::MagicWand() {
+    attachTexture(RenderEngine::LoadTexture("img/wand.png"));
+    mySettings->addSetting(5, SettingEntry::CHECKBOX, L"Add to selection");
+    mySettings->addSetting(6, SettingEntry::CHECKBOX, L"Subtract from selection");
+    mySettings->addSetting(7, SettingEntry::SLIDER, L"Feather");
+}
+
+void MagicWand::startApplication(Canvas &canvas, uint32_t x, uint32_t y, uint32_t, uint32_t,
+                                 std::unordered_map<SettingKey, Setting> settings) {
+    uint32_t width = canvas.getWidth();
+    uint32_t height = canvas.getHeight();
+    PixelRect bounds = FloodFill::BuildMask(canvas.getData(), width, height, x, y,
+                                            ReadOptions(settings), mask);
+
+    Selection region = Selection::FromMask(
+        FloodFill::MaskBytes(mask) + static_cast<size_t>(bounds.y0) * width + bounds.x0, width,
+        bounds);
+    region = region.feathered(settings[7].slider_pos * maxFeather, width, height);
+
+    // Both boxes checked keep only what both selections have
+    SelectionOp op = SelectionOp::REPLACE;
+    if (settings[5].checkbox && settings[6].checkbox) {
+        op = SelectionOp::INTERSECT;
+    } else if (settings[5].checkbox) {
+        op = SelectionOp::UNION;
+    } else if (settings[6].checkbox) {
+        op = SelectionOp::SUBTRACT;
+    }
+
+    canvas.setSelection(Selection::Combine(canvas.getSelection(), region, op));
+}
+
+BlurTool::BlurTool() {
+    attachTexture(RenderEngine::LoadTexture("img/blur.png"));
+    mySettings->addSetting(2, SettingEntry::SLIDER, L"Radius");
+    mySettings->addSetting(3, SettingEntry::CHECKBOX, L"Tile edges");
+}
+
+void BlurTool::startApplication(Canvas &canvas, uint32_t, uint32_t, uint32_t, uint32_t,
+                                std::unordered_map<SettingKey, Setting> settings) {
+    float sigma = settings[2].slider_pos * maxSigma;
+    EdgeMode edges = settings[3].checkbox ? EdgeMode::WRAP : EdgeMode::CLAMP;
+    uint32_t *pixels = canvas.getData();
+    uint32_t width = canvas.getWidth();
+    uint32_t height = canvas.getHeight();
+
+    // Whole active layer is blurred in place when nothing is selected
+    const Selection &selection = canvas.getSelection();
+    if (selection.isEmpty()) {
+        Convolution::GaussianBlur(pixels, pixels, width, height, sigma, edges);
+        canvas.markDirty({0, 0, width, height});
+        return;
+    }
+
+    // Otherwise a copy of the selection bounds with everything the blur reaches around them is
+    // blurred and the selected part is taken back. Tiles wrap around the whole layer
+    PixelRect bounds = selection.getBounds();
+    PixelRect region = {0, 0, width, height};
+    if (edges != EdgeMode::WRAP) {
+        uint32_t reach = std::ceil(3 * sigma) + blurMargin;
+        region = {bounds.x0 - std::min(bounds.x0, reach), bounds.y0 - std::min(bounds.y0, reach),
+                  std::min(width, bounds.x1 + reach), std::min(height, bounds.y1 + reach)};
+    }
+
+    uint32_t regionWidth = region.x1 - region.x0;
+    uint32_t regionHeight = region.y1 - region.y0;
+    PixelStorage blurred(static_cast<size_t>(regionWidth) * regionHeight);
+    for (uint32_t row = 0; row < regionHeight; row++) {
+        CopySpan(blurred.data() + static_cast<size_t>(row) * regionWidth,
+                 pixels + static_cast<size_t>(region.y0 + row) * width + region.x0, regionWidth);
+    }
+    Convolution::GaussianBlur(blurred.data(), blurred.data(), regionWidth, regionHeight, sigma,
+                              edges);
+
+    size_t corner =
+        static_cast<size_t>(bounds.y0 - region.y0) * regionWidth + (bounds.x0 - region.x0);
+    selection.apply(pixels, width, blurred.data() + corner, regionWidth, bounds);
+    canvas.markDirty(bounds);
+}
+
+void BlurTool::endApplication(Canvas &, uint32_t, uint32_t) {}
+
+void BlurTool::apply(Canvas &, uint32_t, uint32_t) {}
+
+Eyedropper::Eyedropper() : radius(0) {
+    attachTexture(RenderEngine::LoadTexture("img/eyedropper.png"));
+    mySettings->addSetting(2, SettingEntry::SLIDER, L"Sample size");
+}
+
+void Eyedropper::startApplication(Canvas &canvas, uint32_t x, uint32_t y, uint32_t, uint32_t,
+                                  std::unordered_map<SettingKey, Setting> settings) {
+    radius = std::lround(settings[2].slider_pos * maxRadius);
+    apply(canvas, x, y);
+}
+
+void Eyedropper::endApplication(Canvas &, uint32_t, uint32_t) {}
+
+void Eyedropper::apply(Canvas &canvas, uint32_t x, uint32_t y) {
+    // Average over the square comes from the summed-area table, whatever its size
+    PixelRect square = {x > radius ? x - radius : 0, y > radius ? y - radius : 0, x + radius + 1,
+                        y + radius + 1};
+    dm->pickColor(canvas.sampleColor(square));
+}
+
+static const wchar_t *BlendModeName(BlendMode mode) {
+    switch (mode) {
+        case BlendMode::MULTIPLY:
+            return L"Multiply";
+        case BlendMode::SCREEN:
+            return L"Screen";
+        case BlendMode::ADD:
+            return L"Add";
+        default:
+            return L"Normal";
+    }
+}
+
+LayerActionButton::LayerActionButton(Action action, const wchar_t *label)
+    : action(action), label(label) {
+    setSize(90, 30);
+    setThickness(-2);
+    setBackgroundColor({0, 0, 0, 0});
+    setOutlineColor({255, 255, 255, 255});
+    setHoverColor({255, 255, 255, 100});
+    setPressColor({255, 255, 255, 255});
+}
+
+void LayerActionButton::click(const Event &) {
+    static_cast<LayerPanel *>(parent)->performAction(action);
+}
+
+void LayerActionButton::drawSelf() {
+    RectangleButton::drawSelf();
+    RenderEngine::DrawText(x + 8, y + 3, label, 18);
+}
+
+LayerEntry::LayerEntry(size_t index) : index(index) {
+    setSize(LayerPanel::entryWidth - 10, 60);
+    setOutlineColor({255, 255, 255, 255});
+    setHoverColor({255, 255, 255, 100});
+    setPressColor({255, 255, 255, 255});
+}
+
+void LayerEntry::update(const Layer &layer, bool isActive) {
+    label = L"Layer " + std::to_wstring(index + 1) + L"\n" + BlendModeName(layer.mode);
+
+    setThickness(isActive ? -4 : -1);
+    setBackgroundColor(layer.isVisible ? Color{0, 0, 0, 0} : Color{90, 90, 90, 255});
+}
+
+void LayerEntry::click(const Event &) { static_cast<LayerPanel *>(parent)->selectLayer(index); }
+
+void LayerEntry::drawSelf() {
+    RectangleButton::drawSelf();
+    RenderEngine::DrawText(x + 8, y + 5, label.c_str(), 18);
+}
+
+OpacitySlider::OpacitySlider() : Slider(true) {
+    setSize(10, 30);
+    setBackgroundColor({0, 0, 0, 0});
+    setHoverColor({255, 255, 255, 100});
+    setPressColor({255, 255, 255, 255});
+    setOutlineColor({255, 255, 255, 255});
+    setThickness(2);
+}
+
+void OpacitySlider::onMouseMove(const Event &ev) {
+    Slider::onMouseMove(ev);
+    if (pressed) static_cast<LayerPanel *>(parent)->applyOpacity();
+}
+
+LayerPanel::LayerPanel() : canvas(nullptr) {
+    setSize(1200, 130);
+    setThickness(-2);
+    setBackgroundColor({0, 0, 0, 0});
+    setOutlineColor({255, 255, 255, 255});
+
+    actions.push_back(new LayerActionButton(LayerActionButton::ADD, L"Add"));
+    actions.push_back(new LayerActionButton(LayerActionButton::REMOVE, L"Remove"));
+    actions.push_back(new LayerActionButton(LayerActionButton::RAISE, L"Raise"));
+    actions.push_back(new LayerActionButton(LayerActionButton::LOWER, L"Lower"));
+    actions.push_back(new LayerActionButton(LayerActionButton::TOGGLE_VISIBILITY, L"Visible"));
+    actions.push_back(new LayerActionButton(LayerActionButton::CYCLE_MODE, L"Mode"));
+
+    for (LayerActionButton *action : actions) {
+        attachChild(action);
+    }
+
+    opacityTrack = new RectangleWindow;
+    opacityTrack->setSize(265, 4);
+    opacityTrack->setBackgroundColor({255, 255, 255, 255});
+
+    opacity = new OpacitySlider;
+    opacity->setLimit(255);
+
+    attachChild(opacityTrack);
+    attachChild(opacity);
+}
+
+int LayerPanel::getOpacityPivot() { return x + 20 + 100 * static_cast<int>(actions.size()); }
+
+void LayerPanel::setPosition(int x, int y) {
+    Rectangle::setPosition(x, y);
+
+    for (size_t i = 0; i < actions.size(); i++) {
+        actions[i]->setPosition(x + 10 + 100 * i, y + 10);
+    }
+    opacityTrack->setPosition(getOpacityPivot(), y + 23);
+    opacity->setPosition(getOpacityPivot(), y + 10);
+
+    for (size_t i = 0; i < entries.size(); i++) {
+        entries[i]->setPosition(x + 10 + entryWidth * i, y + 55);
+    }
+}
+
+void LayerPanel::setCanvas(Canvas *canvas) {
+    this->canvas = canvas;
+    rebuildEntries();
+}
+
+void LayerPanel::rebuildEntries() {
+    for (LayerEntry *entry : entries) {
+        entry->detach();
+        delete entry;
+    }
+    entries.clear();
+
+    if (!canvas) return;
+
+    // New entries take the blocks of the old ones
+    WindowArena::Scope scope(makeArena(entriesArenaChunk));
+
+    for (size_t i = 0; i < canvas->getLayers().getLayersCount(); i++) {
+        LayerEntry *entry = new LayerEntry(i);
+        entry->setPosition(x + 10 + entryWidth * i, y + 55);
+        entries.push_back(entry);
+        attachChild(entry);
+    }
+
+    updateEntries();
+}
+
+void LayerPanel::updateEntries() {
+    LayerStack &layers = canvas->getLayers();
+
+    for (size_t i = 0; i < entries.size(); i++) {
+        entries[i]->update(layers.getLayer(i), i == layers.getActiveLayer());
+    }
+
+    // Slider shows opacity of the active layer
+    opacity->Rectangle::setPosition(
+        getOpacityPivot() + layers.getLayer(layers.getActiveLayer()).opacity, y + 10);
+}
+
+void LayerPanel::performAction(LayerActionButton::Action action) {
+    // Layer that is being decoded into must not go away
+    if (!canvas || canvas->isLoading()) return;
+
+    LayerStack &layers = canvas->getLayers();
+    size_t active = layers.getActiveLayer();
+
+    switch (action) {
+        case LayerActionButton::ADD:
+            layers.addLayer();
+            rebuildEntries();
+            break;
+
+        case LayerActionButton::REMOVE:
+            layers.removeLayer(active);
+            rebuildEntries();
+            break;
+
+        case LayerActionButton::RAISE:
+            if (active + 1 < layers.getLayersCount()) layers.moveLayer(active, active + 1);
+            updateEntries();
+            break;
+
+        case LayerActionButton::LOWER:
+            if (active > 0) layers.moveLayer(active, active - 1);
+            updateEntries();
+            break;
+
+        case LayerActionButton::TOGGLE_VISIBILITY:
+            layers.setVisible(active, !layers.getLayer(active).isVisible);
+            updateEntries();
+            break;
+
+        case LayerActionButton::CYCLE_MODE:
+            layers.setBlendMode(active, static_cast<BlendMode>(
+                                            (static_cast<int>(layers.getLayer(active).mode) + 1) %
+                                            (static_cast<int>(BlendMode::ADD) + 1)));
+            updateEntries();
+            break;
+    }
+
+    canvas->requestUpdate();
+}
+
+void LayerPanel::selectLayer(size_t index) {
+    if (!canvas) return;
+
+    canvas->getLayers().setActiveLayer(index);
+    updateEntries();
+    canvas->requestUpdate();
+}
+
+void LayerPanel::applyOpacity() {
+    if (!canvas) return;
+
+    LayerStack &layers = canvas->getLayers();
+    int position = opacity->getPositionAlongAxis() - getOpacityPivot();
+    layers.setOpacity(layers.getActiveLayer(), std::clamp(position, 0, 255));
+    canvas->requestUpdate();
+}
+
 ColorSample::ColorSample(uint32_t tag) : tag(tag) {
     setThickness(-2);
     setOutlineColor({255, 255, 255, 255});
@@ -623,12 +1595,23 @@ void ColorSample::activate() { setThickness(-5); }
 
 void ColorSample::deactivate() { setThickness(-2); }
 
-void Eraser::startApplication(Canvas &, uint32_t x, uint32_t y, uint32_t, uint32_t bkgColor,
+void Eraser::startApplication(Canvas &canvas, uint32_t x, uint32_t y, uint32_t,
+                              uint32_t bkgColor,
                               std::unordered_map<SettingKey, Setting> settings) {
     prev_x = x;
     prev_y = y;
-    color = bkgColor;
     radius = settings[2].slider_pos * 100;
+    opacity = 255 - std::lround(settings[3].slider_pos * 255);
+    hardness = 1 - settings[4].slider_pos;
+
+    // Bottom layer is erased to the background color, the ones above it to transparency
+    if (canvas.getLayers().getActiveLayer() == 0) {
+        color = bkgColor;
+        mode = BlendMode::NORMAL;
+    } else {
+        color = 0xFF000000;
+        mode = BlendMode::ERASE;
+    }
 }
 
 SettingsContainer::SettingsContainer() : current(nullptr) {
@@ -645,62 +1628,48 @@ void SettingsContainer::setCurrentCollection(SettingsCollection *collection) {
     }
 
     current = collection;
+    if (!current) return;
+
+    current->setPosition({x, y});
+    current->setSize({width, height});
     attachChild(current);
 }
 
 std::unordered_map<SettingKey, Setting> SettingsContainer::getSettings() {
+    if (!current) return {};
     return current->getCurrentSettings();
 }
 
-SettingsCollection::SettingsCollection() : accumulatedHeight(0) {}
-
-void SettingsContainer::draw() {
-    if (current) current->setPosition(x, y);
-    RectangleWindow::draw();
-}
-
-void SettingsCollection::draw() {
-    RenderEngine::pushGlobalOffset(-x, -y);
-    RectangleWindow::draw();
-    RenderEngine::popGlobalOffset();
-}
+SettingsCollection::SettingsCollection() : ListView(this, rowHeight) {}
 
-void SettingsCollection::addSetting(SettingKey key, SettingElement *elem) {
-    elem->setPosition(0, accumulatedHeight);
-    accumulatedHeight += elem->getHeight();
-    attachChild(elem);
+void SettingsCollection::addSetting(SettingKey key, SettingEntry::Type type,
+                                    const wchar_t *label) {
+    SettingEntry entry = {};
+    entry.key = key;
+    entry.type = type;
+    entry.label = label;
+    entries.push_back(entry);
 
-    elems[key] = elem;
+    notifyDataChanged();
 }
 
-void SettingsCollection::processEvent(Event ev) {
-    if (ev.eventType == EV_MOUSE_KEY_PRESS || ev.eventType == EV_MOUSE_KEY_RELEASE ||
-        ev.eventType == EV_MOUSE_MOVE) {
-        ev.mouse.x -= x;
-        ev.mouse.y -= y;
-    }
-
-    RectangleWindow::processEvent(ev);
-}
+SettingEntry &SettingsCollection::getEntry(size_t index) { return entries[index]; }
 
-template <typename T, typename From, typename To>
-concept Mapping = std::is_invocable_r<To, T, From>::value;
+size_t SettingsCollection::getItemsCount() { return entries.size(); }
 
-template <typename KeyType, typename ValueType, typename ResultType, typename Func>
-requires Mapping<Func, ValueType, ResultType> std::unordered_map<KeyType, ResultType>
-applyTransformation(std::unordered_map<KeyType, ValueType> container, Func f) {
-    std::unordered_map<KeyType, ResultType> result;
+AbstractWindow *SettingsCollection::createItem() { return new SettingRow(this); }
 
-    for (const auto &elem : container) {
-        result[elem.first] = f(elem.second);
-    }
-
-    return result;
+void SettingsCollection::bindItem(AbstractWindow *widget, size_t index, int x, int y, int width,
+                                  int height) {
+    static_cast<SettingRow *>(widget)->bind(index, x, y, width, height);
 }
 
 std::unordered_map<SettingKey, Setting> SettingsCollection::getCurrentSettings() {
-    return applyTransformation<SettingKey, SettingElement *, Setting>(
-        elems, [](SettingElement *el) -> Setting { return el->getSettingValue(); });
+    std::unordered_map<SettingKey, Setting> settings;
+    for (const SettingEntry &entry : entries) {
+        settings[entry.key] = entry.value;
+    }
+    return settings;
 }
 
 Checkbox::Checkbox() : value(false) {
@@ -712,8 +1681,12 @@ Checkbox::Checkbox() : value(false) {
     setPressColor({255, 255, 255, 255});
 }
 
-void Checkbox::click(const Event &) {
-    value = !value;
+void Checkbox::click(const Event &) { setValue(!value); }
+
+bool Checkbox::getValue() { return value; }
+
+void Checkbox::setValue(bool newValue) {
+    value = newValue;
 
     if (value) {
         setBackgroundColor({255, 255, 255, 200});
@@ -722,104 +1695,82 @@ void Checkbox::click(const Event &) {
     }
 }
 
-bool Checkbox::getValue() { return value; }
-
-void SettingElement::processEvent(Event ev) {
-    if (ev.eventType == EV_MOUSE_KEY_PRESS || ev.eventType == EV_MOUSE_KEY_RELEASE ||
-        ev.eventType == EV_MOUSE_MOVE) {
-        ev.mouse.x -= x;
-        ev.mouse.y -= y;
-    }
-
-    RectangleWindow::processEvent(ev);
-}
-
-CheckboxSetting::CheckboxSetting(const wchar_t *label) : label(label) {
-    TextWindow *labelWindow = new TextWindow;
-    labelWindow->setText(label);
-    labelWindow->setPosition(8, 3);
-    labelWindow->setCharSize(25);
-
-    checkbox = new Checkbox;
-    checkbox->setPosition(220, 3);
-
-    setOutlineColor({255, 255, 255, 255});
-    setPosition(0, 0);
-    setBackgroundColor({0, 0, 0, 0});
-    setThickness(-1);
-    setSize(260, 35);
-
-    fprintf(stderr, "Created checkbox with the label %ls\n", this->label);
-
-    attachChild(checkbox);
-    attachChild(labelWindow);
-}
-
-int CheckboxSetting::getHeight() { return height; }
-
-Setting CheckboxSetting::getSettingValue() {
-    Setting result;
-    result.checkbox = checkbox->getValue();
-    return result;
-}
-
-void CheckboxSetting::draw() {
-    RenderEngine::pushRelGlobalOffset(-x, -y);
-    ContainerWindow::draw();
-    RenderEngine::popGlobalOffset();
-
-    RenderEngine::DrawRect(x, y, width, height, bkg, frg, thickness);
-}
-
-SliderSetting::SliderSetting(const wchar_t *label) : label(label) {
-    TextWindow *labelWindow = new TextWindow;
-    labelWindow->setText(label);
-    labelWindow->setPosition(8, 3);
-    labelWindow->setCharSize(25);
+SettingRow::SettingRow(SettingsCollection *collection)
+    : collection(collection), index(0), shownType(SettingEntry::SLIDER) {
+    label = new TextWindow;
+    label->setCharSize(25);
 
     slider = new Slider(true);
     slider->setSize(10, 30);
-    slider->setPosition(10, 35);
     slider->setBackgroundColor({0, 0, 0, 0});
     slider->setHoverColor({255, 255, 255, 100});
     slider->setPressColor({255, 255, 255, 255});
     slider->setOutlineColor({255, 255, 255, 255});
-    slider->setLimit(220);
+    slider->setLimit(sliderRange);
     slider->setThickness(2);
 
-    RectangleWindow *sliderBkg = new RectangleWindow;
-    sliderBkg->setSize(230, 4);
-    sliderBkg->setBackgroundColor({255, 255, 255, 255});
-    sliderBkg->setPosition(10, 48);
+    track = new RectangleWindow;
+    track->setSize(sliderRange + 10, 4);
+    track->setBackgroundColor({255, 255, 255, 255});
+
+    checkbox = new Checkbox;
 
     setOutlineColor({255, 255, 255, 255});
-    setPosition(0, 0);
     setBackgroundColor({0, 0, 0, 0});
     setThickness(-1);
-    setSize(260, 70);
-
-    fprintf(stderr, "Created slider with the label %ls\n", this->label);
 
-    attachChild(sliderBkg);
-    attachChild(labelWindow);
+    attachChild(label);
+    attachChild(track);
     attachChild(slider);
 }
 
-int SliderSetting::getHeight() { return height; }
+void SettingRow::showControls(SettingEntry::Type type) {
+    if (type == shownType) return;
 
-Setting SliderSetting::getSettingValue() {
-    Setting res;
-    res.slider_pos = static_cast<double>(slider->getPositionAlongAxis() - 10) / 220;
-    printf("Slider value was fetched. It is %lf\n", res.slider_pos);
-    return res;
+    if (type == SettingEntry::SLIDER) {
+        detachChild(checkbox);
+        attachChild(track);
+        attachChild(slider);
+    } else {
+        detachChild(track);
+        detachChild(slider);
+        attachChild(checkbox);
+    }
+    shownType = type;
 }
 
-void SliderSetting::draw() {
-    RenderEngine::pushRelGlobalOffset(-x, -y);
-    ContainerWindow::draw();
-    RenderEngine::popGlobalOffset();
+void SettingRow::bind(size_t index, int x, int y, int width, int height) {
+    this->index = index;
+    const SettingEntry &entry = collection->getEntry(index);
 
-    RenderEngine::DrawRect(x, y, width, height, bkg, frg, thickness);
+    setPosition(x, y);
+    setSize(width, height);
+    label->setText(entry.label);
+    label->setPosition(x + 8, y + 3);
+
+    showControls(entry.type);
+    if (entry.type == SettingEntry::SLIDER) {
+        track->setPosition(x + 10, y + 48);
+        slider->setPosition(x + 10, y + 35);
+        slider->Rectangle::setPosition(
+            x + 10 + static_cast<int>(std::lround(entry.value.slider_pos * sliderRange)), y + 35);
+    } else {
+        checkbox->setPosition(x + 220, y + 3);
+        checkbox->setValue(entry.value.checkbox);
+    }
+}
+
+void SettingRow::processEvent(const Event &ev) {
+    RectangleWindow::processEvent(ev);
+    if (!IS_MOUSE_EV(ev)) return;
+
+    SettingEntry &entry = collection->getEntry(index);
+    if (entry.type == SettingEntry::SLIDER) {
+        int offset = slider->getPositionAlongAxis() - (x + 10);
+        entry.value.slider_pos = static_cast<double>(offset) / sliderRange;
+    } else {
+        entry.value.checkbox = checkbox->getValue();
+    }
 }
 
 ModalInvokerButton::ModalInvokerButton() : modal(nullptr) {
@@ -840,6 +1791,8 @@ void ModalInvokerButton::click(const Event &) {
 
 // There go dialog windows
 
+constexpr size_t dialogArenaChunk = 4 * 1024;  // Dialog with all of its widgets fits in one chunk
+
 class FinalSaveButton : public TexturedButton {
    public:
     FinalSaveButton();
@@ -863,13 +1816,11 @@ FinalSaveButton::FinalSaveButton() {
     setPressColor({255, 255, 255, 255});
 
     setThickness(2);
-    attachTexture(1);
+    attachTexture(RenderEngine::LoadTexture("img/save.png"));
 }
 
 void FinalSaveButton::click(const Event &) {
-    RenderEngine::SaveToImage(static_cast<SaveDialog *>(parent)->getPath(),
-                              current_canvas->getData(), current_canvas->getWidth(),
-                              current_canvas->getHeight());
+    current_canvas->save(static_cast<SaveDialog *>(parent)->getPath());
     static_cast<SaveDialog *>(parent)->finish();
 }
 
@@ -882,21 +1833,74 @@ FinalLoadButton::FinalLoadButton() {
     setPressColor({255, 255, 255, 255});
 
     setThickness(2);
-    attachTexture(0);
+    attachTexture(RenderEngine::LoadTexture("img/open.png"));
 }
 
 void FinalLoadButton::click(const Event &) {
-    auto [width, height, img] =
-        RenderEngine::LoadFromImage(static_cast<LoadDialog *>(parent)->getPath());
-    current_canvas->emplace(width, height, img);
-    static_cast<SaveDialog *>(parent)->finish();
+    LoadDialog *dialog = static_cast<LoadDialog *>(parent);
+    const wchar_t *path = dialog->getPath();
+    std::string nativePath = ImageIO::ToNativePath(path);
+
+    uint32_t width = 0;
+    uint32_t height = 0;
+    PixelStorage pixels;
+    ImageFormat format = ImageIO::FormatFromPath(nativePath);
+    if (format == ImageFormat::PROJECT) {
+        if (current_canvas->loadProject(nativePath.c_str())) dm->onDocumentReplaced();
+        dialog->finish();
+        return;
+    }
+
+    // Interlaced PNGs are left to the render engine
+    if (format == ImageFormat::PNG && ImageIO::ProbePNG(nativePath.c_str(), width, height)) {
+        if (current_canvas->streamPNG(nativePath.c_str(), width, height, dialog->isFitting())) {
+            dm->onDocumentReplaced();
+        }
+        dialog->finish();
+        return;
+    }
+
+    if (format == ImageFormat::RAW) {
+        pixels = ImageIO::LoadRaw(nativePath.c_str(), width, height);
+    } else {
+        uint32_t *img = nullptr;
+        std::tie(width, height, img) = RenderEngine::LoadFromImage(path);
+        if (img) {
+            pixels = PixelStorage(static_cast<size_t>(width) * height);
+            CopySpan(pixels.data(), img, pixels.size());
+            delete[] img;
+        }
+    }
+
+    uint32_t fitWidth = width;
+    uint32_t fitHeight = height;
+    if (pixels.data() && dialog->isFitting() &&
+        Resampler::FitSize(fitWidth, fitHeight, current_canvas->getWidth(),
+                           current_canvas->getHeight())) {
+        PixelStorage fitted(static_cast<size_t>(fitWidth) * fitHeight);
+        Resampler::Scale(pixels.data(), width, height, fitted.data(), fitWidth, fitHeight,
+                         ResampleFilter::LANCZOS3);
+
+        pixels = std::move(fitted);
+        width = fitWidth;
+        height = fitHeight;
+    }
+
+    if (pixels.data()) current_canvas->emplace(width, height, std::move(pixels));
+    dm->onDocumentReplaced();
+
+    dialog->finish();
 }
 
 const wchar_t *SaveDialog::getPath() { return inp->getString(); }
 
 const wchar_t *LoadDialog::getPath() { return inp->getString(); }
 
+bool LoadDialog::isFitting() { return fit->getValue(); }
+
 SaveDialog::SaveDialog() {
+    WindowArena::Scope scope(makeArena(dialogArenaChunk));
+
     setPosition(100, 100);
     setSize(500, 70);
     setOutlineColor({255, 140, 140, 255});
@@ -913,8 +1917,10 @@ SaveDialog::SaveDialog() {
 }
 
 LoadDialog::LoadDialog() {
+    WindowArena::Scope scope(makeArena(dialogArenaChunk));
+
     setPosition(100, 100);
-    setSize(500, 70);
+    setSize(500, 110);
     setOutlineColor({255, 140, 140, 255});
     setBackgroundColor({0, 0, 0, 255});
     setThickness(6);
@@ -924,6 +1930,181 @@ LoadDialog::LoadDialog() {
     inp->setPosition(120, 120);
     inp->setSize(400, 30);
 
+    TextWindow *fitLabel = new TextWindow;
+    fitLabel->setText(L"Fit to canvas");
+    fitLabel->setPosition(120, 160);
+    fitLabel->setCharSize(25);
+
+    fit = new Checkbox;
+    fit->setPosition(300, 160);
+
     attachChild(but);
     attachChild(inp);
-}
\ No newline at end of file
+    attachChild(fitLabel);
+    attachChild(fit);
+}
+
+static const wchar_t *ResampleFilterName(ResampleFilter filter) {
+    switch (filter) {
+        case ResampleFilter::NEAREST:
+            return L"Nearest";
+        case ResampleFilter::BILINEAR:
+            return L"Bilinear";
+        case ResampleFilter::BICUBIC:
+            return L"Bicubic";
+        default:
+            return L"Lanczos";
+    }
+}
+
+class FinalResizeButton : public TexturedButton {
+   public:
+    FinalResizeButton();
+    virtual void click(const Event &ev) override;
+};
+
+// Switches the filter used for resizing, shows the current one
+class FilterButton : public RectangleButton {
+   public:
+    FilterButton();
+    virtual void click(const Event &ev) override;
+    virtual void drawSelf() override;
+};
+
+FinalResizeButton::FinalResizeButton() {
+    setPosition(540, 120);
+    setSize(30, 30);
+    setOutlineColor({255, 255, 255, 255});
+    setBackgroundColor({0, 0, 0, 0});
+    setHoverColor({255, 255, 255, 100});
+    setPressColor({255, 255, 255, 255});
+
+    setThickness(2);
+    attachTexture(RenderEngine::LoadTexture("img/resize.png"));
+}
+
+void FinalResizeButton::click(const Event &) { static_cast<ResizeDialog *>(parent)->apply(); }
+
+FilterButton::FilterButton() {
+    setPosition(120, 160);
+    setSize(150, 30);
+    setThickness(-2);
+    setBackgroundColor({0, 0, 0, 0});
+    setOutlineColor({255, 255, 255, 255});
+    setHoverColor({255, 255, 255, 100});
+    setPressColor({255, 255, 255, 255});
+}
+
+void FilterButton::click(const Event &) { static_cast<ResizeDialog *>(parent)->cycleFilter(); }
+
+void FilterButton::drawSelf() {
+    RectangleButton::drawSelf();
+    RenderEngine::DrawText(x + 8, y + 3,
+                           ResampleFilterName(static_cast<ResizeDialog *>(parent)->getFilter()), 18);
+}
+
+ResizeDialog::ResizeDialog() : filter(ResampleFilter::LANCZOS3) {
+    WindowArena::Scope scope(makeArena(dialogArenaChunk));
+
+    setPosition(100, 100);
+    setSize(500, 110);
+    setOutlineColor({255, 140, 140, 255});
+    setBackgroundColor({0, 0, 0, 255});
+    setThickness(6);
+
+    widthInput = new InputBox;
+    widthInput->setPosition(120, 120);
+    widthInput->setSize(190, 30);
+
+    heightInput = new InputBox;
+    heightInput->setPosition(330, 120);
+    heightInput->setSize(190, 30);
+
+    attachChild(new FinalResizeButton);
+    attachChild(widthInput);
+    attachChild(heightInput);
+    attachChild(new FilterButton);
+}
+
+void ResizeDialog::apply() {
+    uint32_t oldWidth = current_canvas->getWidth();
+    uint32_t oldHeight = current_canvas->getHeight();
+    uint64_t width = wcstoul(widthInput->getString(), nullptr, 10);
+    uint64_t height = wcstoul(heightInput->getString(), nullptr, 10);
+
+    if (!width && height) {
+        width = std::max<uint64_t>(1, (height * oldWidth + oldHeight / 2) / oldHeight);
+    }
+    if (!height && width) {
+        height = std::max<uint64_t>(1, (width * oldHeight + oldWidth / 2) / oldWidth);
+    }
+
+    if (!width || !height || width > maxSize || height > maxSize) {
+        fprintf(stderr, "Canvas size %" PRIu64 "x%" PRIu64 " is out of range\n", width, height);
+        return;
+    }
+
+    current_canvas->scale(width, height, filter);
+    dm->onDocumentReplaced();
+
+    finish();
+}
+
+void ResizeDialog::cycleFilter() {
+    filter = static_cast<ResampleFilter>((static_cast<int>(filter) + 1) %
+                                         (static_cast<int>(ResampleFilter::LANCZOS3) + 1));
+}
+
+ResampleFilter ResizeDialog::getFilter() { return filter; }
+
+class CloseDialogButton : public RectangleButton {
+   public:
+    CloseDialogButton();
+    virtual void click(const Event &ev) override;
+    virtual void drawSelf() override;
+};
+
+CloseDialogButton::CloseDialogButton() {
+    setSize(80, 30);
+    setThickness(-2);
+    setBackgroundColor({0, 0, 0, 0});
+    setOutlineColor({255, 255, 255, 255});
+    setHoverColor({255, 255, 255, 100});
+    setPressColor({255, 255, 255, 255});
+}
+
+void CloseDialogButton::click(const Event &) { static_cast<ModalWindow *>(parent)->finish(); }
+
+void CloseDialogButton::drawSelf() {
+    RectangleButton::drawSelf();
+    RenderEngine::DrawText(x + 12, y + 3, L"Close", 18);
+}
+
+TextDialog::TextDialog(const wchar_t *text) {
+    WindowArena::Scope scope(makeArena(dialogArenaChunk));
+
+    setPosition(100, 100);
+    setSize(900, 660);
+    setOutlineColor({255, 140, 140, 255});
+    setBackgroundColor({0, 0, 0, 255});
+    setThickness(6);
+
+    view = new TextView;
+    view->setPosition(120, 160);
+    view->setSize(830, 580);
+    view->setCharSize(22);
+    view->setText(text);
+
+    // Scrollbar runs along the right edge of the view and scrolls whatever is in the manager
+    ScrollbarManager *scrollbars = new ScrollbarManager(false, true);
+    scrollbars->adjustScrollbarSize(120, 160, 830, 580);
+    scrollbars->adjustScrollableAreaSize(
+        830, static_cast<int>(std::max<int64_t>(view->getContentHeight(), 580)));
+    scrollbars->attachChild(view);
+
+    CloseDialogButton *close = new CloseDialogButton;
+    close->setPosition(120, 120);
+
+    attachChild(close);
+    attachChild(scrollbars);
+}
@@ -1,27 +1,112 @@
 #ifndef GRAPHIC_EDITOR_HPP_
 #define GRAPHIC_EDITOR_HPP_
 #include <cstdint>
-
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "../ImageProcessing/Autosave.hpp"
+#include "../ImageProcessing/Convolution.hpp"
+#include "../ImageProcessing/FloodFill.hpp"
+#include "../ImageProcessing/ImageIO.hpp"
+#include "../ImageProcessing/LayerStack.hpp"
+#include "../ImageProcessing/MipPyramid.hpp"
+#include "../ImageProcessing/ProjectFile.hpp"
+#include "../ImageProcessing/Resample.hpp"
+#include "../ImageProcessing/Selection.hpp"
+#include "../ImageProcessing/SummedAreaTable.hpp"
 #include "../WindowSystem/Window.hpp"
 #include "../editor_plugin_api/api/api.hpp"
 
-// Canvas is a renderable array array of pixels that supports drawing on it
+// Canvas is a renderable stack of pixel layers that supports drawing on the active one. The
+// rectangle of the window is a zoomable and pannable view of the composite.
 class Canvas : public RectangleWindow {
    public:
+    static constexpr float minZoom = 1.0f / 64;
+    static constexpr float maxZoom = 32;
+    static constexpr uint32_t loadPollInterval = 16;  // Milliseconds between passes of loaded rows
+
     Canvas(uint32_t width, uint32_t height);
     ~Canvas();
+    // Pixels of the active layer, writes must stay within the selection and be followed by
+    // markDirty
     uint32_t *getData();
-    uint32_t getWidth();
-    uint32_t getHeight();
-    void emplace(uint32_t width, uint32_t height, uint32_t *data);
-    virtual void draw() override;
+    LayerStack &getLayers();
+    uint32_t getWidth();   // Width of the image
+    uint32_t getHeight();  // Height of the image
+    void emplace(uint32_t width, uint32_t height, PixelStorage &&pixels);
+    bool loadProject(const char *path);  // Layers of the document are replaced
+    // Decode a PNG of the size ImageIO::ProbePNG reported straight into a new single-layer
+    // document in the background: rows show up as they come and Escape cancels, fitted documents
+    // are scaled once the image is in. False if the image is too large, the document is kept then
+    bool streamPNG(const char *path, uint32_t width, uint32_t height, bool fit);
+    void cancelLoad();  // Rows decoded so far stay
+    bool isLoading();   // Layers keep their pixel buffers until the load is over
+    void scale(uint32_t width, uint32_t height, ResampleFilter filter);  // Resample the document
+    void markDirty(const PixelRect &rect);  // Pixels of the active layer were changed by someone
+    // Layers were changed through getLayers(), the composite and everything built over it are
+    // brought up to date before the next frame is drawn
+    void requestUpdate();
+    SummedAreaTable &getAreaTable();        // Over the composite of the layers, up to date
+    uint32_t sampleColor(const PixelRect &rect);  // Average color of the composite over rect
+    void save(const wchar_t *path);  // Save contents in the background, projects incrementally
+    void waitForSave();
+    void setZoom(float zoom, int pivotX, int pivotY);  // Zoom keeping screen point pivot in place
+    void pan(float dx, float dy);                      // Move the view by screen pixels
+    bool screenToImage(int screenX, int screenY, uint32_t &imageX,
+                       uint32_t &imageY);  // False if the point is outside, coordinates are clamped
+    void setSelection(Selection &&selection);  // Empty selection lets tools draw anywhere
+    void clearSelection();
+    const Selection &getSelection();
+    virtual void drawSelf() override;
 
    private:
-    uint32_t *data;
+    LayerStack layers;
+    uint32_t imageWidth;
+    uint32_t imageHeight;
+    std::shared_ptr<ImageSaveTask> pendingSave;
+    std::wstring queuedSave;  // Path of a save waiting for the autosave shadows to catch up
+    TimerWheel::TimerId saveTimer;
+    std::shared_ptr<ImageLoadTask> pendingLoad;
+    uint32_t loadedRows;  // Rows of the pending load already passed on to the layers
+    uint32_t fitWidth;    // Size the loaded image is scaled to
+    uint32_t fitHeight;
+    ProjectFile project;  // Document file the layers were last saved to or loaded from
+    Autosave autosave;  // Into the scratch directory, recovers work lost in a crash
+    TimerWheel::TimerId autosaveTimer;
+    TimerWheel::TimerId updateTimer;
+    Selection selection;
+
+    float zoom;   // Screen pixels per image pixel
+    float viewX;  // Image coordinates of the top left corner of the view
+    float viewY;
+    MipPyramid mips;                   // Built over the composite of the layers
+    SummedAreaTable areaTable;         // Built over the composite on the first query
+    uint64_t viewBitmap;               // Visible part of the chosen mip level
+    uint64_t viewVersion;              // Changes with the pixels or the part of the level shown
+    size_t viewLevel;
+    PixelRect viewCrop;                // In pixels of viewLevel
+
     // uint32_t prev_x;
     // uint32_t prev_y;
     bool pressed;
-    virtual void handleEvent(Event ev) override;
+    bool panning;
+    int panLastX;
+    int panLastY;
+    void updateComposite();  // Recomposite and pass the changed region on to mips and areaTable
+    void update();           // Runs ahead of the frame, reschedules itself while work is left
+    void scheduleUpdate(uint32_t delay);  // Replaces the update that is scheduled
+    void rebuildDocument();  // Layers were replaced, everything built over them is rebuilt
+    void runAutosave();      // Reschedules itself
+    // Save queuedSave from the autosave shadows, retried until they are in sync unless wait is set
+    void startSave(bool wait = false);
+    void pollLoad();         // Pass decoded rows on, finish the load once it is over
+    void waitForLoad();
+    void fitView();
+    void clampView();
+    void handleWheel(const Event &ev);
+    virtual void handleEvent(const Event &ev) override;
 };
 
 union Setting {
@@ -30,122 +115,158 @@ union Setting {
     char *str;
 };
 
-class SettingElement : public RectangleWindow {
-   public:
-    virtual Setting getSettingValue() = 0;
-    virtual int getHeight() = 0;  // Height getter for the sake of settings fetching
-    virtual void processEvent(Event ev) override;
-
-   private:
-};
-
 class Checkbox : public RectangleButton {
    public:
     Checkbox();
     virtual void click(const Event &ev) override;
     bool getValue();
+    void setValue(bool newValue);
 
    private:
     bool value;
 };
 
-class SliderSetting : public SettingElement {
-   public:
-    SliderSetting(const wchar_t *label);
+using SettingKey = uint32_t;
 
-    virtual Setting getSettingValue() override;
-    virtual int getHeight() override;
-    virtual void draw() override;
-    //  void adjustPosition(int x, int y);
+// Setting of a tool. Values are kept here rather than in the rows showing them, since the rows
+// are bound to whichever settings are scrolled into the view
+struct SettingEntry {
+    enum Type { SLIDER, CHECKBOX };
 
-   private:
+    SettingKey key;
+    Type type;
     const wchar_t *label;
-    Slider *slider;
+    Setting value;
 };
 
-class CheckboxSetting : public SettingElement {
+class SettingsCollection;
+
+// Row of a settings panel: the label of the setting with a slider or a checkbox for its value
+class SettingRow : public RectangleWindow {
    public:
-    CheckboxSetting(const wchar_t *label);
+    static constexpr int sliderRange = 220;  // Pixels the slider moves from 0 to 1
 
-    virtual Setting getSettingValue() override;
-    virtual int getHeight() override;
-    virtual void draw() override;
+    SettingRow(SettingsCollection *collection);
+    void bind(size_t index, int x, int y, int width, int height);
+    virtual void processEvent(const Event &ev) override;  // Controls write the value back
 
    private:
-    const wchar_t *label;
+    void showControls(SettingEntry::Type type);
+
+    SettingsCollection *collection;
+    size_t index;
+    SettingEntry::Type shownType;
+    TextWindow *label;
+    RectangleWindow *track;
+    Slider *slider;
     Checkbox *checkbox;
 };
 
-using SettingKey = uint32_t;
+constexpr size_t settingsArenaChunk = 16 * 1024;  // Rows of a settings panel fit in one chunk
 
-// Collection of settings
-class SettingsCollection : public RectangleWindow {
+// Settings of a tool shown as a list, rows are only made for the settings in the view
+class SettingsCollection : public ListView, public ListAdapter {
    public:
+    static constexpr int rowHeight = 70;
+
     SettingsCollection();
     std::unordered_map<SettingKey, Setting> getCurrentSettings();
-    void addSetting(SettingKey key, SettingElement *el);
-    virtual void draw() override;
-    virtual void processEvent(Event ev) override;
+    void addSetting(SettingKey key, SettingEntry::Type type, const wchar_t *label);
+    SettingEntry &getEntry(size_t index);
+
+    virtual size_t getItemsCount() override;
+    virtual AbstractWindow *createItem() override;
+    virtual void bindItem(AbstractWindow *widget, size_t index, int x, int y, int width,
+                          int height) override;
 
    private:
-    int accumulatedHeight;
-    std::unordered_map<SettingKey, SettingElement *> elems;
-    Setting getSettingElementValue(SettingElement *elem);
+    std::vector<SettingEntry> entries;
 };
 
 // Container for different setting collection windows
 class SettingsContainer : public RectangleWindow {
    public:
     SettingsContainer();
-    virtual void draw() override;
-    void setCurrentCollection(SettingsCollection *collection);
+    void setCurrentCollection(SettingsCollection *collection);  // Placed over the container
     std::unordered_map<SettingKey, Setting> getSettings();
 
    private:
     SettingsCollection *current;
 };
 
-// Tool interface
-class AbstractTool : public TexturedButton {
+// Tool interface. Tools are not windows themselves, the tool manager lists them with buttons
+class AbstractTool {
    public:
     AbstractTool();
-    virtual void click(const Event &ev) override;
+    virtual ~AbstractTool();
 
     virtual void startApplication(Canvas &canvas, uint32_t x, uint32_t y, uint32_t frgColor,
                                   uint32_t bkgColor,
                                   std::unordered_map<SettingKey, Setting> settings) = 0;
     virtual void endApplication(Canvas &canvas, uint32_t x, uint32_t y) = 0;
     virtual void apply(Canvas &canvas, uint32_t x, uint32_t y) = 0;
-    void deactivate();
-    virtual SettingsCollection *activate();
+    void attachTexture(uint64_t descriptor);  // Icon of the tool
+    std::optional<uint64_t> getTexture();
+    SettingsCollection *getSettings();
 
    protected:
     SettingsCollection *mySettings;
+
+   private:
+    std::optional<uint64_t> texture;
+    WindowArena *panelArena;  // Settings panel with its rows, switching tools allocates nothing
+};
+
+class ToolManager;
+
+// Button of the tool list, shows whichever tool it is bound to and selects it on click
+class ToolButton : public TexturedButton {
+   public:
+    ToolButton(ToolManager *manager);
+    void bind(AbstractTool *tool, bool isActive);
+    virtual void click(const Event &ev) override;
+
+   private:
+    ToolManager *manager;
+    AbstractTool *tool;
 };
 
-// Manager for tools that handles boring stuff as well a selection of a certain tool
-class ToolManager : public RectangleWindow {
+// Manager for tools that handles boring stuff as well a selection of a certain tool. Tools and
+// plugins are listed by a ListView, so buttons are only made for the tools in the view
+class ToolManager : public RectangleWindow, public ListAdapter {
    public:
+    static constexpr int itemHeight = 60;
+
     ToolManager();
+    void setPosition(int x, int y);
+    void setSize(unsigned int width, unsigned int height);
     void setActiveTool(AbstractTool *tool);
     void attachTool(AbstractTool *tool);
     AbstractTool *getActiveTool();
 
+    virtual size_t getItemsCount() override;
+    virtual AbstractWindow *createItem() override;
+    virtual void bindItem(AbstractWindow *widget, size_t index, int x, int y, int width,
+                          int height) override;
+
    private:
+    ListView *list;
+    std::vector<AbstractTool *> tools;
     AbstractTool *activeTool;
 };
 
 class HSVSlider : public RectangleButton {
    public:
     HSVSlider(uint32_t width, uint32_t height);
-    virtual void draw() override;
+    virtual void drawSelf() override;
 
    private:
     virtual void onMouseMove(const Event &ev) override;
     virtual void click(const Event &ev) override;
-    //    virtual void handleEvent(Event ev) override;
+    //    virtual void handleEvent(const Event &ev) override;
     uint16_t cur_hue;
     uint32_t *rainbowBkg;
+    uint64_t bitmap;  // Of rainbowBkg, which never changes
 };
 
 class ColorSample : public RectangleButton {
@@ -166,7 +287,7 @@ class HSVFader : public RectangleButton {
     HSVFader(uint32_t width, uint32_t height);
 
     void updateHue(uint16_t hue);
-    virtual void draw() override;
+    virtual void drawSelf() override;
 
    private:
     virtual void onMouseMove(const Event &ev) override;
@@ -174,6 +295,8 @@ class HSVFader : public RectangleButton {
     void redrawBkg();
 
     uint32_t *SVBkg;
+    uint64_t bitmap;  // Of SVBkg
+    uint64_t bitmapVersion;
     uint16_t H;
     uint8_t cur_sat;
     uint8_t cur_val;
@@ -187,6 +310,7 @@ class ColorPicker : public RectangleWindow {
     void updateHue(uint16_t H);
     void updateSV(uint8_t S, uint8_t V);
     void activateColor(uint32_t tag);
+    void pickColor(uint32_t color);  // Make color the active one, sliders are left as they are
 
     void setPosition(int x, int y);
 
@@ -210,6 +334,68 @@ class ColorPicker : public RectangleWindow {
     ColorSample *backgroundColor;
 };
 
+class LayerPanel;
+
+// Button of the layer panel that performs an action with the active layer
+class LayerActionButton : public RectangleButton {
+   public:
+    enum Action { ADD, REMOVE, RAISE, LOWER, TOGGLE_VISIBILITY, CYCLE_MODE };
+
+    LayerActionButton(Action action, const wchar_t *label);
+    virtual void click(const Event &ev) override;
+    virtual void drawSelf() override;
+
+   private:
+    Action action;
+    const wchar_t *label;
+};
+
+// Button representing a single layer, selects the layer on click
+class LayerEntry : public RectangleButton {
+   public:
+    LayerEntry(size_t index);
+    void update(const Layer &layer, bool isActive);
+    virtual void click(const Event &ev) override;
+    virtual void drawSelf() override;
+
+   private:
+    size_t index;
+    std::wstring label;
+};
+
+// Slider that sets opacity of the active layer while being dragged
+class OpacitySlider : public Slider {
+   public:
+    OpacitySlider();
+    virtual void onMouseMove(const Event &ev) override;
+};
+
+// Panel with the list of layers of the canvas and controls for them
+class LayerPanel : public RectangleWindow {
+   public:
+    static constexpr int entryWidth = 110;
+
+    static constexpr size_t entriesArenaChunk = 4 * 1024;  // Entries of a dozen layers
+
+    LayerPanel();
+    void setPosition(int x, int y);
+    void setCanvas(Canvas *canvas);
+    void rebuildEntries();  // Layers were added, removed or reordered
+    void updateEntries();   // Properties of the layers changed
+    void performAction(LayerActionButton::Action action);
+    void selectLayer(size_t index);
+    void applyOpacity();  // Take opacity of the active layer from the slider
+
+   private:
+    int getOpacityPivot();  // Slider position for zero opacity
+
+    Canvas *canvas;
+    std::vector<LayerActionButton *> actions;
+    std::vector<LayerEntry *> entries;
+    RectangleWindow *opacityTrack;
+    OpacitySlider *opacity;
+};
+
 // Class that handles all the drawing activities
 class DrawingManager : public ContainerWindow {
    public:
@@ -221,7 +407,9 @@ class DrawingManager : public ContainerWindow {
     void endToolApplication(uint32_t x, uint32_t y);
     void applyTool(uint32_t x, uint32_t y);
     void updateActiveColor(uint32_t color);
+    void pickColor(uint32_t color);
     void setCurrentSettingsCollection(SettingsCollection *collection);
+    void onDocumentReplaced();  // Canvas got a new set of layers
 
     // ~DrawingManager();
 
@@ -234,6 +422,7 @@ class DrawingManager : public ContainerWindow {
     Canvas *canvas;
     ColorPicker *colorPicker;
     SettingsContainer *settingsContainer;
+    LayerPanel *layerPanel;
 };
 
 // There go important windows
@@ -242,9 +431,11 @@ class LoadDialog : public ModalWindow {
    public:
     LoadDialog();
     const wchar_t *getPath();
+    bool isFitting();  // Loaded image is downscaled to fit into the canvas
 
    private:
     InputBox *inp;
+    Checkbox *fit;
 };
 
 class SaveDialog : public ModalWindow {
@@ -256,6 +447,31 @@ class SaveDialog : public ModalWindow {
     InputBox *inp;
 };
 
+// Dialog with the new size of the canvas, an empty field keeps the aspect ratio
+class ResizeDialog : public ModalWindow {
+   public:
+    static constexpr uint32_t maxSize = ImageIO::maxSize;
+
+    ResizeDialog();
+    void apply();
+    void cycleFilter();
+    ResampleFilter getFilter();
+
+   private:
+    InputBox *widthInput;
+    InputBox *heightInput;
+    ResampleFilter filter;
+};
+
+// Long text in a scrollable view, the poem the editor has always carried
+class TextDialog : public ModalWindow {
+   public:
+    TextDialog(const wchar_t *text);
+
+   private:
+    TextView *view;
+};
+
 // There go important buttons
 
 class ModalInvokerButton : public TexturedButton {
@@ -283,8 +499,18 @@ class PluginTool : public AbstractTool {
     virtual void apply(Canvas &canvas, uint32_t x, uint32_t y) override;
 
    private:
+    // Plugins write anywhere on the canvas they are given, so while something is selected they
+    // get a copy of the selection bounds with the position moved into it, and only the selected
+    // part of the copy is taken back afterwards. Without a selection they draw on the layer, and
+    // the tiles that differ from the mirror of it are the ones marked dirty
+    PluginAPI::Canvas lendCanvas(Canvas &canvas, uint32_t &x, uint32_t &y);
+    void takeBack(Canvas &canvas);
+    void updateMirror(Canvas &canvas);  // Copy of the whole active layer, at start of a stroke
+
     void *handle;
     PluginAPI::Plugin *plugin;
+    PixelStorage scratch;  // Copy of the selection bounds
+    PixelStorage mirror;   // Active layer as the plugin last left it
 };
 
 // Brush tool class
@@ -303,6 +529,68 @@ class Brush : public AbstractTool {
     uint32_t prev_x;
     uint32_t prev_y;
     uint32_t radius;
+    uint8_t opacity;
+    float hardness;  // 1 for hard edges, softer brushes fade out towards the edge
+    BlendMode mode;
+    std::vector<uint8_t> coverage;  // Coverage of the bounding box of a segment
+    std::vector<std::pair<int32_t, int32_t>> rowSpans;  // Covered columns of every row of a segment
+};
+
+// Bucket fill of the region around the pressed pixel
+class FillTool : public AbstractTool {
+   public:
+    FillTool();
+    virtual void startApplication(Canvas &canvas, uint32_t x, uint32_t y, uint32_t frgColor,
+                                  uint32_t bkgColor,
+                                  std::unordered_map<SettingKey, Setting> settings) override;
+    virtual void endApplication(Canvas &canvas, uint32_t x, uint32_t y) override;
+    virtual void apply(Canvas &canvas, uint32_t x, uint32_t y) override;
+
+   protected:
+    static FillOptions ReadOptions(std::unordered_map<SettingKey, Setting> &settings);
+    PixelStorage mask;  // Of the last fill
+};
+
+// Magic wand selects the region instead of filling it, the region may be added to or taken
+// from the current selection
+class MagicWand : public FillTool {
+   public:
+    static constexpr float maxFeather = 50;
+
+    MagicWand();
+    virtual void startApplication(Canvas &canvas, uint32_t x, uint32_t y, uint32_t frgColor,
+                                  uint32_t bkgColor,
+                                  std::unordered_map<SettingKey, Setting> settings) override;
+};
+
+// Gaussian blur of the active layer on click
+class BlurTool : public AbstractTool {
+   public:
+    static constexpr float maxSigma = 100;
+    static constexpr uint32_t blurMargin = 3;  // Box passes reach a little past 3 sigma
+
+    BlurTool();
+    virtual void startApplication(Canvas &canvas, uint32_t x, uint32_t y, uint32_t frgColor,
+                                  uint32_t bkgColor,
+                                  std::unordered_map<SettingKey, Setting> settings) override;
+    virtual void endApplication(Canvas &canvas, uint32_t x, uint32_t y) override;
+    virtual void apply(Canvas &canvas, uint32_t x, uint32_t y) override;
+};
+
+// Picks the average color of the composite around the pointer
+class Eyedropper : public AbstractTool {
+   public:
+    static constexpr uint32_t maxRadius = 32;
+
+    Eyedropper();
+    virtual void startApplication(Canvas &canvas, uint32_t x, uint32_t y, uint32_t frgColor,
+                                  uint32_t bkgColor,
+                                  std::unordered_map<SettingKey, Setting> settings) override;
+    virtual void endApplication(Canvas &canvas, uint32_t x, uint32_t y) override;
+    virtual void apply(Canvas &canvas, uint32_t x, uint32_t y) override;
+
+   private:
+    uint32_t radius;
 };
 
 // Eraser is a modification of brush that uses background color instead of foreground color
@@ -0,0 +1,262 @@
+#include "Autosave.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <numeric>
+
+#include "Blend.hpp"
+
+using Clock = std::chrono::steady_clock;
+
+static double MillisecondsSince(Clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+// Nothing to write: no tiles and the layers still look as they did last time
+static bool IsUnchanged(const ProjectSnapshot &snapshot, const ProjectSnapshot &last) {
+    if (!snapshot.incremental || snapshot.getTilesCount() ||
+        snapshot.activeLayer != last.activeLayer || snapshot.layers.size() != last.layers.size()) {
+        return false;
+    }
+
+    for (size_t i = 0; i < snapshot.layers.size(); i++) {
+        const ProjectSnapshot::LayerState &layer = snapshot.layers[i];
+        const ProjectSnapshot::LayerState &previous = last.layers[i];
+        if (layer.id != previous.id || layer.opacity != previous.opacity ||
+            layer.isVisible != previous.isVisible || layer.mode != previous.mode) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// ShadowSnapshot methods
+void ShadowSnapshot::composite(uint32_t firstRow, uint32_t rowsCount, uint32_t *out) const {
+    size_t from = static_cast<size_t>(firstRow) * width;
+    size_t count = static_cast<size_t>(rowsCount) * width;
+
+    FillSpan(out, 0, count);
+    for (const LayerState &layer : layers) {
+        if (!layer.isVisible) continue;
+
+        layer.pixels->touch(from, from + count);
+        BlendSpan(out, layer.pixels->data() + from, count, layer.mode, layer.opacity);
+    }
+}
+
+// Autosave methods
+Autosave::Autosave(std::string path)
+    : path(std::move(path)),
+      snapshot(),
+      width(0),
+      height(0),
+      tilesX(0),
+      tilesY(0),
+      running(false),
+      frozenCount(0),
+      lastStall(0) {}
+
+Autosave::~Autosave() {
+    if (worker.joinable()) worker.join();
+}
+
+void Autosave::markDirty(LayerStack &layers, size_t index, const PixelRect &rect) {
+    // Shadows of layers that are not adopted yet are stale as a whole anyway
+    auto found = shadows.find(layers.getLayer(index).id);
+    if (found == shadows.end() || layers.getWidth() != width || layers.getHeight() != height) {
+        return;
+    }
+
+    PixelRect clipped = rect;
+    clipped.clip(width, height);
+    if (clipped.isEmpty()) return;
+
+    Shadow &shadow = found->second;
+    uint32_t tileSize = LayerStack::tileSize;
+    for (uint32_t ty = clipped.y0 / tileSize; ty <= (clipped.y1 - 1) / tileSize; ty++) {
+        for (uint32_t tx = clipped.x0 / tileSize; tx <= (clipped.x1 - 1) / tileSize; tx++) {
+            size_t tile = static_cast<size_t>(ty) * tilesX + tx;
+            if (shadow.stale[tile]) continue;
+
+            shadow.stale[tile] = 1;
+            shadow.staleTiles.push_back(tile);
+        }
+    }
+}
+
+void Autosave::adopt(LayerStack &layers) {
+    if (layers.getWidth() != width || layers.getHeight() != height) {
+        shadows.clear();
+        width = layers.getWidth();
+        height = layers.getHeight();
+        tilesX = (width + LayerStack::tileSize - 1) / LayerStack::tileSize;
+        tilesY = (height + LayerStack::tileSize - 1) / LayerStack::tileSize;
+    }
+
+    for (auto shadow = shadows.begin(); shadow != shadows.end();) {
+        bool isPresent = false;
+        for (size_t i = 0; i < layers.getLayersCount(); i++) {
+            isPresent |= layers.getLayer(i).id == shadow->first;
+        }
+        shadow = isPresent ? std::next(shadow) : shadows.erase(shadow);
+    }
+
+    size_t tilesCount = static_cast<size_t>(tilesX) * tilesY;
+    size_t projectTilesCount =
+        static_cast<size_t>((width + ProjectFile::tileSize - 1) / ProjectFile::tileSize) *
+        ((height + ProjectFile::tileSize - 1) / ProjectFile::tileSize);
+    for (size_t i = 0; i < layers.getLayersCount(); i++) {
+        uint64_t id = layers.getLayer(i).id;
+        if (shadows.count(id)) continue;
+
+        Shadow &shadow = shadows[id];
+        shadow.pixels = PixelStorage(static_cast<size_t>(width) * height);
+        shadow.stale.assign(tilesCount, 1);
+        shadow.staleTiles.resize(tilesCount);
+        std::iota(shadow.staleTiles.begin(), shadow.staleTiles.end(), 0);
+        shadow.unsaved.assign(projectTilesCount, 1);
+    }
+}
+
+bool Autosave::sync(LayerStack &layers) {
+    // Shadows are being saved
+    if (!canSync()) return false;
+
+    return copyStale(layers, syncBudget);
+}
+
+bool Autosave::copyStale(LayerStack &layers, double budget) {
+    Clock::time_point begin = Clock::now();
+    adopt(layers);
+
+    uint32_t tileSize = LayerStack::tileSize;
+    uint32_t tilesPerProjectTile = ProjectFile::tileSize / tileSize;
+    uint32_t projectTilesX = (width + ProjectFile::tileSize - 1) / ProjectFile::tileSize;
+    for (size_t i = 0; i < layers.getLayersCount(); i++) {
+        Shadow &shadow = shadows[layers.getLayer(i).id];
+        const uint32_t *source = layers.getLayerPixels(i);
+
+        while (!shadow.staleTiles.empty()) {
+            if (MillisecondsSince(begin) > budget) return false;
+
+            size_t tile = shadow.staleTiles.back();
+            shadow.staleTiles.pop_back();
+            shadow.stale[tile] = 0;
+
+            uint32_t tx = tile % tilesX;
+            uint32_t ty = tile / tilesX;
+            uint32_t x0 = tx * tileSize;
+            uint32_t y0 = ty * tileSize;
+            uint32_t x1 = std::min(x0 + tileSize, width);
+            uint32_t y1 = std::min(y0 + tileSize, height);
+            for (uint32_t y = y0; y < y1; y++) {
+                size_t offset = static_cast<size_t>(y) * width + x0;
+                memcpy(shadow.pixels.data() + offset, source + offset,
+                       (x1 - x0) * sizeof(uint32_t));
+            }
+            shadow.pixels.touch(static_cast<size_t>(y0) * width, static_cast<size_t>(y1) * width);
+
+            size_t projectTile = static_cast<size_t>(ty / tilesPerProjectTile) * projectTilesX +
+                                 tx / tilesPerProjectTile;
+            shadow.unsaved[projectTile] = 1;
+        }
+    }
+
+    return true;
+}
+
+bool Autosave::start(LayerStack &layers) {
+    Clock::time_point begin = Clock::now();
+
+    // Autosave that takes longer than the interval makes the next one skipped
+    if (running) return true;
+    if (worker.joinable()) worker.join();
+    if (!sync(layers)) return false;
+
+    std::vector<ProjectSnapshot::LayerState> states;
+    for (size_t i = 0; i < layers.getLayersCount(); i++) {
+        const Layer &layer = layers.getLayer(i);
+        states.push_back({layer.id, layer.opacity, layer.isVisible, layer.mode,
+                          shadows[layer.id].pixels.data(), {}});
+    }
+
+    ProjectSnapshot next =
+        file.snapshot(path.c_str(), width, height, layers.getActiveLayer(), std::move(states),
+                      [&](size_t layer, size_t tile) {
+                          return shadows[layers.getLayer(layer).id].unsaved[tile] != 0;
+                      });
+    if (IsUnchanged(next, snapshot)) return true;
+
+    for (auto &shadow : shadows) {
+        std::fill(shadow.second.unsaved.begin(), shadow.second.unsaved.end(), 0);
+    }
+    snapshot = std::move(next);
+
+    lastStall = MillisecondsSince(begin);
+    running = true;
+    worker = std::thread(&Autosave::run, this);
+
+    return true;
+}
+
+bool Autosave::isSynced(LayerStack &layers) {
+    if (layers.getWidth() != width || layers.getHeight() != height) return false;
+
+    for (size_t i = 0; i < layers.getLayersCount(); i++) {
+        auto shadow = shadows.find(layers.getLayer(i).id);
+        if (shadow == shadows.end() || !shadow->second.staleTiles.empty()) return false;
+    }
+    return true;
+}
+
+bool Autosave::isRunning() { return running; }
+
+bool Autosave::canSync() { return !running && !frozenCount; }
+
+std::shared_ptr<const ShadowSnapshot> Autosave::freeze(LayerStack &layers, bool wait) {
+    if (wait) {
+        if (worker.joinable()) worker.join();
+        if (!frozenCount) copyStale(layers, std::numeric_limits<double>::infinity());
+    } else if (canSync()) {
+        copyStale(layers, syncBudget);
+    }
+
+    // Running autosave or another snapshot only reads the shadows, they can be shared if in sync
+    if (!isSynced(layers)) return nullptr;
+
+    ShadowSnapshot *snapshot = new ShadowSnapshot{width, height, {}};
+    for (size_t i = 0; i < layers.getLayersCount(); i++) {
+        const Layer &layer = layers.getLayer(i);
+        snapshot->layers.push_back(
+            {&shadows[layer.id].pixels, layer.opacity, layer.isVisible, layer.mode});
+    }
+
+    frozenCount++;
+    return std::shared_ptr<const ShadowSnapshot>(snapshot, [this](const ShadowSnapshot *frozen) {
+        delete frozen;
+        frozenCount--;
+    });
+}
+
+double Autosave::getLastStall() { return lastStall; }
+
+std::string Autosave::DefaultPath() {
+    return std::string(PixelStorage::ScratchDirectory()) + "/autosave.wslp";
+}
+
+void Autosave::run() {
+    Clock::time_point begin = Clock::now();
+
+    // Failed save forgets the file, the next autosave writes everything
+    if (file.save(snapshot)) {
+        fprintf(stderr, "Autosaved %zu tiles to %s in %.0f ms, UI thread was held for %.3f ms\n",
+                snapshot.getTilesCount(), path.c_str(), MillisecondsSince(begin),
+                lastStall.load());
+    }
+
+    running = false;
+}
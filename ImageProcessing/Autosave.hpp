@@ -0,0 +1,96 @@
+#ifndef AUTOSAVE_HPP_
+#define AUTOSAVE_HPP_
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "LayerStack.hpp"
+#include "PixelStorage.hpp"
+#include "ProjectFile.hpp"
+
+// Layers as their shadows were when they were frozen, readable from any thread. The shadows stay
+// frozen until the last reference to it is dropped, the Autosave must outlive it.
+class ShadowSnapshot {
+   public:
+    struct LayerState {
+        PixelStorage *pixels;
+        uint8_t opacity;
+        bool isVisible;
+        BlendMode mode;
+    };
+
+    // Composite rows [firstRow, firstRow + rowsCount) into out, the same way LayerStack does
+    void composite(uint32_t firstRow, uint32_t rowsCount, uint32_t *out) const;
+
+    uint32_t width;
+    uint32_t height;
+    std::vector<LayerState> layers;
+};
+
+// Periodic save of the document into a project file in the background. Every layer has a shadow
+// copy that the tiles painted on are copied into a slice of at most syncBudget at a time, so the
+// UI thread never spends long on it. An autosave waits until the shadows have caught up, takes a
+// snapshot of them and of the layer metadata, and the worker compresses and appends the tiles
+// changed since the previous autosave while the shadows stay frozen and painting goes on.
+class Autosave {
+   public:
+    static constexpr uint32_t interval = 60000;  // Milliseconds between autosaves
+    static constexpr uint32_t retryDelay = 20;   // Milliseconds until shadows are synced again
+    static constexpr double syncBudget = 0.25;   // Milliseconds of copying per call
+
+    explicit Autosave(std::string path);
+    ~Autosave();  // Waits for the running autosave
+    Autosave(const Autosave &) = delete;
+    Autosave &operator=(const Autosave &) = delete;
+
+    void markDirty(LayerStack &layers, size_t index, const PixelRect &rect);
+    // Copy painted tiles into the shadows within the budget, true once all of them are in sync
+    bool sync(LayerStack &layers);
+    // Start saving the shadows unless the previous autosave is running or nothing changed; false
+    // if the shadows have yet to catch up, it is worth trying again after retryDelay
+    bool start(LayerStack &layers);
+    bool isRunning();
+    bool canSync();  // False while the shadows are frozen by an autosave or a snapshot
+    // Shadows of the layers for a save of the flattened image that runs alongside painting; null
+    // if they have yet to catch up, unless wait is set: the running autosave is waited for then
+    // and the shadows are brought up to date whatever it takes
+    std::shared_ptr<const ShadowSnapshot> freeze(LayerStack &layers, bool wait = false);
+    double getLastStall();  // Milliseconds the UI thread spent starting the last autosave
+
+    static std::string DefaultPath();  // In the scratch directory
+
+   private:
+    struct Shadow {
+        PixelStorage pixels;
+        std::vector<uint8_t> stale;      // Tiles of LayerStack size that differ from the layer
+        std::vector<size_t> staleTiles;  // Tiles with stale set, in no particular order
+        std::vector<uint8_t> unsaved;    // Tiles of ProjectFile size changed since the last save
+    };
+
+    void adopt(LayerStack &layers);  // Shadows of new layers are stale, ones of removed are gone
+    bool copyStale(LayerStack &layers, double budget);  // True once every shadow is in sync
+    bool isSynced(LayerStack &layers);                  // Without changing the shadows
+    void run();
+
+    std::string path;
+    ProjectFile file;
+    ProjectSnapshot snapshot;  // Of the running autosave, or the last one
+    std::thread worker;
+
+    uint32_t width;
+    uint32_t height;
+    uint32_t tilesX;  // Of LayerStack size
+    uint32_t tilesY;
+    std::unordered_map<uint64_t, Shadow> shadows;  // By id of the layer
+
+    std::atomic<bool> running;
+    std::atomic<size_t> frozenCount;  // Snapshots of the shadows given out and still alive
+    std::atomic<double> lastStall;
+};
+
+#endif  // AUTOSAVE_HPP_
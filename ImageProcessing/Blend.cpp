@@ -0,0 +1,83 @@
+#include "Blend.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+// Widest kernels the CPU can run, chosen once
+static const BlendKernels &SelectKernels() {
+    const BlendKernels *kernels = &blendKernelsScalar;
+
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) {
+        kernels = &blendKernelsAVX512;
+    } else if (__builtin_cpu_supports("avx2")) {
+        kernels = &blendKernelsAVX2;
+    } else if (__builtin_cpu_supports("sse2")) {
+        kernels = &blendKernelsSSE2;
+    }
+#endif
+
+    fprintf(stderr, "Using %s blend kernels\n", kernels->name);
+    return *kernels;
+}
+
+static const BlendKernels &Kernels() {
+    static const BlendKernels &kernels = SelectKernels();
+    return kernels;
+}
+
+void BlendSpan(uint32_t *dst, const uint32_t *src, size_t count, BlendMode mode,
+               uint8_t opacity) {
+    if (opacity == 0) return;
+    Kernels().blendSpan(dst, src, count, mode, opacity);
+}
+
+void BlendColorSpan(uint32_t *dst, uint32_t color, size_t count, BlendMode mode,
+                    uint8_t opacity) {
+    if (opacity == 0 || (color >> 24) == 0) return;
+
+    // Opaque source over anything is the source itself
+    if (mode == BlendMode::NORMAL && opacity == 255 && (color >> 24) == 255) {
+        FillSpan(dst, color, count);
+        return;
+    }
+
+    Kernels().blendColorSpan(dst, color, count, mode, opacity);
+}
+
+void BlendMaskSpan(uint32_t *dst, uint32_t color, const uint8_t *mask, size_t count,
+                   BlendMode mode, uint8_t opacity) {
+    if (opacity == 0 || (color >> 24) == 0) return;
+    Kernels().blendMaskSpan(dst, color, mask, count, mode, opacity);
+}
+
+void FillSpan(uint32_t *dst, uint32_t color, size_t count) { std::fill(dst, dst + count, color); }
+
+void CopySpan(uint32_t *dst, const uint32_t *src, size_t count) {
+    memcpy(dst, src, count * sizeof(uint32_t));
+}
+
+void FillRect(uint32_t *dst, uint32_t stride, const PixelRect &rect, uint32_t color) {
+    for (uint32_t y = rect.y0; y < rect.y1; y++) {
+        FillSpan(dst + static_cast<size_t>(y) * stride + rect.x0, color, rect.x1 - rect.x0);
+    }
+}
+
+void CopyRect(uint32_t *dst, const uint32_t *src, uint32_t stride, const PixelRect &rect) {
+    for (uint32_t y = rect.y0; y < rect.y1; y++) {
+        size_t offset = static_cast<size_t>(y) * stride + rect.x0;
+        CopySpan(dst + offset, src + offset, rect.x1 - rect.x0);
+    }
+}
+
+void BlendColorRect(uint32_t *dst, uint32_t stride, const PixelRect &rect, uint32_t color,
+                    BlendMode mode, uint8_t opacity) {
+    for (uint32_t y = rect.y0; y < rect.y1; y++) {
+        BlendColorSpan(dst + static_cast<size_t>(y) * stride + rect.x0, color, rect.x1 - rect.x0,
+                       mode, opacity);
+    }
+}
+
+const char *GetBlendKernelsName() { return Kernels().name; }
@@ -0,0 +1,54 @@
+#ifndef BLEND_HPP_
+#define BLEND_HPP_
+#include <cstddef>
+#include <cstdint>
+
+#include "MipPyramid.hpp"
+
+// Pixels are straight alpha RGBA, red in the lowest byte
+enum class BlendMode : uint8_t {
+    NORMAL,    // Source over
+    MULTIPLY,
+    SCREEN,
+    ADD,
+    ERASE,     // Source alpha is removed from the destination alpha, colors are kept
+};
+
+// Blends count pixels of src over dst, alpha of src is multiplied by opacity
+void BlendSpan(uint32_t *dst, const uint32_t *src, size_t count, BlendMode mode,
+               uint8_t opacity = 255);
+// Blends a single color over count pixels of dst
+void BlendColorSpan(uint32_t *dst, uint32_t color, size_t count, BlendMode mode,
+                    uint8_t opacity = 255);
+// Blends a single color with alpha scaled by per-pixel coverage, pixels with zero coverage are
+// left untouched
+void BlendMaskSpan(uint32_t *dst, uint32_t color, const uint8_t *mask, size_t count,
+                   BlendMode mode, uint8_t opacity = 255);
+
+void FillSpan(uint32_t *dst, uint32_t color, size_t count);
+void CopySpan(uint32_t *dst, const uint32_t *src, size_t count);
+// Rect helpers, stride is the width of the image in pixels
+void FillRect(uint32_t *dst, uint32_t stride, const PixelRect &rect, uint32_t color);
+void CopyRect(uint32_t *dst, const uint32_t *src, uint32_t stride, const PixelRect &rect);
+void BlendColorRect(uint32_t *dst, uint32_t stride, const PixelRect &rect, uint32_t color,
+                    BlendMode mode, uint8_t opacity = 255);
+
+const char *GetBlendKernelsName();  // Instruction set of the kernels chosen for this CPU
+
+// Table of kernels built for one instruction set. Every table produces bit-identical results.
+struct BlendKernels {
+    const char *name;
+    void (*blendSpan)(uint32_t *dst, const uint32_t *src, size_t count, BlendMode mode,
+                      uint8_t opacity);
+    void (*blendColorSpan)(uint32_t *dst, uint32_t color, size_t count, BlendMode mode,
+                           uint8_t opacity);
+    void (*blendMaskSpan)(uint32_t *dst, uint32_t color, const uint8_t *mask, size_t count,
+                          BlendMode mode, uint8_t opacity);
+};
+
+extern const BlendKernels blendKernelsScalar;
+extern const BlendKernels blendKernelsSSE2;
+extern const BlendKernels blendKernelsAVX2;
+extern const BlendKernels blendKernelsAVX512;
+
+#endif  // BLEND_HPP_
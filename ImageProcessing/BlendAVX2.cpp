@@ -0,0 +1,5 @@
+#define BLEND_LANES 8
+#include "BlendKernels.inl"
+
+const BlendKernels blendKernelsAVX2 = {"AVX2", BlendSpanKernel, BlendColorSpanKernel,
+                                       BlendMaskSpanKernel};
@@ -0,0 +1,5 @@
+#define BLEND_LANES 16
+#include "BlendKernels.inl"
+
+const BlendKernels blendKernelsAVX512 = {"AVX-512", BlendSpanKernel, BlendColorSpanKernel,
+                                         BlendMaskSpanKernel};
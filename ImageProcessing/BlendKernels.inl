@@ -0,0 +1,173 @@
+// Blend kernels written once with vector extensions and instantiated per instruction set.
+// Includer defines BLEND_LANES (pixels per vector) and is compiled with matching target flags.
+// Everything lives in an anonymous namespace so that code built for a wider instruction set
+// can never be picked by the linker for a caller running on a narrower one.
+#include <cstring>
+
+#include "Blend.hpp"
+
+#ifndef BLEND_LANES
+#error "BLEND_LANES has to be defined before including BlendKernels.inl"
+#endif
+
+namespace {
+
+typedef uint32_t U32 __attribute__((vector_size(BLEND_LANES * sizeof(uint32_t))));
+typedef int32_t I32 __attribute__((vector_size(BLEND_LANES * sizeof(int32_t))));
+typedef float F32 __attribute__((vector_size(BLEND_LANES * sizeof(float))));
+typedef uint8_t U8 __attribute__((vector_size(BLEND_LANES)));
+
+constexpr float inv255 = 1.0f / 255;
+
+inline F32 ToFloat(U32 v) { return __builtin_convertvector(__builtin_bit_cast(I32, v), F32); }
+
+inline U32 ToByte(F32 v) {  // Rounds, v is expected to be within [0, 255]
+    return __builtin_bit_cast(U32, __builtin_convertvector(v + 0.5f, I32));
+}
+
+inline F32 Select(I32 mask, F32 a, F32 b) {
+    return __builtin_bit_cast(F32, (mask & __builtin_bit_cast(I32, a)) |
+                                       (~mask & __builtin_bit_cast(I32, b)));
+}
+
+inline F32 Min(F32 a, F32 b) { return Select(a < b, a, b); }
+
+inline F32 Max(F32 a, F32 b) { return Select(a > b, a, b); }
+
+template <BlendMode mode>
+inline F32 BlendChannel(F32 back, F32 front) {
+    if constexpr (mode == BlendMode::MULTIPLY) {
+        return back * front * inv255;
+    } else if constexpr (mode == BlendMode::SCREEN) {
+        return back + front - back * front * inv255;
+    } else if constexpr (mode == BlendMode::ADD) {
+        return Min(back + front, F32{} + 255.0f);
+    } else {
+        return front;
+    }
+}
+
+template <BlendMode mode>
+inline U32 BlendPixels(U32 back, U32 front, F32 opacityScale) {
+    F32 frontAlpha = ToFloat(front >> 24) * opacityScale;
+    F32 backAlpha = ToFloat(back >> 24);
+
+    if constexpr (mode == BlendMode::ERASE) {
+        F32 outAlpha = backAlpha * (255.0f - frontAlpha) * inv255;
+        return (back & 0x00FFFFFF) | (ToByte(outAlpha) << 24);
+    } else {
+        // Straight alpha compositing: blend mode applies where the backdrop is opaque
+        F32 outAlpha = frontAlpha + backAlpha * (255.0f - frontAlpha) * inv255;
+        F32 backWeight = outAlpha - frontAlpha;
+        F32 invOutAlpha = 1.0f / Max(outAlpha, F32{} + 1e-3f);
+
+        U32 out = ToByte(outAlpha) << 24;
+        for (int shift = 0; shift < 24; shift += 8) {
+            F32 b = ToFloat((back >> shift) & 0xFF);
+            F32 f = ToFloat((front >> shift) & 0xFF);
+
+            F32 mixed = ((255.0f - backAlpha) * f + backAlpha * BlendChannel<mode>(b, f)) * inv255;
+            F32 channel = (frontAlpha * mixed + backWeight * b) * invOutAlpha;
+            out |= ToByte(Min(channel, F32{} + 255.0f)) << shift;
+        }
+
+        return out;
+    }
+}
+
+// Opacity of every pixel is further scaled by its coverage. Uncovered pixels are kept exactly
+template <BlendMode mode>
+inline U32 BlendCovered(U32 back, U32 front, U8 coverage, float opacityScale) {
+    U32 wide = __builtin_convertvector(coverage, U32);
+    U32 out = BlendPixels<mode>(back, front, ToFloat(wide) * (opacityScale * inv255));
+
+    U32 isCovered = __builtin_bit_cast(U32, wide != 0);
+    return (out & isCovered) | (back & ~isCovered);
+}
+
+// Solid sources are passed as src == nullptr, full coverage as mask == nullptr
+template <BlendMode mode>
+void BlendSpanMode(uint32_t *dst, const uint32_t *src, uint32_t color, const uint8_t *mask,
+                   size_t count, uint8_t opacity) {
+    float opacityScale = opacity * inv255;
+    U32 solid = U32{} + color;
+    const U8 uncovered = {};
+
+    size_t i = 0;
+    for (; i + BLEND_LANES <= count; i += BLEND_LANES) {
+        U32 back;
+        U32 front = solid;
+        U32 out;
+        if (mask) {
+            U8 coverage;
+            memcpy(&coverage, mask + i, sizeof(coverage));
+            if (!memcmp(&coverage, &uncovered, sizeof(coverage))) continue;
+
+            memcpy(&back, dst + i, sizeof(back));
+            if (src) memcpy(&front, src + i, sizeof(front));
+            out = BlendCovered<mode>(back, front, coverage, opacityScale);
+        } else {
+            memcpy(&back, dst + i, sizeof(back));
+            if (src) memcpy(&front, src + i, sizeof(front));
+            out = BlendPixels<mode>(back, front, F32{} + opacityScale);
+        }
+        memcpy(dst + i, &out, sizeof(out));
+    }
+
+    // Tail goes through the same vector code on a partially filled vector
+    if (i < count) {
+        size_t tail = (count - i) * sizeof(uint32_t);
+        U32 back = {};
+        U32 front = solid;
+        U32 out;
+        memcpy(&back, dst + i, tail);
+        if (src) memcpy(&front, src + i, tail);
+
+        if (mask) {
+            U8 coverage = {};
+            memcpy(&coverage, mask + i, count - i);
+            out = BlendCovered<mode>(back, front, coverage, opacityScale);
+        } else {
+            out = BlendPixels<mode>(back, front, F32{} + opacityScale);
+        }
+        memcpy(dst + i, &out, tail);
+    }
+}
+
+void BlendAny(uint32_t *dst, const uint32_t *src, uint32_t color, const uint8_t *mask,
+              size_t count, BlendMode mode, uint8_t opacity) {
+    switch (mode) {
+        case BlendMode::MULTIPLY:
+            BlendSpanMode<BlendMode::MULTIPLY>(dst, src, color, mask, count, opacity);
+            break;
+        case BlendMode::SCREEN:
+            BlendSpanMode<BlendMode::SCREEN>(dst, src, color, mask, count, opacity);
+            break;
+        case BlendMode::ADD:
+            BlendSpanMode<BlendMode::ADD>(dst, src, color, mask, count, opacity);
+            break;
+        case BlendMode::ERASE:
+            BlendSpanMode<BlendMode::ERASE>(dst, src, color, mask, count, opacity);
+            break;
+        default:
+            BlendSpanMode<BlendMode::NORMAL>(dst, src, color, mask, count, opacity);
+            break;
+    }
+}
+
+void BlendSpanKernel(uint32_t *dst, const uint32_t *src, size_t count, BlendMode mode,
+                     uint8_t opacity) {
+    BlendAny(dst, src, 0, nullptr, count, mode, opacity);
+}
+
+void BlendColorSpanKernel(uint32_t *dst, uint32_t color, size_t count, BlendMode mode,
+                          uint8_t opacity) {
+    BlendAny(dst, nullptr, color, nullptr, count, mode, opacity);
+}
+
+void BlendMaskSpanKernel(uint32_t *dst, uint32_t color, const uint8_t *mask, size_t count,
+                         BlendMode mode, uint8_t opacity) {
+    BlendAny(dst, nullptr, color, mask, count, mode, opacity);
+}
+
+}  // namespace
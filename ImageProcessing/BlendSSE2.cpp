@@ -0,0 +1,5 @@
+#define BLEND_LANES 4
+#include "BlendKernels.inl"
+
+const BlendKernels blendKernelsSSE2 = {"SSE2", BlendSpanKernel, BlendColorSpanKernel,
+                                       BlendMaskSpanKernel};
@@ -0,0 +1,5 @@
+#define BLEND_LANES 1
+#include "BlendKernels.inl"
+
+const BlendKernels blendKernelsScalar = {"scalar", BlendSpanKernel, BlendColorSpanKernel,
+                                         BlendMaskSpanKernel};
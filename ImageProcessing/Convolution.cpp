@@ -0,0 +1,311 @@
+#include "Convolution.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <memory>
+#include <utility>
+
+#include "PixelStorage.hpp"
+#include "ThreadPool.hpp"
+
+typedef float Pixel __attribute__((vector_size(16)));  // Premultiplied RGBA, one lane per channel
+typedef uint8_t Bytes __attribute__((vector_size(4)));
+typedef uint16_t Words __attribute__((vector_size(8)));
+typedef int32_t Mask __attribute__((vector_size(16)));
+typedef uint8_t Lanes8 __attribute__((vector_size(16)));
+typedef uint16_t Lanes16 __attribute__((vector_size(16)));
+
+constexpr float wordScale = 256;  // Intermediate channels keep 8 bits of fraction
+// Adding 2^23 to a float in [0, 2^23) leaves it rounded to the nearest integer in the low bits of
+// the mantissa. Narrowing this way is a couple of vector instructions even with only SSE2, where
+// converting float vectors to small integers goes one lane at a time.
+constexpr float roundingBias = 8388608;
+
+// Filter applied along rows or along columns. Lines are kept with reach extra positions on both
+// sides, filled according to the edge mode.
+struct LineFilter {
+    std::vector<float> kernel;  // Empty if box passes are used
+    uint32_t boxRadii[3];
+    uint32_t reach;
+};
+
+static LineFilter KernelFilter(const std::vector<float> &kernel) {
+    return {kernel, {0, 0, 0}, static_cast<uint32_t>(kernel.size() / 2)};
+}
+
+static LineFilter BoxFilter(float sigma) {
+    uint32_t widths[3];
+    Convolution::BoxWidths(sigma, widths);
+
+    LineFilter filter = {{}, {widths[0] / 2, widths[1] / 2, widths[2] / 2}, 0};
+    filter.reach = filter.boxRadii[0] + filter.boxRadii[1] + filter.boxRadii[2];
+    return filter;
+}
+
+static Pixel Select(Mask mask, Pixel a, Pixel b) {
+    return __builtin_bit_cast(Pixel, (__builtin_bit_cast(Mask, a) & mask) |
+                                         (__builtin_bit_cast(Mask, b) & ~mask));
+}
+
+static Pixel Clamp(Pixel value, Pixel low, Pixel high) {
+    value = Select(value < low, low, value);
+    return Select(value > high, high, value);
+}
+
+static Pixel Premultiply(uint32_t pixel) {
+    Bytes bytes;
+    memcpy(&bytes, &pixel, sizeof(bytes));
+
+    Pixel value = __builtin_convertvector(bytes, Pixel);
+    Pixel alpha = __builtin_shufflevector(value, value, 3, 3, 3, 3) * (1.f / 255);
+    return value * Select(Mask{0, 0, 0, -1}, Pixel{1, 1, 1, 1}, alpha);
+}
+
+static uint32_t Unpremultiply(Pixel value) {
+    // Colors are kept within what their alpha allows, rounding can push them a little over
+    Pixel alpha = __builtin_shufflevector(value, value, 3, 3, 3, 3);
+    alpha = Clamp(alpha, Pixel{0, 0, 0, 0}, Pixel{255, 255, 255, 255});
+    if (alpha[0] < 0.5f) return 0;
+
+    Pixel limit = Select(Mask{0, 0, 0, -1}, Pixel{255, 255, 255, 255}, alpha);
+    Pixel factor = Select(Mask{0, 0, 0, -1}, Pixel{1, 1, 1, 1}, 255 / alpha);
+    value = Clamp(value, Pixel{0, 0, 0, 0}, limit) * factor + roundingBias;
+
+    Lanes8 bytes = __builtin_bit_cast(Lanes8, value);
+    Bytes packed = __builtin_shufflevector(bytes, bytes, 0, 4, 8, 12);
+    uint32_t pixel;
+    memcpy(&pixel, &packed, sizeof(pixel));
+    return pixel;
+}
+
+static Words ToWords(Pixel value) {
+    value = Clamp(value, Pixel{0, 0, 0, 0}, Pixel{255, 255, 255, 255}) * wordScale + roundingBias;
+
+    Lanes16 words = __builtin_bit_cast(Lanes16, value);
+    return __builtin_shufflevector(words, words, 0, 2, 4, 6);
+}
+
+static Pixel FromWords(Words value) {
+    return __builtin_convertvector(value, Pixel) * (1 / wordScale);
+}
+
+// Position inside of the line that stands for position i outside of it, -1 for nothing
+static int64_t EdgeIndex(int64_t i, int64_t count, EdgeMode edges) {
+    switch (edges) {
+        case EdgeMode::CLAMP:
+            return std::clamp<int64_t>(i, 0, count - 1);
+        case EdgeMode::MIRROR: {
+            int64_t period = (i % (2 * count) + 2 * count) % (2 * count);
+            return period < count ? period : 2 * count - 1 - period;
+        }
+        case EdgeMode::WRAP:
+            return (i % count + count) % count;
+        default:
+            return -1;
+    }
+}
+
+// Every position of a line holds lanes pixels that are filtered together. Rows are lines of a
+// single lane, columns of a strip are filtered as one line of stripWidth lanes.
+template <size_t lanes>
+static void PadPosition(Pixel *inside, int64_t i, int64_t count, EdgeMode edges) {
+    int64_t index = EdgeIndex(i, count, edges);
+    Pixel *padding = inside + i * static_cast<int64_t>(lanes);
+
+    if (index < 0) {
+        std::fill(padding, padding + lanes, Pixel{0, 0, 0, 0});
+    } else {
+        std::copy(inside + index * lanes, inside + (index + 1) * lanes, padding);
+    }
+}
+
+template <size_t lanes>
+static void PadLine(Pixel *line, int64_t count, uint32_t reach, EdgeMode edges) {
+    Pixel *inside = line + reach * lanes;
+    for (int64_t i = 1; i <= reach; i++) {
+        PadPosition<lanes>(inside, -i, count, edges);
+        PadPosition<lanes>(inside, count - 1 + i, count, edges);
+    }
+}
+
+template <size_t lanes>
+static void KernelPass(const Pixel *in, Pixel *out, size_t count, const std::vector<float> &kernel,
+                       uint32_t reach) {
+    size_t radius = kernel.size() / 2;
+
+    for (size_t i = 0; i < count; i++) {
+        Pixel sums[lanes] = {};
+        const Pixel *source = in + (reach + i - radius) * lanes;
+        for (size_t k = 0; k < kernel.size(); k++, source += lanes) {
+            for (size_t lane = 0; lane < lanes; lane++) sums[lane] += source[lane] * kernel[k];
+        }
+
+        std::copy(sums, sums + lanes, out + (reach + i) * lanes);
+    }
+}
+
+// Running sum over the window for positions [from, to), one addition and one subtraction each
+template <size_t lanes>
+static void BoxPass(const Pixel *in, Pixel *out, int64_t from, int64_t to, uint32_t radius,
+                    uint32_t reach) {
+    float scale = 1.f / (2 * radius + 1);
+
+    Pixel sums[lanes] = {};
+    const Pixel *window = in + (reach + from - radius) * lanes;
+    for (size_t k = 0; k <= 2 * radius; k++, window += lanes) {
+        for (size_t lane = 0; lane < lanes; lane++) sums[lane] += window[lane];
+    }
+
+    const Pixel *leaving = in + (reach + from - radius) * lanes;
+    const Pixel *entering = in + (reach + from + radius + 1) * lanes;
+    Pixel *result = out + (reach + from) * lanes;
+    for (int64_t i = from; i < to; i++) {
+        for (size_t lane = 0; lane < lanes; lane++) result[lane] = sums[lane] * scale;
+        if (i + 1 == to) break;
+
+        for (size_t lane = 0; lane < lanes; lane++) sums[lane] += entering[lane] - leaving[lane];
+        leaving += lanes;
+        entering += lanes;
+        result += lanes;
+    }
+}
+
+// Filter a padded line, returns whichever of the two buffers ended up with the result
+template <size_t lanes>
+static Pixel *FilterLine(Pixel *line, Pixel *scratch, size_t count, const LineFilter &filter,
+                         EdgeMode edges) {
+    if (!filter.kernel.empty()) {
+        PadLine<lanes>(line, count, filter.reach, edges);
+        KernelPass<lanes>(line, scratch, count, filter.kernel, filter.reach);
+        return scratch;
+    }
+
+    // Padding is filled once, and every pass but the last also covers as much of it as the
+    // passes after it read, so edges behave as if the image really continued past the border
+    PadLine<lanes>(line, count, filter.reach, edges);
+    int64_t margin = filter.reach;
+    for (uint32_t radius : filter.boxRadii) {
+        margin -= radius;
+        BoxPass<lanes>(line, scratch, -margin, count + margin, radius, filter.reach);
+        std::swap(line, scratch);
+    }
+
+    return line;
+}
+
+static void Run(const uint32_t *src, uint32_t *dst, uint32_t width, uint32_t height,
+                const LineFilter &rows, const LineFilter &columns, EdgeMode edges) {
+    constexpr size_t lanes = Convolution::stripWidth;
+    size_t stripsCount = (width + lanes - 1) / lanes;
+
+    // Rows are stored strip after strip, so that the vertical pass reads every strip as one
+    // sequential block instead of a few bytes from every row. Lanes past the right edge of the
+    // image are zero. At 8 bytes a pixel the buffer is twice the image, so it is pixel storage
+    // that goes to the scratch directory for huge images. Line buffers are written in full
+    // before being read, so they are left uninitialized.
+    size_t wordsCount = stripsCount * height * lanes;
+    PixelStorage storage(wordsCount * sizeof(Words) / sizeof(uint32_t));
+    Words *filtered = reinterpret_cast<Words *>(storage.data());
+
+    size_t bandsCount = (height + Convolution::bandHeight - 1) / Convolution::bandHeight;
+    ThreadPool::Global().parallelFor(bandsCount, [&](size_t band) {
+        std::unique_ptr<Pixel[]> line(new Pixel[stripsCount * lanes + 2 * rows.reach]);
+        std::unique_ptr<Pixel[]> scratch(new Pixel[stripsCount * lanes + 2 * rows.reach]);
+
+        uint32_t yEnd = std::min<uint32_t>(height, (band + 1) * Convolution::bandHeight);
+        for (uint32_t y = band * Convolution::bandHeight; y < yEnd; y++) {
+            const uint32_t *srcRow = src + static_cast<size_t>(y) * width;
+            for (uint32_t x = 0; x < width; x++) line[rows.reach + x] = Premultiply(srcRow[x]);
+
+            Pixel *result =
+                FilterLine<1>(line.get(), scratch.get(), width, rows, edges) + rows.reach;
+            std::fill(result + width, result + stripsCount * lanes, Pixel{0, 0, 0, 0});
+
+            for (size_t strip = 0; strip < stripsCount; strip++) {
+                Words *filteredRow = filtered + (strip * height + y) * lanes;
+                for (size_t lane = 0; lane < lanes; lane++) {
+                    filteredRow[lane] = ToWords(result[strip * lanes + lane]);
+                }
+            }
+        }
+    });
+
+    // Strips are handed out in a few contiguous groups per thread, so that the column buffers
+    // are allocated once per group instead of once per strip
+    size_t groupsCount = std::min(stripsCount, ThreadPool::Global().getThreadsCount() * 4);
+    ThreadPool::Global().parallelFor(groupsCount, [&](size_t group) {
+        size_t positions = height + 2 * columns.reach;
+        std::unique_ptr<Pixel[]> line(new Pixel[positions * lanes]);
+        std::unique_ptr<Pixel[]> scratch(new Pixel[positions * lanes]);
+
+        size_t stripsEnd = (group + 1) * stripsCount / groupsCount;
+        for (size_t strip = group * stripsCount / groupsCount; strip < stripsEnd; strip++) {
+            const Words *stripWords = filtered + strip * height * lanes;
+            Pixel *inside = line.get() + columns.reach * lanes;
+            for (size_t i = 0; i < height * lanes; i++) inside[i] = FromWords(stripWords[i]);
+
+            const Pixel *result = FilterLine<lanes>(line.get(), scratch.get(), height, columns,
+                                                    edges) +
+                                  columns.reach * lanes;
+
+            uint32_t x0 = strip * lanes;
+            uint32_t used = std::min<uint32_t>(lanes, width - x0);  // Last strip may be narrower
+            for (uint32_t y = 0; y < height; y++) {
+                uint32_t *dstRow = dst + static_cast<size_t>(y) * width + x0;
+                for (uint32_t lane = 0; lane < used; lane++) {
+                    dstRow[lane] = Unpremultiply(result[y * lanes + lane]);
+                }
+            }
+        }
+    });
+}
+
+void Convolution::Separable(const uint32_t *src, uint32_t *dst, uint32_t width, uint32_t height,
+                            const std::vector<float> &kernelX, const std::vector<float> &kernelY,
+                            EdgeMode edges) {
+    if (!width || !height) return;
+    Run(src, dst, width, height, KernelFilter(kernelX), KernelFilter(kernelY), edges);
+}
+
+void Convolution::GaussianBlur(const uint32_t *src, uint32_t *dst, uint32_t width,
+                               uint32_t height, float sigma, EdgeMode edges) {
+    if (!width || !height) return;
+
+    if (sigma <= 0) {
+        if (dst != src) memcpy(dst, src, static_cast<size_t>(width) * height * sizeof(uint32_t));
+        return;
+    }
+
+    LineFilter filter = sigma < boxSigma ? KernelFilter(GaussianKernel(sigma)) : BoxFilter(sigma);
+    Run(src, dst, width, height, filter, filter, edges);
+}
+
+std::vector<float> Convolution::GaussianKernel(float sigma) {
+    if (sigma <= 0) return {1};
+
+    int32_t radius = std::ceil(3 * sigma);
+    std::vector<float> kernel(2 * radius + 1);
+
+    double sum = 0;
+    for (int32_t i = -radius; i <= radius; i++) {
+        double weight = std::exp(-0.5 * i * i / (static_cast<double>(sigma) * sigma));
+        kernel[i + radius] = weight;
+        sum += weight;
+    }
+
+    for (float &weight : kernel) weight /= sum;
+    return kernel;
+}
+
+void Convolution::BoxWidths(float sigma, uint32_t widths[3]) {
+    // Variance of a box of width w is (w^2 - 1) / 12; two odd widths around the ideal one are
+    // mixed so that the variances of the three boxes add up to sigma^2
+    double variance = static_cast<double>(sigma) * sigma;
+    int32_t lower = std::floor(std::sqrt(4 * variance + 1));
+    if (lower % 2 == 0) lower--;
+
+    double lowerCount = (12 * variance - 3.0 * lower * lower - 12.0 * lower - 9) / (-4.0 * lower - 4);
+    int32_t count = std::clamp<int32_t>(std::lround(lowerCount), 0, 3);
+    for (int32_t i = 0; i < 3; i++) widths[i] = i < count ? lower : lower + 2;
+}
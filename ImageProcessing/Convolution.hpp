@@ -0,0 +1,42 @@
+#ifndef CONVOLUTION_HPP_
+#define CONVOLUTION_HPP_
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// What filters see past the border of the image
+enum class EdgeMode : uint8_t {
+    CLAMP,        // Border pixels repeat
+    MIRROR,       // Image is reflected, border pixels included
+    WRAP,         // Image tiles
+    TRANSPARENT,  // Everything outside is transparent
+};
+
+// Separable filters on RGBA images. Rows are filtered first, in parallel bands, into a 16-bit
+// premultiplied copy. Columns are then filtered in parallel strips a few pixels wide, all columns
+// of a strip at once. Gaussians wider than boxSigma are approximated by three box passes whose
+// cost does not depend on the radius.
+class Convolution {
+   public:
+    static constexpr float boxSigma = 3;        // Larger blurs are done with box passes
+    static constexpr uint32_t bandHeight = 64;  // Rows per task of the horizontal pass
+    static constexpr uint32_t stripWidth = 16;  // Columns per task of the vertical pass
+
+    // Convolve rows with kernelX and columns with kernelY. Kernels are centered and have odd
+    // length. Values are clamped between the passes, so kernels with negative weights lose a
+    // little of their overshoot. dst may be the same as src.
+    static void Separable(const uint32_t *src, uint32_t *dst, uint32_t width, uint32_t height,
+                          const std::vector<float> &kernelX, const std::vector<float> &kernelY,
+                          EdgeMode edges);
+    static void GaussianBlur(const uint32_t *src, uint32_t *dst, uint32_t width, uint32_t height,
+                             float sigma, EdgeMode edges);
+
+    static std::vector<float> GaussianKernel(float sigma);  // Normalized, reaches 3 sigma
+    // Widths of three box blurs that together are closest to a Gaussian of sigma
+    static void BoxWidths(float sigma, uint32_t widths[3]);
+
+   private:
+    Convolution();
+};
+
+#endif  // CONVOLUTION_HPP_
@@ -0,0 +1,233 @@
+// Test of Convolution against a pixel by pixel reference: kernels and box approximated Gaussians
+// give the same premultiplied result as a direct convolution over an image extended by the edge
+// mode, also for images narrower than the reach of the filter
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#include "../Testing.hpp"
+#include "Convolution.hpp"
+
+constexpr float allowedError = 2;  // Premultiplied channel units, from the 16-bit intermediate
+constexpr uint32_t timingSize = 2048;
+
+struct Color {
+    float channels[4];
+};
+
+// Position inside of the line that stands for position i, -1 for a transparent one
+static int64_t EdgeIndex(int64_t i, int64_t count, EdgeMode edges) {
+    if (i >= 0 && i < count) return i;
+
+    switch (edges) {
+        case EdgeMode::CLAMP:
+            return i < 0 ? 0 : count - 1;
+        case EdgeMode::MIRROR:
+            while (i < 0 || i >= count) i = i < 0 ? -1 - i : 2 * count - 1 - i;
+            return i;
+        case EdgeMode::WRAP:
+            while (i < 0) i += count;
+            return i % count;
+        default:
+            return -1;
+    }
+}
+
+static Color Premultiplied(uint32_t pixel) {
+    float alpha = pixel >> 24;
+    Color color;
+    for (int channel = 0; channel < 3; channel++) {
+        color.channels[channel] = ((pixel >> (8 * channel)) & 0xFF) * alpha / 255;
+    }
+    color.channels[3] = alpha;
+    return color;
+}
+
+// Direct convolution of every row, then of every column; the rows are clamped and rounded to the
+// precision of the intermediate copy in between
+static std::vector<Color> Reference(const std::vector<uint32_t> &src, uint32_t width,
+                                    uint32_t height, const std::vector<float> &kernelX,
+                                    const std::vector<float> &kernelY, EdgeMode edges) {
+    std::vector<Color> rows(src.size());
+    int64_t radiusX = kernelX.size() / 2;
+    for (uint32_t y = 0; y < height; y++) {
+        for (uint32_t x = 0; x < width; x++) {
+            Color sum = {};
+            for (int64_t k = -radiusX; k <= radiusX; k++) {
+                int64_t index = EdgeIndex(x + k, width, edges);
+                if (index < 0) continue;
+
+                Color color = Premultiplied(src[static_cast<size_t>(y) * width + index]);
+                for (int c = 0; c < 4; c++) {
+                    sum.channels[c] += color.channels[c] * kernelX[k + radiusX];
+                }
+            }
+
+            for (float &channel : sum.channels) {
+                channel = std::nearbyint(std::clamp<float>(channel, 0, 255) * 256) / 256;
+            }
+            rows[static_cast<size_t>(y) * width + x] = sum;
+        }
+    }
+
+    std::vector<Color> result(src.size());
+    int64_t radiusY = kernelY.size() / 2;
+    for (uint32_t y = 0; y < height; y++) {
+        for (uint32_t x = 0; x < width; x++) {
+            Color sum = {};
+            for (int64_t k = -radiusY; k <= radiusY; k++) {
+                int64_t index = EdgeIndex(y + k, height, edges);
+                if (index < 0) continue;
+
+                const Color &color = rows[index * width + x];
+                for (int c = 0; c < 4; c++) {
+                    sum.channels[c] += color.channels[c] * kernelY[k + radiusY];
+                }
+            }
+            result[static_cast<size_t>(y) * width + x] = sum;
+        }
+    }
+
+    return result;
+}
+
+// Kernel of the three box passes that stand for a wide Gaussian
+static std::vector<float> BoxKernel(float sigma) {
+    uint32_t widths[3];
+    Convolution::BoxWidths(sigma, widths);
+
+    std::vector<float> kernel = {1};
+    for (uint32_t width : widths) {
+        std::vector<float> wider(kernel.size() + width - 1, 0);
+        for (size_t i = 0; i < kernel.size(); i++) {
+            for (uint32_t k = 0; k < width; k++) wider[i + k] += kernel[i] / width;
+        }
+        kernel = wider;
+    }
+
+    return kernel;
+}
+
+// Largest difference of the premultiplied channels of dst from the reference. Colors of the
+// result never go past its alpha, the reference is limited the same way.
+static float Compare(const std::vector<uint32_t> &dst, const std::vector<Color> &expected) {
+    float error = 0;
+    for (size_t i = 0; i < dst.size(); i++) {
+        Color color = Premultiplied(dst[i]);
+        float alpha = std::clamp<float>(expected[i].channels[3], 0, 255);
+        for (int c = 0; c < 4; c++) {
+            float reference = std::clamp<float>(expected[i].channels[c], 0, alpha);
+            error = std::max(error, std::abs(color.channels[c] - reference));
+        }
+    }
+
+    return error;
+}
+
+static std::vector<uint32_t> NoiseImage(uint32_t width, uint32_t height, std::mt19937 &random) {
+    std::vector<uint32_t> pixels(static_cast<size_t>(width) * height);
+    for (uint32_t &pixel : pixels) pixel = random();
+    return pixels;
+}
+
+// Sizes around the strip width and the band height, and smaller than the reach of the filters so
+// that the padding goes around the image more than once
+static const uint32_t sizes[][2] = {{1, 1}, {2, 3}, {5, 1}, {17, 9}, {40, 70}};
+static const EdgeMode edgeModes[] = {EdgeMode::CLAMP, EdgeMode::MIRROR, EdgeMode::WRAP,
+                                     EdgeMode::TRANSPARENT};
+
+static void TestSeparable() {
+    std::mt19937 random(42);
+    const std::vector<float> kernels[][2] = {
+        {{1}, {0.25f, 0.5f, 0.25f}},
+        {{0.1f, 0.2f, 0.7f}, {0.5f, 0, 0, 0, 0.5f}},
+        {{-0.5f, 2, -0.5f}, {-0.25f, 1.5f, -0.25f}},  // Overshoot is clamped between passes
+    };
+
+    for (auto [width, height] : sizes) {
+        std::vector<uint32_t> src = NoiseImage(width, height, random);
+        for (EdgeMode edges : edgeModes) {
+            for (const auto &kernel : kernels) {
+                std::vector<uint32_t> dst(src.size());
+                Convolution::Separable(src.data(), dst.data(), width, height, kernel[0], kernel[1],
+                                       edges);
+                std::vector<Color> expected = Reference(src, width, height, kernel[0], kernel[1],
+                                                        edges);
+                CHECK(Compare(dst, expected) <= allowedError);
+            }
+        }
+    }
+}
+
+// Narrow Gaussians use the sampled kernel, wide ones the box passes
+static void TestGaussian() {
+    std::mt19937 random(43);
+    const float sigmas[] = {0.7f, 2.5f, Convolution::boxSigma, 4.5f, 11};
+
+    for (auto [width, height] : sizes) {
+        std::vector<uint32_t> src = NoiseImage(width, height, random);
+        for (EdgeMode edges : edgeModes) {
+            for (float sigma : sigmas) {
+                std::vector<float> kernel = sigma < Convolution::boxSigma
+                                                ? Convolution::GaussianKernel(sigma)
+                                                : BoxKernel(sigma);
+
+                // Blurring in place gives the same result
+                std::vector<uint32_t> dst = src;
+                Convolution::GaussianBlur(dst.data(), dst.data(), width, height, sigma, edges);
+                std::vector<Color> expected = Reference(src, width, height, kernel, kernel, edges);
+                CHECK(Compare(dst, expected) <= allowedError);
+            }
+        }
+    }
+}
+
+// Widths are odd, at most one step apart, and their variances add up to the one of the Gaussian
+// within what a step can do
+static void TestBoxWidths() {
+    for (float sigma = Convolution::boxSigma; sigma < 100; sigma += 0.37f) {
+        uint32_t widths[3];
+        Convolution::BoxWidths(sigma, widths);
+
+        double variance = 0;
+        for (uint32_t width : widths) {
+            CHECK(width % 2 == 1);
+            variance += (static_cast<double>(width) * width - 1) / 12;
+        }
+        CHECK(widths[0] <= widths[1] && widths[1] <= widths[2] && widths[2] - widths[0] <= 2);
+
+        // Trading a box for the next width changes the variance by (w + 1) / 3
+        double step = (widths[0] + 1) / 3.0;
+        CHECK(std::abs(variance - static_cast<double>(sigma) * sigma) <= step / 2 + 0.01);
+    }
+}
+
+// Cost of a wide blur does not depend on the radius
+static void TestBlurCost() {
+    std::mt19937 random(44);
+    std::vector<uint32_t> src = NoiseImage(timingSize, timingSize, random);
+    std::vector<uint32_t> dst(src.size());
+
+    for (float sigma : {2.f, 10.f, 50.f}) {
+        auto start = std::chrono::steady_clock::now();
+        Convolution::GaussianBlur(src.data(), dst.data(), timingSize, timingSize, sigma,
+                                  EdgeMode::CLAMP);
+        double elapsed = std::chrono::duration<double, std::milli>(
+                             std::chrono::steady_clock::now() - start)
+                             .count();
+        printf("gaussian blur: %u x %u, sigma %.0f, %.2f ms\n", timingSize, timingSize, sigma,
+               elapsed);
+    }
+}
+
+int main() {
+    TestSeparable();
+    TestGaussian();
+    TestBoxWidths();
+    TestBlurCost();
+    return TestResult();
+}
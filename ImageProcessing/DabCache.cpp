@@ -0,0 +1,90 @@
+#include "DabCache.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+DabCache::DabCache(size_t capacity) : capacity(capacity), bytesUsed(0) {}
+
+const DabMask &DabCache::get(float radius, float hardness, float x, float y, int32_t &originX,
+                             int32_t &originY) {
+    // Sub-pixel position is rounded to the nearest step, carrying into the integer part
+    int64_t stepsX = std::lround(x * subpixelSteps);
+    int64_t stepsY = std::lround(y * subpixelSteps);
+    int64_t cellX = std::floor(static_cast<double>(stepsX) / subpixelSteps);
+    int64_t cellY = std::floor(static_cast<double>(stepsY) / subpixelSteps);
+    uint32_t subX = stepsX - cellX * subpixelSteps;
+    uint32_t subY = stepsY - cellY * subpixelSteps;
+
+    uint32_t radiusKey = std::lround(std::max(radius, 0.5f) * radiusSteps);
+    uint32_t hardnessKey = std::lround(std::clamp(hardness, 0.f, 1.f) * hardnessSteps);
+    uint64_t key = (static_cast<uint64_t>(radiusKey) << 32) | (hardnessKey << 16) |
+                   (subY << 8) | subX;
+
+    auto found = index.find(key);
+    if (found != index.end()) {
+        entries.splice(entries.begin(), entries, found->second);
+    } else {
+        entries.push_front({key, {}});
+        index[key] = entries.begin();
+
+        DabMask &mask = entries.front().mask;
+        Render(mask, static_cast<float>(radiusKey) / radiusSteps,
+               static_cast<float>(hardnessKey) / hardnessSteps,
+               static_cast<float>(subX) / subpixelSteps, static_cast<float>(subY) / subpixelSteps);
+        bytesUsed += mask.coverage.size();
+
+        // The mask just made is never evicted, however large it is
+        while (bytesUsed > capacity && entries.size() > 1) {
+            bytesUsed -= entries.back().mask.coverage.size();
+            index.erase(entries.back().key);
+            entries.pop_back();
+        }
+    }
+
+    const DabMask &mask = entries.front().mask;
+    originX = cellX + mask.origin;
+    originY = cellY + mask.origin;
+    return mask;
+}
+
+void DabCache::Render(DabMask &mask, float radius, float hardness, float offsetX, float offsetY) {
+    int32_t reach = std::ceil(radius) + 1;
+    mask.origin = -reach;
+    mask.size = 2 * reach + 1;
+    mask.coverage.assign(static_cast<size_t>(mask.size) * mask.size, 0);
+    mask.rows.assign(mask.size, {mask.size, 0});
+
+    // Edge is anti-aliased over a pixel, soft brushes additionally fade out with a smoothstep
+    // from hardness * radius to the edge
+    float inner = radius * hardness;
+    for (uint32_t row = 0; row < mask.size; row++) {
+        float dy = static_cast<float>(mask.origin + static_cast<int32_t>(row)) - offsetY;
+
+        for (uint32_t column = 0; column < mask.size; column++) {
+            float dx = static_cast<float>(mask.origin + static_cast<int32_t>(column)) - offsetX;
+            float distance = std::sqrt(dx * dx + dy * dy);
+
+            float coverage = std::clamp(radius + 0.5f - distance, 0.f, 1.f);
+            if (inner < radius && distance > inner && coverage > 0) {
+                float t = std::clamp((radius - distance) / (radius - inner), 0.f, 1.f);
+                coverage *= t * t * (3 - 2 * t);
+            }
+
+            uint8_t value = std::lround(coverage * 255);
+            if (!value) continue;
+
+            mask.coverage[static_cast<size_t>(row) * mask.size + column] = value;
+            mask.rows[row].first = std::min(mask.rows[row].first, column);
+            mask.rows[row].second = std::max(mask.rows[row].second, column + 1);
+        }
+    }
+}
+
+size_t DabCache::getMasksCount() { return entries.size(); }
+
+size_t DabCache::getBytesUsed() { return bytesUsed; }
+
+DabCache &DabCache::Global() {
+    static DabCache cache;
+    return cache;
+}
@@ -0,0 +1,53 @@
+#ifndef DAB_CACHE_HPP_
+#define DAB_CACHE_HPP_
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <unordered_map>
+#include <vector>
+
+// Anti-aliased coverage of a single round brush dab
+struct DabMask {
+    int32_t origin;  // Offset of the first mask pixel from the integer part of the dab center
+    uint32_t size;   // Masks are square
+    std::vector<uint8_t> coverage;
+    std::vector<std::pair<uint32_t, uint32_t>> rows;  // Covered columns [first, last) of every row
+};
+
+// Dab masks keyed by radius, hardness and sub-pixel position of the center, all quantized, with
+// least recently used masks evicted once the cache outgrows its capacity
+class DabCache {
+   public:
+    static constexpr uint32_t subpixelSteps = 4;  // Positions per pixel on every axis
+    static constexpr uint32_t radiusSteps = 4;    // Radii per pixel
+    static constexpr uint32_t hardnessSteps = 64;
+    static constexpr size_t defaultCapacity = 32 * 1024 * 1024;  // Bytes of coverage
+
+    explicit DabCache(size_t capacity = defaultCapacity);
+    DabCache(const DabCache &) = delete;
+    DabCache &operator=(const DabCache &) = delete;
+
+    // Mask for a dab centered at (x, y), its first pixel lands at (originX, originY). Hardness of
+    // 1 is a hard disc, 0 fades out from the center. Returned mask stays valid until the next call.
+    const DabMask &get(float radius, float hardness, float x, float y, int32_t &originX,
+                       int32_t &originY);
+    size_t getMasksCount();
+    size_t getBytesUsed();
+
+    static DabCache &Global();  // Cache shared by the brush tools
+
+   private:
+    struct Entry {
+        uint64_t key;
+        DabMask mask;
+    };
+
+    static void Render(DabMask &mask, float radius, float hardness, float offsetX, float offsetY);
+
+    std::list<Entry> entries;  // Most recently used first
+    std::unordered_map<uint64_t, std::list<Entry>::iterator> index;
+    size_t capacity;
+    size_t bytesUsed;
+};
+
+#endif  // DAB_CACHE_HPP_
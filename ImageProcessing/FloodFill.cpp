@@ -0,0 +1,282 @@
+#include "FloodFill.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+#include "Blend.hpp"
+#include "ThreadPool.hpp"
+
+typedef uint8_t Bytes __attribute__((vector_size(16)));  // Four pixels
+
+constexpr uint32_t bandHeight = 64;  // Rows per task of the parallel passes
+
+// Image being searched together with the seed color
+struct FillRegion {
+    const uint32_t *pixels;
+    uint32_t width;
+    uint32_t height;
+    uint32_t seed;
+    uint8_t tolerance;
+    uint8_t *mask;
+};
+
+static uint32_t Difference(uint32_t a, uint32_t b) {
+    uint32_t result = 0;
+    for (int shift = 0; shift < 32; shift += 8) {
+        int32_t channel = static_cast<int32_t>((a >> shift) & 0xFF) -
+                          static_cast<int32_t>((b >> shift) & 0xFF);
+        result = std::max<uint32_t>(result, std::abs(channel));
+    }
+
+    return result;
+}
+
+static Bytes Splat(uint32_t pixel) {
+    uint32_t pixels[4] = {pixel, pixel, pixel, pixel};
+    Bytes result;
+    memcpy(&result, pixels, sizeof(result));
+    return result;
+}
+
+// Bit per pixel of the four that is out of tolerance
+static uint32_t MismatchBits(const uint32_t *pixels, Bytes seed, Bytes tolerance) {
+    Bytes value;
+    memcpy(&value, pixels, sizeof(value));
+
+    Bytes isGreater = __builtin_bit_cast(Bytes, value > seed);
+    Bytes difference = ((value - seed) & isGreater) | ((seed - value) & ~isGreater);
+    Bytes isOut = __builtin_bit_cast(Bytes, difference > tolerance);
+
+    uint32_t lanes[4];
+    memcpy(lanes, &isOut, sizeof(lanes));
+    return (lanes[0] != 0) | (lanes[1] != 0) << 1 | (lanes[2] != 0) << 2 | (lanes[3] != 0) << 3;
+}
+
+// Number of leading pixels that match (or do not match) the seed
+static size_t Run(const FillRegion &region, const uint32_t *pixels, size_t count, bool matching) {
+    Bytes seed = Splat(region.seed);
+    Bytes tolerance = Splat(region.tolerance * 0x01010101u);
+
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        uint32_t stops = MismatchBits(pixels + i, seed, tolerance) ^ (matching ? 0 : 0xF);
+        if (stops) return i + std::countr_zero(stops);
+    }
+
+    for (; i < count; i++) {
+        if ((Difference(pixels[i], region.seed) <= region.tolerance) != matching) return i;
+    }
+
+    return count;
+}
+
+// Number of matching pixels right before end
+static size_t RunBackward(const FillRegion &region, const uint32_t *end, size_t count) {
+    Bytes seed = Splat(region.seed);
+    Bytes tolerance = Splat(region.tolerance * 0x01010101u);
+
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        uint32_t stops = MismatchBits(end - i - 4, seed, tolerance);
+        if (stops) return i + std::countl_zero(stops) - 28;
+    }
+
+    for (; i < count; i++) {
+        if (Difference(end[-1 - static_cast<ptrdiff_t>(i)], region.seed) > region.tolerance)
+            return i;
+    }
+
+    return count;
+}
+
+// Number of leading nonzero mask bytes
+static size_t SkipFilled(const uint8_t *mask, size_t count) {
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        uint64_t word;
+        memcpy(&word, mask + i, sizeof(word));
+        if ((word - 0x0101010101010101ull) & ~word & 0x8080808080808080ull) break;
+    }
+
+    while (i < count && mask[i]) i++;
+    return i;
+}
+
+// Queue runs of unfilled matching pixels of row y within [left, right)
+static void PushSeeds(const FillRegion &region, uint32_t y, uint32_t left, uint32_t right,
+                      std::vector<std::pair<uint32_t, uint32_t>> &stack) {
+    const uint32_t *row = region.pixels + static_cast<size_t>(y) * region.width;
+    const uint8_t *maskRow = region.mask + static_cast<size_t>(y) * region.width;
+
+    uint32_t x = left;
+    while (x < right) {
+        x += SkipFilled(maskRow + x, right - x);
+        if (x >= right) break;
+
+        size_t matching = Run(region, row + x, right - x, true);
+        if (!matching) {
+            x += Run(region, row + x, right - x, false);
+            continue;
+        }
+
+        // Whole run is grown from its first pixel
+        stack.push_back({x, y});
+        x += matching;
+    }
+}
+
+static PixelRect Grow(const FillRegion &region, uint32_t seedX, uint32_t seedY) {
+    PixelRect bounds = {0, 0, 0, 0};
+    std::vector<std::pair<uint32_t, uint32_t>> stack = {{seedX, seedY}};
+
+    while (!stack.empty()) {
+        auto [x, y] = stack.back();
+        stack.pop_back();
+
+        const uint32_t *row = region.pixels + static_cast<size_t>(y) * region.width;
+        uint8_t *maskRow = region.mask + static_cast<size_t>(y) * region.width;
+        if (maskRow[x]) continue;
+
+        uint32_t left = x - RunBackward(region, row + x, x);
+        uint32_t right = x + Run(region, row + x, region.width - x, true);
+        memset(maskRow + left, 255, right - left);
+        bounds.unite({left, y, right, y + 1});
+
+        if (y > 0) PushSeeds(region, y - 1, left, right, stack);
+        if (y + 1 < region.height) PushSeeds(region, y + 1, left, right, stack);
+    }
+
+    return bounds;
+}
+
+static PixelRect MatchAll(const FillRegion &region) {
+    size_t bandsCount = (region.height + bandHeight - 1) / bandHeight;
+    std::vector<PixelRect> bandBounds(bandsCount, {0, 0, 0, 0});
+
+    ThreadPool::Global().parallelFor(bandsCount, [&](size_t band) {
+        uint32_t yEnd = std::min<uint32_t>(region.height, (band + 1) * bandHeight);
+        for (uint32_t y = band * bandHeight; y < yEnd; y++) {
+            const uint32_t *row = region.pixels + static_cast<size_t>(y) * region.width;
+            uint8_t *maskRow = region.mask + static_cast<size_t>(y) * region.width;
+
+            uint32_t x = 0;
+            while (x < region.width) {
+                uint32_t matching = Run(region, row + x, region.width - x, true);
+                memset(maskRow + x, 255, matching);
+                if (matching) bandBounds[band].unite({x, y, x + matching, y + 1});
+
+                x += matching;
+                x += Run(region, row + x, region.width - x, false);
+            }
+        }
+    });
+
+    PixelRect bounds = {0, 0, 0, 0};
+    for (const PixelRect &rect : bandBounds) bounds.unite(rect);
+    return bounds;
+}
+
+// Pixels next to the region that are a little past the tolerance get partial coverage. Only
+// fully covered neighbours count, so partial values written on the way do not spread.
+static PixelRect FadeEdges(const FillRegion &region, PixelRect bounds) {
+    bounds = {bounds.x0 ? bounds.x0 - 1 : 0, bounds.y0 ? bounds.y0 - 1 : 0, bounds.x1 + 1,
+              bounds.y1 + 1};
+    bounds.clip(region.width, region.height);
+
+    uint32_t width = region.width;
+    for (uint32_t y = bounds.y0; y < bounds.y1; y++) {
+        const uint32_t *row = region.pixels + static_cast<size_t>(y) * width;
+        uint8_t *maskRow = region.mask + static_cast<size_t>(y) * width;
+        const uint8_t *above = y > 0 ? maskRow - width : nullptr;
+        const uint8_t *below = y + 1 < region.height ? maskRow + width : nullptr;
+
+        for (uint32_t x = bounds.x0; x < bounds.x1; x++) {
+            // Inside of the region and empty space away from it are skipped a word at a time
+            if (x + 8 <= bounds.x1) {
+                uint64_t current;
+                uint64_t up = 0;
+                uint64_t down = 0;
+                memcpy(&current, maskRow + x, sizeof(current));
+                if (above) memcpy(&up, above + x, sizeof(up));
+                if (below) memcpy(&down, below + x, sizeof(down));
+
+                bool isInside = current == ~uint64_t(0);
+                bool isAway = !(current | up | down) && (x == 0 || maskRow[x - 1] != 255) &&
+                              (x + 8 >= width || maskRow[x + 8] != 255);
+                if (isInside || isAway) {
+                    x += 7;
+                    continue;
+                }
+            }
+
+            if (maskRow[x]) continue;
+
+            bool isEdge = (x > 0 && maskRow[x - 1] == 255) ||
+                          (x + 1 < width && maskRow[x + 1] == 255) ||
+                          (above && above[x] == 255) || (below && below[x] == 255);
+            if (!isEdge) continue;
+
+            uint32_t past = Difference(row[x], region.seed) - region.tolerance;
+            if (past < FloodFill::edgeFade) {
+                maskRow[x] = (FloodFill::edgeFade - past) * 255 / FloodFill::edgeFade;
+            }
+        }
+    }
+
+    return bounds;
+}
+
+PixelRect FloodFill::BuildMask(const uint32_t *pixels, uint32_t width, uint32_t height,
+                               uint32_t seedX, uint32_t seedY, const FillOptions &options,
+                               PixelStorage &mask) {
+    mask = PixelStorage((static_cast<size_t>(width) * height + 3) / 4);
+    if (seedX >= width || seedY >= height) return {0, 0, 0, 0};
+
+    FillRegion region = {pixels, width, height, pixels[static_cast<size_t>(seedY) * width + seedX],
+                         options.tolerance, MaskBytes(mask)};
+
+    PixelRect bounds = options.isContiguous ? Grow(region, seedX, seedY) : MatchAll(region);
+    if (options.isAntialiased && !bounds.isEmpty()) bounds = FadeEdges(region, bounds);
+
+    return bounds;
+}
+
+PixelRect FloodFill::Fill(uint32_t *pixels, uint32_t width, uint32_t height, uint32_t seedX,
+                          uint32_t seedY, uint32_t color, const FillOptions &options,
+                          const Selection &selection, PixelStorage &mask) {
+    PixelRect bounds = BuildMask(pixels, width, height, seedX, seedY, options, mask);
+    if (bounds.isEmpty()) return bounds;
+
+    // Nothing past the bounds of the selection is filled
+    if (!selection.isEmpty()) {
+        PixelRect selected = selection.getBounds();
+        bounds = {std::max(bounds.x0, selected.x0), std::max(bounds.y0, selected.y0),
+                  std::min(bounds.x1, selected.x1), std::min(bounds.y1, selected.y1)};
+        if (bounds.isEmpty()) return bounds;
+
+        selection.clipMask(MaskBytes(mask) + static_cast<size_t>(bounds.y0) * width + bounds.x0,
+                           width, bounds);
+    }
+
+    // Rows are independent, uncovered pixels are skipped by the kernel
+    size_t bandsCount = (bounds.y1 - bounds.y0 + bandHeight - 1) / bandHeight;
+    ThreadPool::Global().parallelFor(bandsCount, [&](size_t band) {
+        uint32_t yFrom = bounds.y0 + band * bandHeight;
+        uint32_t yTo = std::min(bounds.y1, yFrom + bandHeight);
+
+        for (uint32_t y = yFrom; y < yTo; y++) {
+            size_t offset = static_cast<size_t>(y) * width + bounds.x0;
+            BlendMaskSpan(pixels + offset, color, MaskBytes(mask) + offset, bounds.x1 - bounds.x0,
+                          BlendMode::NORMAL);
+        }
+    });
+
+    return bounds;
+}
+
+uint8_t *FloodFill::MaskBytes(const PixelStorage &mask) {
+    return reinterpret_cast<uint8_t *>(mask.data());
+}
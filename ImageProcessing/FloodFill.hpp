@@ -0,0 +1,39 @@
+#ifndef FLOOD_FILL_HPP_
+#define FLOOD_FILL_HPP_
+#include <cstddef>
+#include <cstdint>
+
+#include "MipPyramid.hpp"
+#include "PixelStorage.hpp"
+#include "Selection.hpp"
+
+struct FillOptions {
+    uint8_t tolerance;   // Largest difference of any channel from the seed that still matches
+    bool isContiguous;   // Only pixels connected to the seed, otherwise every matching pixel
+    bool isAntialiased;  // Partially cover pixels on the edge that are just past the tolerance
+};
+
+// Scanline region growing for bucket fill and magic wand. Runs of matching pixels are found
+// several pixels at a time, and spans waiting to be grown are kept on an explicit stack.
+class FloodFill {
+   public:
+    static constexpr uint32_t edgeFade = 64;  // Difference past tolerance where edges fade out
+
+    // Coverage of the region around the seed, one byte per pixel, into a fresh zeroed mask: only
+    // the pages the region reaches take memory, huge masks go to the scratch directory. Returns
+    // bounds of the region
+    static PixelRect BuildMask(const uint32_t *pixels, uint32_t width, uint32_t height,
+                               uint32_t seedX, uint32_t seedY, const FillOptions &options,
+                               PixelStorage &mask);
+    // Blend color over the region, mask is used as scratch space. A non-empty selection clips the
+    // coverage of the region. Returns the changed area
+    static PixelRect Fill(uint32_t *pixels, uint32_t width, uint32_t height, uint32_t seedX,
+                          uint32_t seedY, uint32_t color, const FillOptions &options,
+                          const Selection &selection, PixelStorage &mask);
+    static uint8_t *MaskBytes(const PixelStorage &mask);  // Coverage bytes of a built mask
+
+   private:
+    FloodFill();
+};
+
+#endif  // FLOOD_FILL_HPP_
@@ -0,0 +1,239 @@
+// Test of FloodFill against a pixel by pixel reference: masks of contiguous and global fills match
+// a breadth-first search, runs are found right whatever their alignment, and edges fade out
+// where the reference says they should
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <queue>
+#include <random>
+#include <utility>
+#include <vector>
+
+#include "../Testing.hpp"
+#include "FloodFill.hpp"
+
+constexpr uint32_t timingSize = 2048;
+
+static uint32_t Difference(uint32_t a, uint32_t b) {
+    uint32_t result = 0;
+    for (int shift = 0; shift < 32; shift += 8) {
+        int32_t channel = static_cast<int32_t>((a >> shift) & 0xFF) -
+                          static_cast<int32_t>((b >> shift) & 0xFF);
+        result = std::max<uint32_t>(result, std::abs(channel));
+    }
+
+    return result;
+}
+
+// Mask the way the fill is specified: four-connected search, then a fade on the outer edge
+static std::vector<uint8_t> ReferenceMask(const std::vector<uint32_t> &pixels, uint32_t width,
+                                          uint32_t height, uint32_t seedX, uint32_t seedY,
+                                          const FillOptions &options) {
+    std::vector<uint8_t> mask(pixels.size(), 0);
+    uint32_t seed = pixels[static_cast<size_t>(seedY) * width + seedX];
+    auto matches = [&](size_t i) { return Difference(pixels[i], seed) <= options.tolerance; };
+
+    if (options.isContiguous) {
+        std::queue<std::pair<uint32_t, uint32_t>> queue;
+        queue.push({seedX, seedY});
+        mask[static_cast<size_t>(seedY) * width + seedX] = 255;
+        while (!queue.empty()) {
+            int64_t x = queue.front().first;
+            int64_t y = queue.front().second;
+            queue.pop();
+
+            std::pair<int64_t, int64_t> neighbours[] = {{x - 1, y}, {x + 1, y}, {x, y - 1},
+                                                        {x, y + 1}};
+            for (auto [nx, ny] : neighbours) {
+                if (nx < 0 || ny < 0 || nx >= width || ny >= height) continue;
+                size_t i = ny * width + nx;
+                if (mask[i] || !matches(i)) continue;
+
+                mask[i] = 255;
+                queue.push({static_cast<uint32_t>(nx), static_cast<uint32_t>(ny)});
+            }
+        }
+    } else {
+        for (size_t i = 0; i < pixels.size(); i++) mask[i] = matches(i) ? 255 : 0;
+    }
+
+    if (!options.isAntialiased) return mask;
+
+    std::vector<uint8_t> faded = mask;
+    for (uint32_t y = 0; y < height; y++) {
+        for (uint32_t x = 0; x < width; x++) {
+            size_t i = static_cast<size_t>(y) * width + x;
+            if (mask[i]) continue;
+
+            bool isEdge = (x > 0 && mask[i - 1]) || (x + 1 < width && mask[i + 1]) ||
+                          (y > 0 && mask[i - width]) || (y + 1 < height && mask[i + width]);
+            uint32_t past = Difference(pixels[i], seed) - options.tolerance;
+            if (isEdge && past < FloodFill::edgeFade) {
+                faded[i] = (FloodFill::edgeFade - past) * 255 / FloodFill::edgeFade;
+            }
+        }
+    }
+
+    return faded;
+}
+
+static PixelRect MaskBounds(const std::vector<uint8_t> &mask, uint32_t width, uint32_t height) {
+    PixelRect bounds = {0, 0, 0, 0};
+    for (uint32_t y = 0; y < height; y++) {
+        for (uint32_t x = 0; x < width; x++) {
+            if (mask[static_cast<size_t>(y) * width + x]) bounds.unite({x, y, x + 1, y + 1});
+        }
+    }
+
+    return bounds;
+}
+
+// Compare the fill from the seed with the reference, returns false on the first mismatch
+static bool CompareFill(const std::vector<uint32_t> &pixels, uint32_t width, uint32_t height,
+                        uint32_t seedX, uint32_t seedY, const FillOptions &options) {
+    PixelStorage mask;
+    PixelRect bounds = FloodFill::BuildMask(pixels.data(), width, height, seedX, seedY, options,
+                                            mask);
+    std::vector<uint8_t> expected = ReferenceMask(pixels, width, height, seedX, seedY, options);
+
+    const uint8_t *bytes = FloodFill::MaskBytes(mask);
+    if (!std::equal(expected.begin(), expected.end(), bytes)) return false;
+
+    // Faded bounds also take in the row and column around the region that were looked at
+    PixelRect expectedBounds = MaskBounds(expected, width, height);
+    if (options.isAntialiased) {
+        std::vector<uint8_t> region(expected.size());
+        for (size_t i = 0; i < expected.size(); i++) region[i] = expected[i] == 255 ? 255 : 0;
+        PixelRect regionBounds = MaskBounds(region, width, height);
+        expectedBounds = {regionBounds.x0 ? regionBounds.x0 - 1 : 0,
+                          regionBounds.y0 ? regionBounds.y0 - 1 : 0, regionBounds.x1 + 1,
+                          regionBounds.y1 + 1};
+        expectedBounds.clip(width, height);
+    }
+
+    return bounds == expectedBounds;
+}
+
+// Noise around a couple of base colors, so that runs of every length and alignment show up
+static std::vector<uint32_t> NoiseImage(uint32_t width, uint32_t height, std::mt19937 &random) {
+    std::vector<uint32_t> pixels(static_cast<size_t>(width) * height);
+    for (uint32_t &pixel : pixels) {
+        uint32_t base = random() % 3 ? 0x80604020 : 0x20406080;
+        for (int shift = 0; shift < 32; shift += 8) {
+            uint32_t channel = ((base >> shift) & 0xFF) + random() % 48;
+            base = (base & ~(0xFFu << shift)) | (channel << shift);
+        }
+        pixel = base;
+    }
+
+    return pixels;
+}
+
+// Single mismatching pixel at every distance to the left and right of the seed, for rows shorter
+// and longer than a vector of pixels: the counting of the backward and forward runs is checked at
+// every bit
+static void TestRunBoundaries() {
+    FillOptions options = {10, true, false};
+
+    for (uint32_t width = 1; width <= 13; width++) {
+        for (uint32_t seedX = 0; seedX < width; seedX++) {
+            for (uint32_t stop = 0; stop <= width; stop++) {
+                if (stop == seedX) continue;
+
+                std::vector<uint32_t> pixels(width, 0x40404040);
+                if (stop < width) pixels[stop] = 0x40404040 + 11;
+                CHECK(CompareFill(pixels, width, 1, seedX, 0, options));
+            }
+        }
+    }
+}
+
+static void TestNoise() {
+    std::mt19937 random(40);
+    const uint32_t sizes[][2] = {{1, 1}, {5, 3}, {31, 17}, {64, 64}, {97, 130}};
+    const uint8_t tolerances[] = {0, 20, 40, 90, 255};
+
+    for (auto [width, height] : sizes) {
+        std::vector<uint32_t> pixels = NoiseImage(width, height, random);
+        for (uint8_t tolerance : tolerances) {
+            for (int options = 0; options < 4; options++) {
+                FillOptions fill = {tolerance, (options & 1) != 0, (options & 2) != 0};
+                uint32_t seedX = random() % width;
+                uint32_t seedY = random() % height;
+                CHECK(CompareFill(pixels, width, height, seedX, seedY, fill));
+            }
+        }
+    }
+}
+
+// Seed outside of the image gives an empty mask
+static void TestOutside() {
+    std::vector<uint32_t> pixels(16, 0xFF000000);
+    PixelStorage mask;
+    FillOptions options = {0, true, true};
+    CHECK(FloodFill::BuildMask(pixels.data(), 4, 4, 4, 0, options, mask).isEmpty());
+    CHECK(FloodFill::MaskBytes(mask)[0] == 0);
+}
+
+// Filled pixels outside of the selection keep their color
+static void TestSelectionClip() {
+    uint32_t width = 40;
+    uint32_t height = 30;
+    std::vector<uint32_t> pixels(static_cast<size_t>(width) * height, 0xFFFFFFFF);
+    Selection selection = Selection::FromRect({10, 5, 25, 20});
+
+    PixelStorage mask;
+    FillOptions options = {0, true, false};
+    PixelRect changed = FloodFill::Fill(pixels.data(), width, height, 0, 0, 0xFF0000FF, options,
+                                        selection, mask);
+    CHECK(changed == (PixelRect{10, 5, 25, 20}));
+
+    for (uint32_t y = 0; y < height; y++) {
+        for (uint32_t x = 0; x < width; x++) {
+            bool isSelected = x >= 10 && x < 25 && y >= 5 && y < 20;
+            CHECK(pixels[static_cast<size_t>(y) * width + x] ==
+                  (isSelected ? 0xFF0000FF : 0xFFFFFFFF));
+        }
+    }
+}
+
+// Contiguous fill of an image speckled with walls against the reference search
+static void TestFillCost() {
+    std::mt19937 random(42);
+    std::vector<uint32_t> pixels(static_cast<size_t>(timingSize) * timingSize, 0xFFFFFFFF);
+    for (uint32_t &pixel : pixels) {
+        if (random() % 8 == 0) pixel = 0xFF000000;
+    }
+    pixels[0] = 0xFFFFFFFF;
+
+    FillOptions options = {0, true, false};
+    PixelStorage mask;
+    auto start = std::chrono::steady_clock::now();
+    PixelRect bounds = FloodFill::BuildMask(pixels.data(), timingSize, timingSize, 0, 0, options,
+                                            mask);
+    double fill =
+        std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    start = std::chrono::steady_clock::now();
+    std::vector<uint8_t> expected = ReferenceMask(pixels, timingSize, timingSize, 0, 0, options);
+    double reference =
+        std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    CHECK(std::equal(expected.begin(), expected.end(), FloodFill::MaskBytes(mask)));
+    CHECK(bounds == MaskBounds(expected, timingSize, timingSize));
+
+    size_t filled = std::count(expected.begin(), expected.end(), 255);
+    printf("flood fill: %u x %u, %zu pixels, %.2f ms, reference %.2f ms\n", timingSize,
+           timingSize, filled, fill, reference);
+}
+
+int main() {
+    TestRunBoundaries();
+    TestNoise();
+    TestOutside();
+    TestSelectionClip();
+    TestFillCost();
+    return TestResult();
+}
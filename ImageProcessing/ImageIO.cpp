@@ -0,0 +1,761 @@
+#include "ImageIO.hpp"
+
+#include <zlib.h>
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <mutex>
+#include <new>
+#include <vector>
+
+#include "ThreadPool.hpp"
+
+// Header of the raw format
+struct RawHeader {
+    char magic[8];
+    uint32_t width;
+    uint32_t height;
+};
+
+static const char rawMagic[8] = {'W', 'S', 'L', 'R', 'G', 'B', 'A', '1'};
+static const uint8_t pngSignature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+
+constexpr size_t rawWriteSlice = 16 * 1024 * 1024;  // Bytes written between progress updates
+constexpr size_t pngReadSlice = 64 * 1024;          // Bytes of IDAT fed to inflate at once
+constexpr size_t pngPaletteSize = 3 * 256;          // Bytes of the largest PLTE
+
+// What LoadPNG needs to know to turn scanlines into pixels
+struct PNGInfo {
+    uint32_t width;
+    uint32_t height;
+    uint8_t bitDepth;
+    uint8_t colorType;
+    uint32_t palette[256];  // Palette images only, with alpha from tRNS
+    bool hasKey;            // Gray or RGB images with a tRNS color that is transparent
+    uint16_t key[3];
+};
+
+// ImageSaveTask methods
+ImageSaveTask::ImageSaveTask(std::string path, ImageFormat format, RowSource source,
+                             uint32_t width, uint32_t height)
+    : path(std::move(path)),
+      format(format),
+      source(std::move(source)),
+      width(width),
+      height(height),
+      progress(0),
+      done(false),
+      success(false),
+      worker(&ImageSaveTask::run, this) {}
+
+ImageSaveTask::~ImageSaveTask() { wait(); }
+
+void ImageSaveTask::run() {
+    if (format == ImageFormat::RAW) {
+        success = ImageIO::SaveRaw(path.c_str(), source, width, height, &progress);
+    } else {
+        success = ImageIO::SavePNG(path.c_str(), source, width, height, &progress);
+    }
+    source = nullptr;
+
+    progress = 1;
+    done = true;
+}
+
+float ImageSaveTask::getProgress() { return progress; }
+
+bool ImageSaveTask::isDone() { return done; }
+
+bool ImageSaveTask::succeeded() { return success; }
+
+void ImageSaveTask::wait() {
+    if (worker.joinable()) worker.join();
+}
+
+// ImageLoadTask methods
+ImageLoadTask::ImageLoadTask(std::string path, uint32_t *pixels, uint32_t width, uint32_t height)
+    : path(std::move(path)),
+      pixels(pixels),
+      width(width),
+      height(height),
+      rowsDone(0),
+      cancelled(false),
+      done(false),
+      success(false),
+      worker(&ImageLoadTask::run, this) {}
+
+ImageLoadTask::~ImageLoadTask() {
+    cancel();
+    wait();
+}
+
+void ImageLoadTask::run() {
+    success = ImageIO::LoadPNG(path.c_str(), pixels, width, height, &rowsDone, &cancelled);
+    done = true;
+}
+
+uint32_t ImageLoadTask::getRowsDone() { return rowsDone; }
+
+float ImageLoadTask::getProgress() { return static_cast<float>(rowsDone) / height; }
+
+bool ImageLoadTask::isDone() { return done; }
+
+bool ImageLoadTask::succeeded() { return success; }
+
+void ImageLoadTask::cancel() { cancelled = true; }
+
+void ImageLoadTask::wait() {
+    if (worker.joinable()) worker.join();
+}
+
+// ImageIO methods
+ImageFormat ImageIO::FormatFromPath(const std::string &path) {
+    std::string extension = std::filesystem::path(path).extension().string();
+
+    if (extension == ".png") return ImageFormat::PNG;
+    if (extension == ".rgba") return ImageFormat::RAW;
+    if (extension == ".wslp") return ImageFormat::PROJECT;
+    return ImageFormat::FOREIGN;
+}
+
+std::string ImageIO::ToNativePath(const wchar_t *path) {
+    return std::filesystem::path(std::wstring(path)).string();
+}
+
+std::shared_ptr<ImageSaveTask> ImageIO::SaveAsync(const wchar_t *path, RowSource source,
+                                                  uint32_t width, uint32_t height) {
+    std::string nativePath = ToNativePath(path);
+    return std::make_shared<ImageSaveTask>(nativePath, FormatFromPath(nativePath),
+                                           std::move(source), width, height);
+}
+
+// Independently deflated horizontal band of a PNG image
+struct PNGBand {
+    std::vector<uint8_t> data;
+    uLong adler;     // Adler-32 of the filtered rows
+    size_t rawSize;  // Size of the filtered rows
+    bool ok;
+    bool isDone;
+};
+
+static void PutBigEndian(uint8_t *out, uint32_t value) {
+    out[0] = value >> 24;
+    out[1] = value >> 16;
+    out[2] = value >> 8;
+    out[3] = value;
+}
+
+static bool WriteChunk(FILE *f, const char *type, const uint8_t *head, size_t headSize,
+                       const uint8_t *body, size_t bodySize, const uint8_t *tail, size_t tailSize) {
+    uint8_t lengthBytes[4];
+    PutBigEndian(lengthBytes, headSize + bodySize + tailSize);
+
+    // Note that crc32() restarts on a null buffer, so empty parts are skipped
+    uLong crc = crc32(0, reinterpret_cast<const Bytef *>(type), 4);
+    if (headSize) crc = crc32(crc, head, headSize);
+    if (bodySize) crc = crc32(crc, body, bodySize);
+    if (tailSize) crc = crc32(crc, tail, tailSize);
+
+    uint8_t crcBytes[4];
+    PutBigEndian(crcBytes, crc);
+
+    return fwrite(lengthBytes, 1, 4, f) == 4 && fwrite(type, 1, 4, f) == 4 &&
+           fwrite(head, 1, headSize, f) == headSize && fwrite(body, 1, bodySize, f) == bodySize &&
+           fwrite(tail, 1, tailSize, f) == tailSize && fwrite(crcBytes, 1, 4, f) == 4;
+}
+
+// Filter rows of the band with PNG "Sub" filter and deflate them as a raw stream. Every band but the
+// last one ends with a sync flush, so the outputs can be simply concatenated
+static void CompressPNGBand(const uint32_t *pixels, uint32_t width, uint32_t rowsCount,
+                            bool last, PNGBand &band) {
+    band.ok = false;
+
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    if (deflateInit2(&stream, ImageIO::pngCompressionLevel, Z_DEFLATED, -MAX_WBITS, 8,
+                     Z_DEFAULT_STRATEGY) != Z_OK)
+        return;
+
+    size_t rowBytes = static_cast<size_t>(width) * 4 + 1;
+    std::vector<uint8_t> row(rowBytes);
+
+    band.rawSize = rowBytes * rowsCount;
+    band.adler = adler32(0, nullptr, 0);
+    // Output starts at a fraction of the worst case and grows if the rows do not compress
+    band.data.resize(band.rawSize / 4 + 64);
+
+    stream.next_out = band.data.data();
+    stream.avail_out = band.data.size();
+
+    for (uint32_t r = 0; r < rowsCount; r++) {
+        const uint8_t *src =
+            reinterpret_cast<const uint8_t *>(pixels + static_cast<size_t>(r) * width);
+
+        row[0] = 1;  // Sub filter
+        memcpy(&row[1], src, 4);
+        for (size_t i = 4; i < rowBytes - 1; i++) {
+            row[i + 1] = src[i] - src[i - 4];
+        }
+
+        band.adler = adler32(band.adler, row.data(), rowBytes);
+
+        stream.next_in = row.data();
+        stream.avail_in = rowBytes;
+
+        int flush = Z_NO_FLUSH;
+        if (r + 1 == rowsCount) flush = last ? Z_FINISH : Z_SYNC_FLUSH;
+
+        do {
+            if (stream.avail_out == 0) {
+                size_t used = band.data.size();
+                band.data.resize(used * 2);
+                stream.next_out = band.data.data() + used;
+                stream.avail_out = band.data.size() - used;
+            }
+
+            int status = deflate(&stream, flush);
+            if (status == Z_STREAM_ERROR) {
+                deflateEnd(&stream);
+                return;
+            }
+        } while (stream.avail_in > 0 || stream.avail_out == 0);
+    }
+
+    band.data.resize(band.data.size() - stream.avail_out);
+    deflateEnd(&stream);
+    band.ok = true;
+}
+
+bool ImageIO::SavePNG(const char *path, const RowSource &source, uint32_t width,
+                      uint32_t height, std::atomic<float> *progress) {
+    if (width == 0 || height == 0) return false;
+
+    FILE *f = fopen(path, "wb");
+    if (!f) {
+        fprintf(stderr, "Unable to open %s for writing\n", path);
+        return false;
+    }
+
+    uint8_t header[13];
+    PutBigEndian(header, width);
+    PutBigEndian(header + 4, height);
+    header[8] = 8;   // Bit depth
+    header[9] = 6;   // RGBA
+    header[10] = 0;  // Deflate
+    header[11] = 0;  // Adaptive filtering
+    header[12] = 0;  // No interlace
+
+    bool ok = fwrite(pngSignature, 1, sizeof(pngSignature), f) == sizeof(pngSignature) &&
+              WriteChunk(f, "IHDR", header, sizeof(header), nullptr, 0, nullptr, 0);
+
+    // Bands live in a ring of slots: band i is compressed into slot i % slotsCount, and the slot
+    // is given to the next band once band i is written
+    ThreadPool &pool = ThreadPool::Global();
+    size_t bandsCount = (height + pngBandHeight - 1) / pngBandHeight;
+    size_t slotsCount = std::min(bandsCount, pngBandsInFlight * pool.getThreadsCount());
+    std::vector<PNGBand> slots(slotsCount);
+    std::mutex mutex;
+    std::condition_variable bandDone;
+
+    auto compress = [&](size_t i) {
+        uint32_t firstRow = i * pngBandHeight;
+        uint32_t rowsCount = std::min(pngBandHeight, height - firstRow);
+        std::vector<uint32_t> rows(static_cast<size_t>(width) * rowsCount);
+        source(firstRow, rowsCount, rows.data());
+
+        PNGBand &band = slots[i % slotsCount];
+        CompressPNGBand(rows.data(), width, rowsCount, i + 1 == bandsCount, band);
+
+        std::lock_guard<std::mutex> lock(mutex);
+        band.isDone = true;
+        bandDone.notify_all();
+    };
+
+    size_t submitted = 0;
+    auto submit = [&] {
+        slots[submitted % slotsCount].isDone = false;
+        size_t i = submitted++;
+        pool.submit([&compress, i] { compress(i); });
+    };
+    while (ok && submitted < slotsCount) submit();
+
+    // Bands are concatenated into a single zlib stream: header, deflated bands, Adler-32
+    const uint8_t zlibHeader[2] = {0x78, 0x01};
+    uLong adler = adler32(0, nullptr, 0);
+
+    // Every submitted band is waited for even after a failure, the tasks use this frame
+    for (size_t i = 0; i < submitted; i++) {
+        PNGBand &band = slots[i % slotsCount];
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            bandDone.wait(lock, [&] { return band.isDone; });
+        }
+
+        ok = ok && band.ok;
+        if (ok) {
+            adler = adler32_combine(adler, band.adler, band.rawSize);
+
+            uint8_t trailer[4];
+            PutBigEndian(trailer, adler);
+
+            ok = WriteChunk(f, "IDAT", zlibHeader, i == 0 ? sizeof(zlibHeader) : 0,
+                            band.data.data(), band.data.size(), trailer,
+                            i + 1 == bandsCount ? sizeof(trailer) : 0);
+        }
+
+        // Written band gives its memory back before the slot is reused
+        std::vector<uint8_t>().swap(band.data);
+        if (ok && submitted < bandsCount) {
+            std::lock_guard<std::mutex> lock(mutex);
+            submit();
+        }
+
+        if (progress) *progress = static_cast<float>(i + 1) / bandsCount;
+    }
+
+    ok = ok && WriteChunk(f, "IEND", nullptr, 0, nullptr, 0, nullptr, 0);
+    ok = (fclose(f) == 0) && ok;
+
+    if (!ok) fprintf(stderr, "An error occurred while saving %s\n", path);
+    return ok;
+}
+
+bool ImageIO::SaveRaw(const char *path, const RowSource &source, uint32_t width,
+                      uint32_t height, std::atomic<float> *progress) {
+    FILE *f = fopen(path, "wb");
+    if (!f) {
+        fprintf(stderr, "Unable to open %s for writing\n", path);
+        return false;
+    }
+
+    RawHeader header;
+    memcpy(header.magic, rawMagic, sizeof(rawMagic));
+    header.width = width;
+    header.height = height;
+
+    bool ok = fwrite(&header, sizeof(header), 1, f) == 1;
+
+    // Rows are asked for and written a slice at a time, bands of a slice are made in parallel
+    size_t rowBytes = static_cast<size_t>(width) * sizeof(uint32_t);
+    uint32_t sliceRows = std::max<size_t>(1, rawWriteSlice / rowBytes);
+    std::vector<uint32_t> rows(static_cast<size_t>(width) * std::min(sliceRows, height));
+    for (uint32_t firstRow = 0; firstRow < height && ok; firstRow += sliceRows) {
+        uint32_t rowsCount = std::min(sliceRows, height - firstRow);
+        size_t bandsCount = (rowsCount + pngBandHeight - 1) / pngBandHeight;
+        ThreadPool::Global().parallelFor(bandsCount, [&](size_t band) {
+            uint32_t from = band * pngBandHeight;
+            source(firstRow + from, std::min(pngBandHeight, rowsCount - from),
+                   rows.data() + static_cast<size_t>(from) * width);
+        });
+
+        ok = fwrite(rows.data(), rowBytes, rowsCount, f) == rowsCount;
+        if (progress) *progress = static_cast<float>(firstRow + rowsCount) / height;
+    }
+
+    ok = (fclose(f) == 0) && ok;
+
+    if (!ok) fprintf(stderr, "An error occurred while saving %s\n", path);
+    return ok;
+}
+
+PixelStorage ImageIO::LoadRaw(const char *path, uint32_t &width, uint32_t &height) {
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        fprintf(stderr, "Unable to open %s\n", path);
+        return PixelStorage();
+    }
+
+    RawHeader header;
+    if (fread(&header, sizeof(header), 1, f) != 1 ||
+        memcmp(header.magic, rawMagic, sizeof(rawMagic)) != 0) {
+        fprintf(stderr, "%s is not a raw image\n", path);
+        fclose(f);
+        return PixelStorage();
+    }
+
+    // Header is checked against the file before anything is allocated for it
+    std::error_code error;
+    uintmax_t fileSize = std::filesystem::file_size(path, error);
+    size_t count = static_cast<size_t>(header.width) * header.height;
+    if (!header.width || !header.height || header.width > maxSize || header.height > maxSize ||
+        error || fileSize != sizeof(header) + count * sizeof(uint32_t)) {
+        fprintf(stderr, "%s has a header of %ux%u that does not match the image\n", path,
+                header.width, header.height);
+        fclose(f);
+        return PixelStorage();
+    }
+
+    PixelStorage pixels;
+    try {
+        pixels = PixelStorage(count);
+    } catch (const std::bad_alloc &) {
+        fprintf(stderr, "Not enough memory for %s\n", path);
+        fclose(f);
+        return PixelStorage();
+    }
+
+    // Read in slices so images larger than the memory stream through it into their scratch file
+    size_t slice = rawWriteSlice / sizeof(uint32_t);
+    for (size_t offset = 0; offset < count; offset += slice) {
+        size_t length = std::min(slice, count - offset);
+        pixels.touch(offset, offset + length);
+
+        if (fread(pixels.data() + offset, sizeof(uint32_t), length, f) != length) {
+            fprintf(stderr, "%s is truncated\n", path);
+            fclose(f);
+            return PixelStorage();
+        }
+    }
+
+    fclose(f);
+
+    width = header.width;
+    height = header.height;
+    return pixels;
+}
+
+static uint32_t GetBigEndian(const uint8_t *in) {
+    return static_cast<uint32_t>(in[0]) << 24 | in[1] << 16 | in[2] << 8 | in[3];
+}
+
+// Signature and IHDR, which has to be the first chunk
+static bool ReadPNGHeader(FILE *f, PNGInfo &info) {
+    uint8_t signature[8];
+    uint8_t chunk[8 + 13 + 4];
+    if (fread(signature, 1, sizeof(signature), f) != sizeof(signature) ||
+        memcmp(signature, pngSignature, sizeof(signature)) != 0 ||
+        fread(chunk, 1, sizeof(chunk), f) != sizeof(chunk) || GetBigEndian(chunk) != 13 ||
+        memcmp(chunk + 4, "IHDR", 4) != 0) {
+        return false;
+    }
+
+    const uint8_t *header = chunk + 8;
+    info.width = GetBigEndian(header);
+    info.height = GetBigEndian(header + 4);
+    info.bitDepth = header[8];
+    info.colorType = header[9];
+    info.hasKey = false;
+    for (uint32_t &entry : info.palette) entry = 0xFF000000;
+
+    bool validDepth = false;
+    switch (info.colorType) {
+        case 0:  // Gray
+            validDepth = info.bitDepth == 1 || info.bitDepth == 2 || info.bitDepth == 4 ||
+                         info.bitDepth == 8 || info.bitDepth == 16;
+            break;
+        case 3:  // Palette
+            validDepth = info.bitDepth == 1 || info.bitDepth == 2 || info.bitDepth == 4 ||
+                         info.bitDepth == 8;
+            break;
+        case 2:  // RGB
+        case 4:  // Gray and alpha
+        case 6:  // RGBA
+            validDepth = info.bitDepth == 8 || info.bitDepth == 16;
+            break;
+    }
+
+    // Adam7 interlacing is left to the render engine
+    return validDepth && info.width && info.height && header[10] == 0 && header[11] == 0 &&
+           header[12] == 0;
+}
+
+static uint32_t PNGChannels(const PNGInfo &info) {
+    switch (info.colorType) {
+        case 2:
+            return 3;
+        case 4:
+            return 2;
+        case 6:
+            return 4;
+        default:
+            return 1;
+    }
+}
+
+// Undo the filter of a scanline in place, previous is the unfiltered scanline above
+static bool UnfilterPNGRow(uint8_t filter, uint8_t *row, const uint8_t *previous, size_t size,
+                           size_t step) {
+    switch (filter) {
+        case 0:  // None
+            return true;
+
+        case 1:  // Sub
+            for (size_t i = step; i < size; i++) row[i] += row[i - step];
+            return true;
+
+        case 2:  // Up
+            for (size_t i = 0; i < size; i++) row[i] += previous[i];
+            return true;
+
+        case 3:  // Average
+            for (size_t i = 0; i < size; i++) {
+                uint32_t left = i >= step ? row[i - step] : 0;
+                row[i] += (left + previous[i]) / 2;
+            }
+            return true;
+
+        case 4:  // Paeth
+            for (size_t i = 0; i < size; i++) {
+                int left = i >= step ? row[i - step] : 0;
+                int up = previous[i];
+                int upLeft = i >= step ? previous[i - step] : 0;
+                int estimate = left + up - upLeft;
+                int distanceLeft = std::abs(estimate - left);
+                int distanceUp = std::abs(estimate - up);
+                int distanceUpLeft = std::abs(estimate - upLeft);
+
+                if (distanceLeft <= distanceUp && distanceLeft <= distanceUpLeft) {
+                    row[i] += left;
+                } else if (distanceUp <= distanceUpLeft) {
+                    row[i] += up;
+                } else {
+                    row[i] += upLeft;
+                }
+            }
+            return true;
+
+        default:
+            return false;
+    }
+}
+
+// Sample x of an unfiltered scanline at the bit depth of the image
+static uint32_t PNGSample(const uint8_t *row, const PNGInfo &info, size_t index) {
+    switch (info.bitDepth) {
+        case 16:
+            return row[index * 2] << 8 | row[index * 2 + 1];
+        case 8:
+            return row[index];
+        default: {
+            size_t bit = index * info.bitDepth;
+            uint32_t mask = (1u << info.bitDepth) - 1;
+            return (row[bit / 8] >> (8 - info.bitDepth - bit % 8)) & mask;
+        }
+    }
+}
+
+static void ConvertPNGRow(const uint8_t *row, const PNGInfo &info, uint32_t *pixels) {
+    uint32_t maxSample = (1u << info.bitDepth) - 1;
+    auto toByte = [&](uint32_t sample) { return sample * 255 / maxSample; };
+
+    for (uint32_t x = 0; x < info.width; x++) {
+        uint32_t red = 0;
+        uint32_t green = 0;
+        uint32_t blue = 0;
+        uint32_t alpha = 255;
+        switch (info.colorType) {
+            case 3:
+                pixels[x] = info.palette[PNGSample(row, info, x)];
+                continue;
+
+            case 0:
+            case 4: {
+                size_t channels = info.colorType == 4 ? 2 : 1;
+                uint32_t gray = PNGSample(row, info, x * channels);
+                if (info.colorType == 4) alpha = toByte(PNGSample(row, info, x * 2 + 1));
+                if (info.hasKey && gray == info.key[0]) alpha = 0;
+                red = green = blue = toByte(gray);
+                break;
+            }
+
+            default: {
+                size_t channels = info.colorType == 6 ? 4 : 3;
+                uint32_t sampleRed = PNGSample(row, info, x * channels);
+                uint32_t sampleGreen = PNGSample(row, info, x * channels + 1);
+                uint32_t sampleBlue = PNGSample(row, info, x * channels + 2);
+                if (info.colorType == 6) alpha = toByte(PNGSample(row, info, x * 4 + 3));
+                if (info.hasKey && sampleRed == info.key[0] && sampleGreen == info.key[1] &&
+                    sampleBlue == info.key[2]) {
+                    alpha = 0;
+                }
+                red = toByte(sampleRed);
+                green = toByte(sampleGreen);
+                blue = toByte(sampleBlue);
+                break;
+            }
+        }
+
+        pixels[x] = red | green << 8 | blue << 16 | alpha << 24;
+    }
+}
+
+// PLTE and tRNS chunks, which precede the image data
+static void ReadPNGPalette(const std::vector<uint8_t> &data, bool isTransparency, PNGInfo &info) {
+    if (!isTransparency) {
+        for (size_t i = 0; i < 256 && i * 3 + 2 < data.size(); i++) {
+            info.palette[i] = 0xFF000000 | data[i * 3] | data[i * 3 + 1] << 8 |
+                              data[i * 3 + 2] << 16;
+        }
+        return;
+    }
+
+    if (info.colorType == 3) {
+        for (size_t i = 0; i < 256 && i < data.size(); i++) {
+            info.palette[i] = (info.palette[i] & 0x00FFFFFF) | static_cast<uint32_t>(data[i]) << 24;
+        }
+    } else if (info.colorType == 0 || info.colorType == 2) {
+        size_t samples = info.colorType == 0 ? 1 : 3;
+        if (data.size() < samples * 2) return;
+
+        info.hasKey = true;
+        for (size_t i = 0; i < samples; i++) info.key[i] = data[i * 2] << 8 | data[i * 2 + 1];
+    }
+}
+
+bool ImageIO::ProbePNG(const char *path, uint32_t &width, uint32_t &height) {
+    FILE *f = fopen(path, "rb");
+    if (!f) return false;
+
+    PNGInfo info;
+    bool ok = ReadPNGHeader(f, info);
+    fclose(f);
+
+    if (ok) {
+        width = info.width;
+        height = info.height;
+    }
+    return ok;
+}
+
+bool ImageIO::LoadPNG(const char *path, uint32_t *pixels, uint32_t width, uint32_t height,
+                      std::atomic<uint32_t> *rowsDone, const std::atomic<bool> *cancelled) {
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        fprintf(stderr, "Unable to open %s\n", path);
+        return false;
+    }
+
+    // Scanline buffers are sized from the header, so it is not trusted beyond maxSize
+    if (width > maxSize || height > maxSize) {
+        fprintf(stderr, "%s is %ux%u, which is too large to open\n", path, width, height);
+        fclose(f);
+        return false;
+    }
+
+    PNGInfo info;
+    if (!ReadPNGHeader(f, info) || info.width != width || info.height != height) {
+        fprintf(stderr, "%s is not a PNG image of %ux%u\n", path, width, height);
+        fclose(f);
+        return false;
+    }
+
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    if (inflateInit(&stream) != Z_OK) {
+        fclose(f);
+        return false;
+    }
+
+    // Scanlines are a filter byte followed by the samples, only two of them are kept
+    size_t bitsPerPixel = static_cast<size_t>(PNGChannels(info)) * info.bitDepth;
+    size_t rowBytes = (static_cast<size_t>(width) * bitsPerPixel + 7) / 8;
+    size_t step = std::max<size_t>(1, bitsPerPixel / 8);
+    std::vector<uint8_t> current(rowBytes + 1);
+    std::vector<uint8_t> previous(rowBytes + 1, 0);
+    std::vector<uint8_t> input(pngReadSlice);
+    std::vector<uint8_t> chunkData;
+
+    uint32_t y = 0;
+    bool ok = true;
+    bool streamEnded = false;
+    stream.next_out = current.data();
+    stream.avail_out = current.size();
+    while (ok && y < height && !streamEnded) {
+        uint8_t chunkHeader[8];
+        if (fread(chunkHeader, 1, sizeof(chunkHeader), f) != sizeof(chunkHeader)) {
+            ok = false;
+            break;
+        }
+
+        uint32_t length = GetBigEndian(chunkHeader);
+        const char *type = reinterpret_cast<const char *>(chunkHeader + 4);
+        if (memcmp(type, "IEND", 4) == 0) break;
+
+        if (memcmp(type, "PLTE", 4) == 0 || memcmp(type, "tRNS", 4) == 0) {
+            // Neither has more than an entry of three bytes for each of 256 colors
+            if (length > pngPaletteSize) {
+                ok = false;
+                break;
+            }
+
+            chunkData.resize(length);
+            ok = fread(chunkData.data(), 1, length, f) == length && fseek(f, 4, SEEK_CUR) == 0;
+            if (ok) ReadPNGPalette(chunkData, type[0] == 't', info);
+            continue;
+        }
+
+        if (memcmp(type, "IDAT", 4) != 0) {
+            ok = fseek(f, static_cast<long>(length) + 4, SEEK_CUR) == 0;
+            continue;
+        }
+
+        // Image data is inflated a slice at a time, every completed scanline goes to pixels
+        for (uint32_t remaining = length; ok && remaining && y < height && !streamEnded;) {
+            size_t slice = std::min<size_t>(remaining, input.size());
+            if (fread(input.data(), 1, slice, f) != slice) {
+                ok = false;
+                break;
+            }
+            remaining -= slice;
+            stream.next_in = input.data();
+            stream.avail_in = slice;
+
+            // Inflate may hold back output, it is drained before more input is read
+            for (;;) {
+                int status = inflate(&stream, Z_NO_FLUSH);
+                if (status == Z_BUF_ERROR) break;
+                if (status != Z_OK && status != Z_STREAM_END) {
+                    ok = false;
+                    break;
+                }
+                streamEnded = status == Z_STREAM_END;
+
+                if (stream.avail_out == 0) {
+                    ok = UnfilterPNGRow(current[0], current.data() + 1, previous.data() + 1,
+                                        rowBytes, step);
+                    if (!ok) break;
+
+                    ConvertPNGRow(current.data() + 1, info,
+                                  pixels + static_cast<size_t>(y) * width);
+                    current.swap(previous);
+                    y++;
+
+                    if (rowsDone) *rowsDone = y;
+                    if (cancelled && *cancelled) {
+                        inflateEnd(&stream);
+                        fclose(f);
+                        return false;
+                    }
+                    if (y == height) break;
+
+                    stream.next_out = current.data();
+                    stream.avail_out = current.size();
+                    continue;
+                }
+
+                if (streamEnded || stream.avail_in == 0) break;
+            }
+        }
+
+        // Rest of the chunk is not needed once the image is complete
+        if (ok && y < height) ok = fseek(f, 4, SEEK_CUR) == 0;
+    }
+
+    inflateEnd(&stream);
+    fclose(f);
+
+    if (!ok || y < height) {
+        fprintf(stderr, "%s is corrupted or truncated\n", path);
+        return false;
+    }
+    return true;
+}
+
+std::shared_ptr<ImageLoadTask> ImageIO::LoadAsync(const char *path, uint32_t *pixels,
+                                                  uint32_t width, uint32_t height) {
+    return std::make_shared<ImageLoadTask>(path, pixels, width, height);
+}
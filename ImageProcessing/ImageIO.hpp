@@ -0,0 +1,124 @@
+#ifndef IMAGE_IO_HPP_
+#define IMAGE_IO_HPP_
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include "PixelStorage.hpp"
+
+enum class ImageFormat {
+    PNG,
+    RAW,      // Uncompressed RGBA pixels behind a small header, for fast saves
+    PROJECT,  // Layered document, see ProjectFile
+    FOREIGN   // Anything else, left to the render engine backend
+};
+
+// Writes rows [firstRow, firstRow + rowsCount) of an image into out. Called from several threads
+// at once, for rows that do not overlap
+using RowSource = std::function<void(uint32_t firstRow, uint32_t rowsCount, uint32_t *out)>;
+
+// Image save that runs in the background, rows are asked from the source a band at a time. The
+// source is dropped as soon as the file is written
+class ImageSaveTask {
+   public:
+    ImageSaveTask(std::string path, ImageFormat format, RowSource source, uint32_t width,
+                  uint32_t height);
+    ~ImageSaveTask();  // Waits for completion
+    ImageSaveTask(const ImageSaveTask &) = delete;
+    ImageSaveTask &operator=(const ImageSaveTask &) = delete;
+
+    float getProgress();  // Part of work done, [0..1]
+    bool isDone();
+    bool succeeded();  // Valid once the task is done
+    void wait();
+
+   private:
+    void run();
+
+    std::string path;
+    ImageFormat format;
+    RowSource source;
+    uint32_t width;
+    uint32_t height;
+
+    std::atomic<float> progress;
+    std::atomic<bool> done;
+    bool success;
+    std::thread worker;
+};
+
+// PNG decode that runs in the background, rows go straight into the pixels as they are inflated.
+// The pixels must stay alive until the task is done
+class ImageLoadTask {
+   public:
+    ImageLoadTask(std::string path, uint32_t *pixels, uint32_t width, uint32_t height);
+    ~ImageLoadTask();  // Cancels and waits
+    ImageLoadTask(const ImageLoadTask &) = delete;
+    ImageLoadTask &operator=(const ImageLoadTask &) = delete;
+
+    uint32_t getRowsDone();  // Rows above this one are final
+    float getProgress();     // Part of work done, [0..1]
+    bool isDone();
+    bool succeeded();  // Valid once the task is done, false if cancelled
+    void cancel();     // Rows decoded so far stay
+    void wait();
+
+   private:
+    void run();
+
+    std::string path;
+    uint32_t *pixels;
+    uint32_t width;
+    uint32_t height;
+
+    std::atomic<uint32_t> rowsDone;
+    std::atomic<bool> cancelled;
+    std::atomic<bool> done;
+    bool success;
+    std::thread worker;
+};
+
+// Image input/output that works on canvas pixels in place
+class ImageIO {
+   public:
+    static constexpr int pngCompressionLevel = 3;  // Fast deflate, the difference in size is small
+    static constexpr uint32_t pngBandHeight = 64;  // Rows per independently compressed band
+    static constexpr size_t pngBandsInFlight = 2;  // Per thread of the pool, bands not written yet
+    static constexpr uint32_t maxSize = 65536;     // Largest width or height of a loaded image
+
+    static ImageFormat FormatFromPath(const std::string &path);
+    static std::string ToNativePath(const wchar_t *path);
+
+    // Source has to keep giving the same rows until the task is done, nothing is copied upfront
+    static std::shared_ptr<ImageSaveTask> SaveAsync(const wchar_t *path, RowSource source,
+                                                    uint32_t width, uint32_t height);
+    // Bands are compressed in parallel and written in order as they complete, at most
+    // pngBandsInFlight per thread are held in memory at once
+    static bool SavePNG(const char *path, const RowSource &source, uint32_t width,
+                        uint32_t height, std::atomic<float> *progress = nullptr);
+    static bool SaveRaw(const char *path, const RowSource &source, uint32_t width,
+                        uint32_t height, std::atomic<float> *progress = nullptr);
+
+    // Read raw image straight into a newly allocated buffer. Returns empty storage on failure,
+    // including headers out of maxSize or not matching the size of the file
+    static PixelStorage LoadRaw(const char *path, uint32_t &width, uint32_t &height);
+
+    // Size of a PNG that LoadPNG can decode, false for anything else (interlaced images included)
+    static bool ProbePNG(const char *path, uint32_t &width, uint32_t &height);
+    // Inflate and unfilter rows one at a time straight into pixels, which have to be of the size
+    // ProbePNG reported and within maxSize. Rows [0, rowsDone) are final; stops early once
+    // cancelled is set
+    static bool LoadPNG(const char *path, uint32_t *pixels, uint32_t width, uint32_t height,
+                        std::atomic<uint32_t> *rowsDone = nullptr,
+                        const std::atomic<bool> *cancelled = nullptr);
+    static std::shared_ptr<ImageLoadTask> LoadAsync(const char *path, uint32_t *pixels,
+                                                    uint32_t width, uint32_t height);
+
+   private:
+    ImageIO();
+};
+
+#endif  // IMAGE_IO_HPP_
@@ -0,0 +1,243 @@
+#include "LayerStack.hpp"
+
+#include <algorithm>
+#include <utility>
+
+#include "ThreadPool.hpp"
+
+LayerStack::LayerStack(uint32_t width, uint32_t height) : active(0), nextLayerId(1) {
+    PixelStorage pixels(static_cast<size_t>(width) * height);
+    FillSpan(pixels.data(), 0xFFFFFFFF, pixels.size());
+    reset(width, height, std::move(pixels));
+}
+
+void LayerStack::reset(uint32_t width, uint32_t height, PixelStorage &&pixels) {
+    std::vector<Layer> single;
+    single.push_back({std::move(pixels), 255, true, BlendMode::NORMAL, 0, {}});
+    assign(width, height, std::move(single), 0);
+}
+
+void LayerStack::assign(uint32_t width, uint32_t height, std::vector<Layer> &&layers,
+                        size_t active) {
+    this->layers = std::move(layers);
+    this->active = std::min(active, this->layers.size() - 1);
+
+    resize(width, height);
+    for (Layer &layer : this->layers) layer.id = nextLayerId++;
+}
+
+void LayerStack::scale(uint32_t width, uint32_t height, ResampleFilter filter) {
+    for (Layer &layer : layers) {
+        PixelStorage pixels(static_cast<size_t>(width) * height);
+        Resampler::Scale(layer.pixels.data(), this->width, this->height, pixels.data(), width,
+                         height, filter);
+        layer.pixels = std::move(pixels);
+    }
+
+    resize(width, height);
+}
+
+void LayerStack::resize(uint32_t width, uint32_t height) {
+    this->width = width;
+    this->height = height;
+    tilesX = (width + tileSize - 1) / tileSize;
+    tilesY = (height + tileSize - 1) / tileSize;
+
+    below = PixelStorage(static_cast<size_t>(width) * height);
+    result = PixelStorage(static_cast<size_t>(width) * height);
+    resultStale.assign(static_cast<size_t>(tilesX) * tilesY, 0);
+    belowStale.assign(static_cast<size_t>(tilesX) * tilesY, 0);
+    staleTiles.clear();
+    for (Layer &layer : layers) layer.unsaved.assign(static_cast<size_t>(tilesX) * tilesY, 0);
+
+    invalidate(true);
+}
+
+size_t LayerStack::addLayer() {
+    // Storage comes zeroed, a transparent layer does not touch its pages until painted on
+    PixelStorage pixels(static_cast<size_t>(width) * height);
+
+    // Transparent layer does not change the composite, but the cache under the active one does
+    layers.insert(layers.begin() + active + 1,
+                  {std::move(pixels), 255, true, BlendMode::NORMAL, nextLayerId++,
+                   std::vector<uint8_t>(static_cast<size_t>(tilesX) * tilesY, 0)});
+    setActiveLayer(active + 1);
+
+    return active;
+}
+
+void LayerStack::removeLayer(size_t index) {
+    if (layers.size() <= 1 || index >= layers.size()) return;
+
+    layers.erase(layers.begin() + index);
+    if (index < active || active == layers.size()) active--;
+
+    invalidate(true);
+}
+
+void LayerStack::moveLayer(size_t from, size_t to) {
+    if (from >= layers.size() || to >= layers.size() || from == to) return;
+
+    // Active layer stays the same layer
+    if (active == from) {
+        active = to;
+    } else if (from < active && to >= active) {
+        active--;
+    } else if (from > active && to <= active) {
+        active++;
+    }
+
+    if (from < to) {
+        std::rotate(layers.begin() + from, layers.begin() + from + 1, layers.begin() + to + 1);
+    } else {
+        std::rotate(layers.begin() + to, layers.begin() + from, layers.begin() + from + 1);
+    }
+
+    invalidate(true);
+}
+
+void LayerStack::setActiveLayer(size_t index) {
+    if (index >= layers.size() || index == active) return;
+
+    // Final composite is the same, only the split point moves
+    active = index;
+    std::fill(belowStale.begin(), belowStale.end(), 1);
+}
+
+size_t LayerStack::getActiveLayer() { return active; }
+
+size_t LayerStack::getLayersCount() { return layers.size(); }
+
+uint32_t *LayerStack::getLayerPixels(size_t index) { return layers[index].pixels.data(); }
+
+const Layer &LayerStack::getLayer(size_t index) { return layers[index]; }
+
+void LayerStack::setOpacity(size_t index, uint8_t opacity) {
+    if (layers[index].opacity == opacity) return;
+
+    layers[index].opacity = opacity;
+    markTiles({0, 0, width, height}, index < active);
+}
+
+void LayerStack::setVisible(size_t index, bool isVisible) {
+    if (layers[index].isVisible == isVisible) return;
+
+    layers[index].isVisible = isVisible;
+    markTiles({0, 0, width, height}, index < active);
+}
+
+void LayerStack::setBlendMode(size_t index, BlendMode mode) {
+    if (layers[index].mode == mode) return;
+
+    layers[index].mode = mode;
+    markTiles({0, 0, width, height}, index < active);
+}
+
+void LayerStack::markDirty(size_t index, const PixelRect &rect) {
+    // Rows just painted on stay in memory, the ones painted on long ago may be paged out
+    if (rect.y0 < rect.y1 && rect.y0 < height) {
+        layers[index].pixels.touch(static_cast<size_t>(rect.y0) * width,
+                                   static_cast<size_t>(std::min(rect.y1, height)) * width);
+    }
+
+    forEachTile(rect, [&](size_t tile) { layers[index].unsaved[tile] = 1; });
+    markTiles(rect, index < active);
+}
+
+bool LayerStack::isModified(size_t index, const PixelRect &rect) {
+    bool modified = false;
+    forEachTile(rect, [&](size_t tile) { modified |= layers[index].unsaved[tile] != 0; });
+    return modified;
+}
+
+void LayerStack::markSaved() {
+    for (Layer &layer : layers) std::fill(layer.unsaved.begin(), layer.unsaved.end(), 0);
+}
+
+void LayerStack::invalidate(bool below) { markTiles({0, 0, width, height}, below); }
+
+template <typename F>
+void LayerStack::forEachTile(const PixelRect &rect, F f) {
+    PixelRect clipped = rect;
+    clipped.clip(width, height);
+    if (clipped.isEmpty()) return;
+
+    for (uint32_t ty = clipped.y0 / tileSize; ty <= (clipped.y1 - 1) / tileSize; ty++) {
+        for (uint32_t tx = clipped.x0 / tileSize; tx <= (clipped.x1 - 1) / tileSize; tx++) {
+            f(static_cast<size_t>(ty) * tilesX + tx);
+        }
+    }
+}
+
+void LayerStack::markTiles(const PixelRect &rect, bool below) {
+    forEachTile(rect, [&](size_t tile) {
+        if (!resultStale[tile]) {
+            resultStale[tile] = 1;
+            staleTiles.push_back(tile);
+        }
+
+        if (below) belowStale[tile] = 1;
+    });
+}
+
+void LayerStack::compositeTile(size_t tile) {
+    uint32_t x0 = (tile % tilesX) * tileSize;
+    uint32_t y0 = (tile / tilesX) * tileSize;
+    uint32_t x1 = std::min(x0 + tileSize, width);
+    uint32_t y1 = std::min(y0 + tileSize, height);
+    uint32_t span = x1 - x0;
+
+    size_t rowsFrom = static_cast<size_t>(y0) * width;
+    size_t rowsTo = static_cast<size_t>(y1) * width;
+    below.touch(rowsFrom, rowsTo);
+    result.touch(rowsFrom, rowsTo);
+    for (Layer &layer : layers) {
+        if (layer.isVisible) layer.pixels.touch(rowsFrom, rowsTo);
+    }
+
+    for (uint32_t y = y0; y < y1; y++) {
+        size_t offset = static_cast<size_t>(y) * width + x0;
+
+        if (belowStale[tile]) {
+            FillSpan(below.data() + offset, 0, span);
+            for (size_t i = 0; i < active; i++) {
+                if (!layers[i].isVisible) continue;
+                BlendSpan(below.data() + offset, layers[i].pixels.data() + offset, span,
+                          layers[i].mode, layers[i].opacity);
+            }
+        }
+
+        CopySpan(result.data() + offset, below.data() + offset, span);
+        for (size_t i = active; i < layers.size(); i++) {
+            if (!layers[i].isVisible) continue;
+            BlendSpan(result.data() + offset, layers[i].pixels.data() + offset, span,
+                      layers[i].mode, layers[i].opacity);
+        }
+    }
+
+    belowStale[tile] = 0;
+    resultStale[tile] = 0;
+}
+
+PixelRect LayerStack::composite() {
+    PixelRect changed = {0, 0, 0, 0};
+
+    for (size_t tile : staleTiles) {
+        uint32_t x0 = (tile % tilesX) * tileSize;
+        uint32_t y0 = (tile / tilesX) * tileSize;
+        changed.unite({x0, y0, std::min(x0 + tileSize, width), std::min(y0 + tileSize, height)});
+    }
+
+    // Tiles are independent of each other
+    ThreadPool::Global().parallelFor(staleTiles.size(),
+                                     [this](size_t i) { compositeTile(staleTiles[i]); });
+    staleTiles.clear();
+
+    return changed;
+}
+
+const uint32_t *LayerStack::getComposite() { return result.data(); }
+
+uint32_t LayerStack::getWidth() { return width; }
+
+uint32_t LayerStack::getHeight() { return height; }
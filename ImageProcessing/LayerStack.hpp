@@ -0,0 +1,82 @@
+#ifndef LAYER_STACK_HPP_
+#define LAYER_STACK_HPP_
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "Blend.hpp"
+#include "MipPyramid.hpp"
+#include "PixelStorage.hpp"
+#include "Resample.hpp"
+
+// Single RGBA layer of a document
+struct Layer {
+    PixelStorage pixels;
+    uint8_t opacity;  // Multiplies alpha of every pixel of the layer
+    bool isVisible;
+    BlendMode mode;
+    uint64_t id;                   // Unique within the session, set by the stack
+    std::vector<uint8_t> unsaved;  // Tiles changed since the document was last saved
+};
+
+// Ordered stack of layers (index 0 is the bottom one) together with their cached composite.
+// The composite is kept in tiles: only tiles touched since the last composite() are recomputed,
+// and the layers under the active one are cached separately so painting on the active layer
+// only blends the active layer and the ones above it.
+class LayerStack {
+   public:
+    static constexpr uint32_t tileSize = 64;
+
+    LayerStack(uint32_t width, uint32_t height);  // Single opaque white layer
+    void reset(uint32_t width, uint32_t height, PixelStorage &&pixels);  // Single layer of pixels
+    // Layers of a loaded document, they count as saved
+    void assign(uint32_t width, uint32_t height, std::vector<Layer> &&layers, size_t active);
+    void scale(uint32_t width, uint32_t height, ResampleFilter filter);  // Resample every layer
+
+    size_t addLayer();  // New transparent layer right above the active one, becomes active
+    void removeLayer(size_t index);  // The last remaining layer is never removed
+    void moveLayer(size_t from, size_t to);
+    void setActiveLayer(size_t index);
+    size_t getActiveLayer();
+    size_t getLayersCount();
+    uint32_t *getLayerPixels(size_t index);
+    const Layer &getLayer(size_t index);
+
+    void setOpacity(size_t index, uint8_t opacity);
+    void setVisible(size_t index, bool isVisible);
+    void setBlendMode(size_t index, BlendMode mode);
+
+    void markDirty(size_t index, const PixelRect &rect);  // Pixels of the layer were changed
+    bool isModified(size_t index, const PixelRect &rect);  // Since the last markSaved()
+    void markSaved();
+    PixelRect composite();  // Bring composite up to date, returns the region that changed
+    const uint32_t *getComposite();
+    uint32_t getWidth();
+    uint32_t getHeight();
+
+   private:
+    void resize(uint32_t width, uint32_t height);
+    void invalidate(bool below);  // Every tile of the composite (and of the below cache) is stale
+    void markTiles(const PixelRect &rect, bool below);
+    void compositeTile(size_t tile);
+    // Calls f(tile) for every tile overlapping rect, rect is clipped to the image
+    template <typename F>
+    void forEachTile(const PixelRect &rect, F f);
+
+    uint32_t width;
+    uint32_t height;
+    uint32_t tilesX;
+    uint32_t tilesY;
+
+    std::vector<Layer> layers;
+    size_t active;
+    uint64_t nextLayerId;
+
+    PixelStorage below;   // Composite of the layers under the active one
+    PixelStorage result;  // Composite of all the layers
+    std::vector<uint8_t> resultStale;
+    std::vector<uint8_t> belowStale;
+    std::vector<size_t> staleTiles;  // Tiles with resultStale set, in no particular order
+};
+
+#endif  // LAYER_STACK_HPP_
@@ -0,0 +1,140 @@
+#include "MipPyramid.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// PixelRect methods
+void PixelRect::unite(const PixelRect &other) {
+    if (other.isEmpty()) return;
+
+    if (isEmpty()) {
+        *this = other;
+        return;
+    }
+
+    x0 = std::min(x0, other.x0);
+    y0 = std::min(y0, other.y0);
+    x1 = std::max(x1, other.x1);
+    y1 = std::max(y1, other.y1);
+}
+
+void PixelRect::clip(uint32_t width, uint32_t height) {
+    x1 = std::min(x1, width);
+    y1 = std::min(y1, height);
+    x0 = std::min(x0, x1);
+    y0 = std::min(y0, y1);
+}
+
+// Average of four pixels, rounded like the SIMD path
+static inline uint32_t Average4(uint32_t a, uint32_t b, uint32_t c, uint32_t d) {
+    uint32_t result = 0;
+    for (int shift = 0; shift < 32; shift += 8) {
+        uint32_t top = (((a >> shift) & 0xFF) + ((b >> shift) & 0xFF) + 1) >> 1;
+        uint32_t bottom = (((c >> shift) & 0xFF) + ((d >> shift) & 0xFF) + 1) >> 1;
+        result |= ((top + bottom + 1) >> 1) << shift;
+    }
+    return result;
+}
+
+void BoxReduce(const uint32_t *src, uint32_t srcWidth, uint32_t srcHeight, uint32_t *dst,
+               uint32_t dstWidth, uint32_t x0, uint32_t y0, uint32_t x1, uint32_t y1) {
+    for (uint32_t y = y0; y < y1; y++) {
+        // Odd trailing row or column of the source is folded into the last destination pixel
+        const uint32_t *row0 = src + static_cast<size_t>(std::min(2 * y, srcHeight - 1)) * srcWidth;
+        const uint32_t *row1 =
+            src + static_cast<size_t>(std::min(2 * y + 1, srcHeight - 1)) * srcWidth;
+        uint32_t *out = dst + static_cast<size_t>(y) * dstWidth;
+
+        uint32_t x = x0;
+#ifdef __SSE2__
+        uint32_t simdEnd = std::min(x1, (srcWidth / 2) & ~3u);
+        for (; x + 4 <= simdEnd; x += 4) {
+            __m128 top0 = _mm_castsi128_ps(
+                _mm_loadu_si128(reinterpret_cast<const __m128i *>(row0 + 2 * x)));
+            __m128 top1 = _mm_castsi128_ps(
+                _mm_loadu_si128(reinterpret_cast<const __m128i *>(row0 + 2 * x + 4)));
+            __m128 bottom0 = _mm_castsi128_ps(
+                _mm_loadu_si128(reinterpret_cast<const __m128i *>(row1 + 2 * x)));
+            __m128 bottom1 = _mm_castsi128_ps(
+                _mm_loadu_si128(reinterpret_cast<const __m128i *>(row1 + 2 * x + 4)));
+
+            // Split into even and odd pixels, then average horizontally and vertically
+            __m128i topEven = _mm_castps_si128(_mm_shuffle_ps(top0, top1, _MM_SHUFFLE(2, 0, 2, 0)));
+            __m128i topOdd = _mm_castps_si128(_mm_shuffle_ps(top0, top1, _MM_SHUFFLE(3, 1, 3, 1)));
+            __m128i bottomEven =
+                _mm_castps_si128(_mm_shuffle_ps(bottom0, bottom1, _MM_SHUFFLE(2, 0, 2, 0)));
+            __m128i bottomOdd =
+                _mm_castps_si128(_mm_shuffle_ps(bottom0, bottom1, _MM_SHUFFLE(3, 1, 3, 1)));
+
+            __m128i result = _mm_avg_epu8(_mm_avg_epu8(topEven, topOdd),
+                                          _mm_avg_epu8(bottomEven, bottomOdd));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(out + x), result);
+        }
+#endif
+        for (; x < x1; x++) {
+            uint32_t left = std::min(2 * x, srcWidth - 1);
+            uint32_t right = std::min(2 * x + 1, srcWidth - 1);
+            out[x] = Average4(row0[left], row0[right], row1[left], row1[right]);
+        }
+    }
+}
+
+// MipPyramid methods
+MipPyramid::MipPyramid() : base{nullptr, 0, 0} {}
+
+void MipPyramid::rebuild(const uint32_t *data, uint32_t width, uint32_t height) {
+    base = {data, width, height};
+    reductions.clear();
+    levels.clear();
+    levels.push_back(base);
+
+    while (width > minLevelSize || height > minLevelSize) {
+        width = std::max(1u, width / 2);
+        height = std::max(1u, height / 2);
+
+        reductions.emplace_back(static_cast<size_t>(width) * height);
+        levels.push_back({reductions.back().data(), width, height});
+    }
+
+    for (size_t level = 1; level < levels.size(); level++) {
+        reduce(level, {0, 0, levels[level].width, levels[level].height});
+    }
+}
+
+void MipPyramid::reduce(size_t level, PixelRect region) {
+    const Level &src = levels[level - 1];
+    Level &dst = levels[level];
+
+    region.clip(dst.width, dst.height);
+    if (region.isEmpty()) return;
+
+    reductions[level - 1].touch(static_cast<size_t>(region.y0) * dst.width,
+                                static_cast<size_t>(region.y1) * dst.width);
+    BoxReduce(src.data, src.width, src.height, reductions[level - 1].data(), dst.width, region.x0,
+              region.y0, region.x1, region.y1);
+}
+
+void MipPyramid::update(const PixelRect &dirty) {
+    PixelRect region = dirty;
+
+    for (size_t level = 1; level < levels.size(); level++) {
+        // Destination pixel depends on a 2x2 block, plus the folded odd row and column at the end
+        region = {region.x0 / 2, region.y0 / 2, (region.x1 + 1) / 2 + 1, (region.y1 + 1) / 2 + 1};
+        reduce(level, region);
+    }
+}
+
+MipPyramid::Level MipPyramid::getLevel(size_t level) { return levels[level]; }
+
+size_t MipPyramid::getLevelsCount() { return levels.size(); }
+
+size_t MipPyramid::chooseLevel(float scale) {
+    if (scale >= 1 || levels.empty()) return 0;
+
+    size_t level = static_cast<size_t>(std::floor(std::log2(1 / scale)));
+    return std::min(level, levels.size() - 1);
+}
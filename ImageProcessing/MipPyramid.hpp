@@ -0,0 +1,53 @@
+#ifndef MIP_PYRAMID_HPP_
+#define MIP_PYRAMID_HPP_
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "PixelStorage.hpp"
+
+// Rectangle of pixels, [x0, x1) x [y0, y1)
+struct PixelRect {
+    uint32_t x0;
+    uint32_t y0;
+    uint32_t x1;
+    uint32_t y1;
+
+    bool operator==(const PixelRect &other) const = default;
+    bool isEmpty() const { return x0 >= x1 || y0 >= y1; }
+    void unite(const PixelRect &other);
+    void clip(uint32_t width, uint32_t height);
+};
+
+// Chain of 2x box-filtered reductions of an RGBA image. Level 0 is the image itself and is not
+// owned by the pyramid; reductions stop once a level fits into minLevelSize.
+class MipPyramid {
+   public:
+    static constexpr uint32_t minLevelSize = 64;
+
+    struct Level {
+        const uint32_t *data;
+        uint32_t width;
+        uint32_t height;
+    };
+
+    MipPyramid();
+    void rebuild(const uint32_t *base, uint32_t width, uint32_t height);
+    void update(const PixelRect &dirty);  // Refresh the part of every level that depends on dirty
+    Level getLevel(size_t level);
+    size_t getLevelsCount();
+    size_t chooseLevel(float scale);  // Coarsest level that still has enough pixels for the scale
+
+   private:
+    void reduce(size_t level, PixelRect region);  // Recompute region of level from the previous one
+
+    Level base;
+    std::vector<PixelStorage> reductions;  // Levels 1..N
+    std::vector<Level> levels;
+};
+
+// Averages 2x2 blocks of src into dst for dst rows [y0, y1) and columns [x0, x1)
+void BoxReduce(const uint32_t *src, uint32_t srcWidth, uint32_t srcHeight, uint32_t *dst,
+               uint32_t dstWidth, uint32_t x0, uint32_t y0, uint32_t x1, uint32_t y1);
+
+#endif  // MIP_PYRAMID_HPP_
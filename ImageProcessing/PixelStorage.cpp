@@ -0,0 +1,193 @@
+#include "PixelStorage.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <string>
+#include <vector>
+
+static std::atomic<uint64_t> nextMappingId{1};
+
+// Unlinked file of the given size mapped into memory, MAP_FAILED if there is no room for it
+static void *MapScratchFile(size_t bytes) {
+    const char *directory = PixelStorage::ScratchDirectory();
+    std::string path = std::string(directory) + "/canvas-XXXXXX";
+    int fd = mkstemp(path.data());
+    if (fd < 0) {
+        fprintf(stderr, "Unable to create a scratch file in %s\n", directory);
+        return MAP_FAILED;
+    }
+
+    // Space is given back as soon as the mapping goes away
+    unlink(path.c_str());
+
+    // Blocks are reserved up front, running out of disk in the middle of a stroke would crash
+    int reserved = fallocate(fd, 0, 0, bytes);
+    if (reserved != 0 && errno == EOPNOTSUPP) reserved = ftruncate(fd, bytes);
+
+    void *memory = MAP_FAILED;
+    if (reserved == 0) {
+        memory = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    } else {
+        fprintf(stderr, "Unable to reserve %zu bytes of scratch space in %s\n", bytes, directory);
+    }
+    close(fd);
+
+    if (memory != MAP_FAILED) madvise(memory, bytes, MADV_RANDOM);
+    return memory;
+}
+
+PixelStorage::PixelStorage() : pixels(nullptr), count(0), id(0) {}
+
+PixelStorage::PixelStorage(size_t count) : pixels(nullptr), count(count), id(0) {
+    if (!count) return;
+
+    size_t bytes = count * sizeof(uint32_t);
+    void *memory = MAP_FAILED;
+    if (bytes >= mappingThreshold) {
+        memory = MapScratchFile(bytes);
+        if (memory != MAP_FAILED) id = nextMappingId++;
+    }
+
+    // Anonymous pages are zeroed lazily too, untouched parts of a buffer cost nothing
+    if (memory == MAP_FAILED) {
+        memory = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    }
+    if (memory == MAP_FAILED) throw std::bad_alloc();
+
+    pixels = static_cast<uint32_t *>(memory);
+}
+
+PixelStorage::PixelStorage(PixelStorage &&other)
+    : pixels(other.pixels), count(other.count), id(other.id) {
+    other.pixels = nullptr;
+    other.count = 0;
+    other.id = 0;
+}
+
+PixelStorage &PixelStorage::operator=(PixelStorage &&other) {
+    if (this == &other) return *this;
+
+    release();
+    pixels = other.pixels;
+    count = other.count;
+    id = other.id;
+    other.pixels = nullptr;
+    other.count = 0;
+    other.id = 0;
+
+    return *this;
+}
+
+PixelStorage::~PixelStorage() { release(); }
+
+void PixelStorage::release() {
+    if (!pixels) return;
+
+    if (id) ResidentSet::Global().forget(id);
+    munmap(pixels, count * sizeof(uint32_t));
+
+    pixels = nullptr;
+    count = 0;
+    id = 0;
+}
+
+uint32_t *PixelStorage::data() const { return pixels; }
+
+size_t PixelStorage::size() const { return count; }
+
+bool PixelStorage::isMapped() const { return id != 0; }
+
+void PixelStorage::touch(size_t from, size_t to) {
+    if (!id || from >= to) return;
+
+    ResidentSet::Global().touch(id, reinterpret_cast<uint8_t *>(pixels), count * sizeof(uint32_t),
+                                from * sizeof(uint32_t), to * sizeof(uint32_t));
+}
+
+const char *PixelStorage::ScratchDirectory() {
+    const char *directory = getenv("TMPDIR");
+    return directory && *directory ? directory : "/var/tmp";
+}
+
+// ResidentSet methods
+ResidentSet::ResidentSet(size_t budget) : budget(budget), residentBytes(0) {}
+
+void ResidentSet::touch(uint64_t id, uint8_t *base, size_t size, size_t from, size_t to) {
+    std::vector<Chunk> evicted;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        for (size_t chunk = from / chunkSize; chunk <= (to - 1) / chunkSize; chunk++) {
+            uint64_t key = (id << 32) | chunk;
+            auto found = index.find(key);
+            if (found != index.end()) {
+                chunks.splice(chunks.begin(), chunks, found->second);
+                continue;
+            }
+
+            size_t offset = chunk * chunkSize;
+            chunks.push_front({id, chunk, base + offset, std::min(chunkSize, size - offset)});
+            index[key] = chunks.begin();
+            residentBytes += chunks.front().length;
+        }
+
+        // Chunk touched last always stays
+        while (residentBytes > budget && chunks.size() > 1) {
+            Chunk &victim = chunks.back();
+            index.erase((victim.id << 32) | victim.index);
+            residentBytes -= victim.length;
+            evicted.push_back(victim);
+            chunks.pop_back();
+        }
+    }
+
+    // Paging out writes to disk, other threads keep touching their chunks meanwhile
+    for (const Chunk &chunk : evicted) {
+#ifdef MADV_PAGEOUT
+        madvise(chunk.address, chunk.length, MADV_PAGEOUT);
+#else
+        madvise(chunk.address, chunk.length, MADV_DONTNEED);  // Left to the page cache
+#endif
+    }
+}
+
+void ResidentSet::forget(uint64_t id) {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    for (auto chunk = chunks.begin(); chunk != chunks.end();) {
+        if (chunk->id != id) {
+            chunk++;
+            continue;
+        }
+
+        index.erase((chunk->id << 32) | chunk->index);
+        residentBytes -= chunk->length;
+        chunk = chunks.erase(chunk);
+    }
+}
+
+void ResidentSet::setBudget(size_t budget) {
+    std::lock_guard<std::mutex> lock(mutex);
+    this->budget = budget;
+}
+
+size_t ResidentSet::getBudget() { return budget; }
+
+size_t ResidentSet::getResidentBytes() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return residentBytes;
+}
+
+ResidentSet &ResidentSet::Global() {
+    static ResidentSet set(static_cast<size_t>(sysconf(_SC_PHYS_PAGES)) * sysconf(_SC_PAGE_SIZE) /
+                           2);
+    return set;
+}
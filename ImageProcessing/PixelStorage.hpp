@@ -0,0 +1,74 @@
+#ifndef PIXEL_STORAGE_HPP_
+#define PIXEL_STORAGE_HPP_
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+
+// Zero-initialized pixel buffer. Ordinary buffers are anonymous memory, buffers from
+// mappingThreshold bytes up live in an unlinked scratch file mapped into memory, so images
+// larger than the RAM are paged to disk by the kernel instead of failing to allocate. Mapped
+// buffers are advised for random access, as strokes touch a few pages of many rows.
+class PixelStorage {
+   public:
+    static constexpr size_t mappingThreshold = size_t(1) << 30;  // Bytes
+
+    PixelStorage();  // Empty
+    explicit PixelStorage(size_t count);
+    PixelStorage(PixelStorage &&other);
+    PixelStorage &operator=(PixelStorage &&other);
+    PixelStorage(const PixelStorage &) = delete;
+    PixelStorage &operator=(const PixelStorage &) = delete;
+    ~PixelStorage();
+
+    uint32_t *data() const;
+    size_t size() const;  // Pixels
+    bool isMapped() const;
+    // Pixels [from, to) are in use, keeps the resident part of mapped buffers within the budget
+    void touch(size_t from, size_t to);
+
+    static const char *ScratchDirectory();  // TMPDIR, or /var/tmp which is rarely in memory
+
+   private:
+    void release();
+
+    uint32_t *pixels;
+    size_t count;
+    uint64_t id;  // Identifies chunks of a mapped buffer in the resident set, 0 if not mapped
+};
+
+// Chunks of mapped pixel buffers touched recently. Once they add up to more than the budget the
+// least recently touched ones are paged out to their scratch files.
+class ResidentSet {
+   public:
+    static constexpr size_t chunkSize = 16 * 1024 * 1024;  // Bytes
+
+    explicit ResidentSet(size_t budget);
+    ResidentSet(const ResidentSet &) = delete;
+    ResidentSet &operator=(const ResidentSet &) = delete;
+
+    void touch(uint64_t id, uint8_t *base, size_t size, size_t from, size_t to);  // Byte offsets
+    void forget(uint64_t id);  // Mapping is about to be unmapped
+    void setBudget(size_t budget);
+    size_t getBudget();
+    size_t getResidentBytes();
+
+    static ResidentSet &Global();  // Half of the physical memory
+
+   private:
+    struct Chunk {
+        uint64_t id;
+        size_t index;
+        uint8_t *address;
+        size_t length;
+    };
+
+    std::mutex mutex;
+    std::list<Chunk> chunks;  // Most recently touched first
+    std::unordered_map<uint64_t, std::list<Chunk>::iterator> index;
+    size_t budget;
+    size_t residentBytes;
+};
+
+#endif  // PIXEL_STORAGE_HPP_
@@ -0,0 +1,424 @@
+#include "ProjectFile.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+
+#include "ThreadPool.hpp"
+
+// Fixed header at the start of the file, rewritten in place after every save
+struct ProjectHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved;
+    uint64_t indexOffset;
+    uint64_t indexSize;
+};
+
+// Index starts with this, followed by a LayerRecord and the tiles of every layer, bottom first
+struct IndexHeader {
+    uint32_t width;
+    uint32_t height;
+    uint32_t tileSize;
+    uint32_t layersCount;
+    uint32_t activeLayer;
+    uint32_t reserved;
+};
+
+struct LayerRecord {
+    uint8_t opacity;
+    uint8_t isVisible;
+    uint8_t mode;
+    uint8_t reserved;
+};
+
+static const char projectMagic[8] = {'W', 'S', 'L', 'P', 'R', 'O', 'J', '1'};
+constexpr uint32_t projectVersion = 1;
+
+static PixelRect TileRect(size_t tile, uint32_t tilesX, uint32_t tileSize, uint32_t width,
+                          uint32_t height) {
+    uint32_t x0 = (tile % tilesX) * tileSize;
+    uint32_t y0 = (tile / tilesX) * tileSize;
+    return {x0, y0, std::min(x0 + tileSize, width), std::min(y0 + tileSize, height)};
+}
+
+static bool WriteAt(int fd, const void *data, size_t size, uint64_t offset) {
+    const uint8_t *bytes = static_cast<const uint8_t *>(data);
+    while (size) {
+        ssize_t written = pwrite(fd, bytes, size, offset);
+        if (written <= 0) return false;
+
+        bytes += written;
+        size -= written;
+        offset += written;
+    }
+
+    return true;
+}
+
+// Compress a tile into blob, which stays empty for single-colored tiles
+static ProjectTile PackTile(const uint32_t *pixels, uint32_t width, const PixelRect &rect,
+                            std::vector<uint8_t> &blob) {
+    uint32_t tileWidth = rect.x1 - rect.x0;
+    size_t count = static_cast<size_t>(tileWidth) * (rect.y1 - rect.y0);
+
+    std::vector<uint32_t> tile(count);
+    for (uint32_t y = rect.y0; y < rect.y1; y++) {
+        memcpy(tile.data() + static_cast<size_t>(y - rect.y0) * tileWidth,
+               pixels + static_cast<size_t>(y) * width + rect.x0, tileWidth * sizeof(uint32_t));
+    }
+
+    blob.clear();
+    if (std::all_of(tile.begin(), tile.end(), [&](uint32_t pixel) { return pixel == tile[0]; })) {
+        return {0, 0, tile[0]};
+    }
+
+    uLongf size = compressBound(count * sizeof(uint32_t));
+    blob.resize(size);
+    compress2(blob.data(), &size, reinterpret_cast<const Bytef *>(tile.data()),
+              count * sizeof(uint32_t), ProjectFile::compressionLevel);
+    blob.resize(size);
+
+    return {0, static_cast<uint32_t>(size), 0};
+}
+
+static bool UnpackTile(const uint8_t *file, const ProjectTile &entry, uint32_t *pixels,
+                       uint32_t width, const PixelRect &rect) {
+    uint32_t tileWidth = rect.x1 - rect.x0;
+    if (!entry.size) {
+        for (uint32_t y = rect.y0; y < rect.y1; y++) {
+            FillSpan(pixels + static_cast<size_t>(y) * width + rect.x0, entry.color, tileWidth);
+        }
+        return true;
+    }
+
+    size_t count = static_cast<size_t>(tileWidth) * (rect.y1 - rect.y0);
+    std::vector<uint32_t> tile(count);
+    uLongf size = count * sizeof(uint32_t);
+    if (uncompress(reinterpret_cast<Bytef *>(tile.data()), &size, file + entry.offset,
+                   entry.size) != Z_OK ||
+        size != count * sizeof(uint32_t)) {
+        return false;
+    }
+
+    for (uint32_t y = rect.y0; y < rect.y1; y++) {
+        memcpy(pixels + static_cast<size_t>(y) * width + rect.x0,
+               tile.data() + static_cast<size_t>(y - rect.y0) * tileWidth,
+               tileWidth * sizeof(uint32_t));
+    }
+    return true;
+}
+
+// ProjectSnapshot methods
+size_t ProjectSnapshot::getTilesCount() const {
+    size_t count = 0;
+    for (const LayerState &layer : layers) count += layer.tiles.size();
+    return count;
+}
+
+// ProjectFile methods
+ProjectFile::ProjectFile() : width(0), height(0), fileSize(0), liveBytes(0) {}
+
+void ProjectFile::forget() {
+    path.clear();
+    tiles.clear();
+    fileSize = 0;
+    liveBytes = 0;
+}
+
+ProjectSnapshot ProjectFile::snapshot(const char *path, uint32_t width, uint32_t height,
+                                     size_t activeLayer,
+                                     std::vector<ProjectSnapshot::LayerState> &&layers,
+                                     const std::function<bool(size_t, size_t)> &isModified) {
+    ProjectSnapshot snapshot = {path, width, height, activeLayer, false, std::move(layers)};
+
+    // Tiles are appended to the file as long as it has not grown too much
+    snapshot.incremental = this->path == path && this->width == width && this->height == height &&
+                           fileSize <= compactionSlack * liveBytes;
+
+    size_t tilesCount = static_cast<size_t>((width + tileSize - 1) / tileSize) *
+                        ((height + tileSize - 1) / tileSize);
+    for (size_t i = 0; i < snapshot.layers.size(); i++) {
+        ProjectSnapshot::LayerState &layer = snapshot.layers[i];
+
+        // Layers the file does not have yet are written whole
+        bool known = snapshot.incremental && tiles.count(layer.id);
+        for (size_t tile = 0; tile < tilesCount; tile++) {
+            if (!known || isModified(i, tile)) layer.tiles.push_back(tile);
+        }
+    }
+
+    return snapshot;
+}
+
+bool ProjectFile::save(const ProjectSnapshot &snapshot) {
+    const char *path = snapshot.path.c_str();
+    uint32_t width = snapshot.width;
+    uint32_t height = snapshot.height;
+    uint32_t tilesX = (width + tileSize - 1) / tileSize;
+    uint32_t tilesY = (height + tileSize - 1) / tileSize;
+    size_t tilesCount = static_cast<size_t>(tilesX) * tilesY;
+
+    // Snapshot lacks the unmodified tiles, a file touched by anyone else can not be appended to
+    bool incremental = snapshot.incremental;
+    int fd = -1;
+    if (incremental) {
+        struct stat info;
+        fd = open(path, O_RDWR);
+        if (fd < 0 || fstat(fd, &info) != 0 || static_cast<uint64_t>(info.st_size) != fileSize) {
+            fprintf(stderr, "%s was changed by someone else, it has to be rewritten\n", path);
+            if (fd >= 0) close(fd);
+            forget();
+            return false;
+        }
+    }
+
+    // Full saves go to a temporary file, the old document survives a failed save
+    std::string target = incremental ? snapshot.path : snapshot.path + ".tmp";
+    if (!incremental) fd = open(target.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        fprintf(stderr, "Unable to open %s\n", target.c_str());
+        return false;
+    }
+
+    struct Job {
+        size_t layer;
+        size_t k;
+    };
+    std::vector<std::vector<ProjectTile>> entries(snapshot.layers.size());
+    std::vector<Job> jobs;
+    for (size_t i = 0; i < entries.size(); i++) {
+        const ProjectSnapshot::LayerState &layer = snapshot.layers[i];
+        auto known = incremental ? tiles.find(layer.id) : tiles.end();
+        if (known != tiles.end()) {
+            entries[i] = known->second;
+        } else {
+            entries[i].resize(tilesCount);
+        }
+
+        for (size_t k = 0; k < layer.tiles.size(); k++) jobs.push_back({i, k});
+    }
+
+    // Tiles are compressed in parallel a batch at a time and appended in order
+    uint64_t offset = incremental ? fileSize : sizeof(ProjectHeader);
+    bool ok = true;
+    std::vector<std::vector<uint8_t>> blobs(std::min(batchTiles, jobs.size()));
+    for (size_t first = 0; ok && first < jobs.size(); first += batchTiles) {
+        size_t count = std::min(batchTiles, jobs.size() - first);
+        ThreadPool::Global().parallelFor(count, [&](size_t k) {
+            const Job &job = jobs[first + k];
+            size_t tile = snapshot.layers[job.layer].tiles[job.k];
+            PixelRect rect = TileRect(tile, tilesX, tileSize, width, height);
+
+            entries[job.layer][tile] =
+                PackTile(snapshot.layers[job.layer].source, width, rect, blobs[k]);
+        });
+
+        for (size_t k = 0; ok && k < count; k++) {
+            if (blobs[k].empty()) continue;
+
+            const Job &job = jobs[first + k];
+            entries[job.layer][snapshot.layers[job.layer].tiles[job.k]].offset = offset;
+            ok = WriteAt(fd, blobs[k].data(), blobs[k].size(), offset);
+            offset += blobs[k].size();
+        }
+    }
+
+    std::vector<uint8_t> index(sizeof(IndexHeader));
+    IndexHeader indexHeader = {width,     height, tileSize, static_cast<uint32_t>(entries.size()),
+                               static_cast<uint32_t>(snapshot.activeLayer), 0};
+    memcpy(index.data(), &indexHeader, sizeof(indexHeader));
+
+    uint64_t tilesBytes = 0;
+    for (size_t i = 0; i < entries.size(); i++) {
+        const ProjectSnapshot::LayerState &layer = snapshot.layers[i];
+        LayerRecord record = {layer.opacity, layer.isVisible, static_cast<uint8_t>(layer.mode), 0};
+
+        size_t position = index.size();
+        index.resize(position + sizeof(record) + tilesCount * sizeof(ProjectTile));
+        memcpy(index.data() + position, &record, sizeof(record));
+        memcpy(index.data() + position + sizeof(record), entries[i].data(),
+               tilesCount * sizeof(ProjectTile));
+
+        for (const ProjectTile &entry : entries[i]) tilesBytes += entry.size;
+    }
+
+    // Header goes last, until then the file still describes the previous save
+    ProjectHeader header = {{}, projectVersion, 0, offset, index.size()};
+    memcpy(header.magic, projectMagic, sizeof(projectMagic));
+    ok = ok && WriteAt(fd, index.data(), index.size(), offset) &&
+         WriteAt(fd, &header, sizeof(header), 0);
+    ok = close(fd) == 0 && ok;
+    if (ok && !incremental) ok = rename(target.c_str(), path) == 0;
+
+    if (!ok) {
+        fprintf(stderr, "Unable to save %s\n", path);
+        if (!incremental) unlink(target.c_str());
+        forget();
+        return false;
+    }
+
+    this->path = snapshot.path;
+    this->width = width;
+    this->height = height;
+    fileSize = offset + index.size();
+    liveBytes = sizeof(header) + tilesBytes + index.size();
+    tiles.clear();
+    for (size_t i = 0; i < entries.size(); i++) {
+        tiles[snapshot.layers[i].id] = std::move(entries[i]);
+    }
+
+    return true;
+}
+
+bool ProjectFile::save(const char *path, LayerStack &layers) {
+    uint32_t width = layers.getWidth();
+    uint32_t height = layers.getHeight();
+    uint32_t tilesX = (width + tileSize - 1) / tileSize;
+
+    std::vector<ProjectSnapshot::LayerState> states;
+    for (size_t i = 0; i < layers.getLayersCount(); i++) {
+        const Layer &layer = layers.getLayer(i);
+        states.push_back({layer.id, layer.opacity, layer.isVisible, layer.mode,
+                          layers.getLayerPixels(i), {}});
+    }
+
+    auto isModified = [&](size_t layer, size_t tile) {
+        return layers.isModified(layer, TileRect(tile, tilesX, tileSize, width, height));
+    };
+    ProjectSnapshot first = snapshot(path, width, height, layers.getActiveLayer(),
+                                     std::vector<ProjectSnapshot::LayerState>(states), isModified);
+    bool saved = save(first);
+
+    // Failed save forgets the file, so the second attempt writes everything from scratch
+    if (!saved && first.incremental) {
+        saved = save(snapshot(path, width, height, layers.getActiveLayer(), std::move(states),
+                              isModified));
+    }
+
+    if (saved) layers.markSaved();
+    return saved;
+}
+
+bool ProjectFile::load(const char *path, LayerStack &layers) {
+    int fd = open(path, O_RDONLY);
+    struct stat info;
+    if (fd < 0 || fstat(fd, &info) != 0) {
+        fprintf(stderr, "Unable to open %s\n", path);
+        if (fd >= 0) close(fd);
+        return false;
+    }
+
+    uint64_t size = info.st_size;
+    void *mapping = size ? mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        fprintf(stderr, "Unable to map %s\n", path);
+        return false;
+    }
+    madvise(mapping, size, MADV_WILLNEED);
+    const uint8_t *file = static_cast<const uint8_t *>(mapping);
+
+    auto fail = [&](const char *reason) {
+        fprintf(stderr, "%s: %s\n", path, reason);
+        munmap(mapping, size);
+        return false;
+    };
+
+    ProjectHeader header;
+    if (size < sizeof(header)) return fail("not a project");
+    memcpy(&header, file, sizeof(header));
+    if (memcmp(header.magic, projectMagic, sizeof(projectMagic)) != 0) {
+        return fail("not a project");
+    }
+    if (header.version != projectVersion) return fail("unsupported version");
+    if (header.indexOffset > size || header.indexSize > size - header.indexOffset ||
+        header.indexSize < sizeof(IndexHeader)) {
+        return fail("index is out of the file");
+    }
+
+    IndexHeader indexHeader;
+    memcpy(&indexHeader, file + header.indexOffset, sizeof(indexHeader));
+    uint32_t width = indexHeader.width;
+    uint32_t height = indexHeader.height;
+    uint32_t fileTileSize = indexHeader.tileSize;
+    if (!width || !height || !fileTileSize || !indexHeader.layersCount) {
+        return fail("index is corrupted");
+    }
+
+    uint32_t tilesX = (width + fileTileSize - 1) / fileTileSize;
+    uint32_t tilesY = (height + fileTileSize - 1) / fileTileSize;
+    size_t tilesCount = static_cast<size_t>(tilesX) * tilesY;
+    size_t layerSize = sizeof(LayerRecord) + tilesCount * sizeof(ProjectTile);
+    if (header.indexSize != sizeof(IndexHeader) + indexHeader.layersCount * layerSize) {
+        return fail("index is corrupted");
+    }
+
+    std::vector<Layer> loaded;
+    std::vector<std::vector<ProjectTile>> entries(indexHeader.layersCount);
+    const uint8_t *position = file + header.indexOffset + sizeof(IndexHeader);
+    for (uint32_t i = 0; i < indexHeader.layersCount; i++, position += layerSize) {
+        LayerRecord record;
+        memcpy(&record, position, sizeof(record));
+        if (record.mode > static_cast<uint8_t>(BlendMode::ERASE)) return fail("unknown blend mode");
+
+        entries[i].resize(tilesCount);
+        memcpy(entries[i].data(), position + sizeof(record), tilesCount * sizeof(ProjectTile));
+        for (const ProjectTile &entry : entries[i]) {
+            if (entry.offset > header.indexOffset || entry.size > header.indexOffset - entry.offset) {
+                return fail("tile is out of the file");
+            }
+        }
+
+        loaded.push_back({PixelStorage(static_cast<size_t>(width) * height), record.opacity,
+                          record.isVisible != 0, static_cast<BlendMode>(record.mode), 0, {}});
+    }
+
+    // Storage comes zeroed, transparent tiles are skipped and their pages never touched
+    struct Job {
+        size_t layer;
+        size_t tile;
+    };
+    std::vector<Job> jobs;
+    for (size_t i = 0; i < entries.size(); i++) {
+        for (size_t tile = 0; tile < tilesCount; tile++) {
+            if (entries[i][tile].size || entries[i][tile].color) jobs.push_back({i, tile});
+        }
+    }
+
+    std::atomic<bool> corrupted{false};
+    ThreadPool::Global().parallelFor(jobs.size(), [&](size_t k) {
+        const Job &job = jobs[k];
+        if (!UnpackTile(file, entries[job.layer][job.tile], loaded[job.layer].pixels.data(), width,
+                        TileRect(job.tile, tilesX, fileTileSize, width, height))) {
+            corrupted = true;
+        }
+    });
+    if (corrupted) return fail("tile is corrupted");
+
+    munmap(mapping, size);
+    layers.assign(width, height, std::move(loaded), indexHeader.activeLayer);
+
+    // Tiles of another size can not be reused, the first save rewrites the file
+    forget();
+    if (fileTileSize != tileSize) return true;
+
+    this->path = path;
+    this->width = width;
+    this->height = height;
+    fileSize = size;
+    liveBytes = sizeof(header) + header.indexSize;
+    for (size_t i = 0; i < entries.size(); i++) {
+        for (const ProjectTile &entry : entries[i]) liveBytes += entry.size;
+        tiles[layers.getLayer(i).id] = std::move(entries[i]);
+    }
+
+    return true;
+}
@@ -0,0 +1,75 @@
+#ifndef PROJECT_FILE_HPP_
+#define PROJECT_FILE_HPP_
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "LayerStack.hpp"
+
+// Where a tile of a layer is stored in the file
+struct ProjectTile {
+    uint64_t offset;
+    uint32_t size;   // Compressed bytes, 0 for a tile of a single color
+    uint32_t color;  // Color of a single-colored tile
+};
+
+// Document at some moment: metadata of the layers and the tiles that have to be written, the
+// rest of the tiles are already in the file it is for. Pixels are read from the sources when the
+// snapshot is saved, until then they must not change.
+struct ProjectSnapshot {
+    struct LayerState {
+        uint64_t id;
+        uint8_t opacity;
+        bool isVisible;
+        BlendMode mode;
+        const uint32_t *source;     // Pixels of the whole layer
+        std::vector<size_t> tiles;  // Tiles to write
+    };
+
+    size_t getTilesCount() const;  // To write, over all layers
+
+    std::string path;
+    uint32_t width;
+    uint32_t height;
+    size_t activeLayer;
+    bool incremental;  // Appended to the file, otherwise every tile is listed
+    std::vector<LayerState> layers;
+};
+
+// Native document: a header pointing at the latest index, zlib-compressed tiles of every layer and
+// the index with the metadata of the layers and the location of each of their tiles. Saving to
+// the file that was last saved or loaded appends only the tiles modified since then followed by a
+// new index, and then points the header at it; the file is rewritten from scratch once most of it
+// is dead space. Loading maps the file and decompresses tiles in parallel straight into the layers,
+// single-colored tiles are not stored at all and transparent ones leave their pages untouched.
+class ProjectFile {
+   public:
+    static constexpr uint32_t tileSize = 256;
+    static constexpr int compressionLevel = 1;      // Saves have to be quick
+    static constexpr size_t batchTiles = 256;       // Tiles compressed before they are written out
+    static constexpr uint64_t compactionSlack = 4;  // File may grow to this many times live data
+
+    ProjectFile();
+    // Tiles of layers to write to path: the ones isModified(layer, tile) is true for, or all of
+    // them if the file can not be appended to or does not have the layer yet
+    ProjectSnapshot snapshot(const char *path, uint32_t width, uint32_t height, size_t activeLayer,
+                             std::vector<ProjectSnapshot::LayerState> &&layers,
+                             const std::function<bool(size_t, size_t)> &isModified);
+    bool save(const ProjectSnapshot &snapshot);
+    bool save(const char *path, LayerStack &layers);  // Tiles modified since the last save
+    bool load(const char *path, LayerStack &layers);  // Replaces the layers, false on failure
+    void forget();  // Layers no longer match any file, the next save writes everything
+
+   private:
+    std::string path;  // File the tiles below are in
+    uint32_t width;
+    uint32_t height;
+    uint64_t fileSize;
+    uint64_t liveBytes;                                          // Header, tiles and index in use
+    std::unordered_map<uint64_t, std::vector<ProjectTile>> tiles;  // By id of the layer
+};
+
+#endif  // PROJECT_FILE_HPP_
@@ -0,0 +1,220 @@
+#include "Resample.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <numbers>
+#include <vector>
+
+#include "ThreadPool.hpp"
+
+typedef float Pixel __attribute__((vector_size(16)));  // Premultiplied RGBA, one lane per channel
+typedef uint8_t Bytes __attribute__((vector_size(4)));
+
+// Source pixels contributing to every output pixel along one axis. Every output pixel reads the
+// same number of taps: near the edges the window is shifted inside the image and the weights
+// that fall outside of it are zero.
+struct Taps {
+    uint32_t count;
+    std::vector<uint32_t> first;
+    std::vector<float> weights;  // count per output pixel, summing to 1
+};
+
+static double Radius(ResampleFilter filter) {
+    switch (filter) {
+        case ResampleFilter::BILINEAR:
+            return 1;
+        case ResampleFilter::BICUBIC:
+            return 2;
+        default:
+            return 3;
+    }
+}
+
+static double Kernel(ResampleFilter filter, double x) {
+    x = std::abs(x);
+
+    switch (filter) {
+        case ResampleFilter::BILINEAR:
+            return x < 1 ? 1 - x : 0;
+        case ResampleFilter::BICUBIC:
+            if (x < 1) return (1.5 * x - 2.5) * x * x + 1;
+            if (x < 2) return ((-0.5 * x + 2.5) * x - 4) * x + 2;
+            return 0;
+        default: {
+            if (x >= 3) return 0;
+            if (x < 1e-6) return 1;
+
+            double angle = std::numbers::pi * x;
+            return 3 * std::sin(angle) * std::sin(angle / 3) / (angle * angle);
+        }
+    }
+}
+
+static Taps BuildTaps(uint32_t srcSize, uint32_t dstSize, ResampleFilter filter) {
+    Taps taps;
+    taps.first.resize(dstSize);
+
+    // Axis that keeps its size is a plain copy
+    if (srcSize == dstSize) {
+        taps.count = 1;
+        for (uint32_t i = 0; i < dstSize; i++) taps.first[i] = i;
+        taps.weights.assign(dstSize, 1);
+        return taps;
+    }
+
+    double scale = static_cast<double>(dstSize) / srcSize;
+    double stretch = std::max(1.0, 1 / scale);
+    double support = Radius(filter) * stretch;
+
+    taps.count = std::min<uint32_t>(srcSize, 2 * std::ceil(support) + 1);
+    taps.weights.assign(static_cast<size_t>(dstSize) * taps.count, 0);
+
+    for (uint32_t i = 0; i < dstSize; i++) {
+        double center = (i + 0.5) / scale - 0.5;
+        int64_t from = std::max<int64_t>(0, std::ceil(center - support));
+        int64_t to = std::min<int64_t>(srcSize - 1, std::floor(center + support));
+        uint32_t first = std::min<int64_t>(from, srcSize - taps.count);
+        taps.first[i] = first;
+
+        float *weights = taps.weights.data() + static_cast<size_t>(i) * taps.count;
+        double sum = 0;
+        for (int64_t k = from; k <= to; k++) {
+            double weight = Kernel(filter, (k - center) / stretch);
+            weights[k - first] = weight;
+            sum += weight;
+        }
+
+        if (sum == 0) continue;
+        for (uint32_t k = 0; k < taps.count; k++) weights[k] /= sum;
+    }
+
+    return taps;
+}
+
+static Pixel Premultiply(uint32_t pixel) {
+    Bytes bytes;
+    memcpy(&bytes, &pixel, sizeof(bytes));
+
+    Pixel value = __builtin_convertvector(bytes, Pixel);
+    float alpha = value[3] / 255;
+    return value * Pixel{alpha, alpha, alpha, 1};
+}
+
+static uint32_t Unpremultiply(Pixel value) {
+    // Sharp filters overshoot, colors are kept within the range their alpha allows
+    float alpha = std::min(value[3], 255.f);
+    if (alpha < 0.5f) return 0;
+
+    Pixel limit = {alpha, alpha, alpha, 255};
+    for (int channel = 0; channel < 4; channel++) {
+        value[channel] = std::clamp(value[channel], 0.f, limit[channel]);
+    }
+
+    float factor = 255 / alpha;
+    value = value * Pixel{factor, factor, factor, 1} + 0.5f;
+
+    Bytes bytes = __builtin_convertvector(value, Bytes);
+    uint32_t pixel;
+    memcpy(&pixel, &bytes, sizeof(pixel));
+    return pixel;
+}
+
+// Horizontal pass over a single source row
+static void FilterRow(const uint32_t *src, uint32_t srcWidth, const Taps &taps, uint32_t dstWidth,
+                      Pixel *line, Pixel *out) {
+    for (uint32_t x = 0; x < srcWidth; x++) line[x] = Premultiply(src[x]);
+
+    const float *weights = taps.weights.data();
+    for (uint32_t x = 0; x < dstWidth; x++, weights += taps.count) {
+        const Pixel *pixels = line + taps.first[x];
+
+        Pixel sum = {0, 0, 0, 0};
+        for (uint32_t k = 0; k < taps.count; k++) sum += pixels[k] * weights[k];
+        out[x] = sum;
+    }
+}
+
+static void ScaleNearest(const uint32_t *src, uint32_t srcWidth, uint32_t srcHeight,
+                         uint32_t *dst, uint32_t dstWidth, uint32_t dstHeight) {
+    // Every output pixel takes the source pixel under its center
+    std::vector<uint32_t> columns(dstWidth);
+    for (uint32_t x = 0; x < dstWidth; x++) {
+        columns[x] = (2 * static_cast<uint64_t>(x) + 1) * srcWidth / (2 * dstWidth);
+    }
+
+    size_t bandsCount = (dstHeight + Resampler::bandHeight - 1) / Resampler::bandHeight;
+    ThreadPool::Global().parallelFor(bandsCount, [&](size_t band) {
+        uint32_t yEnd = std::min<uint32_t>(dstHeight, (band + 1) * Resampler::bandHeight);
+        for (uint32_t y = band * Resampler::bandHeight; y < yEnd; y++) {
+            uint64_t row = (2 * static_cast<uint64_t>(y) + 1) * srcHeight / (2 * dstHeight);
+            const uint32_t *srcRow = src + row * srcWidth;
+            uint32_t *dstRow = dst + static_cast<size_t>(y) * dstWidth;
+
+            for (uint32_t x = 0; x < dstWidth; x++) dstRow[x] = srcRow[columns[x]];
+        }
+    });
+}
+
+void Resampler::Scale(const uint32_t *src, uint32_t srcWidth, uint32_t srcHeight, uint32_t *dst,
+                      uint32_t dstWidth, uint32_t dstHeight, ResampleFilter filter) {
+    if (!srcWidth || !srcHeight || !dstWidth || !dstHeight) return;
+
+    if (srcWidth == dstWidth && srcHeight == dstHeight) {
+        memcpy(dst, src, static_cast<size_t>(srcWidth) * srcHeight * sizeof(uint32_t));
+        return;
+    }
+
+    if (filter == ResampleFilter::NEAREST) {
+        ScaleNearest(src, srcWidth, srcHeight, dst, dstWidth, dstHeight);
+        return;
+    }
+
+    Taps columns = BuildTaps(srcWidth, dstWidth, filter);
+    Taps rows = BuildTaps(srcHeight, dstHeight, filter);
+
+    // Source rows needed by a band overlap with the neighbouring bands by the filter support,
+    // those few rows are filtered horizontally twice instead of being shared between tasks
+    size_t bandsCount = (dstHeight + bandHeight - 1) / bandHeight;
+    ThreadPool::Global().parallelFor(bandsCount, [&](size_t band) {
+        uint32_t yFrom = band * bandHeight;
+        uint32_t yTo = std::min<uint32_t>(dstHeight, yFrom + bandHeight);
+        uint32_t rowsFrom = rows.first[yFrom];
+        uint32_t rowsTo = rows.first[yTo - 1] + rows.count;
+
+        std::vector<Pixel> line(srcWidth);
+        std::vector<Pixel> filtered(static_cast<size_t>(rowsTo - rowsFrom) * dstWidth);
+        std::vector<Pixel> sums(dstWidth);
+
+        for (uint32_t row = rowsFrom; row < rowsTo; row++) {
+            FilterRow(src + static_cast<size_t>(row) * srcWidth, srcWidth, columns, dstWidth,
+                      line.data(), filtered.data() + static_cast<size_t>(row - rowsFrom) * dstWidth);
+        }
+
+        // Vertical pass walks whole intermediate rows to keep the reads sequential
+        for (uint32_t y = yFrom; y < yTo; y++) {
+            const float *weights = rows.weights.data() + static_cast<size_t>(y) * rows.count;
+            const Pixel *pixels =
+                filtered.data() + static_cast<size_t>(rows.first[y] - rowsFrom) * dstWidth;
+
+            std::fill(sums.begin(), sums.end(), Pixel{0, 0, 0, 0});
+            for (uint32_t k = 0; k < rows.count; k++, pixels += dstWidth) {
+                if (weights[k] == 0) continue;
+                for (uint32_t x = 0; x < dstWidth; x++) sums[x] += pixels[x] * weights[k];
+            }
+
+            uint32_t *dstRow = dst + static_cast<size_t>(y) * dstWidth;
+            for (uint32_t x = 0; x < dstWidth; x++) dstRow[x] = Unpremultiply(sums[x]);
+        }
+    });
+}
+
+bool Resampler::FitSize(uint32_t &width, uint32_t &height, uint32_t maxWidth, uint32_t maxHeight) {
+    if (width <= maxWidth && height <= maxHeight) return false;
+
+    double scale = std::min(static_cast<double>(maxWidth) / width,
+                            static_cast<double>(maxHeight) / height);
+    width = std::clamp<uint32_t>(std::lround(width * scale), 1, std::max(maxWidth, 1u));
+    height = std::clamp<uint32_t>(std::lround(height * scale), 1, std::max(maxHeight, 1u));
+    return true;
+}
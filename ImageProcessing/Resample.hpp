@@ -0,0 +1,32 @@
+#ifndef RESAMPLE_HPP_
+#define RESAMPLE_HPP_
+#include <cstddef>
+#include <cstdint>
+
+enum class ResampleFilter : uint8_t {
+    NEAREST,
+    BILINEAR,
+    BICUBIC,   // Catmull-Rom
+    LANCZOS3,  // Sharpest, best for downscaling photos
+};
+
+// Image scaling with separable filters: rows are filtered horizontally into a band of
+// intermediate rows that is then filtered vertically. Bands of output rows are independent and
+// run in parallel. Colors are filtered premultiplied by alpha, so transparent pixels do not bleed
+// into their neighbours. When downscaling the filter is stretched to cover every source pixel.
+class Resampler {
+   public:
+    static constexpr uint32_t bandHeight = 64;  // Output rows per task
+
+    // Scale the whole of src into dst, which holds dstWidth * dstHeight pixels
+    static void Scale(const uint32_t *src, uint32_t srcWidth, uint32_t srcHeight, uint32_t *dst,
+                      uint32_t dstWidth, uint32_t dstHeight, ResampleFilter filter);
+    // Shrink width x height keeping its aspect ratio until it fits into maxWidth x maxHeight.
+    // Returns false if the size already fits and is left as it is.
+    static bool FitSize(uint32_t &width, uint32_t &height, uint32_t maxWidth, uint32_t maxHeight);
+
+   private:
+    Resampler();
+};
+
+#endif  // RESAMPLE_HPP_
@@ -0,0 +1,307 @@
+#include "Selection.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "Convolution.hpp"
+#include "ThreadPool.hpp"
+
+// First column at or past x whose coverage is not value, compared eight bytes at a time
+static uint32_t RunEnd(const uint8_t *row, uint32_t x, uint32_t end, uint8_t value) {
+    uint64_t pattern = value * 0x0101010101010101ull;
+    while (x + 8 <= end) {
+        uint64_t bytes;
+        memcpy(&bytes, row + x, sizeof(bytes));
+        if (bytes != pattern) break;
+        x += 8;
+    }
+
+    while (x < end && row[x] == value) x++;
+    return x;
+}
+
+static uint8_t CombineCoverage(SelectionOp op, uint8_t first, uint8_t second) {
+    switch (op) {
+        case SelectionOp::UNION:
+            return std::max(first, second);
+        case SelectionOp::INTERSECT:
+            return std::min(first, second);
+        case SelectionOp::SUBTRACT:
+            return (first * (255 - second) + 127) / 255;
+        default:
+            return second;
+    }
+}
+
+// Partially selected pixels are a mix of the new and the old value
+static void MixSpan(uint32_t *pixels, const uint32_t *result, uint32_t count, uint8_t coverage) {
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t mixed = 0;
+        for (int channel = 0; channel < 4; channel++) {
+            uint32_t updated = (result[i] >> (8 * channel)) & 0xFF;
+            uint32_t old = (pixels[i] >> (8 * channel)) & 0xFF;
+            mixed |= ((updated * coverage + old * (255 - coverage) + 127) / 255) << (8 * channel);
+        }
+        pixels[i] = mixed;
+    }
+}
+
+Selection::Selection() : bounds{0, 0, 0, 0}, rowStarts{0} {}
+
+Selection Selection::FromRect(const PixelRect &rect) {
+    Selection selection;
+    if (rect.isEmpty()) return selection;
+
+    selection.bounds = rect;
+    for (uint32_t y = rect.y0; y < rect.y1; y++) {
+        selection.appendSpan(rect.x0, rect.x1, 255);
+        selection.finishRow();
+    }
+
+    return selection;
+}
+
+Selection Selection::FromMask(const uint8_t *mask, size_t stride, const PixelRect &bounds) {
+    Selection selection;
+    if (bounds.isEmpty()) return selection;
+
+    selection.bounds = bounds;
+    uint32_t width = bounds.x1 - bounds.x0;
+    for (uint32_t y = bounds.y0; y < bounds.y1; y++) {
+        const uint8_t *row = mask + static_cast<size_t>(y - bounds.y0) * stride;
+
+        for (uint32_t x = RunEnd(row, 0, width, 0); x < width;) {
+            uint32_t end = RunEnd(row, x, width, row[x]);
+            selection.appendSpan(bounds.x0 + x, bounds.x0 + end, row[x]);
+            x = RunEnd(row, end, width, 0);
+        }
+        selection.finishRow();
+    }
+
+    selection.trim();
+    return selection;
+}
+
+Selection Selection::Combine(const Selection &first, const Selection &second, SelectionOp op) {
+    if (op == SelectionOp::REPLACE) return second;
+
+    // Rows the result may have, the rest of the work is the same for every operation
+    PixelRect rows = first.bounds;
+    if (op == SelectionOp::UNION) {
+        rows.unite(second.bounds);
+    } else if (op == SelectionOp::INTERSECT) {
+        rows.y0 = std::max(first.bounds.y0, second.bounds.y0);
+        rows.y1 = std::min(first.bounds.y1, second.bounds.y1);
+    }
+
+    Selection result;
+    if (rows.y0 >= rows.y1 || (first.isEmpty() && second.isEmpty())) return result;
+
+    result.bounds = {0, rows.y0, 0, rows.y1};
+    for (uint32_t y = rows.y0; y < rows.y1; y++) {
+        bool inFirst = y >= first.bounds.y0 && y < first.bounds.y1;
+        bool inSecond = y >= second.bounds.y0 && y < second.bounds.y1;
+        const SelectionSpan *a = inFirst ? first.rowBegin(y) : nullptr;
+        const SelectionSpan *aEnd = inFirst ? first.rowEnd(y) : nullptr;
+        const SelectionSpan *b = inSecond ? second.rowBegin(y) : nullptr;
+        const SelectionSpan *bEnd = inSecond ? second.rowEnd(y) : nullptr;
+
+        // Sweep over the boundaries of both rows, coverage is constant between two of them
+        uint32_t x = 0;
+        while (true) {
+            while (a != aEnd && a->x1 <= x) a++;
+            while (b != bEnd && b->x1 <= x) b++;
+            if (a == aEnd && b == bEnd) break;
+
+            uint8_t coverageA = a != aEnd && a->x0 <= x ? a->coverage : 0;
+            uint8_t coverageB = b != bEnd && b->x0 <= x ? b->coverage : 0;
+
+            uint32_t next = UINT32_MAX;
+            if (a != aEnd) next = std::min(next, a->x0 > x ? a->x0 : a->x1);
+            if (b != bEnd) next = std::min(next, b->x0 > x ? b->x0 : b->x1);
+
+            if (coverageA || coverageB) {
+                result.appendSpan(x, next, CombineCoverage(op, coverageA, coverageB));
+            }
+            x = next;
+        }
+        result.finishRow();
+    }
+
+    result.trim();
+    return result;
+}
+
+Selection Selection::feathered(float radius, uint32_t width, uint32_t height) const {
+    if (isEmpty() || radius < 0.5f) return *this;
+
+    // Blur reaches about three sigma, the area around the bounds catches all of it
+    uint32_t reach = std::ceil(radius) + 2;
+    PixelRect area = {bounds.x0 > reach ? bounds.x0 - reach : 0,
+                      bounds.y0 > reach ? bounds.y0 - reach : 0, bounds.x1 + reach,
+                      bounds.y1 + reach};
+    area.clip(width, height);
+    uint32_t areaWidth = area.x1 - area.x0;
+    uint32_t areaHeight = area.y1 - area.y0;
+    size_t pixelsCount = static_cast<size_t>(areaWidth) * areaHeight;
+
+    // Coverage is blurred as the alpha of a black image, clamping keeps the selection going past
+    // the image edges it touches
+    std::vector<uint8_t> coverage(pixelsCount);
+    toMask(coverage.data(), area);
+
+    std::vector<uint32_t> pixels(pixelsCount);
+    for (size_t i = 0; i < pixelsCount; i++) pixels[i] = static_cast<uint32_t>(coverage[i]) << 24;
+    Convolution::GaussianBlur(pixels.data(), pixels.data(), areaWidth, areaHeight, radius / 3,
+                              EdgeMode::CLAMP);
+    for (size_t i = 0; i < pixelsCount; i++) coverage[i] = pixels[i] >> 24;
+
+    return FromMask(coverage.data(), areaWidth, area);
+}
+
+void Selection::toMask(uint8_t *mask, const PixelRect &rect) const {
+    uint32_t width = rect.x1 - rect.x0;
+    for (uint32_t y = rect.y0; y < rect.y1; y++) {
+        uint8_t *row = mask + static_cast<size_t>(y - rect.y0) * width;
+        memset(row, 0, width);
+        if (y < bounds.y0 || y >= bounds.y1) continue;
+
+        for (const SelectionSpan *span = rowBegin(y); span != rowEnd(y); span++) {
+            uint32_t from = std::max(span->x0, rect.x0);
+            uint32_t to = std::min(span->x1, rect.x1);
+            if (from < to) memset(row + (from - rect.x0), span->coverage, to - from);
+        }
+    }
+}
+
+void Selection::clipMask(uint8_t *mask, size_t stride, const PixelRect &rect) const {
+    if (rect.isEmpty()) return;
+
+    size_t bandsCount = (rect.y1 - rect.y0 + bandHeight - 1) / bandHeight;
+    ThreadPool::Global().parallelFor(bandsCount, [&](size_t band) {
+        uint32_t yFrom = rect.y0 + band * bandHeight;
+        uint32_t yTo = std::min(rect.y1, yFrom + bandHeight);
+
+        for (uint32_t y = yFrom; y < yTo; y++) {
+            uint8_t *row = mask + (y - rect.y0) * stride;
+
+            // Gaps between spans are cleared, feathered runs are scaled down
+            uint32_t x = rect.x0;
+            if (y >= bounds.y0 && y < bounds.y1) {
+                for (const SelectionSpan *span = rowBegin(y); span != rowEnd(y); span++) {
+                    if (span->x1 <= x) continue;
+                    if (span->x0 >= rect.x1) break;
+
+                    uint32_t from = std::max(span->x0, x);
+                    uint32_t to = std::min(span->x1, rect.x1);
+                    memset(row + (x - rect.x0), 0, from - x);
+                    if (span->coverage != 255) {
+                        for (uint32_t i = from - rect.x0; i < to - rect.x0; i++) {
+                            row[i] = (row[i] * span->coverage + 127) / 255;
+                        }
+                    }
+                    x = to;
+                }
+            }
+            memset(row + (x - rect.x0), 0, rect.x1 - x);
+        }
+    });
+}
+
+void Selection::apply(uint32_t *pixels, size_t stride, const uint32_t *result,
+                      size_t resultStride, const PixelRect &rect) const {
+    // Only rows of the bounds have anything selected
+    uint32_t yFirst = std::max(rect.y0, bounds.y0);
+    uint32_t yLast = std::min(rect.y1, bounds.y1);
+    if (rect.isEmpty() || yFirst >= yLast) return;
+
+    size_t bandsCount = (yLast - yFirst + bandHeight - 1) / bandHeight;
+    ThreadPool::Global().parallelFor(bandsCount, [&](size_t band) {
+        uint32_t yFrom = yFirst + band * bandHeight;
+        uint32_t yTo = std::min(yLast, yFrom + bandHeight);
+
+        for (uint32_t y = yFrom; y < yTo; y++) {
+            uint32_t *row = pixels + y * stride;
+            const uint32_t *updated = result + (y - rect.y0) * resultStride;
+
+            for (const SelectionSpan *span = rowBegin(y); span != rowEnd(y); span++) {
+                if (span->x1 <= rect.x0) continue;
+                if (span->x0 >= rect.x1) break;
+
+                uint32_t from = std::max(span->x0, rect.x0);
+                uint32_t to = std::min(span->x1, rect.x1);
+                if (span->coverage == 255) {
+                    memcpy(row + from, updated + (from - rect.x0), (to - from) * sizeof(uint32_t));
+                } else {
+                    MixSpan(row + from, updated + (from - rect.x0), to - from, span->coverage);
+                }
+            }
+        }
+    });
+}
+
+bool Selection::isEmpty() const { return spans.empty(); }
+
+PixelRect Selection::getBounds() const { return bounds; }
+
+size_t Selection::getSpansCount() const { return spans.size(); }
+
+size_t Selection::getMemoryUsage() const {
+    return rowStarts.capacity() * sizeof(uint32_t) + spans.capacity() * sizeof(SelectionSpan);
+}
+
+const SelectionSpan *Selection::rowBegin(uint32_t y) const {
+    return spans.data() + rowStarts[y - bounds.y0];
+}
+
+const SelectionSpan *Selection::rowEnd(uint32_t y) const {
+    return spans.data() + rowStarts[y - bounds.y0 + 1];
+}
+
+void Selection::appendSpan(uint32_t x0, uint32_t x1, uint8_t coverage) {
+    if (x0 >= x1 || coverage == 0) return;
+
+    // Neighbouring runs of the same coverage are one span
+    if (spans.size() > rowStarts.back()) {
+        SelectionSpan &last = spans.back();
+        if (last.x1 == x0 && last.coverage == coverage) {
+            last.x1 = x1;
+            return;
+        }
+    }
+
+    spans.push_back({x0, x1, coverage});
+}
+
+void Selection::finishRow() { rowStarts.push_back(spans.size()); }
+
+void Selection::trim() {
+    uint32_t rows = bounds.y1 - bounds.y0;
+    uint32_t first = 0;
+    while (first < rows && rowStarts[first] == rowStarts[first + 1]) first++;
+    if (first == rows) {
+        *this = Selection();
+        return;
+    }
+
+    uint32_t last = rows;
+    while (rowStarts[last - 1] == rowStarts[last]) last--;
+
+    // Leading empty rows all start at zero, dropping them keeps the index valid
+    rowStarts.erase(rowStarts.begin() + last + 1, rowStarts.end());
+    rowStarts.erase(rowStarts.begin(), rowStarts.begin() + first);
+    bounds.y1 = bounds.y0 + last;
+    bounds.y0 += first;
+
+    bounds.x0 = UINT32_MAX;
+    bounds.x1 = 0;
+    for (uint32_t row = 0; row + 1 < rowStarts.size(); row++) {
+        if (rowStarts[row] == rowStarts[row + 1]) continue;
+        bounds.x0 = std::min(bounds.x0, spans[rowStarts[row]].x0);
+        bounds.x1 = std::max(bounds.x1, spans[rowStarts[row + 1] - 1].x1);
+    }
+
+    spans.shrink_to_fit();
+    rowStarts.shrink_to_fit();
+}
@@ -0,0 +1,70 @@
+#ifndef SELECTION_HPP_
+#define SELECTION_HPP_
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "MipPyramid.hpp"
+
+// Columns [x0, x1) of a row that share the same coverage
+struct SelectionSpan {
+    uint32_t x0;
+    uint32_t x1;
+    uint8_t coverage;  // 255 for fully selected pixels, less on feathered edges
+};
+
+enum class SelectionOp : uint8_t {
+    REPLACE,
+    UNION,      // Maximum of the coverages
+    INTERSECT,  // Minimum of the coverages
+    SUBTRACT,   // First one with the coverage of the second one taken away
+};
+
+// Selected pixels of an image stored as sorted runs of equal coverage per row, only for the rows
+// of the bounds. A hard-edged selection costs a few spans per row whatever its area, feathering
+// only adds short spans along the edges. Clipping walks the spans and moves or clears whole runs
+// at once.
+class Selection {
+   public:
+    static constexpr uint32_t bandHeight = 64;  // Rows per task when clipping
+
+    Selection();  // Nothing is selected
+    static Selection FromRect(const PixelRect &rect);
+    // Mask has a byte of coverage per pixel of bounds, starting at its top left corner, with rows
+    // stride bytes apart
+    static Selection FromMask(const uint8_t *mask, size_t stride, const PixelRect &bounds);
+    static Selection Combine(const Selection &first, const Selection &second, SelectionOp op);
+
+    // Edges fade out over radius pixels on either side, the result is clipped to the image
+    Selection feathered(float radius, uint32_t width, uint32_t height) const;
+    // Coverage of rect into mask with rows of rect width bytes, unselected pixels are zero
+    void toMask(uint8_t *mask, const PixelRect &rect) const;
+
+    // Scale the coverage of rect by the selection, unselected pixels become zero. Mask starts at
+    // the top left corner of rect and has rows stride bytes apart
+    void clipMask(uint8_t *mask, size_t stride, const PixelRect &rect) const;
+    // Copy the selected pixels of rect from result into pixels, partially selected ones are mixed.
+    // Pixels has rows of stride pixels, result starts at the top left corner of rect and has rows
+    // resultStride pixels apart
+    void apply(uint32_t *pixels, size_t stride, const uint32_t *result, size_t resultStride,
+               const PixelRect &rect) const;
+
+    bool isEmpty() const;
+    PixelRect getBounds() const;
+    size_t getSpansCount() const;
+    size_t getMemoryUsage() const;  // Bytes taken by the spans and the row index
+
+   private:
+    // Spans of row y of the bounds, begin and end
+    const SelectionSpan *rowBegin(uint32_t y) const;
+    const SelectionSpan *rowEnd(uint32_t y) const;
+    void appendSpan(uint32_t x0, uint32_t x1, uint8_t coverage);  // To the last row
+    void finishRow();
+    void trim();  // Shrink bounds to the rows and columns that have spans
+
+    PixelRect bounds;
+    std::vector<uint32_t> rowStarts;  // Index of the first span of every row of bounds, then end
+    std::vector<SelectionSpan> spans;
+};
+
+#endif  // SELECTION_HPP_
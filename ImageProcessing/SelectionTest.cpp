@@ -0,0 +1,266 @@
+// Test of Selection against a coverage map with a byte per pixel: selections made from masks and
+// combined in every way select the same pixels as the map, with tight bounds and a span per run,
+// and clipping and applying scale pixels the way the map says
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#include "../Testing.hpp"
+#include "Selection.hpp"
+
+constexpr uint32_t imageWidth = 70;
+constexpr uint32_t imageHeight = 140;  // Clipping goes over more than one band
+constexpr uint32_t timingSize = 4096;
+
+// Coverage of every pixel of the image
+typedef std::vector<uint8_t> CoverageMap;
+
+static uint8_t CombineCoverage(SelectionOp op, uint8_t first, uint8_t second) {
+    switch (op) {
+        case SelectionOp::UNION:
+            return std::max(first, second);
+        case SelectionOp::INTERSECT:
+            return std::min(first, second);
+        case SelectionOp::SUBTRACT:
+            return (first * (255 - second) + 127) / 255;
+        default:
+            return second;
+    }
+}
+
+// Map of a few overlapping rectangles of random coverage, and the selection made from it. The
+// mask given to the selection has empty rows and columns around the rectangles and padding at the
+// end of its rows, so that trimming has work to do.
+static Selection RandomSelection(std::mt19937 &random, CoverageMap &map) {
+    map.assign(imageWidth * imageHeight, 0);
+
+    PixelRect area = {static_cast<uint32_t>(random() % 30), static_cast<uint32_t>(random() % 60),
+                      0, 0};
+    area.x1 = area.x0 + 1 + random() % (imageWidth - area.x0);
+    area.y1 = area.y0 + 1 + random() % (imageHeight - area.y0);
+
+    uint32_t rectsCount = random() % 5;  // Sometimes nothing is selected at all
+    for (uint32_t i = 0; i < rectsCount; i++) {
+        uint32_t x0 = area.x0 + random() % (area.x1 - area.x0);
+        uint32_t y0 = area.y0 + random() % (area.y1 - area.y0);
+        uint32_t x1 = x0 + 1 + random() % (area.x1 - x0);
+        uint32_t y1 = y0 + 1 + random() % (area.y1 - y0);
+        uint8_t coverage = random() % 2 ? 255 : 1 + random() % 254;
+
+        for (uint32_t y = y0; y < y1; y++) {
+            std::fill(map.begin() + y * imageWidth + x0, map.begin() + y * imageWidth + x1,
+                      coverage);
+        }
+    }
+
+    uint32_t stride = area.x1 - area.x0 + 3;
+    std::vector<uint8_t> mask(stride * (area.y1 - area.y0), 0xAA);
+    for (uint32_t y = area.y0; y < area.y1; y++) {
+        std::copy(map.begin() + y * imageWidth + area.x0, map.begin() + y * imageWidth + area.x1,
+                  mask.begin() + (y - area.y0) * stride);
+    }
+
+    return Selection::FromMask(mask.data(), stride, area);
+}
+
+static PixelRect MapBounds(const CoverageMap &map) {
+    PixelRect bounds = {0, 0, 0, 0};
+    for (uint32_t y = 0; y < imageHeight; y++) {
+        for (uint32_t x = 0; x < imageWidth; x++) {
+            if (map[y * imageWidth + x]) bounds.unite({x, y, x + 1, y + 1});
+        }
+    }
+
+    return bounds;
+}
+
+// Runs of equal coverage, which is the number of spans a selection needs
+static size_t MapRuns(const CoverageMap &map) {
+    size_t runs = 0;
+    for (uint32_t y = 0; y < imageHeight; y++) {
+        for (uint32_t x = 0; x < imageWidth; x++) {
+            uint8_t coverage = map[y * imageWidth + x];
+            if (coverage && (x == 0 || map[y * imageWidth + x - 1] != coverage)) runs++;
+        }
+    }
+
+    return runs;
+}
+
+static bool Matches(const Selection &selection, const CoverageMap &map) {
+    CoverageMap coverage(map.size());
+    selection.toMask(coverage.data(), {0, 0, imageWidth, imageHeight});
+
+    PixelRect bounds = MapBounds(map);
+    return coverage == map && selection.getBounds() == bounds &&
+           selection.isEmpty() == bounds.isEmpty() && selection.getSpansCount() == MapRuns(map);
+}
+
+static void TestFromMask() {
+    std::mt19937 random(44);
+    for (int i = 0; i < 200; i++) {
+        CoverageMap map;
+        Selection selection = RandomSelection(random, map);
+        CHECK(Matches(selection, map));
+    }
+
+    // Rectangle takes a span per row whatever its width
+    Selection rect = Selection::FromRect({3, 4, 60, 100});
+    CHECK(rect.getSpansCount() == 96);
+    CHECK(rect.getBounds() == (PixelRect{3, 4, 60, 100}));
+}
+
+static void TestCombine() {
+    std::mt19937 random(45);
+    const SelectionOp ops[] = {SelectionOp::REPLACE, SelectionOp::UNION, SelectionOp::INTERSECT,
+                               SelectionOp::SUBTRACT};
+
+    for (int i = 0; i < 200; i++) {
+        CoverageMap firstMap;
+        CoverageMap secondMap;
+        Selection first = RandomSelection(random, firstMap);
+        Selection second = RandomSelection(random, secondMap);
+
+        for (SelectionOp op : ops) {
+            CoverageMap expected(firstMap.size());
+            for (size_t pixel = 0; pixel < expected.size(); pixel++) {
+                expected[pixel] = CombineCoverage(op, firstMap[pixel], secondMap[pixel]);
+            }
+            CHECK(Matches(Selection::Combine(first, second, op), expected));
+        }
+    }
+
+    // Selections that do not overlap leave nothing when intersected or subtracted from each other
+    Selection top = Selection::FromRect({0, 0, 10, 10});
+    Selection bottom = Selection::FromRect({0, 20, 10, 30});
+    CHECK(Selection::Combine(top, bottom, SelectionOp::INTERSECT).isEmpty());
+    CHECK(Selection::Combine(top, top, SelectionOp::SUBTRACT).isEmpty());
+    CHECK(Selection::Combine(Selection(), top, SelectionOp::SUBTRACT).isEmpty());
+    CHECK(Selection::Combine(Selection(), top, SelectionOp::UNION).getBounds() ==
+          top.getBounds());
+}
+
+// Coverage of a mask is scaled by the selection, bytes past the rect stay as they are
+static void TestClipMask() {
+    std::mt19937 random(46);
+    for (int i = 0; i < 100; i++) {
+        CoverageMap map;
+        Selection selection = RandomSelection(random, map);
+
+        PixelRect rect = {static_cast<uint32_t>(random() % imageWidth),
+                          static_cast<uint32_t>(random() % imageHeight), imageWidth, imageHeight};
+        rect.x1 = rect.x0 + random() % (imageWidth - rect.x0 + 1);
+        uint32_t width = rect.x1 - rect.x0;
+        uint32_t height = rect.y1 - rect.y0;
+        size_t stride = width + 5;
+
+        std::vector<uint8_t> mask(stride * height);
+        for (uint8_t &byte : mask) byte = random();
+        std::vector<uint8_t> expected = mask;
+        for (uint32_t y = 0; y < height; y++) {
+            for (uint32_t x = 0; x < width; x++) {
+                uint8_t coverage = map[(rect.y0 + y) * imageWidth + rect.x0 + x];
+                uint8_t &byte = expected[y * stride + x];
+                byte = (byte * coverage + 127) / 255;
+            }
+        }
+
+        selection.clipMask(mask.data(), stride, rect);
+        CHECK(mask == expected);
+    }
+}
+
+// Selected pixels take the result, partially selected ones a mix of both
+static void TestApply() {
+    std::mt19937 random(47);
+    for (int i = 0; i < 100; i++) {
+        CoverageMap map;
+        Selection selection = RandomSelection(random, map);
+
+        PixelRect rect = {static_cast<uint32_t>(random() % imageWidth),
+                          static_cast<uint32_t>(random() % imageHeight), imageWidth, imageHeight};
+        uint32_t width = rect.x1 - rect.x0;
+        uint32_t height = rect.y1 - rect.y0;
+
+        std::vector<uint32_t> pixels(imageWidth * imageHeight);
+        std::vector<uint32_t> result(width * height);
+        for (uint32_t &pixel : pixels) pixel = random();
+        for (uint32_t &pixel : result) pixel = random();
+
+        std::vector<uint32_t> expected = pixels;
+        for (uint32_t y = rect.y0; y < rect.y1; y++) {
+            for (uint32_t x = rect.x0; x < rect.x1; x++) {
+                uint32_t coverage = map[y * imageWidth + x];
+                uint32_t updated = result[(y - rect.y0) * width + x - rect.x0];
+                uint32_t &pixel = expected[y * imageWidth + x];
+
+                uint32_t mixed = 0;
+                for (int shift = 0; shift < 32; shift += 8) {
+                    uint32_t channel = ((updated >> shift) & 0xFF) * coverage +
+                                       ((pixel >> shift) & 0xFF) * (255 - coverage);
+                    mixed |= ((channel + 127) / 255) << shift;
+                }
+                pixel = mixed;
+            }
+        }
+
+        selection.apply(pixels.data(), imageWidth, result.data(), width, rect);
+        CHECK(pixels == expected);
+    }
+}
+
+// Feathered edges fall off away from the selection and stay within its reach, edges on the border
+// of the image stay selected
+static void TestFeathered() {
+    float radius = 6;
+    uint32_t reach = 8;
+    Selection rect = Selection::FromRect({20, 40, 50, 100});
+    Selection feathered = rect.feathered(radius, imageWidth, imageHeight);
+
+    CoverageMap coverage(imageWidth * imageHeight);
+    feathered.toMask(coverage.data(), {0, 0, imageWidth, imageHeight});
+    PixelRect bounds = feathered.getBounds();
+    CHECK(bounds.x0 >= 20 - reach && bounds.x1 <= 50 + reach);
+    CHECK(bounds.y0 >= 40 - reach && bounds.y1 <= 100 + reach);
+
+    const uint8_t *row = coverage.data() + 70 * imageWidth;
+    CHECK(row[35] == 255);
+    CHECK(row[20] > 64 && row[20] < 192 && row[49] > 64 && row[49] < 192);
+    for (uint32_t x = 35; x + 1 < imageWidth; x++) CHECK(row[x + 1] <= row[x]);
+    for (uint32_t x = 35; x > 0; x--) CHECK(row[x - 1] <= row[x]);
+
+    Selection corner =
+        Selection::FromRect({0, 0, 30, 30}).feathered(radius, imageWidth, imageHeight);
+    CoverageMap cornerCoverage(imageWidth * imageHeight);
+    corner.toMask(cornerCoverage.data(), {0, 0, imageWidth, imageHeight});
+    CHECK(cornerCoverage[0] == 255);
+    CHECK(corner.getBounds().x0 == 0 && corner.getBounds().y0 == 0);
+}
+
+// Combining stripes of the whole height of a large image costs a few spans per row
+static void TestCombineCost() {
+    Selection first = Selection::FromRect({0, 0, timingSize / 2, timingSize});
+    Selection second = Selection::FromRect({timingSize / 4, 0, timingSize, timingSize});
+
+    auto start = std::chrono::steady_clock::now();
+    Selection combined = Selection::Combine(first, second, SelectionOp::SUBTRACT);
+    double elapsed =
+        std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+
+    CHECK(combined.getBounds() == (PixelRect{0, 0, timingSize / 4, timingSize}));
+    printf("combine: %u x %u, %zu spans, %.2f us\n", timingSize, timingSize,
+           combined.getSpansCount(), elapsed);
+}
+
+int main() {
+    TestFromMask();
+    TestCombine();
+    TestClipMask();
+    TestApply();
+    TestFeathered();
+    TestCombineCost();
+    return TestResult();
+}
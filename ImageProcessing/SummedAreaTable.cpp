@@ -0,0 +1,147 @@
+#include "SummedAreaTable.hpp"
+
+#include <algorithm>
+
+#include "ThreadPool.hpp"
+
+static uint32_t MeanColor(const ChannelSums &sums, uint64_t area) {
+    uint32_t color = 0;
+    for (int channel = 0; channel < 4; channel++) {
+        uint64_t average = (sums.channels[channel] + area / 2) / area;
+        color |= static_cast<uint32_t>(average) << (8 * channel);
+    }
+
+    return color;
+}
+
+SummedAreaTable::SummedAreaTable() : width(0), height(0), staleX(0), staleY(0) {}
+
+void SummedAreaTable::reset(uint32_t width, uint32_t height) {
+    this->width = width;
+    this->height = height;
+    staleX = 0;
+    staleY = 0;
+
+    // Table is only allocated once someone asks for it
+    table.clear();
+    table.shrink_to_fit();
+}
+
+void SummedAreaTable::markDirty(const PixelRect &rect) {
+    if (rect.isEmpty()) return;
+
+    staleX = std::min(staleX, rect.x0);
+    staleY = std::min(staleY, rect.y0);
+}
+
+bool SummedAreaTable::isStale() { return staleX < width && staleY < height; }
+
+void SummedAreaTable::update(const uint32_t *pixels) {
+    if (table.empty()) {
+        table.assign(static_cast<size_t>(width + 1) * (height + 1) * 4, 0);
+        staleX = 0;
+        staleY = 0;
+    }
+
+    if (!isStale()) return;
+
+    size_t stride = static_cast<size_t>(width + 1) * 4;
+    uint32_t x0 = staleX;
+    uint32_t y0 = staleY;
+
+    // Rows are turned into running sums along the row, continuing from the fresh entries on the
+    // left of the stale part
+    size_t bandsCount = (height - y0 + bandHeight - 1) / bandHeight;
+    ThreadPool::Global().parallelFor(bandsCount, [&](size_t band) {
+        uint32_t yFrom = y0 + band * bandHeight;
+        uint32_t yTo = std::min(height, yFrom + bandHeight);
+
+        for (uint32_t y = yFrom; y < yTo; y++) {
+            const uint32_t *row = pixels + static_cast<size_t>(y) * width;
+            const uint64_t *above = table.data() + y * stride + x0 * 4;
+            uint64_t *entry = table.data() + (y + 1) * stride + x0 * 4;
+
+            uint64_t sums[4];
+            for (int channel = 0; channel < 4; channel++) {
+                sums[channel] = entry[channel] - above[channel];
+            }
+
+            for (uint32_t x = x0; x < width; x++) {
+                entry += 4;
+                for (int channel = 0; channel < 4; channel++) {
+                    sums[channel] += (row[x] >> (8 * channel)) & 0xFF;
+                    entry[channel] = sums[channel];
+                }
+            }
+        }
+    });
+
+    // Then every entry gets the one above it added, top to bottom, in independent strips
+    size_t columns = width - x0;
+    size_t stripsCount = (columns + stripWidth - 1) / stripWidth;
+    ThreadPool::Global().parallelFor(stripsCount, [&](size_t strip) {
+        size_t from = (x0 + 1 + strip * stripWidth) * 4;
+        size_t to = (x0 + 1 + std::min(columns, (strip + 1) * stripWidth)) * 4;
+
+        for (uint32_t y = y0 + 1; y <= height; y++) {
+            uint64_t *row = table.data() + y * stride;
+            const uint64_t *above = row - stride;
+            for (size_t i = from; i < to; i++) row[i] += above[i];
+        }
+    });
+
+    staleX = width;
+    staleY = height;
+}
+
+ChannelSums SummedAreaTable::sum(const PixelRect &rect) {
+    PixelRect clipped = rect;
+    clipped.clip(width, height);
+
+    ChannelSums result = {{0, 0, 0, 0}};
+    if (clipped.isEmpty() || table.empty()) return result;
+
+    size_t stride = static_cast<size_t>(width + 1) * 4;
+    const uint64_t *top = table.data() + clipped.y0 * stride;
+    const uint64_t *bottom = table.data() + clipped.y1 * stride;
+    for (int channel = 0; channel < 4; channel++) {
+        result.channels[channel] = bottom[clipped.x1 * 4 + channel] -
+                                   bottom[clipped.x0 * 4 + channel] -
+                                   top[clipped.x1 * 4 + channel] + top[clipped.x0 * 4 + channel];
+    }
+
+    return result;
+}
+
+uint32_t SummedAreaTable::mean(const PixelRect &rect) {
+    PixelRect clipped = rect;
+    clipped.clip(width, height);
+    if (clipped.isEmpty()) return 0;
+
+    uint64_t area = static_cast<uint64_t>(clipped.x1 - clipped.x0) * (clipped.y1 - clipped.y0);
+    return MeanColor(sum(clipped), area);
+}
+
+uint32_t SummedAreaTable::DirectMean(const uint32_t *pixels, uint32_t width, uint32_t height,
+                                     const PixelRect &rect) {
+    PixelRect clipped = rect;
+    clipped.clip(width, height);
+    if (clipped.isEmpty()) return 0;
+
+    ChannelSums sums = {{0, 0, 0, 0}};
+    for (uint32_t y = clipped.y0; y < clipped.y1; y++) {
+        const uint32_t *row = pixels + static_cast<size_t>(y) * width;
+        for (uint32_t x = clipped.x0; x < clipped.x1; x++) {
+            for (int channel = 0; channel < 4; channel++) {
+                sums.channels[channel] += (row[x] >> (8 * channel)) & 0xFF;
+            }
+        }
+    }
+
+    uint64_t area = static_cast<uint64_t>(clipped.x1 - clipped.x0) * (clipped.y1 - clipped.y0);
+    return MeanColor(sums, area);
+}
+
+uint32_t SummedAreaTable::getWidth() { return width; }
+
+uint32_t SummedAreaTable::getHeight() { return height; }
@@ -0,0 +1,48 @@
+#ifndef SUMMED_AREA_TABLE_HPP_
+#define SUMMED_AREA_TABLE_HPP_
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "MipPyramid.hpp"
+
+// Sums of every channel of the pixels of a rectangle, red first
+struct ChannelSums {
+    uint64_t channels[4];
+};
+
+// Every entry holds the per-channel sums of all the pixels above and to the left of it, so the
+// sum over any rectangle is four lookups. Changes only make the entries below and to the right of
+// them stale; the table is brought up to date lazily, on the first query after a change, starting
+// from the topmost changed row and the leftmost changed column.
+class SummedAreaTable {
+   public:
+    static constexpr uint32_t bandHeight = 64;   // Rows per task of the row pass
+    static constexpr uint32_t stripWidth = 256;  // Columns per task of the column pass
+    // Table takes 32 bytes per pixel, larger images are better off summing small rects directly
+    static constexpr uint64_t maxPixels = uint64_t(1) << 27;
+
+    SummedAreaTable();
+    void reset(uint32_t width, uint32_t height);  // New image, everything is stale
+    void markDirty(const PixelRect &rect);        // Pixels of the image were changed
+    void update(const uint32_t *pixels);          // Recompute the stale part, pixels are RGBA
+    bool isStale();
+
+    ChannelSums sum(const PixelRect &rect);  // Rect is clipped to the image, table must be fresh
+    uint32_t mean(const PixelRect &rect);    // Rounded average color, 0 for an empty rect
+    // Same average summed straight from the pixels, without a table
+    static uint32_t DirectMean(const uint32_t *pixels, uint32_t width, uint32_t height,
+                               const PixelRect &rect);
+    uint32_t getWidth();
+    uint32_t getHeight();
+
+   private:
+    uint32_t width;
+    uint32_t height;
+    // (width + 1) x (height + 1) entries of 4 sums, first row and column are zero
+    std::vector<uint64_t> table;
+    uint32_t staleX;  // Entries of image pixels at or past both of these are stale
+    uint32_t staleY;
+};
+
+#endif  // SUMMED_AREA_TABLE_HPP_
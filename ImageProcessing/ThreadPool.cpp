@@ -0,0 +1,93 @@
+#include "ThreadPool.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+
+ThreadPool::ThreadPool(size_t threadsCount) : stopping(false) {
+    if (threadsCount == 0) threadsCount = 1;
+
+    for (size_t i = 0; i < threadsCount; i++) {
+        workers.emplace_back(&ThreadPool::workerLoop, this);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    hasTasks.notify_all();
+
+    for (auto &worker : workers) {
+        worker.join();
+    }
+}
+
+void ThreadPool::workerLoop() {
+    while (true) {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            hasTasks.wait(lock, [this] { return stopping || !tasks.empty(); });
+            if (tasks.empty()) return;
+
+            task = std::move(tasks.front());
+            tasks.pop();
+        }
+
+        task();
+    }
+}
+
+void ThreadPool::submit(std::function<void()> task) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        tasks.push(std::move(task));
+    }
+    hasTasks.notify_one();
+}
+
+void ThreadPool::parallelFor(size_t count, const std::function<void(size_t)> &body) {
+    if (count == 0) return;
+
+    // Workers and the calling thread grab indices from a shared counter, so the call never
+    // deadlocks even if all workers are busy with someone else's job
+    struct Job {
+        std::atomic<size_t> next{0};
+        std::atomic<size_t> finished{0};
+        std::mutex mutex;
+        std::condition_variable done;
+    };
+    auto job = std::make_shared<Job>();
+
+    auto runner = [job, count, &body] {
+        size_t completed = 0;
+        for (size_t i = job->next++; i < count; i = job->next++) {
+            body(i);
+            completed++;
+        }
+
+        if (completed && job->finished.fetch_add(completed) + completed == count) {
+            std::lock_guard<std::mutex> lock(job->mutex);
+            job->done.notify_all();
+        }
+    };
+
+    size_t helpers = std::min(count - 1, workers.size());
+    for (size_t i = 0; i < helpers; i++) {
+        submit(runner);
+    }
+
+    runner();
+
+    std::unique_lock<std::mutex> lock(job->mutex);
+    job->done.wait(lock, [&] { return job->finished == count; });
+}
+
+size_t ThreadPool::getThreadsCount() { return workers.size(); }
+
+ThreadPool &ThreadPool::Global() {
+    static ThreadPool pool(std::thread::hardware_concurrency());
+    return pool;
+}
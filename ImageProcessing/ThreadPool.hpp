@@ -0,0 +1,36 @@
+#ifndef THREAD_POOL_HPP_
+#define THREAD_POOL_HPP_
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+// Fixed-size pool of worker threads shared by the image processing engines
+class ThreadPool {
+   public:
+    explicit ThreadPool(size_t threadsCount);
+    ~ThreadPool();
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    void submit(std::function<void()> task);  // Run task asynchronously
+    void parallelFor(size_t count,
+                     const std::function<void(size_t)> &body);  // Run body(0..count-1) and wait
+    size_t getThreadsCount();
+
+    static ThreadPool &Global();  // Pool with one thread per hardware core
+
+   private:
+    void workerLoop();
+
+    std::vector<std::thread> workers;
+    std::queue<std::function<void()>> tasks;
+    std::mutex mutex;
+    std::condition_variable hasTasks;
+    bool stopping;
+};
+
+#endif  // THREAD_POOL_HPP_
@@ -0,0 +1,182 @@
+#include "RenderCommands.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+void FrameRect::unite(const FrameRect &other) {
+    if (other.isEmpty()) return;
+
+    if (isEmpty()) {
+        *this = other;
+        return;
+    }
+
+    x0 = std::min(x0, other.x0);
+    y0 = std::min(y0, other.y0);
+    x1 = std::max(x1, other.x1);
+    y1 = std::max(y1, other.y1);
+}
+
+void FrameRect::clip(const FrameRect &bounds) {
+    x0 = std::max(x0, bounds.x0);
+    y0 = std::max(y0, bounds.y0);
+    x1 = std::min(x1, bounds.x1);
+    y1 = std::min(y1, bounds.y1);
+}
+
+static inline uint64_t Mix(uint64_t hash, uint64_t value) {
+    hash ^= value + 0x9E3779B97F4A7C15ull + (hash << 6) + (hash >> 2);
+    hash *= 0xFF51AFD7ED558CCDull;
+    return hash ^ (hash >> 32);
+}
+
+static inline uint64_t FloatBits(float value) {
+    uint32_t bits = 0;
+    memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+// Hash of a payload slice, eight bytes at a time
+static uint64_t HashBytes(const void *data, size_t size, uint64_t hash) {
+    const uint8_t *bytes = static_cast<const uint8_t *>(data);
+
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8) {
+        uint64_t word = 0;
+        memcpy(&word, bytes + i, sizeof(word));
+        hash = Mix(hash, word);
+    }
+
+    uint64_t tail = 0;
+    memcpy(&tail, bytes + i, size - i);
+    return Mix(hash, tail ^ size);
+}
+
+static FrameRect OuterRect(float x, float y, float width, float height) {
+    return {static_cast<int>(std::floor(x)), static_cast<int>(std::floor(y)),
+            static_cast<int>(std::ceil(x + width)), static_cast<int>(std::ceil(y + height))};
+}
+
+FrameRect EstimateTextBounds(float x, float y, uint32_t characterSize, const wchar_t *text,
+                             size_t length) {
+    uint32_t lines = 1;
+    uint32_t longestLine = 0;
+    uint32_t currentLine = 0;
+
+    for (size_t i = 0; i < length; i++) {
+        if (text[i] == L'\n') {
+            lines++;
+            currentLine = 0;
+        } else {
+            longestLine = std::max(longestLine, ++currentLine);
+        }
+    }
+
+    return OuterRect(x, y, static_cast<float>(longestLine) * characterSize,
+                     2.0f * lines * characterSize);
+}
+
+void RenderFrame::analyze() {
+    hashes.resize(commands.size());
+    bounds.resize(commands.size());
+
+    std::vector<size_t> offScreenStarts;
+
+    for (size_t i = 0; i < commands.size(); i++) {
+        const RenderCommand &command = commands[i];
+        uint64_t hash = Mix(0, command.type);
+
+        switch (command.type) {
+            case RenderCommand::QUAD: {
+                const RenderCommand::Quad &quad = command.quad;
+                hash = Mix(hash, FloatBits(quad.x) | FloatBits(quad.y) << 32);
+                hash = Mix(hash, FloatBits(quad.width) | FloatBits(quad.height) << 32);
+                hash = Mix(hash, FloatBits(quad.u) | FloatBits(quad.v) << 32);
+                hash = Mix(hash, FloatBits(quad.uWidth) | FloatBits(quad.vHeight) << 32);
+                hash = Mix(hash, quad.color | static_cast<uint64_t>(quad.page) << 32);
+                bounds[i] = OuterRect(quad.x, quad.y, quad.width, quad.height);
+                break;
+            }
+
+            case RenderCommand::TEXT: {
+                const RenderCommand::Text &text = command.text;
+                hash = Mix(hash, FloatBits(text.x) | FloatBits(text.y) << 32);
+                hash = Mix(hash, text.characterSize);
+                hash = HashBytes(this->text.data() + text.offset, text.length * sizeof(wchar_t),
+                                 hash);
+                bounds[i] = EstimateTextBounds(text.x, text.y, text.characterSize,
+                                               this->text.data() + text.offset, text.length);
+                break;
+            }
+
+            case RenderCommand::BITMAP: {
+                const RenderCommand::Bitmap &bitmap = command.bitmap;
+                hash = Mix(hash, FloatBits(bitmap.x) | FloatBits(bitmap.y) << 32);
+                hash = Mix(hash, FloatBits(bitmap.scale));
+                hash = Mix(hash, bitmap.width | static_cast<uint64_t>(bitmap.height) << 32);
+
+                // Version the caller gave stands for the pixels, which may not be in the frame
+                hash = Mix(hash, bitmap.handle);
+                hash = Mix(hash, bitmap.version);
+                bounds[i] = OuterRect(bitmap.x, bitmap.y, bitmap.width * bitmap.scale,
+                                      bitmap.height * bitmap.scale);
+                break;
+            }
+
+            case RenderCommand::BEGIN_OFF_SCREEN:
+            case RenderCommand::END_OFF_SCREEN: {
+                const RenderCommand::OffScreen &offScreen = command.offScreen;
+                hash = Mix(hash, static_cast<uint32_t>(offScreen.x) |
+                                     static_cast<uint64_t>(static_cast<uint32_t>(offScreen.y)) << 32);
+                hash = Mix(hash, offScreen.width | static_cast<uint64_t>(offScreen.height) << 32);
+
+                if (command.type == RenderCommand::BEGIN_OFF_SCREEN) {
+                    offScreenStarts.push_back(i);
+                } else if (!offScreenStarts.empty()) {
+                    // Whole off-screen block lands where it is flushed, so every command inside
+                    // shares its bounds
+                    size_t start = offScreenStarts.back();
+                    offScreenStarts.pop_back();
+
+                    const RenderCommand::OffScreen &begin = commands[start].offScreen;
+                    FrameRect block = {offScreen.x, offScreen.y,
+                                       offScreen.x + static_cast<int>(begin.width),
+                                       offScreen.y + static_cast<int>(begin.height)};
+                    std::fill(bounds.begin() + start, bounds.begin() + i + 1, block);
+                }
+                break;
+            }
+
+            case RenderCommand::SET_CLIP: {
+                const FrameRect &clip = command.clip;
+                hash = Mix(hash, static_cast<uint32_t>(clip.x0) |
+                                     static_cast<uint64_t>(static_cast<uint32_t>(clip.y0)) << 32);
+                hash = Mix(hash, static_cast<uint32_t>(clip.x1) |
+                                     static_cast<uint64_t>(static_cast<uint32_t>(clip.y1)) << 32);
+                bounds[i] = clip;
+                break;
+            }
+        }
+
+        hashes[i] = hash;
+    }
+}
+
+bool RenderFrame::diff(const RenderFrame &previous, FrameRect &changed) const {
+    changed = {0, 0, 0, 0};
+
+    // Only frames that differ in place are handled, insertions and removals redraw everything
+    if (previous.commands.size() != commands.size()) return false;
+
+    for (size_t i = 0; i < commands.size(); i++) {
+        if (previous.commands[i].type != commands[i].type) return false;
+        if (previous.hashes[i] == hashes[i]) continue;
+
+        // Old content has to be erased and new one drawn
+        changed.unite(previous.bounds[i]);
+        changed.unite(bounds[i]);
+    }
+
+    return true;
+}
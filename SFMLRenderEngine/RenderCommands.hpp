@@ -0,0 +1,102 @@
+#ifndef RENDER_COMMANDS_HPP_
+#define RENDER_COMMANDS_HPP_
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Screen rectangle, [x0, x1) x [y0, y1)
+struct FrameRect {
+    int x0;
+    int y0;
+    int x1;
+    int y1;
+
+    bool operator==(const FrameRect &other) const = default;
+    bool isEmpty() const { return x0 >= x1 || y0 >= y1; }
+    bool intersects(const FrameRect &other) const {
+        return x0 < other.x1 && other.x0 < x1 && y0 < other.y1 && other.y0 < y1;
+    }
+    void unite(const FrameRect &other);
+    void clip(const FrameRect &bounds);
+};
+
+// Single recorded drawing operation. Coordinates are final: global offsets are applied when the
+// command is recorded, so the render thread does not need any state of the window tree.
+struct RenderCommand {
+    enum TYPE : uint8_t {
+        QUAD,              // Textured quad sampled from an atlas page
+        TEXT,              // Text from the text payload of the frame
+        BITMAP,            // Texture of a bitmap handle, updated from the pixel payload if it has any
+        BEGIN_OFF_SCREEN,  // Following commands go to a new off-screen target
+        END_OFF_SCREEN,    // Off-screen target is drawn to the previous one and dropped
+        SET_CLIP,          // Following commands are clipped to the rect
+    };
+
+    struct Quad {
+        float x, y, width, height;   // Destination
+        float u, v, uWidth, vHeight;  // Source region on the page
+        uint32_t color;               // RGBA, red in the lowest byte
+        uint32_t page;
+    };
+
+    struct Text {
+        float x, y;
+        uint32_t characterSize;
+        uint32_t offset;  // Position of the text in the text payload
+        uint32_t length;
+    };
+
+    struct Bitmap {
+        float x, y;
+        float scale;
+        uint32_t width, height;
+        uint64_t handle;
+        uint64_t version;  // Identifies the pixels, they are not compared
+        size_t offset;     // Position of new pixels in the pixel payload
+        bool hasPixels;    // Otherwise the texture of the handle is up to date
+    };
+
+    struct OffScreen {
+        int x, y;  // Position of the target when it is flushed
+        uint32_t width, height;
+    };
+
+    TYPE type;
+    union {
+        Quad quad;
+        Text text;
+        Bitmap bitmap;
+        OffScreen offScreen;
+        FrameRect clip;
+    };
+};
+
+// Generous estimate of the area text may cover: glyphs are measured on the render thread only, and
+// no glyph is wider than the character size while lines are less than twice as high
+FrameRect EstimateTextBounds(float x, float y, uint32_t characterSize, const wchar_t *text,
+                             size_t length);
+
+// Everything recorded between Clear and Display
+struct RenderFrame {
+    std::vector<RenderCommand> commands;
+    std::vector<wchar_t> text;
+    std::vector<uint32_t> pixels;
+
+    // Filled by analyze
+    std::vector<uint64_t> hashes;   // Hash of every command with its text, or bitmap version
+    std::vector<FrameRect> bounds;  // Screen area every command may touch
+    FrameRect dirty;                // Area that differs from the previous frame on the screen
+
+    void clear() {
+        commands.clear();
+        text.clear();
+        pixels.clear();
+    }
+
+    void analyze();  // Compute hashes and bounds of the commands
+    // Area of the screen that changes if this frame replaces previous. False if the frames are too
+    // different to tell, e.g. have different structure.
+    bool diff(const RenderFrame &previous, FrameRect &changed) const;
+};
+
+#endif  // RENDER_COMMANDS_HPP_
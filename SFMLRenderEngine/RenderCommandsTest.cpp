@@ -0,0 +1,65 @@
+// Test of RenderFrame analysis: bitmaps are compared by their version, so a frame that carries
+// pixels and one that reuses the texture are the same frame, and a new version redraws the bitmap
+
+#include <chrono>
+#include <cstdio>
+
+#include "../Testing.hpp"
+#include "RenderCommands.hpp"
+
+constexpr uint32_t bitmapWidth = 4096;
+constexpr uint32_t bitmapHeight = 2048;
+constexpr size_t framesCount = 1000;
+
+static void RecordFrame(RenderFrame &frame, uint64_t version, bool hasPixels) {
+    frame.clear();
+
+    RenderCommand &quad = frame.commands.emplace_back();
+    quad.type = RenderCommand::QUAD;
+    quad.quad = {0, 0, 100, 20, 0, 0, 0, 0, 0xFFFFFFFF, 0};
+
+    RenderCommand &bitmap = frame.commands.emplace_back();
+    bitmap.type = RenderCommand::BITMAP;
+    bitmap.bitmap = {200, 100, 0.25f, bitmapWidth, bitmapHeight, 1, version, 0, hasPixels};
+    if (hasPixels) frame.pixels.assign(static_cast<size_t>(bitmapWidth) * bitmapHeight, version);
+
+    frame.analyze();
+}
+
+static void TestDiff() {
+    RenderFrame previous;
+    RenderFrame frame;
+    FrameRect changed;
+
+    // Pixels sent with a version are not looked at again
+    RecordFrame(previous, 1, true);
+    RecordFrame(frame, 1, false);
+    CHECK(frame.diff(previous, changed));
+    CHECK(changed.isEmpty());
+
+    // New version redraws the area of the bitmap only
+    RecordFrame(previous, 1, false);
+    RecordFrame(frame, 2, true);
+    CHECK(frame.diff(previous, changed));
+    CHECK(changed == (FrameRect{200, 100, 200 + bitmapWidth / 4, 100 + bitmapHeight / 4}));
+}
+
+// Analysis of a frame with a large bitmap does not depend on its size
+static void TestAnalysisCost() {
+    RenderFrame frame;
+    RecordFrame(frame, 1, true);
+
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < framesCount; i++) frame.analyze();
+    double elapsed =
+        std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+
+    printf("analyze: %u x %u bitmap, %.2f us per frame\n", bitmapWidth, bitmapHeight,
+           elapsed / framesCount);
+}
+
+int main() {
+    TestDiff();
+    TestAnalysisCost();
+    return TestResult();
+}
@@ -1,35 +1,60 @@
 #ifndef RENDERENGINE_HPP_
 #define RENDERENGINE_HPP_
 #include <SFML/Graphics.hpp>
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
 #include <stack>
+#include <thread>
+#include <unordered_map>
 
 #include "../Color.hpp"
 #include "../Event.hpp"
+#include "RenderCommands.hpp"
+#include "TextureAtlas.hpp"
 
+// Drawing functions only record commands into a frame. Display hands the frame over to the render
+// thread, which replays it with SFML while the next frame is being recorded. Frames are compared
+// with the previous one: identical frames are not submitted at all, and only the changed area of
+// the others is redrawn into a persistent copy of the screen.
 class RenderEngine {
    public:
     static void Init(unsigned int width, unsigned int height);  // Initialization
     static void Finalize();                                     // Finalization
     static bool Run();                                          // Do one loop iteration
-    static void Clear();                                        // Function that clears window
-    static void Display();             // Function that displays new content on window
+    static void Clear();                                        // Start recording a new frame
+    static void Display();             // Submit recorded frame to the render thread if it changed
     static bool PollEvent(Event& ev);  // Event polling
+    static bool Wait(uint32_t milliseconds);  // Sleep until timeout or RequestFrame, true if woken
+    static void RequestFrame();  // Interrupt Wait, may be called from any thread
+    static uint32_t GetTime();   // Milliseconds since initialization, same clock as timestamps
+    static void SetVerticalSync(bool isEnabled);  // Present frames in sync with the display
     static void DrawRect(int x, int y, unsigned int width, unsigned int height, Color bkgColor,
                          Color frgColor, float thickness);                       // Draw rectangle
     static void DrawTexture(int x, int y, unsigned int width, unsigned int height, uint64_t texture_descriptor); // Draw texture
     static void DrawText(int x, int y, const wchar_t* text, int characterSize);  // Draw text
+    static float MeasureText(const wchar_t* text, int characterSize);  // Width of text as drawn
     static void InitOffScreen(
         unsigned int width, unsigned int height);  // Initialize new target for off-screen rendering
     static void FlushOffScreen(int x, int y);      // Render off-screen buffer at a certain position
-    static void DrawBitmap(int x, int y, uint32_t width, uint32_t height,
-                           uint32_t* data);      // Draw array of pixels
+    static uint64_t CreateBitmap();  // Handle for DrawBitmap, its texture is kept between frames
+    // Draw pixels with rows stride pixels apart. They are only read, and uploaded once, when the
+    // version differs from the one last drawn with the handle; otherwise the texture is reused
+    static void DrawBitmap(uint64_t bitmap, uint64_t version, int x, int y, uint32_t width,
+                           uint32_t height, const uint32_t *data, uint32_t stride,
+                           float scale = 1);
     static void pushGlobalOffset(int x, int y);  // Push offset settings on the stack
     static void pushRelGlobalOffset(int x, int y);
-    static uint64_t LoadTexture(const char *texture); // Load texture and return its descriptor 
+    static uint64_t LoadTexture(const char *texture);  // Load texture into the atlas and return its
+                                                       // descriptor. Same path gives same descriptor
     static int getGlobalXOffset();
     static int getGlobalYOffset();
     static void popGlobalOffset();  // Pop offset settings
-    static void SaveToImage(const wchar_t *path, uint32_t *img, unsigned int width, unsigned int height);
+    static void pushClip(int x, int y, unsigned int width,
+                         unsigned int height);  // Clip drawing to the rect, nested clips intersect
+    static void popClip();
+    static void SaveToImage(const wchar_t *path, const uint32_t *img, unsigned int width, unsigned int height);
     static std::tuple<unsigned int, unsigned int, uint32_t *> LoadFromImage(const wchar_t *path);
     // static void RenderToMain(); // Set current target to mainWindow
     // static void SetRenderTarget(RenderTarget* target); // Set current render target
@@ -39,12 +64,64 @@ class RenderEngine {
                                Event& ev);  // Translate SFML event into own event type
     static Event::MOUSE_BUTTON TranslateMouseButton(
         sf::Mouse::Button button);  // Translate SFML mouse key identifier to own event system
+    static uint8_t CurrentModifiers();  // Modifier keys that are currently held down
+
+    // Recording, happens on the thread that traverses windows
+    static RenderCommand &Record(RenderCommand::TYPE type);  // Append command to the frame
+    static bool PrepareRecord(const FrameRect &bounds);  // False if bounds are clipped away,
+                                                         // otherwise makes the current clip active
+    static void RecordQuad(size_t page, const sf::FloatRect &dst, const sf::FloatRect &src,
+                           const Color &color);
+    static void RecordSolidQuad(float x, float y, float width, float height, const Color &color);
+
+    // Replaying, happens on the render thread
+    static void RenderLoop();
+    static void Replay(const RenderFrame &frame);
+    static void PushQuad(const sf::Texture *texture, const RenderCommand::Quad &quad);  // Append
+                                                                                        // to batch
+    static void FlushBatch();  // Submit batched geometry to the current target
+    static void ApplyClip(sf::RenderTarget *target, const FrameRect &clip);  // Scissor via view
+    static void UploadBitmap(const RenderFrame &frame, const RenderCommand::Bitmap &bitmap);
+
+    // Glyph metrics of one character size, filled on the first use
+    struct FontMetrics {
+        std::unordered_map<uint32_t, float> advances;
+        std::unordered_map<uint64_t, float> kernings;  // By pair of characters
+    };
+
     static std::stack<sf::Vector2i> globalOffsets;  // Global drawing offset
+    static std::stack<FrameRect> clips;             // Clip rects in screen coordinates
+    static FrameRect recordedClip;                  // Clip the frame has last switched to
+    static int offScreenDepth;  // Off-screen targets have their own coordinates and no clipping
     static std::stack<sf::RenderTarget*>
         targets;  // Stack of off-screen targets for nested viewports and such
-    static std::vector<sf::Texture> textures;
+    static TextureAtlas atlas;              // All the textures loaded with LoadTexture
+    static std::vector<sf::Vertex> batch;   // Quads waiting to be drawn with a single call
+    static const sf::Texture *batchTexture;  // Atlas page the batch samples from
+    static std::unordered_map<uint64_t, std::unique_ptr<sf::Texture>>
+        bitmapTextures;                                       // By handle, render thread only
+    static std::unordered_map<uint64_t, uint64_t> bitmapVersions;  // Recorded last, by handle
+    static uint64_t nextBitmap;
+    static std::unordered_map<int, FontMetrics> fontMetrics;  // By character size, recording only
+    static sf::RenderTexture frameCache;  // Screen contents, updated in the dirty area only
     static sf::RenderWindow mainWindow;  // System window for displaying anything
     static sf::Font defaultFont;         // Default text font
+    static sf::Clock clock;              // Source of event timestamps
+
+    static RenderFrame frames[2];    // One frame is recorded while the other one is replayed
+    static size_t recordingFrame;    // Index of the frame being recorded
+    static bool hasPreviousFrame;    // Other frame holds what is on the screen
+    static std::thread renderThread;
+    static std::mutex frameMutex;  // Guards the flags below
+    static std::condition_variable frameCondition;
+    static bool frameReady;        // Frame is submitted but not yet picked up
+    static bool renderBusy;        // Render thread is replaying a frame
+    static bool stopping;
+    static std::mutex resourceMutex;  // Atlas is modified by one thread and sampled by the other
+    static std::mutex wakeMutex;      // Guards frameRequested
+    static std::condition_variable wakeCondition;
+    static bool frameRequested;
+    static std::atomic<int> verticalSync;  // Requested vsync state, -1 once applied
     RenderEngine();  // Private constructor ensures that class is a singletone indeed
 };
 #endif  // RENDERENGINE_HPP_
\ No newline at end of file
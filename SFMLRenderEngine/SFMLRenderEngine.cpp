@@ -1,14 +1,42 @@
 #include <SFML/Graphics.hpp>
 #include <locale>
 #include <codecvt>
+#include <chrono>
+#include <cmath>
 #include <cstring>
+#include <cwchar>
 #include "RenderEngine.hpp"
 
 sf::RenderWindow RenderEngine::mainWindow;
 sf::Font RenderEngine::defaultFont;
 std::stack<sf::Vector2i> RenderEngine::globalOffsets;
 std::stack<sf::RenderTarget *> RenderEngine::targets;
-std::vector<sf::Texture> RenderEngine::textures;
+std::stack<FrameRect> RenderEngine::clips;
+FrameRect RenderEngine::recordedClip;
+int RenderEngine::offScreenDepth = 0;
+TextureAtlas RenderEngine::atlas;
+std::vector<sf::Vertex> RenderEngine::batch;
+const sf::Texture *RenderEngine::batchTexture = nullptr;
+sf::Clock RenderEngine::clock;
+std::unordered_map<uint64_t, std::unique_ptr<sf::Texture>> RenderEngine::bitmapTextures;
+std::unordered_map<uint64_t, uint64_t> RenderEngine::bitmapVersions;
+uint64_t RenderEngine::nextBitmap = 1;
+std::unordered_map<int, RenderEngine::FontMetrics> RenderEngine::fontMetrics;
+RenderFrame RenderEngine::frames[2];
+sf::RenderTexture RenderEngine::frameCache;
+size_t RenderEngine::recordingFrame = 0;
+bool RenderEngine::hasPreviousFrame = false;
+std::thread RenderEngine::renderThread;
+std::mutex RenderEngine::frameMutex;
+std::condition_variable RenderEngine::frameCondition;
+bool RenderEngine::frameReady = false;
+bool RenderEngine::renderBusy = false;
+bool RenderEngine::stopping = false;
+std::mutex RenderEngine::resourceMutex;
+std::mutex RenderEngine::wakeMutex;
+std::condition_variable RenderEngine::wakeCondition;
+bool RenderEngine::frameRequested = false;
+std::atomic<int> RenderEngine::verticalSync = -1;
 
 void RenderEngine::Init(unsigned int width, unsigned int height) {
     mainWindow.create(sf::VideoMode(width, height), "My window system", sf::Style::None);
@@ -17,22 +45,96 @@ void RenderEngine::Init(unsigned int width, unsigned int height) {
         exit(-1);
     }
 
-    targets.push(&mainWindow);
     pushGlobalOffset(0, 0);
+    clips.push({0, 0, static_cast<int>(width), static_cast<int>(height)});
+
+    // Solid quads are recorded with the white block of page 0 without taking the resource lock,
+    // so the page has to exist before the render thread starts reading the atlas
+    atlas.prepare();
+
+    // Window keeps being polled here, but its context belongs to the render thread from now on
+    mainWindow.setActive(false);
+    renderThread = std::thread(RenderLoop);
 }
 
 void RenderEngine::Finalize() {
+    {
+        std::lock_guard<std::mutex> lock(frameMutex);
+        stopping = true;
+    }
+    frameCondition.notify_all();
+    if (renderThread.joinable()) renderThread.join();
+
     if (!mainWindow.isOpen()) {
         mainWindow.close();
     }
 }
 
 void RenderEngine::Clear() {
-    mainWindow.clear();
+    frames[recordingFrame].clear();
+    recordedClip = clips.top();
 }
 
 void RenderEngine::Display() {
-    mainWindow.display();
+    RenderFrame &frame = frames[recordingFrame];
+    frame.analyze();
+
+    // Previous frame is only read here, so it can be compared while it is being replayed
+    FrameRect screen = {0, 0, static_cast<int>(mainWindow.getSize().x),
+                        static_cast<int>(mainWindow.getSize().y)};
+    if (!hasPreviousFrame || !frame.diff(frames[recordingFrame ^ 1], frame.dirty)) {
+        frame.dirty = screen;
+    } else if (frame.dirty.isEmpty()) {
+        return;  // Exactly the same frame is on the screen already
+    }
+    frame.dirty.clip(screen);
+    hasPreviousFrame = true;
+
+    std::unique_lock<std::mutex> lock(frameMutex);
+
+    // Other frame is free once the render thread is done with it
+    frameCondition.wait(lock, [] { return !frameReady && !renderBusy; });
+
+    frameReady = true;
+    recordingFrame ^= 1;
+    frameCondition.notify_all();
+}
+
+void RenderEngine::RenderLoop() {
+    mainWindow.setActive(true);
+    frameCache.create(mainWindow.getSize().x, mainWindow.getSize().y);
+    frameCache.clear();
+    targets.push(&frameCache);
+
+    std::unique_lock<std::mutex> lock(frameMutex);
+    while (true) {
+        frameCondition.wait(lock, [] { return frameReady || stopping; });
+        if (!frameReady) break;
+
+        // Frame that was submitted last is the one not being recorded
+        const RenderFrame &frame = frames[recordingFrame ^ 1];
+        frameReady = false;
+        renderBusy = true;
+        lock.unlock();
+
+        // Vsync belongs to the context, which is only active on this thread
+        int vsync = verticalSync.exchange(-1);
+        if (vsync >= 0) mainWindow.setVerticalSyncEnabled(vsync);
+
+        Replay(frame);
+
+        frameCache.display();
+        mainWindow.clear();
+        mainWindow.draw(sf::Sprite(frameCache.getTexture()));
+        mainWindow.display();
+
+        lock.lock();
+        renderBusy = false;
+        frameCondition.notify_all();
+    }
+
+    targets.pop();
+    mainWindow.setActive(false);
 }
 
 bool RenderEngine::Run() {
@@ -42,13 +144,42 @@ bool RenderEngine::Run() {
 bool RenderEngine::PollEvent(Event &ev) {
     sf::Event sfmlEv;
     while (mainWindow.pollEvent(sfmlEv)) {
-        if (TranslateEvent(sfmlEv, ev))
+        if (TranslateEvent(sfmlEv, ev)) {
+            ev.timestamp = GetTime();
+            ev.modifiers = CurrentModifiers();
             return true;
+        }
     }
 
     return false;
 }
 
+bool RenderEngine::Wait(uint32_t milliseconds) {
+    // SFML cannot wait for input with a timeout, so callers keep milliseconds short when they need
+    // to respond to input quickly
+    std::unique_lock<std::mutex> lock(wakeMutex);
+    bool isWoken = wakeCondition.wait_for(lock, std::chrono::milliseconds(milliseconds),
+                                          [] { return frameRequested; });
+    frameRequested = false;
+    return isWoken;
+}
+
+void RenderEngine::RequestFrame() {
+    {
+        std::lock_guard<std::mutex> lock(wakeMutex);
+        frameRequested = true;
+    }
+    wakeCondition.notify_all();
+}
+
+uint32_t RenderEngine::GetTime() {
+    return clock.getElapsedTime().asMilliseconds();
+}
+
+void RenderEngine::SetVerticalSync(bool isEnabled) {
+    verticalSync = isEnabled;
+}
+
 Event::MOUSE_BUTTON RenderEngine::TranslateMouseButton(sf::Mouse::Button button) {
     switch (button) {
         case sf::Mouse::Left:
@@ -65,12 +196,42 @@ Event::MOUSE_BUTTON RenderEngine::TranslateMouseButton(sf::Mouse::Button button)
     }
 }
 
+uint8_t RenderEngine::CurrentModifiers() {
+    uint8_t modifiers = Event::MOD_NONE;
+
+    if (sf::Keyboard::isKeyPressed(sf::Keyboard::LShift) ||
+        sf::Keyboard::isKeyPressed(sf::Keyboard::RShift))
+        modifiers |= Event::MOD_SHIFT;
+
+    if (sf::Keyboard::isKeyPressed(sf::Keyboard::LControl) ||
+        sf::Keyboard::isKeyPressed(sf::Keyboard::RControl))
+        modifiers |= Event::MOD_CTRL;
+
+    if (sf::Keyboard::isKeyPressed(sf::Keyboard::LAlt) ||
+        sf::Keyboard::isKeyPressed(sf::Keyboard::RAlt))
+        modifiers |= Event::MOD_ALT;
+
+    if (sf::Keyboard::isKeyPressed(sf::Keyboard::LSystem) ||
+        sf::Keyboard::isKeyPressed(sf::Keyboard::RSystem))
+        modifiers |= Event::MOD_SYSTEM;
+
+    return modifiers;
+}
+
 bool RenderEngine::TranslateEvent(sf::Event sfmlEv, Event &ev) {
     switch (sfmlEv.type) {
         case sf::Event::Closed:
             ev.eventType = EV_CLOSED;
             break;
 
+        case sf::Event::GainedFocus:
+            ev.eventType = EV_FOCUS_GAINED;
+            break;
+
+        case sf::Event::LostFocus:
+            ev.eventType = EV_FOCUS_LOST;
+            break;
+
         case sf::Event::MouseButtonPressed:
             ev.eventType = EV_MOUSE_KEY_PRESS;
             ev.mouse.x = sfmlEv.mouseButton.x;
@@ -105,7 +266,14 @@ bool RenderEngine::TranslateEvent(sf::Event sfmlEv, Event &ev) {
         case sf::Event::TextEntered:
             ev.eventType = EV_TEXT;
             ev.keyboard.character = sfmlEv.text.unicode;
-            fprintf(stderr, "Generated EV_TEXT event for character %c\n", ev.keyboard.character);
+            break;
+
+        case sf::Event::MouseWheelScrolled:
+            ev.eventType = EV_MOUSE_WHEEL;
+            ev.wheel.x = sfmlEv.mouseWheelScroll.x;
+            ev.wheel.y = sfmlEv.mouseWheelScroll.y;
+            ev.wheel.delta = std::lround(sfmlEv.mouseWheelScroll.delta * 100);
+            ev.wheel.isHorizontal = sfmlEv.mouseWheelScroll.wheel == sf::Mouse::HorizontalWheel;
             break;
 
         default:
@@ -115,44 +283,321 @@ bool RenderEngine::TranslateEvent(sf::Event sfmlEv, Event &ev) {
     return true;
 }
 
+static uint32_t PackColor(const Color &color) {
+    return color.red | (color.green << 8) | (color.blue << 16) | (static_cast<uint32_t>(color.alpha) << 24);
+}
+
+static sf::Color UnpackColor(uint32_t color) {
+    return sf::Color(color & 0xFF, (color >> 8) & 0xFF, (color >> 16) & 0xFF, color >> 24);
+}
+
+RenderCommand &RenderEngine::Record(RenderCommand::TYPE type) {
+    RenderCommand &command = frames[recordingFrame].commands.emplace_back();
+    command.type = type;
+    return command;
+}
+
+bool RenderEngine::PrepareRecord(const FrameRect &bounds) {
+    if (offScreenDepth > 0) return true;
+
+    // Anything outside of the clip never reaches the render thread
+    const FrameRect &clip = clips.top();
+    if (!bounds.intersects(clip)) return false;
+
+    // Clip changes are recorded lazily, so that push/pop pairs with nothing visible in between
+    // do not break batches
+    if (!(clip == recordedClip)) {
+        Record(RenderCommand::SET_CLIP).clip = clip;
+        recordedClip = clip;
+    }
+
+    return true;
+}
+
+void RenderEngine::RecordQuad(size_t page, const sf::FloatRect &dst, const sf::FloatRect &src,
+                              const Color &color) {
+    FrameRect bounds = {static_cast<int>(std::floor(dst.left)), static_cast<int>(std::floor(dst.top)),
+                        static_cast<int>(std::ceil(dst.left + dst.width)),
+                        static_cast<int>(std::ceil(dst.top + dst.height))};
+    if (!PrepareRecord(bounds)) return;
+
+    RenderCommand::Quad &quad = Record(RenderCommand::QUAD).quad;
+    quad = {dst.left, dst.top, dst.width, dst.height,
+            src.left, src.top, src.width, src.height,
+            PackColor(color), static_cast<uint32_t>(page)};
+}
+
+void RenderEngine::RecordSolidQuad(float x, float y, float width, float height,
+                                   const Color &color) {
+    if (color.alpha == 0 || width <= 0 || height <= 0) return;
+
+    sf::Vector2f white = atlas.getWhitePixel();
+    RecordQuad(0, sf::FloatRect(x, y, width, height), sf::FloatRect(white.x, white.y, 0, 0), color);
+}
+
+void RenderEngine::PushQuad(const sf::Texture *texture, const RenderCommand::Quad &quad) {
+    if (texture != batchTexture) {
+        FlushBatch();
+        batchTexture = texture;
+    }
+
+    sf::Color color = UnpackColor(quad.color);
+
+    sf::Vector2f topLeft(quad.x, quad.y);
+    sf::Vector2f topRight(quad.x + quad.width, quad.y);
+    sf::Vector2f bottomLeft(quad.x, quad.y + quad.height);
+    sf::Vector2f bottomRight(quad.x + quad.width, quad.y + quad.height);
+
+    sf::Vector2f texTopLeft(quad.u, quad.v);
+    sf::Vector2f texTopRight(quad.u + quad.uWidth, quad.v);
+    sf::Vector2f texBottomLeft(quad.u, quad.v + quad.vHeight);
+    sf::Vector2f texBottomRight(quad.u + quad.uWidth, quad.v + quad.vHeight);
+
+    batch.emplace_back(topLeft, color, texTopLeft);
+    batch.emplace_back(topRight, color, texTopRight);
+    batch.emplace_back(bottomLeft, color, texBottomLeft);
+    batch.emplace_back(bottomLeft, color, texBottomLeft);
+    batch.emplace_back(topRight, color, texTopRight);
+    batch.emplace_back(bottomRight, color, texBottomRight);
+}
+
+void RenderEngine::FlushBatch() {
+    if (batch.empty()) return;
+
+    targets.top()->draw(batch.data(), batch.size(), sf::Triangles, sf::RenderStates(batchTexture));
+    batch.clear();
+}
+
+void RenderEngine::ApplyClip(sf::RenderTarget *target, const FrameRect &clip) {
+    // View that maps the rect onto the same pixels of the target acts as a scissor
+    sf::Vector2f size(target->getSize().x, target->getSize().y);
+    sf::View view(sf::FloatRect(clip.x0, clip.y0, clip.x1 - clip.x0, clip.y1 - clip.y0));
+    view.setViewport(sf::FloatRect(clip.x0 / size.x, clip.y0 / size.y,
+                                   (clip.x1 - clip.x0) / size.x, (clip.y1 - clip.y0) / size.y));
+    target->setView(view);
+}
+
+void RenderEngine::UploadBitmap(const RenderFrame &frame, const RenderCommand::Bitmap &bitmap) {
+    std::unique_ptr<sf::Texture> &texture = bitmapTextures[bitmap.handle];
+    if (!texture) texture = std::make_unique<sf::Texture>();
+
+    // Texture is only recreated when the size changes
+    if (texture->getSize() != sf::Vector2u(bitmap.width, bitmap.height)) {
+        texture->create(bitmap.width, bitmap.height);
+    }
+    texture->update(reinterpret_cast<const uint8_t *>(frame.pixels.data() + bitmap.offset));
+}
+
+void RenderEngine::Replay(const RenderFrame &frame) {
+    // Atlas pages must not be reallocated while they are sampled from
+    std::lock_guard<std::mutex> lock(resourceMutex);
+
+    // Everything outside of the dirty area is clipped away, so the rest of the cache stays intact
+    const FrameRect &dirty = frame.dirty;
+    ApplyClip(&frameCache, dirty);
+    bool isClippedOut = false;  // Current clip does not intersect the dirty area
+
+    sf::Vector2f white = atlas.getWhitePixel();
+    RenderCommand::Quad background = {static_cast<float>(dirty.x0),
+                                      static_cast<float>(dirty.y0),
+                                      static_cast<float>(dirty.x1 - dirty.x0),
+                                      static_cast<float>(dirty.y1 - dirty.y0),
+                                      white.x, white.y, 0, 0, 0xFF000000, 0};
+    PushQuad(&atlas.getPage(0), background);
+
+    for (size_t i = 0; i < frame.commands.size(); i++) {
+        const RenderCommand &command = frame.commands[i];
+
+        // New pixels are taken even if they are not drawn now, later frames do not carry them
+        if (command.type == RenderCommand::BITMAP && command.bitmap.hasPixels) {
+            UploadBitmap(frame, command.bitmap);
+        }
+
+        if (command.type == RenderCommand::SET_CLIP) {
+            FlushBatch();
+            FrameRect clip = command.clip;
+            clip.clip(dirty);
+
+            isClippedOut = clip.isEmpty();
+            if (!isClippedOut) ApplyClip(&frameCache, clip);
+            continue;
+        }
+
+        // Commands that cannot touch the dirty area are skipped. Off-screen blocks share bounds,
+        // so they are either replayed or skipped as a whole.
+        if (!frame.bounds[i].intersects(dirty)) continue;
+        if (isClippedOut && targets.size() == 1 && command.type != RenderCommand::BEGIN_OFF_SCREEN)
+            continue;
+
+        switch (command.type) {
+            case RenderCommand::QUAD:
+                PushQuad(&atlas.getPage(command.quad.page), command.quad);
+                break;
+
+            case RenderCommand::TEXT: {
+                FlushBatch();
+                const RenderCommand::Text &text = command.text;
+                sf::Text txt(std::wstring(frame.text.data() + text.offset, text.length),
+                             defaultFont);
+                txt.setPosition(text.x, text.y);
+                txt.setFillColor(sf::Color::White);
+                txt.setCharacterSize(text.characterSize);
+                targets.top()->draw(txt);
+                break;
+            }
+
+            case RenderCommand::BITMAP: {
+                FlushBatch();
+                const RenderCommand::Bitmap &bitmap = command.bitmap;
+                auto texture = bitmapTextures.find(bitmap.handle);
+                if (texture == bitmapTextures.end()) break;
+
+                sf::Sprite bitmap_sprite(*texture->second);
+                bitmap_sprite.setPosition(bitmap.x, bitmap.y);
+                bitmap_sprite.setScale(bitmap.scale, bitmap.scale);
+                targets.top()->draw(bitmap_sprite);
+                break;
+            }
+
+            case RenderCommand::BEGIN_OFF_SCREEN: {
+                FlushBatch();
+                sf::RenderTexture *offScreen = new sf::RenderTexture();
+                offScreen->create(command.offScreen.width, command.offScreen.height);
+                offScreen->clear();
+                targets.push(offScreen);
+                break;
+            }
+
+            case RenderCommand::END_OFF_SCREEN: {
+                FlushBatch();
+                sf::RenderTexture *current = static_cast<sf::RenderTexture *>(targets.top());
+                targets.pop();
+                current->display();
+                sf::Sprite offScreenTargetSprite(current->getTexture());
+                offScreenTargetSprite.setPosition(command.offScreen.x, command.offScreen.y);
+                if (!isClippedOut || targets.size() > 1) targets.top()->draw(offScreenTargetSprite);
+                delete current;
+                break;
+            }
+
+            default:
+                break;
+        }
+    }
+
+    FlushBatch();
+}
+
 void RenderEngine::DrawRect(int x, int y,
                             unsigned int width, unsigned int height,
                             Color bkgColor, Color frgColor, float thickness) {
-    sf::RectangleShape rect(sf::Vector2f(width, height));
-    rect.setPosition(x - globalOffsets.top().x, y - globalOffsets.top().y);
-    rect.setFillColor(sf::Color(bkgColor.red, bkgColor.green, bkgColor.blue, bkgColor.alpha));
-    rect.setOutlineColor(sf::Color(frgColor.red, frgColor.green, frgColor.blue, frgColor.alpha));
-    rect.setOutlineThickness(thickness);
-    targets.top()->draw(rect);
+    float left = x - globalOffsets.top().x;
+    float top = y - globalOffsets.top().y;
+
+    // Rectangles are built from solid quads that sample the white texel of the atlas, so that
+    // they end up in the same batch as icons
+    RecordSolidQuad(left, top, width, height, bkgColor);
+
+    if (thickness != 0) {
+        // Outline goes outwards for positive thickness and inwards for negative one, as in SFML
+        float band = std::abs(thickness);
+        float outer = std::max(thickness, 0.0f);
+        float l = left - outer;
+        float t = top - outer;
+        float w = width + 2 * outer;
+        float h = height + 2 * outer;
+
+        RecordSolidQuad(l, t, w, band, frgColor);
+        RecordSolidQuad(l, t + h - band, w, band, frgColor);
+        RecordSolidQuad(l, t + band, band, h - 2 * band, frgColor);
+        RecordSolidQuad(l + w - band, t + band, band, h - 2 * band, frgColor);
+    }
 }
 
 void RenderEngine::DrawText(int x, int y, const wchar_t *text, int characterSize) {
-    sf::Text txt(text, defaultFont);
-    txt.setPosition(x - globalOffsets.top().x, y - globalOffsets.top().y);
-    txt.setFillColor(sf::Color::White);
-    txt.setFont(defaultFont);
-    txt.setCharacterSize(characterSize);
-    targets.top()->draw(txt);
+    if (!text) return;
+
+    size_t length = wcslen(text);
+    float left = x - globalOffsets.top().x;
+    float top = y - globalOffsets.top().y;
+    if (!PrepareRecord(EstimateTextBounds(left, top, characterSize, text, length))) return;
+
+    RenderFrame &frame = frames[recordingFrame];
+
+    RenderCommand::Text &command = Record(RenderCommand::TEXT).text;
+    command = {left, top, static_cast<uint32_t>(characterSize),
+               static_cast<uint32_t>(frame.text.size()), static_cast<uint32_t>(length)};
+
+    // Text is copied, so the window is free to change it right after the call
+    frame.text.insert(frame.text.end(), text, text + length);
+}
+
+float RenderEngine::MeasureText(const wchar_t *text, int characterSize) {
+    if (!text) return 0;
+
+    // Measuring a glyph for the first time loads it into the font texture, which the render
+    // thread samples; the lock is only taken then, known metrics come from the cache
+    std::unique_lock<std::mutex> lock(resourceMutex, std::defer_lock);
+    FontMetrics &metrics = fontMetrics[characterSize];
+
+    float width = 0;
+    uint32_t previous = 0;
+    for (; *text; text++) {
+        uint32_t character = static_cast<uint32_t>(*text);
+
+        if (previous) {
+            uint64_t pair = static_cast<uint64_t>(previous) << 32 | character;
+            auto kerning = metrics.kernings.find(pair);
+            if (kerning == metrics.kernings.end()) {
+                if (!lock.owns_lock()) lock.lock();
+                kerning = metrics.kernings
+                              .emplace(pair, defaultFont.getKerning(previous, character,
+                                                                    characterSize))
+                              .first;
+            }
+            width += kerning->second;
+        }
+
+        auto advance = metrics.advances.find(character);
+        if (advance == metrics.advances.end()) {
+            if (!lock.owns_lock()) lock.lock();
+            advance = metrics.advances
+                          .emplace(character,
+                                   defaultFont.getGlyph(character, characterSize, false).advance)
+                          .first;
+        }
+        width += advance->second;
+
+        previous = character;
+    }
+
+    return width;
 }
 
 void RenderEngine::InitOffScreen(unsigned int width, unsigned int height) {
-    sf::RenderTexture *offScreen = new sf::RenderTexture();
-    offScreen->create(width, height);
-    offScreen->clear();
-    targets.push(offScreen);
+    // Block is drawn under the clip that is current outside of it
+    PrepareRecord(clips.top());
+    offScreenDepth++;
+    Record(RenderCommand::BEGIN_OFF_SCREEN).offScreen = {0, 0, width, height};
 }
 
 void RenderEngine::FlushOffScreen(int x, int y) {
-    // offScreenTarget.display();
-    sf::RenderTexture *current = static_cast<sf::RenderTexture *>(targets.top());
-    targets.pop();
-    current->display();
-    // printf("Flushin off-screen buffer at coordinates (%d, %d)\n", x, y);
-    sf::Sprite offScreenTargetSprite(current->getTexture());
-    offScreenTargetSprite.setPosition(x - globalOffsets.top().x, y - globalOffsets.top().y);
-    targets.top()->draw(offScreenTargetSprite);
-    delete current;
-    // currentTarget = &mainWindow;
+    offScreenDepth--;
+    Record(RenderCommand::END_OFF_SCREEN).offScreen = {x - globalOffsets.top().x,
+                                                       y - globalOffsets.top().y, 0, 0};
+}
+
+void RenderEngine::pushClip(int x, int y, unsigned int width, unsigned int height) {
+    int left = x - globalOffsets.top().x;
+    int top = y - globalOffsets.top().y;
+
+    FrameRect clip = {left, top, left + static_cast<int>(width), top + static_cast<int>(height)};
+    clip.clip(clips.top());
+    clips.push(clip);
+}
+
+void RenderEngine::popClip() {
+    clips.pop();
 }
 
 void RenderEngine::popGlobalOffset() {
@@ -167,35 +612,52 @@ void RenderEngine::pushRelGlobalOffset(int x, int y) {
     globalOffsets.emplace(globalOffsets.top().x + x, globalOffsets.top().y + y);
 }
 
-void RenderEngine::DrawBitmap(int x, int y, uint32_t width, uint32_t height, uint32_t* data) {
-    sf::Texture texture;
-    texture.create(width, height);
-    texture.update(reinterpret_cast<uint8_t *>(data));
-    sf::Sprite bitmap_sprite(texture);
-    bitmap_sprite.setPosition(x, y);
-    mainWindow.draw(bitmap_sprite);
+uint64_t RenderEngine::CreateBitmap() { return nextBitmap++; }
+
+void RenderEngine::DrawBitmap(uint64_t bitmap, uint64_t version, int x, int y, uint32_t width,
+                              uint32_t height, const uint32_t *data, uint32_t stride,
+                              float scale) {
+    int left = x - globalOffsets.top().x;
+    int top = y - globalOffsets.top().y;
+    FrameRect bounds = {left, top, left + static_cast<int>(std::ceil(width * scale)),
+                        top + static_cast<int>(std::ceil(height * scale))};
+    if (!width || !height || !PrepareRecord(bounds)) return;
+
+    RenderFrame &frame = frames[recordingFrame];
+
+    // Frame with a new version differs from the one before and is always replayed, so pixels of
+    // a version are sent once
+    auto recorded = bitmapVersions.find(bitmap);
+    bool hasPixels = recorded == bitmapVersions.end() || recorded->second != version;
+
+    RenderCommand::Bitmap &command = Record(RenderCommand::BITMAP).bitmap;
+    command = {static_cast<float>(left), static_cast<float>(top), scale, width, height, bitmap,
+               version, frame.pixels.size(), hasPixels};
+    if (!hasPixels) return;
+
+    bitmapVersions[bitmap] = version;
+    for (uint32_t row = 0; row < height; row++) {
+        const uint32_t *source = data + static_cast<size_t>(row) * stride;
+        frame.pixels.insert(frame.pixels.end(), source, source + width);
+    }
 }
 
 uint64_t RenderEngine::LoadTexture(const char *path) {
-    uint64_t descriptor = textures.size();
-    textures.emplace_back();
-    textures[descriptor].loadFromFile(path);
-
-    return descriptor;
+    std::lock_guard<std::mutex> lock(resourceMutex);
+    return atlas.load(path);
 }
 
 void RenderEngine::DrawTexture(int x, int y, unsigned int width, unsigned int height, uint64_t descriptor) {
-    sf::Sprite currentSprite;
-    currentSprite.setTexture(textures[descriptor]);
-    auto size = textures[descriptor].getSize();
-    currentSprite.setScale(static_cast<float>(width) / size.x, static_cast<float>(height) / size.y);
-    currentSprite.setPosition(x - globalOffsets.top().x, y - globalOffsets.top().y);
-    targets.top()->draw(currentSprite);
+    const AtlasRegion &region = atlas.getRegion(descriptor);
+    RecordQuad(region.page,
+               sf::FloatRect(x - globalOffsets.top().x, y - globalOffsets.top().y, width, height),
+               sf::FloatRect(region.rect.left, region.rect.top, region.rect.width, region.rect.height),
+               {255, 255, 255, 255});
 }
 
-void RenderEngine::SaveToImage(const wchar_t *path, uint32_t *img, unsigned int width, unsigned int height) {
+void RenderEngine::SaveToImage(const wchar_t *path, const uint32_t *img, unsigned int width, unsigned int height) {
     sf::Image image;
-    image.create(width, height, reinterpret_cast<uint8_t *>(img));
+    image.create(width, height, reinterpret_cast<const uint8_t *>(img));
     std::wstring_convert<std::codecvt_utf8<wchar_t>> converter;
     image.saveToFile(converter.to_bytes(std::wstring(path)));
 }
@@ -0,0 +1,109 @@
+#include "TextureAtlas.hpp"
+
+#include <cstdio>
+
+TextureAtlas::TextureAtlas() : whitePixel(0, 0) {}
+
+size_t TextureAtlas::addPage(unsigned int size) {
+    Page page;
+    page.texture = std::make_unique<sf::Texture>();
+    page.texture->create(size, size);
+    page.size = size;
+    page.top = 0;
+
+    pages.push_back(std::move(page));
+
+    if (pages.size() == 1) {
+        // Reserve a white block for untextured geometry, so it can share batches with images
+        sf::Image white;
+        white.create(2, 2, sf::Color::White);
+        sf::Vector2u pos;
+        place(pages[0], 2, 2, pos);
+        pages[0].texture->update(white, pos.x, pos.y);
+        whitePixel = sf::Vector2f(pos.x + 1.0f, pos.y + 1.0f);
+    }
+
+    return pages.size() - 1;
+}
+
+bool TextureAtlas::place(Page &page, unsigned int width, unsigned int height, sf::Vector2u &pos) {
+    width += padding;
+    height += padding;
+
+    // Best fit among shelves that are tall enough but not too wasteful
+    Shelf *best = nullptr;
+    for (auto &shelf : page.shelves) {
+        if (shelf.height < height || shelf.height > height * 2) continue;
+        if (shelf.cursor + width > page.size) continue;
+
+        if (!best || shelf.height < best->height) best = &shelf;
+    }
+
+    if (!best) {
+        if (page.top + height > page.size || width > page.size) return false;
+
+        page.shelves.push_back({page.top, height, 0});
+        page.top += height;
+        best = &page.shelves.back();
+    }
+
+    pos = sf::Vector2u(best->cursor, best->y);
+    best->cursor += width;
+
+    return true;
+}
+
+AtlasRegion TextureAtlas::insert(const sf::Image &image) {
+    sf::Vector2u size = image.getSize();
+    sf::Vector2u pos;
+
+    if (pages.empty()) addPage(pageSize);
+
+    size_t pageIndex = pages.size();
+    for (size_t i = 0; i < pages.size(); i++) {
+        if (place(pages[i], size.x, size.y, pos)) {
+            pageIndex = i;
+            break;
+        }
+    }
+
+    if (pageIndex == pages.size()) {
+        unsigned int dedicatedSize = std::max(pageSize, std::max(size.x, size.y) + padding);
+        pageIndex = addPage(dedicatedSize);
+        place(pages[pageIndex], size.x, size.y, pos);
+    }
+
+    pages[pageIndex].texture->update(image, pos.x, pos.y);
+
+    return {pageIndex, sf::IntRect(pos.x, pos.y, size.x, size.y)};
+}
+
+uint64_t TextureAtlas::load(const char *path) {
+    auto loaded = loadedPaths.find(path);
+    if (loaded != loadedPaths.end()) return loaded->second;
+
+    sf::Image image;
+    if (!image.loadFromFile(path)) {
+        fprintf(stderr, "Unable to load texture %s\n", path);
+        image.create(1, 1, sf::Color::Transparent);
+    }
+
+    uint64_t descriptor = regions.size();
+    regions.push_back(insert(image));
+    loadedPaths.emplace(path, descriptor);
+
+    return descriptor;
+}
+
+const AtlasRegion &TextureAtlas::getRegion(uint64_t descriptor) { return regions[descriptor]; }
+
+const sf::Texture &TextureAtlas::getPage(size_t page) {
+    if (pages.empty()) addPage(pageSize);
+    return *pages[page].texture;
+}
+
+void TextureAtlas::prepare() {
+    if (pages.empty()) addPage(pageSize);
+}
+
+sf::Vector2f TextureAtlas::getWhitePixel() const { return whitePixel; }
@@ -0,0 +1,56 @@
+#ifndef TEXTURE_ATLAS_HPP_
+#define TEXTURE_ATLAS_HPP_
+#include <SFML/Graphics.hpp>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Part of an atlas page occupied by a single image
+struct AtlasRegion {
+    size_t page;
+    sf::IntRect rect;
+};
+
+// Runtime texture atlas. Images are packed into a few large pages with a shelf packer, so that
+// everything that samples from the same page can be drawn with a single draw call. Images are
+// deduplicated by path.
+class TextureAtlas {
+   public:
+    static constexpr unsigned int pageSize = 2048;
+    static constexpr unsigned int padding = 1;  // Gap between images to prevent bleeding
+
+    TextureAtlas();
+    void prepare();  // Create page 0, before anything else shares the atlas
+    uint64_t load(const char *path);  // Load image and return descriptor of its region
+    const AtlasRegion &getRegion(uint64_t descriptor);
+    const sf::Texture &getPage(size_t page);
+    sf::Vector2f getWhitePixel() const;  // Texture coordinates of an opaque white texel on page
+                                         // 0, never changes the atlas once it is prepared
+
+   private:
+    // Horizontal strip of the page that images of similar height are placed into
+    struct Shelf {
+        unsigned int y;
+        unsigned int height;
+        unsigned int cursor;  // First free column
+    };
+
+    struct Page {
+        std::unique_ptr<sf::Texture> texture;
+        std::vector<Shelf> shelves;
+        unsigned int size;
+        unsigned int top;  // First row that does not belong to any shelf
+    };
+
+    bool place(Page &page, unsigned int width, unsigned int height, sf::Vector2u &pos);
+    AtlasRegion insert(const sf::Image &image);
+    size_t addPage(unsigned int size);
+
+    std::vector<Page> pages;
+    std::vector<AtlasRegion> regions;
+    std::unordered_map<std::string, uint64_t> loadedPaths;
+    sf::Vector2f whitePixel;
+};
+
+#endif  // TEXTURE_ATLAS_HPP_
@@ -0,0 +1,21 @@
+#ifndef TESTING_HPP
+#define TESTING_HPP
+
+#include <cstdio>
+
+// Checks of the tests: a failed one is reported and the test goes on, main() returns
+// TestResult() so that make stops at a failed test
+inline int testFailures = 0;
+
+#define CHECK(condition)                                                              \
+    if (!(condition)) {                                                               \
+        fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+        testFailures++;                                                               \
+    }
+
+inline int TestResult() {
+    if (testFailures) fprintf(stderr, "%d checks failed\n", testFailures);
+    return testFailures ? 1 : 0;
+}
+
+#endif  // TESTING_HPP
@@ -0,0 +1,50 @@
+#include "HeadlessRenderEngine.hpp"
+
+#include <cwchar>
+#include <utility>
+#include <vector>
+
+#include "../SFMLRenderEngine/RenderEngine.hpp"
+
+DrawCounters drawCounters = {};
+
+static std::vector<std::pair<int, int>> offsets = {{0, 0}};
+
+void RenderEngine::DrawRect(int, int, unsigned int, unsigned int, Color, Color, float) {
+    drawCounters.rects++;
+}
+
+void RenderEngine::DrawTexture(int, int, unsigned int, unsigned int, uint64_t) {
+    drawCounters.textures++;
+}
+
+void RenderEngine::DrawText(int, int, const wchar_t *text, int) {
+    drawCounters.texts++;
+    if (text) drawCounters.textChars += wcslen(text);
+}
+
+// Glyphs are taken to be half as wide as they are tall
+float RenderEngine::MeasureText(const wchar_t *text, int characterSize) {
+    return text ? wcslen(text) * characterSize / 2.0f : 0;
+}
+
+// Offsets are kept as the real engine keeps them, nothing is drawn where they would apply
+void RenderEngine::pushGlobalOffset(int x, int y) { offsets.emplace_back(x, y); }
+
+void RenderEngine::pushRelGlobalOffset(int x, int y) {
+    offsets.emplace_back(offsets.back().first + x, offsets.back().second + y);
+}
+
+void RenderEngine::popGlobalOffset() { offsets.pop_back(); }
+
+int RenderEngine::getGlobalXOffset() { return offsets.back().first; }
+
+int RenderEngine::getGlobalYOffset() { return offsets.back().second; }
+
+void RenderEngine::pushClip(int, int, unsigned int, unsigned int) {}
+
+void RenderEngine::popClip() {}
+
+void RenderEngine::RequestFrame() {}
+
+uint32_t RenderEngine::GetTime() { return 0; }
@@ -0,0 +1,18 @@
+#ifndef HEADLESS_RENDER_ENGINE_HPP_
+#define HEADLESS_RENDER_ENGINE_HPP_
+#include <cstddef>
+
+// Tests and benchmarks of the window system link HeadlessRenderEngine.o instead of the SFML one.
+// Nothing is drawn, the calls are only counted
+struct DrawCounters {
+    size_t rects;
+    size_t texts;
+    size_t textures;
+    size_t textChars;  // Characters passed to DrawText, as much as would be laid out
+};
+
+extern DrawCounters drawCounters;
+
+inline void ResetDrawCounters() { drawCounters = {}; }
+
+#endif  // HEADLESS_RENDER_ENGINE_HPP_
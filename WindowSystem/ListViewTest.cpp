@@ -0,0 +1,200 @@
+// Test of ListView on a headless render engine: a list of ten thousand items makes widgets only
+// for the items in the view, and events and draws reach only the widgets showing an item
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <vector>
+
+#include "../Testing.hpp"
+#include "HeadlessRenderEngine.hpp"
+#include "Window.hpp"
+
+constexpr size_t itemsCount = 10000;
+constexpr int itemHeight = 20;
+constexpr int viewX = 100;
+constexpr int viewY = 50;
+constexpr int viewWidth = 300;
+constexpr int viewHeight = 600;
+constexpr size_t poolSize = viewHeight / itemHeight + 2 + 2 * ListView::overscan;
+constexpr size_t framesCount = 2000;
+
+static double MicrosecondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start)
+        .count();
+}
+
+// Remembers the item it shows and counts what reaches it
+class ItemButton : public RectangleButton {
+   public:
+    size_t item = 0;
+    size_t events = 0;
+    size_t clicks = 0;
+    size_t clickedItem = 0;
+
+    virtual void processEvent(const Event &ev) override {
+        events++;
+        RectangleButton::processEvent(ev);
+    }
+
+    virtual void click(const Event &) override {
+        clicks++;
+        clickedItem = item;
+    }
+};
+
+class CountingAdapter : public ListAdapter {
+   public:
+    size_t count = itemsCount;
+    size_t created = 0;
+    size_t bound = 0;
+    std::vector<ItemButton *> widgets;
+
+    virtual size_t getItemsCount() override { return count; }
+
+    virtual AbstractWindow *createItem() override {
+        created++;
+        widgets.push_back(new ItemButton);
+        return widgets.back();
+    }
+
+    virtual void bindItem(AbstractWindow *widget, size_t index, int x, int y, int width,
+                          int height) override {
+        bound++;
+        ItemButton *button = static_cast<ItemButton *>(widget);
+        button->item = index;
+        button->setPosition(x, y);
+        button->setSize(width, height);
+    }
+
+    size_t countEvents() {
+        size_t events = 0;
+        for (ItemButton *widget : widgets) events += widget->events;
+        return events;
+    }
+};
+
+static ListView *MakeList(CountingAdapter &adapter) {
+    ListView *list = new ListView(&adapter, itemHeight);
+    list->setPosition({viewX, viewY});
+    list->setSize({viewWidth, viewHeight});
+    list->notifyDataChanged();
+    return list;
+}
+
+static void DrawFrame(ListView *list) {
+    ResetDrawCounters();
+    list->draw();
+}
+
+static Event MouseEvent(uint64_t type, int x, int y) {
+    Event ev = {};
+    ev.eventType = type;
+    ev.mouse.x = x;
+    ev.mouse.y = y;
+    return ev;
+}
+
+static void TestRealization() {
+    CountingAdapter adapter;
+    ListView *list = MakeList(adapter);
+
+    CHECK(adapter.created == poolSize);
+    CHECK(list->getContentHeight() == static_cast<int64_t>(itemsCount) * itemHeight);
+
+    DrawFrame(list);
+    CHECK(drawCounters.rects <= poolSize);
+
+    // Scrolling to the end rebinds the widgets there are, it makes no new ones
+    list->scrollToItem(itemsCount - 1);
+    DrawFrame(list);
+    CHECK(adapter.created == poolSize);
+    CHECK(drawCounters.rects <= poolSize);
+
+    size_t lastShown = 0;
+    for (ItemButton *widget : adapter.widgets) lastShown = std::max(lastShown, widget->item);
+    CHECK(lastShown == itemsCount - 1);
+
+    // Event reaches every widget showing an item once, the ten thousand items are not visited
+    size_t eventsBefore = adapter.countEvents();
+    list->processEvent(MouseEvent(EV_MOUSE_MOVE, viewX + 10, viewY + 10));
+    CHECK(adapter.countEvents() - eventsBefore <= poolSize);
+
+    printf("realization: %zu items, %zu widgets made\n", itemsCount, adapter.created);
+}
+
+// Click in the view lands on the widget that shows the item under the pointer
+static void TestClick() {
+    CountingAdapter adapter;
+    ListView *list = MakeList(adapter);
+    list->scrollToItem(5000);
+
+    int y = viewY + 3 * itemHeight + itemHeight / 2;
+    list->processEvent(MouseEvent(EV_MOUSE_KEY_PRESS, viewX + 10, y));
+    list->processEvent(MouseEvent(EV_MOUSE_KEY_RELEASE, viewX + 10, y));
+
+    size_t clicks = 0;
+    size_t clickedItem = 0;
+    for (ItemButton *widget : adapter.widgets) {
+        clicks += widget->clicks;
+        if (widget->clicks) clickedItem = widget->clickedItem;
+    }
+    CHECK(clicks == 1);
+    CHECK(clickedItem == 5003);
+
+    // Pointer outside of the view clicks nothing
+    list->processEvent(MouseEvent(EV_MOUSE_KEY_PRESS, viewX + 10, viewY + viewHeight + 5));
+    list->processEvent(MouseEvent(EV_MOUSE_KEY_RELEASE, viewX + 10, viewY + viewHeight + 5));
+    clicks = 0;
+    for (ItemButton *widget : adapter.widgets) clicks += widget->clicks;
+    CHECK(clicks == 1);
+}
+
+// Lists shorter than the view get a widget per item
+static void TestShortList() {
+    CountingAdapter adapter;
+    adapter.count = 3;
+    ListView *list = MakeList(adapter);
+
+    CHECK(adapter.created == 3);
+    DrawFrame(list);
+    CHECK(drawCounters.rects == 3);
+
+    adapter.count = 5;
+    list->notifyDataChanged();
+    CHECK(adapter.created == 5);
+}
+
+// Wheel scrolls through the whole list, each frame costs the same wherever it is
+static void TestScrolling() {
+    CountingAdapter adapter;
+    ListView *list = MakeList(adapter);
+
+    Event ev = {};
+    ev.eventType = EV_MOUSE_WHEEL;
+    ev.wheel.x = viewX + viewWidth / 2;
+    ev.wheel.y = viewY + viewHeight / 2;
+    ev.wheel.delta = -100;
+
+    size_t maxRects = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < framesCount; i++) {
+        list->processEvent(ev);
+        DrawFrame(list);
+        maxRects = std::max(maxRects, drawCounters.rects);
+    }
+    double scrolling = MicrosecondsSince(start);
+
+    CHECK(adapter.created == poolSize);
+    CHECK(maxRects <= poolSize);
+    printf("scrolling: %zu frames, %.2f us per frame, %zu binds, at most %zu items drawn\n",
+           framesCount, scrolling / framesCount, adapter.bound, maxRects);
+}
+
+int main() {
+    TestRealization();
+    TestClick();
+    TestShortList();
+    TestScrolling();
+    return TestResult();
+}
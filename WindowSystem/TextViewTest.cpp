@@ -0,0 +1,147 @@
+// Test of TextView on a headless render engine: a text of several megabytes is indexed once,
+// and every frame lays out and draws only the lines in the view wherever it is scrolled to
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cwchar>
+#include <string>
+
+#include "../Testing.hpp"
+#include "HeadlessRenderEngine.hpp"
+#include "Window.hpp"
+
+constexpr size_t linesCount = 200000;
+constexpr int viewWidth = 800;
+constexpr int viewHeight = 600;
+constexpr int charSize = 20;
+constexpr int lineHeight = charSize * 6 / 5;
+constexpr size_t maxVisibleLines = viewHeight / lineHeight + 2;
+constexpr size_t framesCount = 2000;
+
+static double MillisecondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start)
+        .count();
+}
+
+// Lines of different lengths, some of them far wider than the view
+static std::wstring MakeText() {
+    std::wstring text;
+    for (size_t line = 0; line < linesCount; line++) {
+        text += L"Line " + std::to_wstring(line) + L": ";
+        text.append(line % 97 == 0 ? 2000 : line % 40, L'x');
+        text += L'\n';
+    }
+    return text;
+}
+
+static void DrawFrame(TextView &view) {
+    ResetDrawCounters();
+    view.draw();
+}
+
+// Frame draws only the lines it shows, and no more of a line than fits into the width
+static void CheckFrameIsBounded() {
+    size_t maxColumns = viewWidth * 6 / charSize + 1;
+    CHECK(drawCounters.texts <= maxVisibleLines);
+    CHECK(drawCounters.textChars <= maxVisibleLines * maxColumns);
+}
+
+static void TestLayout(TextView &view, const std::wstring &text) {
+    auto start = std::chrono::steady_clock::now();
+    view.setText(text.c_str(), text.size());
+    double indexing = MillisecondsSince(start);
+
+    CHECK(view.getLinesCount() == linesCount + 1);
+    CHECK(view.getContentHeight() == static_cast<int64_t>(linesCount + 1) * lineHeight);
+
+    DrawFrame(view);
+    CHECK(drawCounters.texts == maxVisibleLines);
+    CheckFrameIsBounded();
+
+    printf("layout: %zu KB of text, %zu lines indexed in %.1f ms\n",
+           text.size() * sizeof(wchar_t) / 1024, linesCount, indexing);
+}
+
+static void TestScrolling(TextView &view, const std::wstring &text) {
+    view.scrollToLine(linesCount / 2);
+    CHECK(view.getTopLine() == linesCount / 2);
+    DrawFrame(view);
+    CheckFrameIsBounded();
+
+    // Scrollbar puts the top of the view halfway down the text
+    Event ev = {};
+    ev.eventType = EV_SCROLL;
+    ev.scroll.isHorizontal = false;
+    ev.scroll.position = 0.5f;
+    view.processEvent(ev);
+    CHECK(view.getTopLine() == (linesCount + 1) / 2);
+
+    // View stops at the last line however far it is scrolled
+    view.scrollToLine(linesCount * 2);
+    DrawFrame(view);
+    CHECK(view.getTopLine() + viewHeight / lineHeight >= linesCount);
+    CheckFrameIsBounded();
+
+    // Line with a character far down the text
+    view.scrollToOffset(text.find(L"Line 123456:") + 3);
+    CHECK(view.getTopLine() == 123456);
+
+    // Wheel scrolls through the whole text, each frame costs the same wherever it is
+    srand(1);
+    ev = {};
+    ev.eventType = EV_MOUSE_WHEEL;
+    ev.wheel.x = viewWidth / 2;
+    ev.wheel.y = viewHeight / 2;
+
+    size_t maxTexts = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < framesCount; i++) {
+        if (i % 100 == 0) view.scrollToLine(rand() % linesCount);
+        ev.wheel.delta = -100;
+        view.processEvent(ev);
+        DrawFrame(view);
+        maxTexts = std::max(maxTexts, drawCounters.texts);
+    }
+    double scrolling = MillisecondsSince(start);
+
+    CHECK(maxTexts <= maxVisibleLines);
+    printf("scrolling: %zu frames, %.1f us per frame, at most %zu lines drawn\n", framesCount,
+           scrolling * 1000 / framesCount, maxTexts);
+}
+
+// Text appended to the same buffer keeps the lines indexed before it
+static void TestAppend() {
+    std::wstring log = L"first\nsecond\nthi";
+    log.reserve(64);
+
+    TextView *view = new TextView;
+    view->setSize(viewWidth, viewHeight);
+    view->setText(log.c_str(), log.size());
+    CHECK(view->getLinesCount() == 3);
+
+    log += L"rd\nfourth";
+    view->setText(log.c_str(), log.size());
+    CHECK(view->getLinesCount() == 4);
+
+    DrawFrame(*view);
+    CHECK(drawCounters.texts == 4);
+    CHECK(drawCounters.textChars == wcslen(L"firstsecondthirdfourth"));
+}
+
+int main() {
+    std::wstring text = MakeText();
+
+    // Windows report being deleted outside of a tree, the ones here are left alone
+    TextView *view = new TextView;
+    view->setPosition(0, 0);
+    view->setSize(viewWidth, viewHeight);
+    view->setCharSize(charSize);
+
+    TestLayout(*view, text);
+    TestScrolling(*view, text);
+    TestAppend();
+
+    return TestResult();
+}
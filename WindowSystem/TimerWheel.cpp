@@ -0,0 +1,181 @@
+#include "TimerWheel.hpp"
+
+#include <algorithm>
+#include <bit>
+
+TimerWheel::TimerWheel(uint64_t now) : current(now), activeCount(0) {
+    std::fill(std::begin(heads), std::end(heads), -1);
+    std::fill(std::begin(occupied), std::end(occupied), 0);
+}
+
+TimerWheel::TimerId TimerWheel::schedule(uint32_t delay, std::function<void()> callback,
+                                         uint32_t period) {
+    int32_t node;
+    if (freeNodes.empty()) {
+        node = timers.size();
+        timers.push_back({0, 0, 1, -1, -1, -1, nullptr});
+    } else {
+        node = freeNodes.back();
+        freeNodes.pop_back();
+    }
+
+    // Zero delay still waits for the next tick, so a callback rescheduling itself cannot loop
+    Timer &timer = timers[node];
+    timer.deadline = current + std::max<uint32_t>(delay, 1);
+    timer.period = period;
+    timer.callback = std::move(callback);
+
+    insert(node);
+    activeCount++;
+    return makeId(node);
+}
+
+bool TimerWheel::cancel(TimerId id) {
+    int32_t node = findNode(id);
+    if (node < 0) return false;
+
+    unlink(node);
+    release(node);
+    return true;
+}
+
+bool TimerWheel::isScheduled(TimerId id) { return findNode(id) >= 0; }
+
+size_t TimerWheel::advance(uint64_t now) {
+    size_t firedCount = 0;
+
+    // Ticks without anything to fire or cascade are skipped at once
+    while (current < now) {
+        uint64_t next = getNextDeadline();
+        if (next > now) {
+            current = now;
+            break;
+        }
+
+        current = next;
+        for (uint32_t level = levelsCount - 1; level > 0; level--) {
+            if ((current & ((uint64_t(1) << (slotBits * level)) - 1)) == 0) cascade(level);
+        }
+
+        size_t slot = current & (slotsCount - 1);
+        while (heads[slot] >= 0) {
+            int32_t node = heads[slot];
+            unlink(node);
+
+            // Callback is taken out of the node first: it may schedule timers and reallocate
+            // the nodes, or cancel its own timer
+            std::function<void()> callback;
+            Timer &timer = timers[node];
+            if (timer.period) {
+                callback = timer.callback;
+                timer.deadline = std::max(timer.deadline + timer.period, current + 1);
+                insert(node);
+            } else {
+                callback = std::move(timer.callback);
+                release(node);
+            }
+
+            callback();
+            firedCount++;
+        }
+    }
+
+    return firedCount;
+}
+
+uint64_t TimerWheel::getNextDeadline() {
+    uint64_t next = noDeadline;
+
+    for (uint32_t level = 0; level < levelsCount; level++) {
+        if (!occupied[level]) continue;
+
+        // First non-empty slot after the current one, the current slot itself comes up last
+        uint32_t shift = slotBits * level;
+        uint64_t base = current >> shift;
+        uint64_t rotated = std::rotr(occupied[level], (base + 1) & (slotsCount - 1));
+        uint64_t distance = std::countr_zero(rotated) + 1;
+
+        next = std::min(next, (base + distance) << shift);
+    }
+
+    return next;
+}
+
+uint64_t TimerWheel::getTime() { return current; }
+
+size_t TimerWheel::getTimersCount() { return activeCount; }
+
+TimerWheel &TimerWheel::Global() {
+    static TimerWheel wheel;
+    return wheel;
+}
+
+TimerWheel::TimerId TimerWheel::makeId(int32_t node) {
+    return (static_cast<uint64_t>(timers[node].generation) << 32) | static_cast<uint32_t>(node + 1);
+}
+
+int32_t TimerWheel::findNode(TimerId id) {
+    int64_t node = static_cast<int64_t>(id & 0xFFFFFFFF) - 1;
+    if (node < 0 || node >= static_cast<int64_t>(timers.size())) return -1;
+
+    const Timer &timer = timers[node];
+    if (timer.generation != (id >> 32) || timer.slot < 0) return -1;
+    return node;
+}
+
+void TimerWheel::insert(int32_t node) {
+    Timer &timer = timers[node];
+
+    // Deadline decides the level by its distance and the slot by its own bits, so a slot of a
+    // coarse level comes up exactly when its timers get close enough for the level below
+    uint64_t placement = std::max(timer.deadline, current);
+    uint32_t level = 0;
+    while (level < levelsCount - 1 && placement - current >= uint64_t(1) << (slotBits * (level + 1)))
+        level++;
+
+    uint64_t horizon = uint64_t(1) << (slotBits * levelsCount);
+    if (placement - current >= horizon) placement = current + horizon - 1;  // Cascaded again later
+
+    uint32_t slot = (placement >> (slotBits * level)) & (slotsCount - 1);
+    int32_t index = level * slotsCount + slot;
+
+    timer.slot = index;
+    timer.prev = -1;
+    timer.next = heads[index];
+    if (heads[index] >= 0) timers[heads[index]].prev = node;
+    heads[index] = node;
+    occupied[level] |= uint64_t(1) << slot;
+}
+
+void TimerWheel::unlink(int32_t node) {
+    Timer &timer = timers[node];
+    int32_t index = timer.slot;
+
+    if (timer.prev >= 0) {
+        timers[timer.prev].next = timer.next;
+    } else {
+        heads[index] = timer.next;
+    }
+    if (timer.next >= 0) timers[timer.next].prev = timer.prev;
+
+    if (heads[index] < 0) occupied[index / slotsCount] &= ~(uint64_t(1) << (index % slotsCount));
+    timer.slot = -1;
+}
+
+void TimerWheel::release(int32_t node) {
+    Timer &timer = timers[node];
+    timer.generation++;
+    timer.callback = nullptr;
+    freeNodes.push_back(node);
+    activeCount--;
+}
+
+void TimerWheel::cascade(uint32_t level) {
+    int32_t index = level * slotsCount + ((current >> (slotBits * level)) & (slotsCount - 1));
+
+    while (heads[index] >= 0) {
+        int32_t node = heads[index];
+        unlink(node);
+        insert(node);
+    }
+}
@@ -0,0 +1,63 @@
+#ifndef TIMER_WHEEL_HPP_
+#define TIMER_WHEEL_HPP_
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+// Hierarchical timer wheel with millisecond ticks. Every level has 64 slots, each slot of a level
+// spans the whole previous level; timers far in the future sit in coarse slots and are moved down
+// when their slot comes up. Scheduling and cancelling are O(1), and nothing is done between the
+// deadlines no matter how many timers are pending.
+class TimerWheel {
+   public:
+    using TimerId = uint64_t;
+    static constexpr TimerId invalidTimer = 0;
+    static constexpr uint32_t slotBits = 6;
+    static constexpr uint32_t slotsCount = 1 << slotBits;
+    static constexpr uint32_t levelsCount = 4;  // Deadlines up to 2^24 ms (4.6 hours) are direct
+    static constexpr uint64_t noDeadline = UINT64_MAX;
+
+    explicit TimerWheel(uint64_t now = 0);
+    TimerWheel(const TimerWheel &) = delete;
+    TimerWheel &operator=(const TimerWheel &) = delete;
+
+    // Call callback once after delay milliseconds, then every period milliseconds if it is not 0
+    TimerId schedule(uint32_t delay, std::function<void()> callback, uint32_t period = 0);
+    bool cancel(TimerId id);  // False if the timer has already fired or was cancelled
+    bool isScheduled(TimerId id);
+
+    size_t advance(uint64_t now);  // Fire everything due by now, returns number of callbacks run
+    uint64_t getNextDeadline();    // Never later than the earliest deadline, noDeadline if empty
+    uint64_t getTime();            // Time of the last advance
+    size_t getTimersCount();
+
+    static TimerWheel &Global();  // Wheel driven by the application loop
+
+   private:
+    struct Timer {
+        uint64_t deadline;
+        uint32_t period;
+        uint32_t generation;  // Distinguishes reuses of the same node
+        int32_t prev;
+        int32_t next;
+        int32_t slot;  // Index into heads, -1 if the node is not in a slot
+        std::function<void()> callback;
+    };
+
+    TimerId makeId(int32_t node);
+    int32_t findNode(TimerId id);  // -1 for stale or invalid ids
+    void insert(int32_t node);     // Put the node into the slot its deadline belongs to
+    void unlink(int32_t node);
+    void release(int32_t node);
+    void cascade(uint32_t level);  // Move the timers of the current slot of level down
+
+    std::vector<Timer> timers;
+    std::vector<int32_t> freeNodes;
+    int32_t heads[levelsCount * slotsCount];
+    uint64_t occupied[levelsCount];  // Bit per non-empty slot of every level
+    uint64_t current;                // Last processed tick
+    size_t activeCount;
+};
+
+#endif  // TIMER_WHEEL_HPP_
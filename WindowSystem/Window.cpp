@@ -1,7 +1,11 @@
 #include "Window.hpp"
 
+#include <algorithm>
+#include <climits>
+#include <cmath>
 #include <cstdio>
 #include <cstdlib>
+#include <cwchar>
 
 const char* uint64_to_bin(uint64_t val) {
     char* bin = new char[65]();
@@ -63,7 +67,20 @@ void AbstractWindow::invokeModalWindow(ModalWindow* modal) {
         }                                                               \
     }
 
-void AbstractWindow::draw() {}
+// Window a flattened draw list is drawing through drawTree(). The default drawTree() clears it and
+// leaves the children to the list, an override leaves it as it is and draws them itself
+static AbstractWindow* drawProbe = nullptr;
+
+void AbstractWindow::draw() { drawTree(); }
+
+void AbstractWindow::drawTree() {
+    drawSelf();
+    if (drawProbe == this) drawProbe = nullptr;
+}
+
+void AbstractWindow::drawSelf() {}
+
+void AbstractWindow::collectDrawList(DrawList& list) { list.push_back({this, list.size() + 1}); }
 
 DUMP_CONT(ContainerWindow);
 DUMP_CONT(RectangleWindow);
@@ -75,6 +92,8 @@ DUMP(Slider);
 DUMP_CONT(ScrollbarBackground);
 DUMP_CONT(Viewport);
 DUMP_CONT(TextWindow);
+DUMP_CONT(TextView);
+DUMP_CONT(ListView);
 
 void ScrollbarManager::dump(FILE* f) {
     fprintf(f,
@@ -116,6 +135,8 @@ void ScrollbarManager::dump(FILE* f) {
 
 AbstractWindow::AbstractWindow() {
     parent = nullptr;
+    siblingIndex = 0;
+    drawsOwnChildren = false;
     eventMask = 0;
     propagationMask = 0;
 }
@@ -130,12 +151,28 @@ AbstractWindow::~AbstractWindow() {
     }
 }
 
-void AbstractWindow::processEvent(Event ev) {
+void AbstractWindow::processEvent(const Event& ev) {
     if (!(ev.eventType & eventMask)) return;
 
     handleEvent(ev);
 }
 
+void* AbstractWindow::operator new(size_t size) {
+    WindowArena* arena = WindowArena::current();
+    return arena ? arena->allocate(size) : ::operator new(size);
+}
+
+void AbstractWindow::operator delete(void* ptr, size_t size) {
+    if (!ptr) return;
+
+    WindowArena* arena = WindowArena::owner(ptr);
+    if (arena) {
+        arena->deallocate(ptr, size);
+    } else {
+        ::operator delete(ptr);
+    }
+}
+
 void AbstractWindow::attachToParent(AbstractWindow* parent) {
     this->parent = parent;
     parent->updatePropagationMask(eventMask | propagationMask);
@@ -159,9 +196,7 @@ void AbstractWindow::updateEventMask(uint64_t update) {
     }
 }
 
-void AbstractWindow::handleEvent(Event ev) {
-    printf("Event type: %lx\nEvent type mask: %lx\n\n", ev.eventType, eventMask);
-}
+void AbstractWindow::handleEvent(const Event&) {}
 
 void AbstractWindow::detach() {
     if (!parent) return;
@@ -172,22 +207,112 @@ void AbstractWindow::detach() {
 
 // ContainerWindow methods
 
+ContainerWindow::ContainerWindow() : hierarchyVersion(1), drawListVersion(0), arena(nullptr) {}
+
 ContainerWindow::~ContainerWindow() {
     for (auto child : children) {
         delete child;
     }
+
+    // Windows detached from the tree may still live in the arena
+    if (arena) arena->release();
+}
+
+WindowArena* ContainerWindow::makeArena(size_t chunkSize) {
+    if (!arena) arena = new WindowArena(chunkSize);
+    return arena;
+}
+
+void ContainerWindow::drawTree() {
+    drawSelf();
+
+    // Draw list has entries for the children
+    if (drawProbe == this) {
+        drawProbe = nullptr;
+        return;
+    }
+
+    drawChildren();
 }
 
-void ContainerWindow::draw() {
+void ContainerWindow::drawChildren() {
     for (auto child : children) {
         child->draw();
     }
 }
 
-void ContainerWindow::processEvent(Event ev) {
-    if (ev.eventType & propagationMask) {
+void ContainerWindow::collectDrawList(DrawList& list) {
+    size_t index = list.size();
+    list.push_back({this, 0});
+
+    if (!drawsOwnChildren) {
         for (auto child : children) {
-            child->processEvent(ev);
+            child->collectDrawList(list);
+        }
+    }
+
+    list[index].subtreeEnd = list.size();
+}
+
+void ContainerWindow::drawFlattened() {
+    if (drawListVersion != hierarchyVersion) {
+        drawList.clear();
+        for (auto child : children) {
+            child->collectDrawList(drawList);
+        }
+        drawListVersion = hierarchyVersion;
+    }
+
+    // A list may be drawn from an override of drawTree() that another list is probing
+    AbstractWindow* outerProbe = drawProbe;
+
+    for (size_t i = 0; i < drawList.size();) {
+        AbstractWindow* window = drawList[i].window;
+        drawProbe = window;
+        window->drawTree();
+        if (!drawProbe) {
+            i++;
+            continue;
+        }
+
+        // Window has drawn its children, lists are built without them from now on
+        drawProbe = nullptr;
+        if (!window->drawsOwnChildren) {
+            window->drawsOwnChildren = true;
+            if (drawList[i].subtreeEnd > i + 1) {
+                static_cast<ContainerWindow*>(window->parent)->invalidateDrawLists();
+            }
+        }
+        i = drawList[i].subtreeEnd;
+    }
+
+    drawProbe = outerProbe;
+}
+
+bool ContainerWindow::isChild(AbstractWindow* window) {
+    return window->siblingIndex < children.size() && children[window->siblingIndex] == window;
+}
+
+void ContainerWindow::invalidateDrawLists() {
+    ContainerWindow* window = this;
+
+    // Windows drawing their children themselves are single entries in the lists above them, and
+    // windows attached without being children (scrollbars, modals) are not in those lists at all
+    while (true) {
+        window->hierarchyVersion++;
+        if (window->drawsOwnChildren || !window->parent) return;
+
+        ContainerWindow* above = static_cast<ContainerWindow*>(window->parent);
+        if (!above->isChild(window)) return;
+        window = above;
+    }
+}
+
+void ContainerWindow::processEvent(const Event& ev) {
+    if (ev.eventType & propagationMask) {
+        // Children may attach or detach windows while handling the event, so no iterators here
+        for (size_t i = 0; i < children.size(); i++) {
+            children[i]->processEvent(ev);
         }
     }
 
@@ -195,11 +320,47 @@ void ContainerWindow::processEvent(Event ev) {
 }
 
 void ContainerWindow::attachChild(AbstractWindow* win) {
+    win->siblingIndex = children.size();
     children.push_back(win);
     win->attachToParent(this);
+    invalidateDrawLists();
+}
+
+void ContainerWindow::detachChild(AbstractWindow* child) {
+    if (!isChild(child)) return;
+    size_t index = child->siblingIndex;
+
+    children.erase(children.begin() + index);
+    for (size_t i = index; i < children.size(); i++) {
+        children[i]->siblingIndex = i;
+    }
+
+    invalidateDrawLists();
+}
+
+void ContainerWindow::raiseChild(AbstractWindow* child) {
+    if (!isChild(child)) return;
+    size_t index = child->siblingIndex;
+
+    std::rotate(children.begin() + index, children.begin() + index + 1, children.end());
+    for (size_t i = index; i < children.size(); i++) {
+        children[i]->siblingIndex = i;
+    }
+
+    invalidateDrawLists();
 }
 
-void ContainerWindow::detachChild(AbstractWindow* child) { children.remove(child); }
+void ContainerWindow::lowerChild(AbstractWindow* child) {
+    if (!isChild(child)) return;
+    size_t index = child->siblingIndex;
+
+    std::rotate(children.begin(), children.begin() + index, children.begin() + index + 1);
+    for (size_t i = 0; i <= index; i++) {
+        children[i]->siblingIndex = i;
+    }
+
+    invalidateDrawLists();
+}
 
 // AbstractButton methods
 // void AbstractButton::attachToParent(AbstractWindow* parent) {
@@ -215,39 +376,54 @@ AbstractButton::AbstractButton() {
     updateEventMask(EV_MOUSE_KEY_PRESS | EV_MOUSE_KEY_RELEASE | EV_MOUSE_MOVE);
 }
 
-void AbstractButton::handleEvent(Event ev) {
-    if (IS_MOUSE_EV(ev)) {
-        bool inside = isInside(ev.mouse.x, ev.mouse.y);
+const AbstractButton::EventHandler AbstractButton::eventHandlers[EV_TYPES_COUNT] = {
+    nullptr,                               // EV_CLOSED
+    &AbstractButton::handleMousePress,     // EV_MOUSE_KEY_PRESS
+    &AbstractButton::handleMouseRelease,   // EV_MOUSE_KEY_RELEASE
+    &AbstractButton::handleMouseMove,      // EV_MOUSE_MOVE
+};
+
+void AbstractButton::handleEvent(const Event& ev) {
+    unsigned int index = eventTypeIndex(ev.eventType);
+    if (index == invalidEventTypeIndex) return;
+
+    EventHandler handler = eventHandlers[index];
+    if (handler) (this->*handler)(ev);
+}
 
-        if (ev.eventType == EV_MOUSE_KEY_PRESS) {
-            if(inside) {
+void AbstractButton::handleMousePress(const Event& ev) {
+    if (isInside(ev.mouse.x, ev.mouse.y)) {
+        hovered = true;
+        if (!pressed) {
+            pressed = true;
+            onButtonPress(ev);
+        }
+    } else {
+        onButtonPressOutside(ev);
+    }
+}
+
+void AbstractButton::handleMouseRelease(const Event& ev) {
+    if (!pressed) return;
+
+    onButtonRelease(ev);
+    if (isInside(ev.mouse.x, ev.mouse.y)) click(ev);
+    pressed = false;
+}
+
+void AbstractButton::handleMouseMove(const Event& ev) {
+    if (isInside(ev.mouse.x, ev.mouse.y)) {
+        if (!hovered) {
             hovered = true;
-            if (!pressed) {
-                pressed = true;
-                onButtonPress(ev);
-            }
-            } else {
-                onButtonPressOutside(ev);
-            }
-        } else if (ev.eventType == EV_MOUSE_KEY_RELEASE && pressed) {
-            onButtonRelease(ev);
-            if (inside) click(ev);
-            pressed = false;
-        } else if (ev.eventType == EV_MOUSE_MOVE) {
-            if (inside) {
-                if (!hovered) {
-                    hovered = true;
-                    onHoverEnter(ev);
-                }
-            } else {
-                if (hovered) {
-                    hovered = false;
-                    onHoverExit(ev);
-                }
-            }
-            onMouseMove(ev);
+            onHoverEnter(ev);
+        }
+    } else {
+        if (hovered) {
+            hovered = false;
+            onHoverExit(ev);
         }
     }
+    onMouseMove(ev);
 }
 
 void AbstractButton::onButtonPressOutside(const Event&) {}
@@ -290,15 +466,9 @@ int Rectangle::getWidth() { return width; }
 int Rectangle::getHeight() { return height; }
 
 // RectangleButton methods
-void RectangleButton::draw() {
-    RenderEngine::DrawRect(x, y, width, height, bkg, frg, thickness);
-    ContainerWindow::draw();
-}
+void RectangleButton::drawSelf() { RenderEngine::DrawRect(x, y, width, height, bkg, frg, thickness); }
 
-void RectangleWindow::draw() {
-    RenderEngine::DrawRect(x, y, width, height, bkg, frg, thickness);
-    ContainerWindow::draw();
-}
+void RectangleWindow::drawSelf() { RenderEngine::DrawRect(x, y, width, height, bkg, frg, thickness); }
 
 void RectangleButton::setHoverColor(const Color& color) { hoverBkg = color; }
 
@@ -336,8 +506,8 @@ TexturedButton::TexturedButton() : textureDescriptor(std::nullopt) {}
 
 void TexturedButton::attachTexture(uint64_t descriptor) { textureDescriptor = descriptor; }
 
-void TexturedButton::draw() {
-    RectangleButton::draw();
+void TexturedButton::drawSelf() {
+    RectangleButton::drawSelf();
 
     if (textureDescriptor.has_value()) {
         unsigned int shift = 3;
@@ -389,7 +559,7 @@ void Slider::onMouseMove(const Event& ev) {
     }
 }
 
-void Slider::handleEvent(Event ev) {
+void Slider::handleEvent(const Event& ev) {
     if (IS_MOUSE_EV(ev)) {
         AbstractButton::handleEvent(ev);
     } else if (ev.eventType == EV_SCROLL) {
@@ -496,25 +666,22 @@ Scrollbar::Scrollbar(int length, bool isHorizontal) : isHorizontal(isHorizontal)
     eventMask |= EV_SCROLL;  // Don't really want to propagate subscription to scroll event
 }
 
-void Scrollbar::handleEvent(Event ev) {
+void Scrollbar::handleEvent(const Event& ev) {
     if (!parent) return;
-    fprintf(stderr, "Scrollbar %p processing event of type %lu\n", static_cast<void*>(this),
-            ev.eventType);
     if (ev.eventType == EV_SCROLL) {
-        fprintf(stderr, "THAT IS A GODDAMN SCROLL EVENT!\n");
+        Event scrollEv = ev;
         if (isHorizontal) {
-            ev.scroll.isHorizontal = true;
-            ev.scroll.position =
+            scrollEv.scroll.isHorizontal = true;
+            scrollEv.scroll.position =
                 ((float)slider->x - slider->pivot) / (slider->limit + slider->width);
 
         } else {
-            ev.scroll.isHorizontal = false;
-            ev.scroll.position =
+            scrollEv.scroll.isHorizontal = false;
+            scrollEv.scroll.position =
                 ((float)slider->y - slider->pivot) / (slider->limit + slider->height);
-            fprintf(stderr, "Scroll pos: %f\n", ev.scroll.position);
         }
 
-        parent->processEvent(ev);
+        parent->processEvent(scrollEv);
     }
 }
 
@@ -594,14 +761,39 @@ int Scrollbar::getBkgLength() {
 }
 
 // Scrollbar button methods
-ScrollbarButton::ScrollbarButton(bool isUp) : isUp(isUp) {
+ScrollbarButton::ScrollbarButton(bool isUp) : isUp(isUp), repeatTimer(TimerWheel::invalidTimer) {
     updateEventMask(EV_MOUSE_KEY_PRESS | EV_MOUSE_KEY_RELEASE | EV_MOUSE_MOVE);
 }
 
-void ScrollbarButton::click(const Event&) {
+ScrollbarButton::~ScrollbarButton() { TimerWheel::Global().cancel(repeatTimer); }
+
+void ScrollbarButton::click(const Event&) {}  // Scrolling has already happened on press
+
+void ScrollbarButton::onButtonPress(const Event& ev) {
+    RectangleButton::onButtonPress(ev);
+    scroll(ev);
+
+    // Repeats pause while the pointer is away from the button
+    pressEvent = ev;
+    TimerWheel::Global().cancel(repeatTimer);
+    repeatTimer = TimerWheel::Global().schedule(
+        repeatDelay,
+        [this] {
+            if (hovered) scroll(pressEvent);
+        },
+        repeatInterval);
+}
+
+void ScrollbarButton::onButtonRelease(const Event& ev) {
+    RectangleButton::onButtonRelease(ev);
+    TimerWheel::Global().cancel(repeatTimer);
+    repeatTimer = TimerWheel::invalidTimer;
+}
+
+void ScrollbarButton::scroll(const Event& ev) {
     if (!parent) return;
 
-    Event scrollEvent;
+    Event scrollEvent = ev;
     scrollEvent.eventType = EV_SCROLL;
 
     if (isUp) {
@@ -618,13 +810,12 @@ ScrollbarBackground::ScrollbarBackground(bool isHorizontal) : isHorizontal(isHor
     updateEventMask(EV_MOUSE_KEY_RELEASE);
 }
 
-void ScrollbarBackground::handleEvent(Event ev) {
+void ScrollbarBackground::handleEvent(const Event& ev) {
     Scrollbar* p = static_cast<Scrollbar*>(parent);  // Believe me
     if (!parent) return;
 
     if (ev.eventType == EV_MOUSE_KEY_RELEASE && isInsideRect(ev.mouse.x, ev.mouse.y) &&
         !p->isInsideSlider(ev.mouse.x, ev.mouse.y)) {
-        printf("Scrollbar background had received an interesting event!\n");
         int coord = 0;
         if (isHorizontal) {
             coord = ev.mouse.x;
@@ -632,7 +823,7 @@ void ScrollbarBackground::handleEvent(Event ev) {
             coord = ev.mouse.y;
         }
 
-        Event newEv;
+        Event newEv = ev;
         newEv.eventType = EV_SCROLL;
 
         if (coord < p->getSliderPositionAlongAxis()) {
@@ -646,7 +837,8 @@ void ScrollbarBackground::handleEvent(Event ev) {
 }
 
 // ScrollbarManager methods
-ScrollbarManager::ScrollbarManager(bool horizontalScrollable, bool verticalScrollable) {
+ScrollbarManager::ScrollbarManager(bool horizontalScrollable, bool verticalScrollable)
+    : horizontal(nullptr), vertical(nullptr) {
     eventMask |= EV_SCROLL;  // Want to process event; don't really want to propagate subscription
                              // since scroll events are going to be issued by a child
     propagationMask |= EV_SCROLL;
@@ -661,8 +853,7 @@ ScrollbarManager::ScrollbarManager(bool horizontalScrollable, bool verticalScrol
     }
 }
 
-void ScrollbarManager::processEvent(Event ev) {
-    fprintf(stderr, "Issuing event of type %lu\n", ev.eventType);
+void ScrollbarManager::processEvent(const Event& ev) {
     if (ev.eventType != EV_SCROLL && ev.eventType & propagationMask) {
         if (horizontal) {
             horizontal->processEvent(ev);
@@ -708,7 +899,7 @@ void ScrollbarManager::adjustScrollableAreaSize(int width, int height) {
     }
 }
 
-void ScrollbarManager::draw() {
+void ScrollbarManager::drawTree() {
     if (horizontal) horizontal->draw();
 
     if (vertical) vertical->draw();
@@ -725,7 +916,129 @@ void TextWindow::setCharSize(int size) { characterSize = size; }
 
 void TextWindow::setText(const wchar_t* newContent) { content = newContent; }
 
-void TextWindow::draw() { RenderEngine::DrawText(x, y, content, characterSize); }
+void TextWindow::drawSelf() { RenderEngine::DrawText(x, y, content, characterSize); }
+
+// TextView methods
+TextView::TextView() : content(nullptr), length(0), lineStarts{0}, characterSize(30), scrollY(0) {
+    updateEventMask(EV_SCROLL | EV_MOUSE_WHEEL);
+}
+
+void TextView::setText(const wchar_t* newContent, size_t newLength) {
+    size_t indexed = length;
+
+    // Last line may have grown, the ones before it are as they were
+    if (newContent == content && newLength >= length) {
+        layouts.erase(lineStarts.size() - 1);
+    } else {
+        lineStarts.assign(1, 0);
+        layouts.clear();
+        scrollY = 0;
+        indexed = 0;
+    }
+
+    content = newContent;
+    length = newLength;
+    for (size_t i = indexed; i < length; i++) {
+        if (content[i] == L'\n') lineStarts.push_back(i + 1);
+    }
+
+    scrollBy(0);
+}
+
+void TextView::setText(const wchar_t* newContent) {
+    setText(newContent, newContent ? wcslen(newContent) : 0);
+}
+
+void TextView::setCharSize(int size) {
+    characterSize = size;
+    layouts.clear();
+    scrollBy(0);
+}
+
+int TextView::getLineHeight() { return characterSize * 6 / 5; }
+
+size_t TextView::getLinesCount() { return lineStarts.size(); }
+
+size_t TextView::getTopLine() { return scrollY / getLineHeight(); }
+
+int64_t TextView::getContentHeight() {
+    return static_cast<int64_t>(lineStarts.size()) * getLineHeight();
+}
+
+void TextView::scrollBy(int64_t pixels) {
+    int64_t limit = std::max<int64_t>(getContentHeight() - height, 0);
+    scrollY = std::clamp<int64_t>(scrollY + pixels, 0, limit);
+}
+
+void TextView::scrollTo(float position) {
+    // Scrollbars report the top of the slider along the track, which is the top of the view
+    // along the text
+    scrollY = std::llround(static_cast<double>(position) * getContentHeight());
+    scrollBy(0);
+}
+
+void TextView::scrollToLine(size_t line) {
+    scrollY = static_cast<int64_t>(line) * getLineHeight();
+    scrollBy(0);
+}
+
+void TextView::scrollToOffset(size_t offset) {
+    auto next = std::upper_bound(lineStarts.begin(), lineStarts.end(), offset);
+    scrollToLine(next - lineStarts.begin() - 1);
+}
+
+const std::wstring& TextView::layoutLine(size_t line) {
+    auto found = layouts.find(line);
+    if (found != layouts.end()) return found->second;
+
+    // No glyph is narrower than a sixth of the size, the rest of a long line is clipped anyway
+    size_t maxColumns = static_cast<size_t>(width) * 6 / std::max(characterSize, 1) + 1;
+    size_t begin = lineStarts[line];
+    size_t end = line + 1 < lineStarts.size() ? lineStarts[line + 1] - 1 : length;
+
+    std::wstring& layout = layouts[line];
+    for (size_t i = begin; i < end && layout.size() < maxColumns; i++) {
+        if (content[i] != L'\r') layout.push_back(content[i]);
+    }
+
+    return layout;
+}
+
+void TextView::drawSelf() {
+    RectangleWindow::drawSelf();
+    if (!content) return;
+
+    int lineHeight = getLineHeight();
+    size_t first = getTopLine();
+    size_t last = std::min(lineStarts.size(), first + height / lineHeight + 2);
+
+    RenderEngine::pushClip(x, y, width, height);
+    for (size_t line = first; line < last; line++) {
+        const std::wstring& layout = layoutLine(line);
+        if (layout.empty()) continue;
+
+        int top = static_cast<int>(static_cast<int64_t>(line) * lineHeight - scrollY);
+        RenderEngine::DrawText(x, y + top, layout.c_str(), characterSize);
+    }
+    RenderEngine::popClip();
+
+    // Lines scrolled away are laid out again if they come back
+    if (layouts.size() > layoutCacheSize) {
+        for (auto layout = layouts.begin(); layout != layouts.end();) {
+            bool isVisible = layout->first >= first && layout->first < last;
+            layout = isVisible ? std::next(layout) : layouts.erase(layout);
+        }
+    }
+}
+
+void TextView::handleEvent(const Event& ev) {
+    if (ev.eventType == EV_SCROLL && !ev.scroll.isHorizontal) {
+        scrollTo(ev.scroll.position);
+    } else if (ev.eventType == EV_MOUSE_WHEEL && !ev.wheel.isHorizontal &&
+               isInsideRect(ev.wheel.x, ev.wheel.y)) {
+        scrollBy(-std::lround(ev.wheel.delta / 100.0f * wheelLines * getLineHeight()));
+    }
+}
 
 // Vector2:
 template <typename T>
@@ -743,7 +1056,7 @@ void Viewport::setSpan(const Vector2<int>& span) { this->span = span; }
 
 void Viewport::setSize(const Vector2<int>& size) { this->size = size; }
 
-void Viewport::handleEvent(Event ev) {
+void Viewport::handleEvent(const Event& ev) {
     if (ev.eventType == EV_SCROLL) {
         if (ev.scroll.isHorizontal) {
             viewPosition.x = ev.scroll.position * span.x;
@@ -753,17 +1066,126 @@ void Viewport::handleEvent(Event ev) {
     }
 }
 
-void Viewport::draw() {
-    RenderEngine::InitOffScreen(size.x, size.y);
-    RenderEngine::pushGlobalOffset(viewPosition.x, viewPosition.y);
-    ContainerWindow::draw();
+void Viewport::drawTree() {
+    // Contents are clipped in place instead of going through an off-screen target
+    RenderEngine::pushClip(position.x, position.y, size.x, size.y);
+    RenderEngine::pushRelGlobalOffset(viewPosition.x - position.x, viewPosition.y - position.y);
+    drawChildren();
     RenderEngine::popGlobalOffset();
-    RenderEngine::FlushOffScreen(position.x, position.y);
+    RenderEngine::popClip();
+}
+
+// ListView methods
+ListView::ListView(ListAdapter* adapter, int itemHeight)
+    : adapter(adapter), itemHeight(std::max(itemHeight, 1)), firstItem(0), lastItem(0) {
+    updateEventMask(EV_SCROLL | EV_MOUSE_WHEEL);
+}
+
+int64_t ListView::getContentHeight() {
+    return static_cast<int64_t>(adapter->getItemsCount()) * itemHeight;
+}
+
+void ListView::notifyDataChanged() {
+    std::fill(boundItems.begin(), boundItems.end(), noItem);
+    realize();
+}
+
+void ListView::scrollBy(int64_t pixels) {
+    viewPosition.y = static_cast<int>(viewPosition.y + pixels);
+    realize();
+}
+
+void ListView::scrollTo(float position) {
+    viewPosition.y = static_cast<int>(std::lround(position * span.y));
+    realize();
+}
+
+void ListView::scrollToItem(size_t index) {
+    viewPosition.y = static_cast<int>(static_cast<int64_t>(index) * itemHeight);
+    realize();
+}
+
+void ListView::realize() {
+    size_t count = adapter->getItemsCount();
+    span.y = static_cast<int>(std::max<int64_t>(getContentHeight() - size.y, 0));
+    viewPosition.y = std::clamp(viewPosition.y, 0, span.y);
+
+    // Pool is only ever grown, widgets are bound anew since their items are spread differently.
+    // Short lists get a widget per item
+    size_t poolSize = std::min(count, std::max(size.y, 0) / itemHeight + 2 + 2 * overscan);
+    if (pool.size() < poolSize) {
+        // Widgets come from the arena the list itself came from
+        WindowArena::Scope scope(WindowArena::owner(this));
+        while (pool.size() < poolSize) {
+            pool.push_back(adapter->createItem());
+            attachChild(pool.back());
+        }
+        boundItems.assign(pool.size(), noItem);
+    }
+
+    size_t top = viewPosition.y / itemHeight;
+    firstItem = top > overscan ? top - overscan : 0;
+    lastItem = std::min(count, firstItem + pool.size());
+
+    for (size_t item = firstItem; item < lastItem; item++) {
+        size_t slot = item % pool.size();
+        if (boundItems[slot] == item) continue;
+
+        adapter->bindItem(pool[slot], item, 0, static_cast<int>(item * itemHeight), size.x,
+                          itemHeight);
+        boundItems[slot] = item;
+    }
+}
+
+void ListView::drawTree() {
+    // Size may have changed since the last frame
+    realize();
+
+    RenderEngine::pushClip(position.x, position.y, size.x, size.y);
+    RenderEngine::pushRelGlobalOffset(viewPosition.x - position.x, viewPosition.y - position.y);
+    for (size_t item = firstItem; item < lastItem; item++) {
+        pool[item % pool.size()]->draw();
+    }
+    RenderEngine::popGlobalOffset();
+    RenderEngine::popClip();
+}
+
+void ListView::processEvent(const Event& ev) {
+    if (ev.eventType & propagationMask) {
+        // Widgets live in the coordinates of the contents, pointer outside of the view is nowhere
+        Event translated = ev;
+        if (IS_MOUSE_EV(ev) || ev.eventType == EV_MOUSE_WHEEL) {
+            int relX = static_cast<int>(ev.mouse.x) - position.x;
+            int relY = static_cast<int>(ev.mouse.y) - position.y;
+            bool isInside = relX >= 0 && relY >= 0 && relX < size.x && relY < size.y;
+            translated.mouse.x = isInside ? relX + viewPosition.x : UINT_MAX;
+            translated.mouse.y = isInside ? relY + viewPosition.y : UINT_MAX;
+        }
+
+        // Handlers may change the items, so the range is checked on every step
+        for (size_t item = firstItem; item < lastItem; item++) {
+            pool[item % pool.size()]->processEvent(translated);
+        }
+    }
+
+    if (ev.eventType & eventMask) handleEvent(ev);
+}
+
+void ListView::handleEvent(const Event& ev) {
+    if (ev.eventType == EV_SCROLL && !ev.scroll.isHorizontal) {
+        scrollTo(ev.scroll.position);
+    } else if (ev.eventType == EV_MOUSE_WHEEL && !ev.wheel.isHorizontal) {
+        int relX = static_cast<int>(ev.wheel.x) - position.x;
+        int relY = static_cast<int>(ev.wheel.y) - position.y;
+        if (relX < 0 || relY < 0 || relX >= size.x || relY >= size.y) return;
+
+        scrollBy(-std::lround(ev.wheel.delta / 100.0f * wheelItems * itemHeight));
+    }
 }
 
 ModalWindowManager::ModalWindowManager() : currentModal(nullptr), invoked(false) {}
 
-void ModalWindowManager::processEvent(Event ev) {
+void ModalWindowManager::processEvent(const Event& ev) {
     if (invoked) {
         currentModal->processEvent(ev);
     } else {
@@ -771,8 +1193,8 @@ void ModalWindowManager::processEvent(Event ev) {
     }
 }
 
-void ModalWindowManager::draw() {
-    ContainerWindow::draw();
+void ModalWindowManager::drawTree() {
+    drawFlattened();
 
     if (invoked) {
         currentModal->draw();
@@ -795,7 +1217,8 @@ void ModalWindow::finish() {
     }
 }
 
-InputBox::InputBox() : active(false) {
+InputBox::InputBox()
+    : active(false), caretTimer(TimerWheel::invalidTimer), isCaretVisible(false) {
     setThickness(2);
     setBackgroundColor({0, 0, 0, 0});
     setOutlineColor({255, 255, 255, 255});
@@ -807,13 +1230,36 @@ InputBox::InputBox() : active(false) {
     attachChild(content);
 }
 
-void InputBox::click(const Event&) { active = true; }
+InputBox::~InputBox() { TimerWheel::Global().cancel(caretTimer); }
+
+void InputBox::click(const Event&) {
+    active = true;
+    restartCaret();
+}
 
 void InputBox::onButtonPressOutside(const Event&) {
     active = false;
+    TimerWheel::Global().cancel(caretTimer);
+    caretTimer = TimerWheel::invalidTimer;
 }
 
-void InputBox::handleEvent(Event ev) {
+void InputBox::restartCaret() {
+    isCaretVisible = true;
+    TimerWheel::Global().cancel(caretTimer);
+    caretTimer = TimerWheel::Global().schedule(
+        caretBlinkInterval, [this] { isCaretVisible = !isCaretVisible; }, caretBlinkInterval);
+}
+
+void InputBox::drawSelf() {
+    RectangleButton::drawSelf();
+    if (!active || !isCaretVisible) return;
+
+    float textWidth = RenderEngine::MeasureText(str.c_str(), height - 4);
+    RenderEngine::DrawRect(x + 3 + textWidth, y + 3, 2, height - 6, {255, 255, 255, 255},
+                           {0, 0, 0, 0}, 0);
+}
+
+void InputBox::handleEvent(const Event& ev) {
     // fprintf(stderr, "Inputbox %p received event of type %lu\n", static_cast<void *>(this),
     // ev.eventType);
     if (ev.eventType == EV_TEXT) {
@@ -822,12 +1268,9 @@ void InputBox::handleEvent(Event ev) {
             } else if (ev.keyboard.character == '\b') {
                 if (str.length() > 0) str.pop_back();
             } else {
-                str.push_back(ev.keyboard.character);
+                str.push_back(static_cast<wchar_t>(ev.keyboard.character));
             }
-            fprintf(stderr, "New length of string is %zu\n", str.length());
-        } else {
-            fprintf(stderr, "Inputbox is inactive, yet there is an event for character %c\n",
-                    ev.keyboard.character);
+            restartCaret();
         }
 
         content->setText(str.c_str());
@@ -1,9 +1,14 @@
 #ifndef WINDOW_HPP_
 #define WINDOW_HPP_
-#include <list>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
 
 #include "../Event.hpp"
 #include "../SFMLRenderEngine/RenderEngine.hpp"
+#include "TimerWheel.hpp"
+#include "WindowArena.hpp"
 
 // TODO Buttons with icons
 
@@ -18,14 +23,25 @@ struct Vector2 {
 };
 
 class ModalWindow;
+class AbstractWindow;
+
+// Entry of a flattened draw list. Every window of the subtree has an entry of its own, the
+// descendants of a window follow it and are skipped if it draws them itself
+struct DrawListEntry {
+    AbstractWindow *window;
+    size_t subtreeEnd;  // Index past the entries of the descendants
+};
+
+using DrawList = std::vector<DrawListEntry>;
 
 // Abstract window that can handle an event
 class AbstractWindow {
    public:
     AbstractWindow();
-    virtual void draw();  // Draw the window
+    void draw();              // Draw the window together with its children, through drawTree()
+    virtual void drawSelf();  // Draw the window without its children
     virtual void processEvent(
-        Event ev);  // Event processing. Just dummy function that calls handleEvent
+        const Event &ev);  // Event processing. Just dummy function that calls handleEvent
     virtual void attachToParent(
         AbstractWindow *parent);  // Function that attaches this window to some other window
     void updateEventMask(uint64_t update);  // Function that updates event mask of the window as
@@ -38,27 +54,62 @@ class AbstractWindow {
     virtual void invokeModalWindow(ModalWindow *modal);
     void detach();  // Detach from parent
 
+    // Windows are allocated from WindowArena::current() if there is one, and deleted windows go
+    // back to the arena they came from
+    static void *operator new(size_t size);
+    static void operator delete(void *ptr, size_t size);
+
    protected:
     uint64_t eventMask;                  // Mask for filtering out unnecessary events
     uint64_t propagationMask;            // Mask for filtering events that should be propag
     AbstractWindow *parent;              // Parent window
-    virtual void handleEvent(Event ev);  // Handle certain (function that should be overloaded in
-                                         // order to implement event handling)
+    size_t siblingIndex;                 // Position among the children of the parent
+    bool drawsOwnChildren;  // drawTree() is overridden, found out the first time it is drawn
+    virtual void handleEvent(const Event &ev);  // Handle certain (function that should be overloaded
+                                                // in order to implement event handling)
+
+   private:
+    // Draws the window and then its children. Windows that draw their children in a way of their
+    // own (clipped, moved, only some of them) override it. The default is private, so an override
+    // cannot draw through it, and a flattened draw list finds the overrides without being told
+    virtual void drawTree();
+    virtual void collectDrawList(DrawList &list);  // Append draw list entries of the subtree
+
+    friend class ContainerWindow;
 };
 
 // Abstract container window that can have child windows and pass on events.
 // Here implementation of processEvent is different and actually passes on event to children
 class ContainerWindow : public AbstractWindow {
    public:
-    virtual void processEvent(Event ev) override;
-    virtual void draw() override;
+    ContainerWindow();
+    virtual void processEvent(const Event &ev) override;
     void attachChild(AbstractWindow *win);
     virtual ~ContainerWindow();
     virtual void dump(FILE *f) override;
     void detachChild(AbstractWindow *child);
+    void raiseChild(AbstractWindow *child);  // Move child to the top of z-order
+    void lowerChild(AbstractWindow *child);  // Move child to the bottom of z-order
+    WindowArena *makeArena(size_t chunkSize = WindowArena::defaultChunkSize);  // Arena released
+                                                                               // with the window
 
    protected:
-    std::list<AbstractWindow *> children;
+    void drawChildren();   // Draw children without the window itself
+    void drawFlattened();  // Draw children through the cached flattened draw list
+
+    std::vector<AbstractWindow *> children;  // Children in z-order, the last one is drawn on top
+    DrawList drawList;                       // Flattened draw list of the children
+    uint64_t hierarchyVersion;  // Bumped when the subtree changes in a way a draw list sees
+    uint64_t drawListVersion;   // Hierarchy version the draw list was built for
+    WindowArena *arena;         // Owned arena for the subtree, released after children
+
+   private:
+    virtual void drawTree() override;
+    virtual void collectDrawList(DrawList &list) override;
+    bool isChild(AbstractWindow *window);
+    // Subtree changed: this window and the ones above it whose draw lists include it get a new
+    // hierarchy version
+    void invalidateDrawLists();
 };
 
 // Class of a rectangle primitive
@@ -86,7 +137,7 @@ class Rectangle {
 // Container window that can be represented as a rectangle
 class RectangleWindow : public ContainerWindow, public Rectangle {
    public:
-    virtual void draw() override;  // Function that draws the rectangle window
+    virtual void drawSelf() override;  // Function that draws the rectangle window
     virtual void dump(FILE *f) override;
 };
 
@@ -113,7 +164,14 @@ class AbstractButton : public ContainerWindow {
     virtual void dump(FILE *f) override;
 
    protected:
-    virtual void handleEvent(Event ev) override;  // New event handler
+    virtual void handleEvent(const Event &ev) override;  // Dispatches event through eventHandlers
+
+    // Per-type event handlers, indexed with eventTypeIndex
+    using EventHandler = void (AbstractButton::*)(const Event &ev);
+    static const EventHandler eventHandlers[EV_TYPES_COUNT];
+    void handleMousePress(const Event &ev);
+    void handleMouseRelease(const Event &ev);
+    void handleMouseMove(const Event &ev);
 
     bool hovered;  // Button is currently hovered over
     bool pressed;  // Button is currently being pressed down
@@ -132,7 +190,7 @@ class RectangleButton : public AbstractButton, public Rectangle {
     virtual void onMouseMove(const Event &ev) override;      // Arbitrary mouse move event
     virtual void onButtonRelease(const Event &ev) override;  // Mouse button release
     virtual bool isInside(int x, int y) override;
-    virtual void draw() override;
+    virtual void drawSelf() override;
     virtual void dump(FILE *f) override;
 
    protected:
@@ -148,7 +206,7 @@ class TexturedButton : public RectangleButton {
     TexturedButton();
     void attachTexture(uint64_t descriptor);
 
-    virtual void draw() override;
+    virtual void drawSelf() override;
 
    private:
     std::optional<uint64_t> textureDescriptor;
@@ -168,7 +226,7 @@ class Slider : public RectangleButton {
     virtual void dump(FILE *f) override;
 
    private:
-    virtual void handleEvent(Event ev)
+    virtual void handleEvent(const Event &ev)
         override;       // handleEvent should be overriden in order to allow for proper movement
     int pivot;          // Coordinates of the beginning
     int strokeStart;    // Coordinate of the stroke start
@@ -179,14 +237,24 @@ class Slider : public RectangleButton {
     friend class Scrollbar;
 };
 
+// Scrolls once when pressed and keeps scrolling while it is held down
 class ScrollbarButton : public RectangleButton {
    public:
+    static constexpr uint32_t repeatDelay = 400;     // Milliseconds before auto-repeat starts
+    static constexpr uint32_t repeatInterval = 50;
+
     ScrollbarButton(bool isUp);
+    virtual ~ScrollbarButton();
     virtual void dump(FILE *f) override;
 
    private:
     virtual void click(const Event &ev) override;
+    virtual void onButtonPress(const Event &ev) override;
+    virtual void onButtonRelease(const Event &ev) override;
+    void scroll(const Event &ev);
     bool isUp;
+    TimerWheel::TimerId repeatTimer;
+    Event pressEvent;  // Repeated scrolls are based on it
 };
 
 class ScrollbarBackground : public RectangleWindow {
@@ -195,7 +263,7 @@ class ScrollbarBackground : public RectangleWindow {
     virtual void dump(FILE *f) override;
 
    private:
-    virtual void handleEvent(Event ev) override;
+    virtual void handleEvent(const Event &ev) override;
     bool isHorizontal;
 };
 
@@ -216,7 +284,7 @@ class Scrollbar : public ContainerWindow {
     virtual void dump(FILE *f) override;
 
    private:
-    virtual void handleEvent(Event ev) override;
+    virtual void handleEvent(const Event &ev) override;
     int x;
     int y;
     ScrollbarButton *up;
@@ -236,49 +304,134 @@ class TextWindow : public RectangleWindow {
     TextWindow();
     void setText(const wchar_t *newContent);
     void setCharSize(int size);
-    virtual void draw() override;
+    virtual void drawSelf() override;
     virtual void dump(FILE *f) override;
 
    private:
-    // virtual void handleEvent(Event ev) override;
+    // virtual void handleEvent(const Event &ev) override;
     const wchar_t *content;
     int characterSize;
 };
 
+// Scrollable non-owning view of a long text such as a log. Starts of the lines are indexed once
+// and a frame lays out and draws only the lines inside the view, so its cost does not depend on
+// the length of the text
+class TextView : public RectangleWindow {
+   public:
+    static constexpr size_t layoutCacheSize = 512;  // Laid out lines kept around the view
+    static constexpr int wheelLines = 3;            // Lines scrolled per wheel notch
+
+    TextView();
+    void setText(const wchar_t *newContent, size_t newLength);  // Text appended to the same
+                                                                // buffer is indexed on its own
+    void setText(const wchar_t *newContent);                    // Null-terminated
+    void setCharSize(int size);
+    void scrollTo(float position);       // Top of the view along the text, as in scroll events
+    void scrollToLine(size_t line);      // Line at the top of the view
+    void scrollToOffset(size_t offset);  // Line with the character at the top of the view
+    size_t getLinesCount();
+    size_t getTopLine();
+    int64_t getContentHeight();  // Of all the lines, for the scrollbars
+    virtual void drawSelf() override;
+    virtual void dump(FILE *f) override;
+
+   private:
+    virtual void handleEvent(const Event &ev) override;
+    int getLineHeight();
+    void scrollBy(int64_t pixels);
+    const std::wstring &layoutLine(size_t line);  // Part of the line that fits into the width
+
+    const wchar_t *content;
+    size_t length;
+    std::vector<size_t> lineStarts;                    // Offset of every line in the content
+    std::unordered_map<size_t, std::wstring> layouts;  // By line
+    int characterSize;
+    int64_t scrollY;  // Pixels from the top of the text to the top of the view
+};
+
 class ScrollbarManager : public ContainerWindow {
    public:
     ScrollbarManager(bool horizontalScrollable, bool verticalScrollable);
     void adjustScrollbarSize(int x, int y, int width, int height);
     void adjustScrollableAreaSize(
         int width, int height);  // Adjusts scrollbar properties to the size of the scrollable area
-    virtual void draw() override;
     Scrollbar *horizontal;
     Scrollbar *vertical;
-    virtual void processEvent(Event ev) override;  // Event redirector
+    virtual void processEvent(const Event &ev) override;  // Event redirector
     virtual void dump(FILE *f) override;
 
    private:
+    virtual void drawTree() override;
     int adjWidth;
     int adjHeight;
 };
 
-// Class for an offscreen drawing of its contents. Window supports scrolling. The contents of
+// Class for a clipped drawing of its contents. Window supports scrolling. The contents of
 // children must be treated as relative to the Viewport position
 class Viewport : public ContainerWindow {
    public:
     void setPosition(const Vector2<int> &pos);
     void setSpan(const Vector2<int> &span);
     void setSize(const Vector2<int> &size);
-    virtual void draw() override;
     virtual void dump(FILE *f) override;
 
    protected:
-    virtual void handleEvent(Event ev) override;
+    virtual void handleEvent(const Event &ev) override;
 
     Vector2<int> position;      // Position on the screen where it is rendered to
     Vector2<int> viewPosition;  // Position of the view in coordinate system of the contents
     Vector2<int> size;          // Size of the viewport
     Vector2<int> span;          // Span of the viewport to move along
+
+   private:
+    virtual void drawTree() override;
+};
+
+// Items of a ListView. Widgets are created for as many items as fit into the view and are then
+// bound to whichever items get scrolled into it
+class ListAdapter {
+   public:
+    virtual ~ListAdapter() = default;
+    virtual size_t getItemsCount() = 0;
+    virtual AbstractWindow *createItem() = 0;  // Widget for any of the items, owned by the list
+    // Show the item in the widget and place it at the rect, in the coordinates of the contents
+    virtual void bindItem(AbstractWindow *widget, size_t index, int x, int y, int width,
+                          int height) = 0;
+};
+
+// Viewport over a list of items of the same height that only realizes the items in the view.
+// Widgets of items scrolled out of the view are rebound to the ones scrolled in, and only the
+// widgets showing an item are drawn and get events, so a list of ten thousand items costs the
+// same as a list of ten
+class ListView : public Viewport {
+   public:
+    static constexpr size_t overscan = 1;  // Items realized past each edge of the view
+    static constexpr int wheelItems = 3;   // Items scrolled per wheel notch
+
+    ListView(ListAdapter *adapter, int itemHeight);  // Adapter is not owned
+    void notifyDataChanged();                        // Count or contents of the items changed
+    void scrollTo(float position);                   // Fraction of the way down
+    void scrollToItem(size_t index);                 // Item at the top of the view
+    int64_t getContentHeight();                      // Of all the items, for the scrollbars
+    virtual void processEvent(const Event &ev) override;
+    virtual void dump(FILE *f) override;
+
+   protected:
+    virtual void handleEvent(const Event &ev) override;
+
+   private:
+    static constexpr size_t noItem = SIZE_MAX;
+
+    virtual void drawTree() override;
+    void realize();  // Bind widgets to the items in the view
+    void scrollBy(int64_t pixels);
+
+    ListAdapter *adapter;
+    int itemHeight;
+    std::vector<AbstractWindow *> pool;  // Item i is shown by widget i modulo the pool size
+    std::vector<size_t> boundItems;      // Item each widget of the pool shows
+    size_t firstItem;                    // Items that have widgets
+    size_t lastItem;
 };
 
 // Class for modal window implementation
@@ -292,19 +445,26 @@ class ModalWindow : public RectangleWindow {
 // Class for inputting characters via a keyboard
 class InputBox : public RectangleButton {
    public:
+    static constexpr uint32_t caretBlinkInterval = 500;
+
     InputBox();
+    virtual ~InputBox();
     const wchar_t *getString();
     virtual void click(const Event &ev) override;
     virtual void onButtonPressOutside(const Event &ev) override;
+    virtual void drawSelf() override;
 
     void setPosition(int x, int y);
     void setSize(unsigned int x, unsigned int y);
 
    private:
     bool active;
-    virtual void handleEvent(Event ev) override;
+    virtual void handleEvent(const Event &ev) override;
+    void restartCaret();  // Show the caret and start blinking from there
     std::wstring str;
     TextWindow *content;
+    TimerWheel::TimerId caretTimer;
+    bool isCaretVisible;
 };
 
 // Class for modal window management
@@ -312,11 +472,11 @@ class ModalWindowManager : public ContainerWindow {
    public:
     ModalWindowManager();
     virtual void invokeModalWindow(ModalWindow *modal) override;
-    virtual void processEvent(Event ev) override;
-    virtual void draw() override;
+    virtual void processEvent(const Event &ev) override;
     void deinvoke();
 
    private:
+    virtual void drawTree() override;
     ModalWindow *currentModal;
     bool invoked;
 };
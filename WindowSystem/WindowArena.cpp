@@ -0,0 +1,108 @@
+#include "WindowArena.hpp"
+
+#include <map>
+#include <new>
+
+thread_local WindowArena *WindowArena::active = nullptr;
+
+constexpr size_t arenaAlignment = alignof(std::max_align_t);
+
+static size_t alignUp(size_t size) { return (size + arenaAlignment - 1) & ~(arenaAlignment - 1); }
+
+// Memory of the arenas by its first byte: chunks and the blocks allocated on their own
+struct ArenaRegion {
+    const char *end;
+    WindowArena *arena;
+};
+
+static std::map<const char *, ArenaRegion> regions;
+
+static void AddRegion(const char *begin, size_t size, WindowArena *arena) {
+    regions[begin] = {begin + size, arena};
+}
+
+WindowArena::WindowArena(size_t chunkSize)
+    : freeLists(alignUp(maxPooledSize) / arenaAlignment + 1, nullptr),
+      cursor(nullptr),
+      available(0),
+      chunkSize(alignUp(chunkSize)),
+      liveBlocks(0),
+      isReleased(false) {}
+
+WindowArena::~WindowArena() {
+    for (auto chunk : chunks) {
+        regions.erase(chunk);
+        ::operator delete(chunk);
+    }
+}
+
+void *WindowArena::allocate(size_t size) {
+    size = alignUp(size);
+    liveBlocks++;
+
+    if (size > maxPooledSize || size > chunkSize) {
+        char *block = static_cast<char *>(::operator new(size));
+        AddRegion(block, size, this);
+        return block;
+    }
+
+    // Block of a deleted window of the same size class is taken first
+    FreeBlock *&freeList = freeLists[size / arenaAlignment];
+    if (freeList) {
+        FreeBlock *block = freeList;
+        freeList = block->next;
+        return block;
+    }
+
+    if (size > available) {
+        chunks.push_back(static_cast<char *>(::operator new(chunkSize)));
+        AddRegion(chunks.back(), chunkSize, this);
+        cursor = chunks.back();
+        available = chunkSize;
+    }
+
+    void *block = cursor;
+    cursor += size;
+    available -= size;
+
+    return block;
+}
+
+void WindowArena::deallocate(void *block, size_t size) {
+    size = alignUp(size);
+
+    if (size > maxPooledSize || size > chunkSize) {
+        regions.erase(static_cast<char *>(block));
+        ::operator delete(block);
+    } else {
+        FreeBlock *&freeList = freeLists[size / arenaAlignment];
+        freeList = new (block) FreeBlock{freeList};
+    }
+
+    liveBlocks--;
+    if (isReleased && !liveBlocks) delete this;
+}
+
+void WindowArena::release() {
+    isReleased = true;
+    if (!liveBlocks) delete this;
+}
+
+size_t WindowArena::getChunksCount() { return chunks.size(); }
+
+WindowArena *WindowArena::current() { return active; }
+
+WindowArena *WindowArena::owner(const void *block) {
+    if (regions.empty()) return nullptr;
+
+    const char *address = static_cast<const char *>(block);
+    auto region = regions.upper_bound(address);
+    if (region == regions.begin()) return nullptr;
+
+    --region;
+    return address < region->second.end ? region->second.arena : nullptr;
+}
+
+WindowArena::Scope::Scope(WindowArena *arena) : previous(active) { active = arena; }
+
+WindowArena::Scope::~Scope() { active = previous; }
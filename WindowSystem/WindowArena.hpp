@@ -0,0 +1,59 @@
+#ifndef WINDOW_ARENA_HPP_
+#define WINDOW_ARENA_HPP_
+#include <cstddef>
+#include <vector>
+
+// Pool allocator for window trees. Windows created while an arena is active (see
+// WindowArena::Scope) are carved out of a few large chunks, and freed blocks go to a free list of
+// their size class, so a tree that is torn down and built again reuses the same memory without the
+// global allocator. Blocks carry no header, the arena a window came from is found by its address.
+// An arena given up by its owner is destroyed once the last of its windows is deleted, so a window
+// detached from the tree may outlive the owner.
+class WindowArena {
+   public:
+    static constexpr size_t defaultChunkSize = 64 * 1024;
+    static constexpr size_t maxPooledSize = 1024;  // Larger blocks are allocated on their own
+
+    explicit WindowArena(size_t chunkSize = defaultChunkSize);
+    WindowArena(const WindowArena &) = delete;
+    WindowArena &operator=(const WindowArena &) = delete;
+
+    void *allocate(size_t size);                // Get a block aligned to alignof(std::max_align_t)
+    void deallocate(void *block, size_t size);  // Size is the one the block was allocated with
+    void release();  // Owner is done with the arena, it is destroyed once no blocks are in use
+    size_t getChunksCount();
+
+    static WindowArena *current();                 // Arena new windows come from, null for the heap
+    static WindowArena *owner(const void *block);  // Arena the block came from, null for the heap
+
+    // Makes an arena current for the lifetime of the scope
+    class Scope {
+       public:
+        explicit Scope(WindowArena *arena);
+        ~Scope();
+        Scope(const Scope &) = delete;
+        Scope &operator=(const Scope &) = delete;
+
+       private:
+        WindowArena *previous;
+    };
+
+   private:
+    struct FreeBlock {
+        FreeBlock *next;
+    };
+
+    ~WindowArena();  // Through release() only
+
+    std::vector<char *> chunks;          // Of chunkSize bytes, in the order they are filled
+    std::vector<FreeBlock *> freeLists;  // By size class, in steps of the alignment
+    char *cursor;                        // First free byte of the last chunk
+    size_t available;                    // Bytes left in the last chunk
+    size_t chunkSize;
+    size_t liveBlocks;
+    bool isReleased;
+
+    static thread_local WindowArena *active;
+};
+
+#endif  // WINDOW_ARENA_HPP_
@@ -0,0 +1,113 @@
+// Test of WindowArena: trees rebuilt in an arena reuse the blocks of the deleted windows, windows
+// find their arena by address, and an arena outlives its owner while its windows are alive
+
+#include <cstdio>
+#include <cstdlib>
+#include <set>
+#include <vector>
+
+#include "../Testing.hpp"
+#include "Window.hpp"
+#include "WindowArena.hpp"
+
+constexpr size_t rowsCount = 20;
+
+// Window larger than a block that is pooled
+class LargeWindow : public RectangleWindow {
+   public:
+    char payload[WindowArena::maxPooledSize * 2];
+};
+
+static std::vector<RectangleButton *> BuildRows(ContainerWindow *owner) {
+    WindowArena::Scope scope(owner->makeArena(4 * 1024));
+
+    std::vector<RectangleButton *> rows;
+    for (size_t i = 0; i < rowsCount; i++) {
+        rows.push_back(new RectangleButton);
+        owner->attachChild(rows.back());
+    }
+    return rows;
+}
+
+static void DeleteRows(std::vector<RectangleButton *> &rows) {
+    for (RectangleButton *row : rows) {
+        row->detach();
+        delete row;
+    }
+    rows.clear();
+}
+
+// Rebuilt rows take the blocks of the deleted ones, no chunk is added
+static void TestReuse() {
+    ContainerWindow *owner = new ContainerWindow;
+    std::vector<RectangleButton *> rows = BuildRows(owner);
+    WindowArena *arena = owner->makeArena();
+    size_t chunks = arena->getChunksCount();
+
+    std::set<void *> blocks(rows.begin(), rows.end());
+    for (int rebuild = 0; rebuild < 3; rebuild++) {
+        DeleteRows(rows);
+        rows = BuildRows(owner);
+
+        for (RectangleButton *row : rows) CHECK(blocks.count(row) == 1);
+        CHECK(arena->getChunksCount() == chunks);
+    }
+
+    // Windows of one size class are packed without headers between them
+    ptrdiff_t distance = reinterpret_cast<char *>(rows[1]) - reinterpret_cast<char *>(rows[0]);
+    CHECK(static_cast<size_t>(std::abs(distance)) < sizeof(RectangleButton) + 16);
+
+    delete owner;
+}
+
+static void TestOwner() {
+    ContainerWindow *owner = new ContainerWindow;
+    WindowArena *arena = owner->makeArena();
+
+    RectangleWindow *heapWindow = new RectangleWindow;
+    CHECK(WindowArena::owner(heapWindow) == nullptr);
+
+    RectangleWindow *arenaWindow = nullptr;
+    LargeWindow *largeWindow = nullptr;
+    {
+        WindowArena::Scope scope(arena);
+        arenaWindow = new RectangleWindow;
+        largeWindow = new LargeWindow;
+    }
+    CHECK(WindowArena::owner(arenaWindow) == arena);
+    CHECK(WindowArena::owner(largeWindow) == arena);
+    CHECK(WindowArena::owner(largeWindow->payload + sizeof(largeWindow->payload) - 1) == arena);
+
+    // Windows allocated outside of any scope stay on the heap
+    RectangleWindow *laterWindow = new RectangleWindow;
+    CHECK(WindowArena::owner(laterWindow) == nullptr);
+
+    owner->attachChild(arenaWindow);
+    owner->attachChild(largeWindow);
+    owner->attachChild(heapWindow);
+    owner->attachChild(laterWindow);
+    delete owner;
+}
+
+// Window detached from the tree keeps the arena of its former owner alive
+static void TestDetachedWindow() {
+    ContainerWindow *owner = new ContainerWindow;
+    std::vector<RectangleButton *> rows = BuildRows(owner);
+    WindowArena *arena = owner->makeArena();
+
+    RectangleButton *survivor = rows.back();
+    survivor->detach();
+    delete owner;
+
+    CHECK(WindowArena::owner(survivor) == arena);
+    survivor->setSize(10, 10);
+    delete survivor;
+    CHECK(WindowArena::owner(survivor) == nullptr);
+}
+
+int main() {
+    TestReuse();
+    TestOwner();
+    TestDetachedWindow();
+    return TestResult();
+}
@@ -0,0 +1,111 @@
+// Benchmark of the window tree on a headless render engine: events are dispatched through a tree
+// of ten thousand buttons, as in a panel with a large list of controls, and the tree is drawn
+// while a panel drawing its own children swaps them, as the settings panel does on tool switches
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+#include "HeadlessRenderEngine.hpp"
+#include "Window.hpp"
+
+constexpr int panelsCount = 100;
+constexpr int buttonsPerPanel = 100;
+constexpr int buttonSize = 10;
+constexpr size_t eventsCount = 20000;
+constexpr size_t framesCount = 500;
+
+// Draws its children itself, the way the settings panel does
+class SwitchingPanel : public RectangleWindow {
+   private:
+    virtual void drawTree() override {
+        drawSelf();
+        drawChildren();
+    }
+};
+
+static double NanosecondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start)
+        .count();
+}
+
+static ContainerWindow *BuildTree() {
+    ContainerWindow *root = new ModalWindowManager;
+
+    for (int panelIndex = 0; panelIndex < panelsCount; panelIndex++) {
+        RectangleWindow *panel = new RectangleWindow;
+        panel->setPosition(0, panelIndex * buttonSize);
+        panel->setSize(buttonsPerPanel * buttonSize, buttonSize);
+
+        for (int buttonIndex = 0; buttonIndex < buttonsPerPanel; buttonIndex++) {
+            RectangleButton *button = new RectangleButton;
+            button->setPosition(buttonIndex * buttonSize, panelIndex * buttonSize);
+            button->setSize(buttonSize, buttonSize);
+            button->setBackgroundColor({0, 0, 0, 0});
+            button->setHoverColor({255, 255, 255, 100});
+            panel->attachChild(button);
+        }
+
+        root->attachChild(panel);
+    }
+
+    return root;
+}
+
+static void BenchDispatch(ContainerWindow *root) {
+    Event ev = {};
+    ev.eventType = EV_MOUSE_MOVE;
+
+    // Pointer wanders over the whole tree, so hover states keep changing
+    srand(1);
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < eventsCount; i++) {
+        ev.mouse.x = rand() % (buttonsPerPanel * buttonSize);
+        ev.mouse.y = rand() % (panelsCount * buttonSize);
+        root->processEvent(ev);
+    }
+    double nanoseconds = NanosecondsSince(start);
+
+    size_t nodes = panelsCount * (buttonsPerPanel + 1);
+    printf("dispatch: %zu events through %zu windows, %.1f us per event, %.2f ns per window\n",
+           eventsCount, nodes, nanoseconds / eventsCount / 1000,
+           nanoseconds / eventsCount / nodes);
+}
+
+static void BenchDraw(ContainerWindow *root) {
+    SwitchingPanel *panel = new SwitchingPanel;
+    panel->setSize(buttonSize, buttonSize);
+    root->attachChild(panel);
+
+    RectangleButton *first = new RectangleButton;
+    RectangleButton *second = new RectangleButton;
+    panel->attachChild(first);
+    root->draw();
+
+    ResetDrawCounters();
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < framesCount; i++) {
+        root->draw();
+    }
+    double steady = NanosecondsSince(start);
+    size_t rectsPerFrame = drawCounters.rects / framesCount;
+
+    // Every frame switches the child of the panel, the list of the root stays as it is
+    start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < framesCount; i++) {
+        panel->detachChild(i % 2 ? second : first);
+        panel->attachChild(i % 2 ? first : second);
+        root->draw();
+    }
+    double switching = NanosecondsSince(start);
+
+    printf("draw: %zu rects per frame, %.1f us per frame, %.1f us per frame with a switch\n",
+           rectsPerFrame, steady / framesCount / 1000, switching / framesCount / 1000);
+}
+
+int main() {
+    ContainerWindow *root = BuildTree();
+    BenchDispatch(root);
+    BenchDraw(root);
+    return 0;
+}
@@ -3,6 +3,8 @@
 
 int main() {
     Application::Init(1600, 900);
+    Application::SetFrameRate(60);
+    Application::SetVerticalSync(true);
 
     DrawingManager *dm = new DrawingManager;
     dm->createCanvas(1200, 700);